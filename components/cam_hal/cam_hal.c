@@ -1,6 +1,9 @@
 #include "cam_hal.h"
 #include "esp_log.h"
 #include "esp_camera.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "sdkconfig.h"
 
 static const char *TAG = "CAM_HAL";
@@ -23,6 +26,52 @@ static const char *TAG = "CAM_HAL";
 #define HREF_GPIO_NUM     23
 #define PCLK_GPIO_NUM     22
 
+// Escalera de calidad (de mejor a peor). El paso DEFAULT_PROFILE coincide
+// con la configuración de arranque (VGA, calidad 12).
+typedef struct {
+    framesize_t size;
+    cam_profile_t info;
+} profile_entry_t;
+
+static const profile_entry_t s_profiles[] = {
+    { FRAMESIZE_VGA,  { 640, 480, 10 } },
+    { FRAMESIZE_VGA,  { 640, 480, 12 } },
+    { FRAMESIZE_VGA,  { 640, 480, 15 } },
+    { FRAMESIZE_HVGA, { 480, 320, 15 } },
+    { FRAMESIZE_CIF,  { 400, 296, 18 } },
+    { FRAMESIZE_QVGA, { 320, 240, 20 } },
+    { FRAMESIZE_QVGA, { 320, 240, 28 } },
+};
+#define PROFILE_COUNT   ((int)(sizeof(s_profiles) / sizeof(s_profiles[0])))
+#define DEFAULT_PROFILE 1
+
+static int s_current_profile = DEFAULT_PROFILE;
+
+// Mientras se graba el tamaño de salida queda fijo (el AVI toma ancho y alto
+// del primer frame): solo se aceptan pasos que cambian la calidad JPEG
+static SemaphoreHandle_t s_lock = NULL;     // Sensor, perfil y retenciones
+static int s_size_holds = 0;
+static int s_deferred_profile = -1;         // Paso a aplicar al liberar el tamaño
+
+// Región de interés: coordenadas sobre el frame de arranque (4:3 completo)
+#define NVS_NAMESPACE_ROI   "cam_roi"
+#define ROI_REF_WIDTH       640
+#define ROI_REF_HEIGHT      480
+#define ROI_MIN_SIZE        64
+#define ROI_MAX_ZOOM        2
+// Modos del OV2640 (ov2640_sensor_mode_t del driver) y su campo visual completo
+#define OV2640_MODE_UXGA    0
+#define OV2640_MODE_SVGA    1
+#define UXGA_WIDTH          1600
+#define SVGA_WIDTH          800
+
+static cam_roi_t s_roi = { .enabled = false, .zoom = 1 };
+static uint16_t s_roi_out_w = 0;
+static uint16_t s_roi_out_h = 0;
+
+static esp_err_t apply_roi(const cam_roi_t *roi);
+static void load_roi(void);
+
 esp_err_t camera_init_hardware(void) {
     camera_config_t config = {0};
     config.ledc_channel = LEDC_CHANNEL_0;
@@ -52,17 +101,18 @@ esp_err_t camera_init_hardware(void) {
     
     // Resolución VGA (640x480) - Balance velocidad/calidad
     // Opciones más rápidas: FRAMESIZE_HVGA (480x320) o FRAMESIZE_CIF (400x296)
-    config.frame_size = FRAMESIZE_VGA; 
+    config.frame_size = s_profiles[DEFAULT_PROFILE].size;
 
     // JPEG Quality: 12-15 = buena calidad, 18-25 = más velocidad
     // Valor óptimo para streaming fluido
-    config.jpeg_quality = 12;
+    config.jpeg_quality = s_profiles[DEFAULT_PROFILE].info.quality;
     
 #if CONFIG_SPIRAM
-    // OPTIMIZACIÓN: 3 buffers en PSRAM para pipeline DMA sin esperas
-    // El driver captura en uno mientras envías otro
+    // OPTIMIZACIÓN: 4 buffers en PSRAM para pipeline DMA sin esperas.
+    // El driver captura en uno; el frame bus retiene hasta 3 (uno puede
+    // estar fijado por un consumidor lento sin frenar a los demás)
     config.fb_location = CAMERA_FB_IN_PSRAM;
-    config.fb_count = 3;
+    config.fb_count = 4;
 #else
     // Sin PSRAM: 2 buffers máximo por limitación de DRAM
     config.fb_location = CAMERA_FB_IN_DRAM;
@@ -70,10 +120,239 @@ esp_err_t camera_init_hardware(void) {
 #endif
     config.grab_mode = CAMERA_GRAB_LATEST;
 
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
     esp_err_t err = esp_camera_init(&config);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Fallo al iniciar camara: 0x%x", err);
         return err;
     }
+
+    // Región de interés guardada (si falla se sigue con el frame completo)
+    load_roi();
+    if (s_roi.enabled && apply_roi(&s_roi) != ESP_OK) {
+        s_roi.enabled = false;
+    }
     return ESP_OK;
 }
+
+// ============================================================================
+// ESCALERA DE CALIDAD
+// ============================================================================
+int cam_hal_profile_count(void) {
+    return PROFILE_COUNT;
+}
+
+int cam_hal_default_profile(void) {
+    return DEFAULT_PROFILE;
+}
+
+int cam_hal_get_profile(void) {
+    return s_current_profile;
+}
+
+const cam_profile_t *cam_hal_profile_info(int step) {
+    if (step < 0 || step >= PROFILE_COUNT) return NULL;
+    return &s_profiles[step].info;
+}
+
+// Llamar con s_lock tomado
+static esp_err_t set_profile_locked(int step) {
+    if (step == s_current_profile) return ESP_OK;
+
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s) return ESP_ERR_INVALID_STATE;
+
+    // Con región de interés activa la ventana la fija el ROI: el paso solo
+    // cambia la calidad JPEG (set_framesize la pisaría)
+    const profile_entry_t *p = &s_profiles[step];
+    bool resize = !s_roi.enabled && p->size != s_profiles[s_current_profile].size;
+    if (resize && s_size_holds > 0) return ESP_ERR_INVALID_STATE;
+    if (!s_roi.enabled && s->status.framesize != p->size && s->set_framesize(s, p->size) != 0) {
+        ESP_LOGE(TAG, "No se pudo cambiar resolucion");
+        return ESP_FAIL;
+    }
+    if (s->set_quality(s, p->info.quality) != 0) {
+        ESP_LOGE(TAG, "No se pudo cambiar calidad JPEG");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Perfil %d -> %d: %ux%u calidad %d", s_current_profile, step,
+             p->info.width, p->info.height, p->info.quality);
+    s_current_profile = step;
+    return ESP_OK;
+}
+
+esp_err_t cam_hal_set_profile(int step) {
+    if (step < 0 || step >= PROFILE_COUNT) return ESP_ERR_INVALID_ARG;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = set_profile_locked(step);
+    if (err == ESP_OK) s_deferred_profile = -1;
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t cam_hal_defer_profile(int step) {
+    if (step < 0 || step >= PROFILE_COUNT) return ESP_ERR_INVALID_ARG;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = set_profile_locked(step);
+    if (err == ESP_ERR_INVALID_STATE && s_size_holds > 0) {
+        s_deferred_profile = step;
+        err = ESP_OK;
+    } else if (err == ESP_OK) {
+        s_deferred_profile = -1;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void cam_hal_hold_size(bool hold) {
+    if (!s_lock) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (hold) {
+        s_size_holds++;
+    } else if (s_size_holds > 0 && --s_size_holds == 0 && s_deferred_profile >= 0) {
+        // Terminó la última grabación: aplicar lo que quedó pendiente
+        set_profile_locked(s_deferred_profile);
+        s_deferred_profile = -1;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+bool cam_hal_size_held(void) {
+    return s_size_holds > 0;
+}
+
+// ============================================================================
+// REGIÓN DE INTERÉS
+// ============================================================================
+static void load_roi(void) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_ROI, NVS_READONLY, &nvs_handle) != ESP_OK) return;
+
+    int32_t en = 0, x = 0, y = 0, w = 0, h = 0, zoom = 1;
+    nvs_get_i32(nvs_handle, "enabled", &en);
+    nvs_get_i32(nvs_handle, "x", &x);
+    nvs_get_i32(nvs_handle, "y", &y);
+    nvs_get_i32(nvs_handle, "w", &w);
+    nvs_get_i32(nvs_handle, "h", &h);
+    nvs_get_i32(nvs_handle, "zoom", &zoom);
+    nvs_close(nvs_handle);
+
+    s_roi.enabled = (en != 0);
+    s_roi.x = x;
+    s_roi.y = y;
+    s_roi.width = w;
+    s_roi.height = h;
+    s_roi.zoom = zoom;
+}
+
+static esp_err_t save_roi(const cam_roi_t *roi) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_ROI, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, "enabled", roi->enabled ? 1 : 0);
+    nvs_set_i32(nvs_handle, "x", roi->x);
+    nvs_set_i32(nvs_handle, "y", roi->y);
+    nvs_set_i32(nvs_handle, "w", roi->width);
+    nvs_set_i32(nvs_handle, "h", roi->height);
+    nvs_set_i32(nvs_handle, "zoom", roi->zoom);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err;
+}
+
+static bool roi_valid(const cam_roi_t *roi) {
+    return roi->width >= ROI_MIN_SIZE && roi->height >= ROI_MIN_SIZE &&
+           roi->x + roi->width <= ROI_REF_WIDTH && roi->y + roi->height <= ROI_REF_HEIGHT &&
+           roi->zoom >= 1 && roi->zoom <= ROI_MAX_ZOOM;
+}
+
+// Programa la ventana del DSP: recorte en coordenadas del modo del sensor
+// y salida escalada (el DSP solo achica, nunca agranda).
+static esp_err_t apply_roi(const cam_roi_t *roi) {
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s) return ESP_ERR_INVALID_STATE;
+
+    if (!roi->enabled) {
+        // Volver al frame completo del paso actual
+        if (s->set_framesize(s, s_profiles[s_current_profile].size) != 0) return ESP_FAIL;
+        s_roi_out_w = 0;
+        s_roi_out_h = 0;
+        return ESP_OK;
+    }
+    if (s->id.PID != OV2640_PID || !s->set_res_raw) return ESP_ERR_NOT_SUPPORTED;
+    if (!roi_valid(roi)) return ESP_ERR_INVALID_ARG;
+
+    // Salida: el recorte al mismo detalle que el frame completo, por zoom.
+    // Nunca más grande que los frame buffers (dimensionados para 640x480).
+    uint32_t out_w = roi->width * roi->zoom;
+    uint32_t out_h = roi->height * roi->zoom;
+    if (out_w > ROI_REF_WIDTH) {
+        out_h = out_h * ROI_REF_WIDTH / out_w;
+        out_w = ROI_REF_WIDTH;
+    }
+    if (out_h > ROI_REF_HEIGHT) {
+        out_w = out_w * ROI_REF_HEIGHT / out_h;
+        out_h = ROI_REF_HEIGHT;
+    }
+    out_w &= ~7u;       // Múltiplos de 8 para el codificador JPEG
+    out_h &= ~7u;
+
+    // SVGA lee el sensor más rápido; UXGA solo si la salida pide más
+    // detalle del que tiene la ventana en SVGA
+    int mode = OV2640_MODE_SVGA;
+    uint32_t full_w = SVGA_WIDTH;
+    if (out_w > (uint32_t)roi->width * SVGA_WIDTH / ROI_REF_WIDTH) {
+        mode = OV2640_MODE_UXGA;
+        full_w = UXGA_WIDTH;
+    }
+    // Ventana en coordenadas del modo (múltiplos de 4, como pide el DSP)
+    uint32_t off_x = ((uint32_t)roi->x * full_w / ROI_REF_WIDTH) & ~3u;
+    uint32_t off_y = ((uint32_t)roi->y * full_w / ROI_REF_WIDTH) & ~3u;
+    uint32_t win_w = ((uint32_t)roi->width * full_w / ROI_REF_WIDTH) & ~3u;
+    uint32_t win_h = ((uint32_t)roi->height * full_w / ROI_REF_WIDTH) & ~3u;
+    if (out_w > win_w) out_w = win_w & ~7u;
+    if (out_h > win_h) out_h = win_h & ~7u;
+
+    if (s->set_res_raw(s, mode, 0, 0, 0, off_x, off_y, win_w, win_h, out_w, out_h, false, false) != 0) {
+        ESP_LOGE(TAG, "No se pudo programar la ventana del sensor");
+        return ESP_FAIL;
+    }
+    s->set_quality(s, s_profiles[s_current_profile].info.quality);
+
+    s_roi_out_w = out_w;
+    s_roi_out_h = out_h;
+    ESP_LOGI(TAG, "ROI %ux%u+%u+%u x%u -> %lux%lu (%s)", roi->width, roi->height, roi->x, roi->y,
+             roi->zoom, (unsigned long)out_w, (unsigned long)out_h,
+             mode == OV2640_MODE_SVGA ? "SVGA" : "UXGA");
+    return ESP_OK;
+}
+
+esp_err_t cam_hal_set_roi(const cam_roi_t *roi) {
+    if (!roi) return ESP_ERR_INVALID_ARG;
+    cam_roi_t cfg = *roi;
+    if (cfg.zoom == 0) cfg.zoom = 1;
+    if (cfg.enabled && !roi_valid(&cfg)) return ESP_ERR_INVALID_ARG;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    // Cambiar la ventana cambia el tamaño de salida: no en medio de un video
+    esp_err_t err = s_size_holds > 0 ? ESP_ERR_INVALID_STATE : apply_roi(&cfg);
+    if (err == ESP_OK) s_roi = cfg;
+    xSemaphoreGive(s_lock);
+    if (err != ESP_OK) return err;
+    return save_roi(&cfg);
+}
+
+void cam_hal_get_roi(cam_roi_t *roi, uint16_t *out_width, uint16_t *out_height) {
+    if (roi) *roi = s_roi;
+    if (out_width) *out_width = s_roi.enabled ? s_roi_out_w : s_profiles[s_current_profile].info.width;
+    if (out_height) *out_height = s_roi.enabled ? s_roi_out_h : s_profiles[s_current_profile].info.height;
+}
@@ -1,5 +1,67 @@
 #pragma once
 #include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
 
 // Prototipo de la función
 esp_err_t camera_init_hardware(void);
+
+// ============================================================================
+// ESCALERA DE CALIDAD (resolución + calidad JPEG)
+// ============================================================================
+// Paso 0 = mejor imagen. Nunca supera la resolución de camera_init_hardware()
+// porque los frame buffers se dimensionan al iniciar.
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    int quality;        // 10 = mejor, 63 = peor
+} cam_profile_t;
+
+// Cantidad de pasos disponibles
+int cam_hal_profile_count(void);
+
+// Paso configurado en camera_init_hardware()
+int cam_hal_default_profile(void);
+
+// Paso aplicado actualmente
+int cam_hal_get_profile(void);
+
+// Aplica un paso de la escalera al sensor. ESP_ERR_INVALID_STATE si el paso
+// cambia la resolución mientras el tamaño está retenido.
+esp_err_t cam_hal_set_profile(int step);
+
+// Como cam_hal_set_profile, pero si el tamaño está retenido el paso se
+// aplica cuando se libera la última retención
+esp_err_t cam_hal_defer_profile(int step);
+
+// Retención del tamaño de salida (contada): la toma cada grabación abierta,
+// porque el contenedor fija ancho y alto con el primer frame. Mientras haya
+// alguna solo se aceptan pasos de calidad y no se puede cambiar la ROI.
+void cam_hal_hold_size(bool hold);
+bool cam_hal_size_held(void);
+
+// Datos de un paso (NULL si no existe)
+const cam_profile_t *cam_hal_profile_info(int step);
+
+// ============================================================================
+// REGIÓN DE INTERÉS (ventana del sensor, solo OV2640)
+// ============================================================================
+// El DSP del sensor recorta y escala antes de comprimir: el JPEG sale ya
+// recortado, más chico y más rápido de enviar. Coordenadas en píxeles del
+// frame completo de arranque (640x480). zoom multiplica el tamaño de salida
+// (1 = mismo detalle que el frame completo), limitado a 640x480.
+typedef struct {
+    bool enabled;
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint8_t zoom;
+} cam_roi_t;
+
+// Aplica la región y la guarda en NVS (enabled = false vuelve al frame completo).
+// ESP_ERR_INVALID_STATE si hay una grabación abierta.
+esp_err_t cam_hal_set_roi(const cam_roi_t *roi);
+
+// Región configurada y tamaño real que entrega el sensor
+void cam_hal_get_roi(cam_roi_t *roi, uint16_t *out_width, uint16_t *out_height);
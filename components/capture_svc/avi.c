@@ -0,0 +1,238 @@
+#include "avi.h"
+#include "crypto.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "AVI";
+
+// Desplazamientos de la cabecera fija (RIFF + hdrl + INFO + inicio de movi)
+#define AVI_HEADER_LEN      340
+#define AVI_OFF_RIFF_SIZE   4
+#define AVI_OFF_AVIH        32      // Datos de avih (MainAVIHeader, 56 bytes)
+#define AVI_OFF_STRH        108     // Datos de strh (AVIStreamHeader, 56 bytes)
+#define AVI_OFF_STRF        172     // Datos de strf (BITMAPINFOHEADER, 40 bytes)
+#define AVI_OFF_INFO        212     // LIST INFO con un ICMT de largo fijo
+#define AVI_OFF_ICMT        232     // Texto del comentario (AVI_COMMENT_LEN)
+#define AVI_OFF_MOVI_SIZE   332
+#define AVI_MOVI_FOURCC     336     // Base de los offsets de idx1
+
+#define AVIF_HASINDEX       0x10
+#define AVIIF_KEYFRAME      0x10
+
+#define AVI_INDEX_GROW      1024    // Entradas por cada ampliación del índice
+#define AVI_IDX_BATCH       64      // Entradas de idx1 por escritura
+#define AVI_DEFAULT_FPS     10      // Si no hay dos frames para medir
+
+// Entrada compacta del índice: idx1 usa 16 bytes, acá alcanza con 8
+typedef struct {
+    uint32_t offset;                // Desde el fourcc 'movi'
+    uint32_t size;                  // JPEG sin relleno
+} avi_index_entry_t;
+
+struct avi_writer {
+    crypto_stream_t *stream;
+    avi_index_entry_t *index;       // PSRAM
+    uint32_t index_cap;
+    uint32_t frames;
+    uint32_t movi_len;              // Desde el fourcc 'movi' (incluido)
+    uint32_t max_frame;
+    uint16_t width;
+    uint16_t height;
+    int64_t first_us;
+    int64_t last_us;
+    char comment[AVI_COMMENT_LEN];
+};
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+static void put_chunk(uint8_t *p, const char *fourcc, uint32_t size) {
+    memcpy(p, fourcc, 4);
+    put_le32(p + 4, size);
+}
+
+// Arma la cabecera completa con los valores actuales (en cero al abrir)
+static void build_header(const avi_writer_t *avi, uint8_t *h, uint32_t riff_size,
+                         uint32_t us_per_frame, uint32_t rate, uint32_t scale) {
+    memset(h, 0, AVI_HEADER_LEN);
+
+    put_chunk(h, "RIFF", riff_size);
+    memcpy(h + 8, "AVI ", 4);
+    put_chunk(h + 12, "LIST", 192);
+    memcpy(h + 20, "hdrl", 4);
+
+    put_chunk(h + 24, "avih", 56);
+    uint8_t *a = h + AVI_OFF_AVIH;
+    put_le32(a + 0, us_per_frame);
+    put_le32(a + 4, us_per_frame ? (uint32_t)((uint64_t)avi->max_frame * 1000000 / us_per_frame) : 0);
+    put_le32(a + 12, AVIF_HASINDEX);
+    put_le32(a + 16, avi->frames);
+    put_le32(a + 24, 1);                        // Streams
+    put_le32(a + 28, avi->max_frame);
+    put_le32(a + 32, avi->width);
+    put_le32(a + 36, avi->height);
+
+    put_chunk(h + 88, "LIST", 116);
+    memcpy(h + 96, "strl", 4);
+
+    put_chunk(h + 100, "strh", 56);
+    uint8_t *s = h + AVI_OFF_STRH;
+    memcpy(s + 0, "vids", 4);
+    memcpy(s + 4, "MJPG", 4);
+    put_le32(s + 20, scale);
+    put_le32(s + 24, rate);
+    put_le32(s + 32, avi->frames);              // dwLength
+    put_le32(s + 36, avi->max_frame);
+    put_le32(s + 40, 0xFFFFFFFF);               // Calidad por defecto
+    put_le16(s + 52, avi->width);               // rcFrame
+    put_le16(s + 54, avi->height);
+
+    put_chunk(h + 164, "strf", 40);
+    uint8_t *b = h + AVI_OFF_STRF;
+    put_le32(b + 0, 40);
+    put_le32(b + 4, avi->width);
+    put_le32(b + 8, avi->height);
+    put_le16(b + 12, 1);                        // Planos
+    put_le16(b + 14, 24);                       // Bits por pixel
+    memcpy(b + 16, "MJPG", 4);
+    put_le32(b + 20, (uint32_t)avi->width * avi->height * 3);
+
+    put_chunk(h + AVI_OFF_INFO, "LIST", 4 + AVI_CHUNK_HEADER + AVI_COMMENT_LEN);
+    memcpy(h + AVI_OFF_INFO + 8, "INFO", 4);
+    put_chunk(h + AVI_OFF_ICMT - AVI_CHUNK_HEADER, "ICMT", AVI_COMMENT_LEN);
+    memcpy(h + AVI_OFF_ICMT, avi->comment, AVI_COMMENT_LEN);
+
+    put_chunk(h + AVI_OFF_MOVI_SIZE - 4, "LIST", avi->movi_len);
+    memcpy(h + AVI_MOVI_FOURCC, "movi", 4);
+}
+
+avi_writer_t *avi_writer_open(const char *filename) {
+    avi_writer_t *avi = calloc(1, sizeof(avi_writer_t));
+    if (!avi) return NULL;
+
+    avi->stream = crypto_stream_open(filename);
+    if (!avi->stream) {
+        free(avi);
+        return NULL;
+    }
+    avi->movi_len = 4;
+
+    // Cabecera provisoria: un reproductor ve un AVI vacío hasta el cierre
+    uint8_t header[AVI_HEADER_LEN];
+    build_header(avi, header, AVI_HEADER_LEN - 8, 0, 0, 0);
+    if (crypto_stream_write(avi->stream, header, sizeof(header)) != ESP_OK) {
+        crypto_stream_close(avi->stream);
+        free(avi);
+        return NULL;
+    }
+    return avi;
+}
+
+void avi_chunk_frame(uint8_t *chunk, size_t jpeg_len) {
+    put_chunk(chunk, "00dc", (uint32_t)jpeg_len);
+    if (jpeg_len & 1) chunk[AVI_CHUNK_HEADER + jpeg_len] = 0;
+}
+
+void avi_writer_set_comment(avi_writer_t *avi, const char *text) {
+    // Siempre termina en '\0' y el resto queda en cero
+    memset(avi->comment, 0, sizeof(avi->comment));
+    snprintf(avi->comment, sizeof(avi->comment), "%s", text);
+}
+
+esp_err_t avi_writer_add_frame(avi_writer_t *avi, uint8_t *chunk, size_t jpeg_len,
+                               uint16_t width, uint16_t height, int64_t timestamp_us) {
+    if (avi->frames == avi->index_cap) {
+        uint32_t cap = avi->index_cap + AVI_INDEX_GROW;
+        avi_index_entry_t *idx = heap_caps_realloc(avi->index, cap * sizeof(avi_index_entry_t),
+                                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!idx) {
+            ESP_LOGE(TAG, "Sin memoria para el índice (%lu frames)", (unsigned long)avi->frames);
+            return ESP_ERR_NO_MEM;
+        }
+        avi->index = idx;
+        avi->index_cap = cap;
+    }
+
+    size_t len = avi_chunk_len(jpeg_len);
+    esp_err_t err = crypto_stream_write(avi->stream, chunk, len);
+    if (err != ESP_OK) return err;
+
+    avi->index[avi->frames].offset = avi->movi_len;
+    avi->index[avi->frames].size = (uint32_t)jpeg_len;
+    avi->frames++;
+    avi->movi_len += len;
+
+    if (jpeg_len > avi->max_frame) avi->max_frame = (uint32_t)jpeg_len;
+    if (avi->frames == 1) {
+        avi->width = width;
+        avi->height = height;
+        avi->first_us = timestamp_us;
+    }
+    avi->last_us = timestamp_us;
+    return ESP_OK;
+}
+
+static esp_err_t write_index(avi_writer_t *avi) {
+    uint8_t buf[AVI_IDX_BATCH * 16];
+
+    put_chunk(buf, "idx1", avi->frames * 16);
+    esp_err_t err = crypto_stream_write(avi->stream, buf, AVI_CHUNK_HEADER);
+
+    for (uint32_t i = 0; err == ESP_OK && i < avi->frames; i += AVI_IDX_BATCH) {
+        uint32_t n = avi->frames - i;
+        if (n > AVI_IDX_BATCH) n = AVI_IDX_BATCH;
+        for (uint32_t j = 0; j < n; j++) {
+            uint8_t *e = buf + j * 16;
+            memcpy(e, "00dc", 4);
+            put_le32(e + 4, AVIIF_KEYFRAME);
+            put_le32(e + 8, avi->index[i + j].offset);
+            put_le32(e + 12, avi->index[i + j].size);
+        }
+        err = crypto_stream_write(avi->stream, buf, n * 16);
+    }
+    return err;
+}
+
+esp_err_t avi_writer_close(avi_writer_t *avi) {
+    if (!avi) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = write_index(avi);
+
+    // Tasa real: frames medidos entre el primero y el último, en milésimas de FPS
+    uint32_t scale = 1000;
+    uint32_t rate = AVI_DEFAULT_FPS * scale;
+    int64_t span_us = avi->last_us - avi->first_us;
+    if (avi->frames > 1 && span_us > 0) {
+        uint64_t r = ((uint64_t)(avi->frames - 1) * 1000000ULL * scale + span_us / 2) / span_us;
+        if (r > 0) rate = (uint32_t)r;
+    }
+    uint32_t us_per_frame = (uint32_t)(1000000ULL * scale / rate);
+
+    uint32_t riff_size = AVI_MOVI_FOURCC - 8 + avi->movi_len + AVI_CHUNK_HEADER + avi->frames * 16;
+    uint8_t header[AVI_HEADER_LEN];
+    build_header(avi, header, riff_size, us_per_frame, rate, scale);
+    if (err == ESP_OK) err = crypto_stream_patch(avi->stream, 0, header, sizeof(header));
+
+    esp_err_t close_err = crypto_stream_close(avi->stream);
+    if (err == ESP_OK) err = close_err;
+
+    ESP_LOGI(TAG, "AVI cerrado: %lu frames, %lux%u, %lu.%03lu FPS",
+             (unsigned long)avi->frames, (unsigned long)avi->width, avi->height,
+             (unsigned long)(rate / scale), (unsigned long)(rate % scale));
+
+    heap_caps_free(avi->index);
+    free(avi);
+    return err;
+}
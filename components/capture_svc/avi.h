@@ -0,0 +1,44 @@
+#pragma once
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// CONTENEDOR AVI (MJPEG) SOBRE UN STREAM CIFRADO
+// ============================================================================
+// Se escribe de corrido: una cabecera de tamaño fijo con los campos en cero,
+// después un chunk '00dc' por frame dentro de LIST 'movi', y al cerrar el
+// índice 'idx1'. Los tamaños, la cantidad de frames y la tasa real (medida con
+// los timestamps de los frames) se parchean en la cabecera al final, junto
+// con un comentario INFO/ICMT de largo fijo (ritmo logrado, jitter, descartes).
+//
+// Cada frame se arma en el buffer del llamador, que lo cifra en el lugar:
+//   [AVI_CHUNK_HEADER][JPEG][1 byte de relleno si el JPEG es impar]
+
+#define AVI_CHUNK_HEADER    8
+#define AVI_CHUNK_PAD       1               // Relleno máximo al final
+#define AVI_COMMENT_LEN     96              // Texto de ICMT, con '\0'
+
+typedef struct avi_writer avi_writer_t;
+
+// Abre /sdcard/<filename>.enc y escribe la cabecera provisoria
+avi_writer_t *avi_writer_open(const char *filename);
+
+// Largo total del chunk para un JPEG de jpeg_len bytes
+static inline size_t avi_chunk_len(size_t jpeg_len) {
+    return AVI_CHUNK_HEADER + jpeg_len + (jpeg_len & 1);
+}
+
+// Completa la cabecera y el relleno de un chunk con el JPEG ya copiado
+// en chunk + AVI_CHUNK_HEADER
+void avi_chunk_frame(uint8_t *chunk, size_t jpeg_len);
+
+// Escribe el chunk (lo deja cifrado) y lo anota en el índice
+esp_err_t avi_writer_add_frame(avi_writer_t *avi, uint8_t *chunk, size_t jpeg_len,
+                               uint16_t width, uint16_t height, int64_t timestamp_us);
+
+// Comentario para los metadatos (se escribe al cerrar; se trunca)
+void avi_writer_set_comment(avi_writer_t *avi, const char *text);
+
+// Escribe idx1, parchea la cabecera y cierra. Libera aunque falle.
+esp_err_t avi_writer_close(avi_writer_t *avi);
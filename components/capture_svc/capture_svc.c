@@ -0,0 +1,1033 @@
+#include "capture_svc.h"
+#include "cam_hal.h"
+#include "crypto.h"
+#include "frame_bus.h"
+#include "preroll.h"
+#include "recorder.h"
+#include "dvr.h"
+#include "pacer.h"
+#include "sd_hal.h"
+#include "catalog.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static const char *TAG = "CAPTURE";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+// NVS para persistir el contador (mismo espacio que usaba main.c)
+#define NVS_NAMESPACE_PHOTO "photos"
+#define NVS_KEY_COUNTER     "counter"
+#define NVS_NAMESPACE_REC   "recording"
+#define NVS_KEY_REC_FPS     "fps"
+#define NVS_NAMESPACE_TL    "timelapse"
+#define NVS_KEY_TL_INTERVAL "interval"
+#define NVS_KEY_TL_ROLL     "roll"
+
+#define CAPTURE_MOUNT_POINT "/sdcard"
+
+#define CAPTURE_TASK_STACK  4096
+#define CAPTURE_TASK_PRIO   (tskIDLE_PRIORITY + 2)
+#define CAPTURE_TASK_CORE   0       // El core 1 queda para red y streaming
+#define CAPTURE_PHOTO_WAIT_MS 2000
+#define CAPTURE_BURST_WAIT_MS 500   // Entre frames de una ráfaga
+#define WRITER_TASK_STACK   4096
+#define WRITER_TASK_PRIO    (tskIDLE_PRIORITY + 1)
+
+static uint32_t photo_counter = 0;
+static volatile uint32_t s_record_fps = CAPTURE_REC_DEFAULT_FPS;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_task = NULL;
+static uint32_t s_next_id = 1;
+
+static capture_job_t s_queue[CAPTURE_QUEUE_LEN];   // Sin orden; id crece con el encolado
+static int s_depth = 0;
+static capture_job_t s_running;
+static bool s_busy = false;
+static char s_open_video[CAPTURE_FILE_LEN];         // Video abierto en la SD (sin .enc), bajo s_lock
+static capture_job_t s_history[CAPTURE_HISTORY_LEN];
+static int s_history_head = 0;                      // Próxima posición a escribir
+static int s_history_count = 0;
+
+static capture_svc_stats_t s_stats;
+static uint64_t s_total_wait_ms = 0;
+static uint64_t s_total_run_ms = 0;
+static uint32_t s_started = 0;
+static uint32_t s_finished = 0;
+
+// Ráfaga capturada, en PSRAM hasta que la escribe writer_task
+typedef struct {
+    uint32_t job_id;
+    uint32_t counter;
+    int count;
+    uint8_t *buf[CAPTURE_BURST_MAX];
+    size_t len[CAPTURE_BURST_MAX];
+} burst_t;
+
+static QueueHandle_t s_burst_queue = NULL;
+static burst_t *s_burst_ready = NULL;       // Se entrega después de publicar el trabajo
+
+// Time-lapse: configuración y estado los comparte la API (bajo s_lock); el
+// lote en PSRAM es solo de la tarea de captura
+static capture_timelapse_status_t s_tl;
+static esp_timer_handle_t s_tl_timer = NULL;
+static volatile bool s_tl_flush_req = false;
+static uint8_t *s_tl_batch = NULL;
+static uint64_t s_tl_total_late_ms = 0;
+static uint64_t s_tl_total_flush_ms = 0;
+static uint32_t s_tl_late_count = 0;
+
+// ============================================================================
+// NOMBRES
+// ============================================================================
+static const char *const TYPE_NAMES[] = { "photo", "video", "burst", "timelapse" };
+static const char *const PRIO_NAMES[] = { "low", "normal", "high" };
+static const char *const STATE_NAMES[] = { "queued", "running", "done", "failed", "dropped", "writing" };
+
+const char *capture_job_type_name(capture_job_type_t type) {
+    return type <= CAPTURE_JOB_TIMELAPSE ? TYPE_NAMES[type] : "?";
+}
+
+const char *capture_prio_name(capture_prio_t prio) {
+    return prio <= CAPTURE_PRIO_HIGH ? PRIO_NAMES[prio] : "?";
+}
+
+const char *capture_state_name(capture_state_t state) {
+    return state <= CAPTURE_STATE_WRITING ? STATE_NAMES[state] : "?";
+}
+
+// Las tomas de time-lapse solo las encola el timer
+bool capture_parse_job_type(const char *s, capture_job_type_t *type) {
+    for (int i = 0; i <= CAPTURE_JOB_BURST; i++) {
+        if (strcmp(s, TYPE_NAMES[i]) == 0) {
+            *type = (capture_job_type_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool capture_parse_prio(const char *s, capture_prio_t *prio) {
+    for (int i = 0; i <= CAPTURE_PRIO_HIGH; i++) {
+        if (strcmp(s, PRIO_NAMES[i]) == 0) {
+            *prio = (capture_prio_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// CONTADOR DE ARCHIVOS (sobrevive reinicios)
+// ============================================================================
+static void load_photo_counter(void) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_PHOTO, NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_get_u32(nvs_handle, NVS_KEY_COUNTER, &photo_counter);
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "Contador de fotos recuperado: %lu", (unsigned long)photo_counter);
+        } else {
+            photo_counter = 0;
+            ESP_LOGI(TAG, "Contador de fotos iniciando en 0");
+        }
+        nvs_close(nvs_handle);
+    } else {
+        photo_counter = 0;
+    }
+}
+
+static void save_photo_counter(void) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_PHOTO, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        nvs_set_u32(nvs_handle, NVS_KEY_COUNTER, photo_counter);
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+}
+
+static void load_record_fps(void) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_REC, NVS_READONLY, &nvs_handle) != ESP_OK) return;
+    int32_t val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_REC_FPS, &val) == ESP_OK &&
+        val >= CAPTURE_REC_MIN_FPS && val <= CAPTURE_REC_MAX_FPS) {
+        s_record_fps = val;
+    }
+    nvs_close(nvs_handle);
+}
+
+// Alta en el catálogo de un archivo escrito con sufijo .enc
+static void catalog_add_enc(const char *filename) {
+    char name[CAPTURE_FILE_LEN + 4];
+    snprintf(name, sizeof(name), "%s.enc", filename);
+    catalog_add(name);
+}
+
+// ============================================================================
+// FOTO
+// ============================================================================
+static esp_err_t capture_encrypted_photo(capture_job_t *job) {
+    // Tomamos el frame del bus (compartido con el streaming)
+    frame_bus_sub_t *sub = frame_bus_subscribe("photo");
+    const frame_t *fb = sub ? frame_bus_acquire(sub, pdMS_TO_TICKS(CAPTURE_PHOTO_WAIT_MS)) : NULL;
+    frame_bus_unsubscribe(sub);
+    if (!fb) {
+        ESP_LOGE(TAG, "Error capturando foto");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Generar nombre único
+    char filename[CAPTURE_FILE_LEN];
+    snprintf(filename, sizeof(filename), "IMG_%08lu", (unsigned long)photo_counter++);
+
+    // Guardar encriptado
+    esp_err_t ret = crypto_save_file(filename, fb->buf, fb->len);
+
+    frame_bus_release(fb);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Foto guardada: %s.enc", filename);
+        catalog_add_enc(filename);
+        // Persistir el contador para sobrevivir reinicios
+        save_photo_counter();
+        if (job->files++ == 0) snprintf(job->file, sizeof(job->file), "%s", filename);
+    } else {
+        ESP_LOGE(TAG, "Error guardando foto encriptada");
+        photo_counter--;  // Revertir si falló
+    }
+    return ret;
+}
+
+// ============================================================================
+// RÁFAGA
+// ============================================================================
+// Solo copiar: cifrar y escribir cada frame antes del siguiente limitaba la
+// ráfaga a lo que tarda la SD. Los frames quedan en PSRAM para writer_task.
+static esp_err_t capture_encrypted_burst(capture_job_t *job) {
+    burst_t *b = heap_caps_calloc(1, sizeof(burst_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    frame_bus_sub_t *sub = frame_bus_subscribe("burst");
+    if (!b || !sub) {
+        frame_bus_unsubscribe(sub);
+        heap_caps_free(b);
+        return ESP_ERR_NO_MEM;
+    }
+
+    int64_t prev_ts = 0;
+    uint64_t total_gap = 0;
+    while (b->count < job->req.count) {
+        const frame_t *fb = frame_bus_acquire(sub, pdMS_TO_TICKS(CAPTURE_BURST_WAIT_MS));
+        if (!fb) break;
+        uint8_t *copy = heap_caps_malloc(fb->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!copy) {
+            frame_bus_done(sub, fb);
+            ESP_LOGW(TAG, "Ráfaga: sin PSRAM después de %d frames", b->count);
+            break;
+        }
+        memcpy(copy, fb->buf, fb->len);
+        b->buf[b->count] = copy;
+        b->len[b->count] = fb->len;
+        b->count++;
+
+        if (prev_ts) {
+            uint32_t gap = (uint32_t)(fb->timestamp_us - prev_ts);
+            total_gap += gap;
+            if (!job->spacing_min_us || gap < job->spacing_min_us) job->spacing_min_us = gap;
+            if (gap > job->spacing_max_us) job->spacing_max_us = gap;
+        }
+        prev_ts = fb->timestamp_us;
+        frame_bus_done(sub, fb);
+    }
+    frame_bus_unsubscribe(sub);
+
+    job->frames = b->count;
+    if (b->count > 1) job->spacing_avg_us = (uint32_t)(total_gap / (b->count - 1));
+    if (b->count == 0) {
+        heap_caps_free(b);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    b->job_id = job->id;
+    b->counter = photo_counter++;
+    save_photo_counter();
+    snprintf(job->file, sizeof(job->file), "BST_%08lu_00", (unsigned long)b->counter);
+    ESP_LOGI(TAG, "Ráfaga #%lu: %d frames, separación media %lu us (min %lu, max %lu)",
+             (unsigned long)job->id, b->count, (unsigned long)job->spacing_avg_us,
+             (unsigned long)job->spacing_min_us, (unsigned long)job->spacing_max_us);
+    s_burst_ready = b;
+    return ESP_OK;
+}
+
+// Trabajo ya publicado en el historial (solo con s_lock tomado)
+static capture_job_t *history_find(uint32_t id);
+
+// Cifra y escribe las ráfagas en segundo plano, sin frenar la cola
+static void writer_task(void *arg) {
+    burst_t *b;
+    while (true) {
+        if (xQueueReceive(s_burst_queue, &b, portMAX_DELAY) != pdTRUE) continue;
+
+        int written = 0;
+        for (int i = 0; i < b->count; i++) {
+            char filename[CAPTURE_FILE_LEN];
+            snprintf(filename, sizeof(filename), "BST_%08lu_%02d", (unsigned long)b->counter, i);
+            if (crypto_save_file(filename, b->buf[i], b->len[i]) == ESP_OK) {
+                catalog_add_enc(filename);
+                written++;
+            }
+            heap_caps_free(b->buf[i]);
+            b->buf[i] = NULL;
+        }
+        ESP_LOGI(TAG, "Ráfaga #%lu escrita: %d/%d archivos", (unsigned long)b->job_id, written, b->count);
+
+        portENTER_CRITICAL(&s_lock);
+        capture_job_t *job = history_find(b->job_id);
+        if (job) {
+            job->files = written;
+            job->state = written == b->count ? CAPTURE_STATE_DONE : CAPTURE_STATE_FAILED;
+            job->finished_us = esp_timer_get_time();
+        }
+        if (written == b->count) s_stats.done++;
+        else s_stats.failed++;
+        portEXIT_CRITICAL(&s_lock);
+
+        heap_caps_free(b);
+    }
+}
+
+// ============================================================================
+// VIDEO
+// ============================================================================
+typedef struct {
+    recorder_t *rec;
+    pacer_t *pacer;             // Arranca con el primer frame del pre-evento
+    bool paced;
+    uint32_t fps;
+    uint16_t width;             // Tamaño fijado por recorder_open()
+    uint16_t height;
+    int skipped;
+} preroll_dump_t;
+
+static bool preroll_to_recorder(const frame_t *frame, void *ctx) {
+    preroll_dump_t *dump = ctx;
+    // Frames de antes de un cambio de resolución: el AVI tiene un solo tamaño
+    if (frame->width != dump->width || frame->height != dump->height) {
+        dump->skipped++;
+        return true;
+    }
+    // Es una copia del anillo: se puede esperar a la SD sin retener nada
+    esp_err_t err = recorder_reserve(dump->rec, REC_SLOT_WAIT_MS);
+    if (err == ESP_FAIL) return false;
+    if (err != ESP_OK) return true;
+
+    // Mismo reloj de deadlines que el resto del clip: el pre-evento también
+    // se ajusta al FPS de grabación y entra en las estadísticas
+    if (!dump->paced) {
+        pacer_start(dump->pacer, dump->fps, frame->timestamp_us);
+        dump->paced = true;
+    }
+    if (!pacer_offer(dump->pacer, frame->timestamp_us)) return true;
+    return recorder_add_frame(dump->rec, frame) == ESP_OK;
+}
+
+// Captura video (AVI MJPEG con índice, ver avi.h) directo a la
+// SD: cifrado y escrito a medida que llega, con memoria fija (ver recorder.h).
+// Empieza con los segundos previos al disparo que guarda el anillo de pre-evento.
+static esp_err_t capture_encrypted_video(capture_job_t *job) {
+    int duration_sec = job->req.duration_s;
+    ESP_LOGI(TAG, "Iniciando captura de video por %d segundos...", duration_sec);
+
+    char filename[CAPTURE_FILE_LEN];
+    snprintf(filename, sizeof(filename), "VID_%08lu.avi", (unsigned long)photo_counter);
+
+    // Suscribirse antes de volcar el pre-evento para no perder frames en el medio
+    frame_bus_sub_t *sub = frame_bus_subscribe("video");
+    if (!sub) {
+        ESP_LOGE(TAG, "No se pudo registrar el grabador en el frame bus");
+        return ESP_ERR_NO_MEM;
+    }
+
+    recorder_t *rec = recorder_open(filename);
+    if (!rec) {
+        ESP_LOGE(TAG, "No se pudo abrir %s.enc", filename);
+        frame_bus_unsubscribe(sub);
+        return ESP_FAIL;
+    }
+    photo_counter++;
+    save_photo_counter();
+    portENTER_CRITICAL(&s_lock);
+    memcpy(s_open_video, filename, sizeof(s_open_video));
+    portEXIT_CRITICAL(&s_lock);
+
+    // El volcado no frena al anillo: los frames que llegan mientras se
+    // escribe entran al anillo y se vuelcan también, y el bus sigue desde last_seq
+    uint32_t last_seq = 0;
+    pacer_t pacer;
+    preroll_dump_t dump = { .rec = rec, .pacer = &pacer, .fps = s_record_fps };
+    cam_hal_get_roi(NULL, &dump.width, &dump.height);
+    int preroll_frames = preroll_visit(preroll_to_recorder, &dump, &last_seq);
+    if (preroll_frames > 0) {
+        ESP_LOGI(TAG, "Pre-evento: %lu de %d frames al clip (%d de otro tamaño)",
+                 (unsigned long)(dump.paced ? pacer.frames : 0), preroll_frames, dump.skipped);
+    }
+
+    int64_t start_time = esp_timer_get_time();
+    int64_t end_time = start_time + ((int64_t)duration_sec * 1000000);
+    // Sin pre-evento el reloj arranca ahora; con pre-evento sigue el del
+    // anillo y el hueco hasta el primer frame en vivo cuenta como descartes
+    if (!dump.paced) pacer_start(&pacer, s_record_fps, start_time);
+
+    while (esp_timer_get_time() < end_time) {
+        pacer_sleep(&pacer);
+        // Primero el slot: si la SD va atrás se espera sin retener un frame
+        esp_err_t err = recorder_reserve(rec, REC_SLOT_WAIT_MS);
+        if (err == ESP_FAIL) {
+            ESP_LOGE(TAG, "Error escribiendo video, se corta la grabación");
+            break;
+        }
+        if (err != ESP_OK) continue;
+
+        const frame_t *fb = frame_bus_acquire(sub, pdMS_TO_TICKS(500));
+        if (!fb) {
+            ESP_LOGW(TAG, "Frame perdido");
+            continue;
+        }
+
+        // Ya está en el clip (vino del anillo de pre-evento) o llegó antes
+        // de la ventana de su deadline
+        if (fb->seq <= last_seq || !pacer_offer(&pacer, fb->timestamp_us)) {
+            frame_bus_done(sub, fb);
+            continue;
+        }
+
+        err = recorder_add_frame(rec, fb);
+        frame_bus_done(sub, fb);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error escribiendo video, se corta la grabación");
+            break;
+        }
+    }
+
+    frame_bus_unsubscribe(sub);
+
+    char comment[96];
+    pacer_describe(&pacer, comment, sizeof(comment));
+    recorder_set_comment(rec, comment);
+
+    capture_rec_stats_t rs;
+    esp_err_t ret = recorder_close(rec, &rs);
+    portENTER_CRITICAL(&s_lock);
+    s_open_video[0] = '\0';
+    portEXIT_CRITICAL(&s_lock);
+    rs.target_fps = pacer.target_fps;
+    rs.fps_x100 = pacer_fps_x100(&pacer);
+    rs.jitter_avg_us = pacer_avg_jitter_us(&pacer);
+    rs.jitter_max_us = pacer.max_jitter_us;
+    rs.paced_drops = pacer.drops;
+    portENTER_CRITICAL(&s_lock);
+    s_stats.last_recording = rs;
+    portEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Video capturado: %lu frames, %llu bytes (descartados %lu, escritura media %lu ms), %s",
+             (unsigned long)rs.frames, (unsigned long long)rs.bytes,
+             (unsigned long)(rs.dropped_large + rs.dropped_busy), (unsigned long)rs.avg_write_ms, comment);
+
+    if (rs.frames == 0) {
+        // Nada que guardar: no dejar un archivo vacío
+        char filepath[64];
+        snprintf(filepath, sizeof(filepath), CAPTURE_MOUNT_POINT "/%s.enc", filename);
+        remove(filepath);
+        return ESP_FAIL;
+    }
+
+    // Aun con error de escritura, lo que llegó a la SD queda con la cabecera completa
+    snprintf(job->file, sizeof(job->file), "%s", filename);
+    job->files = 1;
+    catalog_add_enc(filename);
+    if (ret == ESP_OK) ESP_LOGI(TAG, "Video guardado: %s.enc", filename);
+    else ESP_LOGE(TAG, "Video %s.enc incompleto", filename);
+    return ret;
+}
+
+// ============================================================================
+// TIME-LAPSE
+// ============================================================================
+static void load_timelapse_config(void) {
+    s_tl.cfg.interval_s = CAPTURE_TL_DEFAULT_INTERVAL_S;
+    s_tl.cfg.roll_frames = CAPTURE_TL_DEFAULT_ROLL;
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_TL, NVS_READONLY, &nvs_handle) != ESP_OK) return;
+    int32_t val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_TL_INTERVAL, &val) == ESP_OK &&
+        val >= CAPTURE_TL_MIN_INTERVAL_S && val <= CAPTURE_TL_MAX_INTERVAL_S) {
+        s_tl.cfg.interval_s = val;
+    }
+    if (nvs_get_i32(nvs_handle, NVS_KEY_TL_ROLL, &val) == ESP_OK &&
+        val >= CAPTURE_TL_MIN_ROLL && val <= CAPTURE_TL_MAX_ROLL) {
+        s_tl.cfg.roll_frames = val;
+    }
+    nvs_close(nvs_handle);
+}
+
+static esp_err_t save_timelapse_config(const capture_timelapse_config_t *cfg) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_TL, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_TL_INTERVAL, cfg->interval_s);
+    nvs_set_i32(nvs_handle, NVS_KEY_TL_ROLL, cfg->roll_frames);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err;
+}
+
+// Desde la tarea de esp_timer: solo encolar. Si la toma anterior todavía
+// espera, se fusiona y cuenta como salteada.
+static void tl_timer_cb(void *arg) {
+    capture_request_t req = { .type = CAPTURE_JOB_TIMELAPSE, .prio = CAPTURE_PRIO_LOW };
+    bool merged = false;
+    esp_err_t err = capture_svc_submit(&req, NULL, &merged);
+
+    portENTER_CRITICAL(&s_lock);
+    s_tl.shots++;
+    if (err != ESP_OK || merged) s_tl.skipped++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Escribe el lote pendiente al contenedor en curso (un fopen por lote)
+static void tl_flush(void) {
+    if (!s_tl_batch || s_tl.pending_frames == 0) return;
+
+    int64_t t0 = esp_timer_get_time();
+    char filepath[64];
+    snprintf(filepath, sizeof(filepath), CAPTURE_MOUNT_POINT "/%s.tlx", s_tl.file);
+
+    bool ok = false;
+    FILE *f = fopen(filepath, "ab");
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        ok = ftell(f) > 0 || fwrite("TLX1", 1, 4, f) == 4;
+        ok = ok && fwrite(s_tl_batch, 1, s_tl.pending_bytes, f) == s_tl.pending_bytes;
+        ok = fflush(f) == 0 && ok;
+        fsync(fileno(f));
+        fclose(f);
+    }
+    uint32_t flush_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+
+    portENTER_CRITICAL(&s_lock);
+    if (ok) {
+        s_tl.written += s_tl.pending_frames;
+        s_tl.flushes++;
+        s_tl_total_flush_ms += flush_ms;
+        s_tl.avg_flush_ms = (uint32_t)(s_tl_total_flush_ms / s_tl.flushes);
+    } else {
+        s_tl.skipped += s_tl.pending_frames;
+        s_tl.file_frames -= s_tl.pending_frames;
+    }
+    uint32_t frames = s_tl.pending_frames;
+    s_tl.pending_frames = 0;
+    s_tl.pending_bytes = 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (ok) {
+        // Alta del contenedor o nuevo tamaño
+        char name[CAPTURE_FILE_LEN + 4];
+        snprintf(name, sizeof(name), "%s.tlx", s_tl.file);
+        catalog_add(name);
+        ESP_LOGI(TAG, "Time-lapse: %lu tomas escritas en %s.tlx (%lu ms)",
+                 (unsigned long)frames, s_tl.file, (unsigned long)flush_ms);
+    } else {
+        ESP_LOGE(TAG, "Time-lapse: no se pudo escribir %s (%lu tomas perdidas)",
+                 filepath, (unsigned long)frames);
+    }
+}
+
+static void tl_release_batch(void) {
+    heap_caps_free(s_tl_batch);
+    s_tl_batch = NULL;
+}
+
+// Una toma: cifrar y agregar al lote; escribir cuando se llena o al rotar
+static esp_err_t capture_timelapse_shot(capture_job_t *job) {
+    frame_bus_sub_t *sub = frame_bus_subscribe("timelapse");
+    const frame_t *fb = sub ? frame_bus_acquire(sub, pdMS_TO_TICKS(CAPTURE_PHOTO_WAIT_MS)) : NULL;
+    frame_bus_unsubscribe(sub);
+    if (!fb) {
+        ESP_LOGE(TAG, "Time-lapse: sin frame");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int64_t late_us = fb->timestamp_us - job->queued_us;
+    uint32_t late_ms = late_us > 0 ? (uint32_t)(late_us / 1000) : 0;
+
+    size_t enc_max = 16 + ((fb->len / 16) + 1) * 16;
+    size_t needed = sizeof(capture_tl_record_t) + enc_max;
+    if (needed > CAPTURE_TL_BATCH_BYTES) {
+        frame_bus_release(fb);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!s_tl_batch) {
+        s_tl_batch = heap_caps_malloc(CAPTURE_TL_BATCH_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_tl_batch) {
+            frame_bus_release(fb);
+            ESP_LOGE(TAG, "Time-lapse: sin PSRAM para el lote");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (s_tl.pending_bytes + needed > CAPTURE_TL_BATCH_BYTES) tl_flush();
+
+    // Contenedor nuevo al arrancar o al rotar
+    if (s_tl.file[0] == '\0') {
+        char name[CAPTURE_FILE_LEN];
+        snprintf(name, sizeof(name), "TLX_%08lu", (unsigned long)photo_counter++);
+        save_photo_counter();
+        portENTER_CRITICAL(&s_lock);
+        memcpy(s_tl.file, name, sizeof(s_tl.file));
+        s_tl.file_frames = 0;
+        portEXIT_CRITICAL(&s_lock);
+        ESP_LOGI(TAG, "Time-lapse: nuevo contenedor %s.tlx", name);
+    }
+
+    uint8_t *rec = s_tl_batch + s_tl.pending_bytes;
+    int enc_len = crypto_encrypt(fb->buf, fb->len, rec + sizeof(capture_tl_record_t), enc_max);
+    if (enc_len < 0) {
+        frame_bus_release(fb);
+        return ESP_FAIL;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    capture_tl_record_t hdr = {
+        .magic = { 'T', 'L', 'R', '1' },
+        .orig_len = fb->len,
+        .enc_len = (uint32_t)enc_len,
+        .seq = fb->seq,
+        .unix_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec,
+    };
+    memcpy(rec, &hdr, sizeof(hdr));
+    frame_bus_release(fb);
+
+    portENTER_CRITICAL(&s_lock);
+    s_tl.pending_bytes += sizeof(hdr) + enc_len;
+    s_tl.pending_frames++;
+    s_tl.file_frames++;
+    s_tl_late_count++;
+    s_tl_total_late_ms += late_ms;
+    s_tl.avg_late_ms = (uint32_t)(s_tl_total_late_ms / s_tl_late_count);
+    if (late_ms > s_tl.max_late_ms) s_tl.max_late_ms = late_ms;
+    bool roll = s_tl.file_frames >= s_tl.cfg.roll_frames;
+    portEXIT_CRITICAL(&s_lock);
+
+    snprintf(job->file, sizeof(job->file), "%s", s_tl.file);
+    job->files = 1;
+
+    if (roll || s_tl.pending_frames >= CAPTURE_TL_BATCH_FRAMES) tl_flush();
+    if (roll) {
+        portENTER_CRITICAL(&s_lock);
+        s_tl.file[0] = '\0';
+        portEXIT_CRITICAL(&s_lock);
+    }
+    return ESP_OK;
+}
+
+// ============================================================================
+// COLA (solo con s_lock tomado)
+// ============================================================================
+static void history_push(const capture_job_t *job) {
+    s_history[s_history_head] = *job;
+    s_history_head = (s_history_head + 1) % CAPTURE_HISTORY_LEN;
+    if (s_history_count < CAPTURE_HISTORY_LEN) s_history_count++;
+}
+
+static capture_job_t *history_find(uint32_t id) {
+    for (int i = 0; i < s_history_count; i++) {
+        if (s_history[i].id == id) return &s_history[i];
+    }
+    return NULL;
+}
+
+static void queue_remove(int i) {
+    s_queue[i] = s_queue[--s_depth];
+}
+
+// Mayor prioridad primero; a igual prioridad, el más viejo
+static int queue_best(void) {
+    int best = -1;
+    for (int i = 0; i < s_depth; i++) {
+        if (best < 0 || s_queue[i].req.prio > s_queue[best].req.prio ||
+            (s_queue[i].req.prio == s_queue[best].req.prio && s_queue[i].id < s_queue[best].id)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// El que se sacrifica con la cola llena: menor prioridad, el más nuevo
+static int queue_worst(void) {
+    int worst = -1;
+    for (int i = 0; i < s_depth; i++) {
+        if (worst < 0 || s_queue[i].req.prio < s_queue[worst].req.prio ||
+            (s_queue[i].req.prio == s_queue[worst].req.prio && s_queue[i].id > s_queue[worst].id)) {
+            worst = i;
+        }
+    }
+    return worst;
+}
+
+// ============================================================================
+// TAREA
+// ============================================================================
+static void capture_task(void *arg) {
+    while (true) {
+        portENTER_CRITICAL(&s_lock);
+        int i = queue_best();
+        if (i >= 0) {
+            s_running = s_queue[i];
+            queue_remove(i);
+            s_running.state = CAPTURE_STATE_RUNNING;
+            s_running.started_us = esp_timer_get_time();
+            s_busy = true;
+
+            uint32_t wait_ms = (uint32_t)((s_running.started_us - s_running.queued_us) / 1000);
+            s_started++;
+            s_total_wait_ms += wait_ms;
+            s_stats.avg_wait_ms = (uint32_t)(s_total_wait_ms / s_started);
+            if (wait_ms > s_stats.max_wait_ms) s_stats.max_wait_ms = wait_ms;
+        }
+        portEXIT_CRITICAL(&s_lock);
+
+        if (i < 0) {
+            // Time-lapse detenido: bajar el lote a la SD antes de dormir
+            if (s_tl_flush_req) {
+                s_tl_flush_req = false;
+                tl_flush();
+                tl_release_batch();
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        // s_running solo lo escribe esta tarea; los lectores copian bajo s_lock
+        capture_job_t job = s_running;
+        esp_err_t err = ESP_ERR_INVALID_STATE;
+        if (sd_card_is_mounted()) {
+            switch (job.req.type) {
+                case CAPTURE_JOB_PHOTO: err = capture_encrypted_photo(&job); break;
+                case CAPTURE_JOB_VIDEO: err = capture_encrypted_video(&job); break;
+                case CAPTURE_JOB_BURST: err = capture_encrypted_burst(&job); break;
+                case CAPTURE_JOB_TIMELAPSE: err = capture_timelapse_shot(&job); break;
+            }
+        }
+        job.finished_us = esp_timer_get_time();
+        job.state = err == ESP_OK ? CAPTURE_STATE_DONE : CAPTURE_STATE_FAILED;
+        if (s_burst_ready) job.state = CAPTURE_STATE_WRITING;
+
+        uint32_t run_ms = (uint32_t)((job.finished_us - job.started_us) / 1000);
+        bool quiet = job.req.type == CAPTURE_JOB_TIMELAPSE;
+        if (quiet && err != ESP_OK) {
+            portENTER_CRITICAL(&s_lock);
+            s_tl.skipped++;
+            portEXIT_CRITICAL(&s_lock);
+        }
+        if (!quiet || err != ESP_OK) ESP_LOGI(TAG, "Trabajo #%lu (%s) %s en %lu ms", (unsigned long)job.id,
+                 capture_job_type_name(job.req.type), capture_state_name(job.state), (unsigned long)run_ms);
+
+        portENTER_CRITICAL(&s_lock);
+        // Las tomas de time-lapse no ocupan el historial: taparían los
+        // trabajos que se consultan por ID
+        if (!quiet) history_push(&job);
+        s_busy = false;
+        if (job.state == CAPTURE_STATE_DONE) s_stats.done++;
+        else if (job.state == CAPTURE_STATE_FAILED) s_stats.failed++;
+        s_finished++;
+        s_total_run_ms += run_ms;
+        s_stats.avg_run_ms = (uint32_t)(s_total_run_ms / s_finished);
+        portEXIT_CRITICAL(&s_lock);
+
+        // Recién ahora, con el trabajo en el historial: si hay dos ráfagas
+        // esperando escritura, la cola espera acá (la PSRAM es el límite)
+        if (s_burst_ready) {
+            xQueueSend(s_burst_queue, &s_burst_ready, portMAX_DELAY);
+            s_burst_ready = NULL;
+        }
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t capture_svc_start(void) {
+    if (s_task) return ESP_OK;
+
+    load_photo_counter();
+    load_record_fps();
+    load_timelapse_config();
+
+    esp_timer_create_args_t timer_args = {
+        .callback = tl_timer_cb,
+        .name = "timelapse",
+    };
+    if (esp_timer_create(&timer_args, &s_tl_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "No se pudo crear el timer de time-lapse");
+        return ESP_FAIL;
+    }
+
+    if (recorder_init() != ESP_OK) return ESP_FAIL;
+    if (dvr_init() != ESP_OK) return ESP_FAIL;
+
+    s_burst_queue = xQueueCreate(CAPTURE_BURST_PENDING, sizeof(burst_t *));
+    if (!s_burst_queue ||
+        xTaskCreatePinnedToCore(writer_task, "capture_wr", WRITER_TASK_STACK, NULL,
+                                WRITER_TASK_PRIO, NULL, CAPTURE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de escritura");
+        return ESP_FAIL;
+    }
+
+    if (xTaskCreatePinnedToCore(capture_task, "capture", CAPTURE_TASK_STACK, NULL,
+                                CAPTURE_TASK_PRIO, &s_task, CAPTURE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de captura");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t capture_svc_submit(const capture_request_t *req, uint32_t *job_id, bool *merged) {
+    if (merged) *merged = false;
+    if (!req || req->type > CAPTURE_JOB_TIMELAPSE || req->prio > CAPTURE_PRIO_HIGH) return ESP_ERR_INVALID_ARG;
+    if (req->type == CAPTURE_JOB_VIDEO &&
+        (req->duration_s < CAPTURE_VIDEO_MIN_S || req->duration_s > CAPTURE_VIDEO_MAX_S)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (req->type == CAPTURE_JOB_BURST && (req->count < CAPTURE_BURST_MIN || req->count > CAPTURE_BURST_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_task || !sd_card_is_mounted()) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.rejected++;
+        portEXIT_CRITICAL(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    capture_job_t dropped;
+    bool did_drop = false;
+    esp_err_t err = ESP_OK;
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.submitted++;
+
+    // Deduplicar: un pedido del mismo tipo que todavía espera absorbe este
+    int same = -1;
+    for (int i = 0; i < s_depth; i++) {
+        if (s_queue[i].req.type == req->type) {
+            same = i;
+            break;
+        }
+    }
+    if (same >= 0) {
+        capture_job_t *job = &s_queue[same];
+        if (req->prio > job->req.prio) job->req.prio = req->prio;
+        if (req->duration_s > job->req.duration_s) job->req.duration_s = req->duration_s;
+        if (req->count > job->req.count) job->req.count = req->count;
+        job->merged++;
+        s_stats.merged++;
+        if (job_id) *job_id = job->id;
+        if (merged) *merged = true;
+    } else {
+        if (s_depth == CAPTURE_QUEUE_LEN) {
+            // Llena: solo entra desplazando a uno de menor prioridad
+            int worst = queue_worst();
+            if (s_queue[worst].req.prio < req->prio) {
+                dropped = s_queue[worst];
+                dropped.state = CAPTURE_STATE_DROPPED;
+                dropped.finished_us = esp_timer_get_time();
+                history_push(&dropped);
+                queue_remove(worst);
+                s_stats.dropped++;
+                did_drop = true;
+            } else {
+                s_stats.rejected++;
+                err = ESP_ERR_NO_MEM;
+            }
+        }
+        if (err == ESP_OK) {
+            capture_job_t *job = &s_queue[s_depth++];
+            memset(job, 0, sizeof(*job));
+            job->id = s_next_id++;
+            job->req = *req;
+            job->state = CAPTURE_STATE_QUEUED;
+            job->queued_us = esp_timer_get_time();
+            if (s_depth > s_stats.max_depth) s_stats.max_depth = s_depth;
+            if (job_id) *job_id = job->id;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (did_drop) {
+        ESP_LOGW(TAG, "Cola llena: trabajo #%lu (%s) descartado", (unsigned long)dropped.id,
+                 capture_job_type_name(dropped.req.type));
+    }
+    if (err == ESP_OK) xTaskNotifyGive(s_task);
+    return err;
+}
+
+bool capture_svc_get_job(uint32_t id, capture_job_t *job) {
+    bool found = false;
+    portENTER_CRITICAL(&s_lock);
+    if (s_busy && s_running.id == id) {
+        *job = s_running;
+        found = true;
+    }
+    for (int i = 0; !found && i < s_depth; i++) {
+        if (s_queue[i].id == id) {
+            *job = s_queue[i];
+            found = true;
+        }
+    }
+    if (!found) {
+        capture_job_t *h = history_find(id);
+        if (h) {
+            *job = *h;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return found;
+}
+
+int capture_svc_get_jobs(capture_job_t *out, int max) {
+    int n = 0;
+    portENTER_CRITICAL(&s_lock);
+    // En cola, del más nuevo al más viejo (el id crece con el encolado)
+    uint32_t below = UINT32_MAX;
+    while (n < max) {
+        int pick = -1;
+        for (int i = 0; i < s_depth; i++) {
+            if (s_queue[i].id < below && (pick < 0 || s_queue[i].id > s_queue[pick].id)) pick = i;
+        }
+        if (pick < 0) break;
+        out[n++] = s_queue[pick];
+        below = s_queue[pick].id;
+    }
+    if (s_busy && n < max) out[n++] = s_running;
+    for (int i = 0; i < s_history_count && n < max; i++) {
+        int idx = (s_history_head - 1 - i + CAPTURE_HISTORY_LEN) % CAPTURE_HISTORY_LEN;
+        out[n++] = s_history[idx];
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+void capture_svc_get_stats(capture_svc_stats_t *stats) {
+    if (!stats) return;
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    stats->depth = s_depth;
+    stats->busy = s_busy;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// name == base + suffix (base vacío = nada abierto)
+static bool same_file(const char *name, const char *base, const char *suffix) {
+    size_t n = strlen(base);
+    return n > 0 && strncmp(name, base, n) == 0 && strcmp(name + n, suffix) == 0;
+}
+
+bool capture_svc_file_in_use(const char *name) {
+    char video[CAPTURE_FILE_LEN];
+    char tl[CAPTURE_FILE_LEN];
+    portENTER_CRITICAL(&s_lock);
+    memcpy(video, s_open_video, sizeof(video));
+    memcpy(tl, s_tl.file, sizeof(tl));
+    portEXIT_CRITICAL(&s_lock);
+
+    capture_dvr_status_t dvr;
+    capture_svc_get_dvr_status(&dvr);
+    return same_file(name, video, ".enc") || same_file(name, dvr.file, ".enc") ||
+           same_file(name, tl, ".tlx");
+}
+
+uint32_t capture_svc_get_record_fps(void) {
+    return s_record_fps;
+}
+
+esp_err_t capture_svc_set_record_fps(uint32_t fps) {
+    if (fps < CAPTURE_REC_MIN_FPS || fps > CAPTURE_REC_MAX_FPS) return ESP_ERR_INVALID_ARG;
+    s_record_fps = fps;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_REC, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_REC_FPS, fps);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err;
+}
+
+void capture_svc_get_timelapse_config(capture_timelapse_config_t *cfg) {
+    if (!cfg) return;
+    portENTER_CRITICAL(&s_lock);
+    *cfg = s_tl.cfg;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t capture_svc_configure_timelapse(const capture_timelapse_config_t *cfg) {
+    if (!cfg || cfg->interval_s < CAPTURE_TL_MIN_INTERVAL_S || cfg->interval_s > CAPTURE_TL_MAX_INTERVAL_S ||
+        cfg->roll_frames < CAPTURE_TL_MIN_ROLL || cfg->roll_frames > CAPTURE_TL_MAX_ROLL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_tl.cfg = *cfg;
+    bool active = s_tl.active;
+    portEXIT_CRITICAL(&s_lock);
+
+    // Reprogramar con el intervalo nuevo
+    if (active && s_tl_timer) {
+        esp_timer_stop(s_tl_timer);
+        esp_timer_start_periodic(s_tl_timer, (uint64_t)cfg->interval_s * 1000000);
+    }
+    ESP_LOGI(TAG, "Time-lapse: una toma cada %lus, %lu tomas por contenedor",
+             (unsigned long)cfg->interval_s, (unsigned long)cfg->roll_frames);
+    return save_timelapse_config(cfg);
+}
+
+void capture_svc_set_timelapse_active(bool active) {
+    if (!s_tl_timer || !s_task) return;
+
+    portENTER_CRITICAL(&s_lock);
+    bool was = s_tl.active;
+    s_tl.active = active;
+    uint32_t interval_s = s_tl.cfg.interval_s;
+    portEXIT_CRITICAL(&s_lock);
+    if (was == active) return;
+
+    if (active) {
+        // Periódico: los disparos no acumulan deriva aunque una toma tarde
+        esp_timer_start_periodic(s_tl_timer, (uint64_t)interval_s * 1000000);
+        ESP_LOGI(TAG, "Time-lapse activo (cada %lus)", (unsigned long)interval_s);
+    } else {
+        esp_timer_stop(s_tl_timer);
+        s_tl_flush_req = true;
+        xTaskNotifyGive(s_task);
+        ESP_LOGI(TAG, "Time-lapse detenido");
+    }
+}
+
+void capture_svc_get_timelapse_status(capture_timelapse_status_t *status) {
+    if (!status) return;
+    portENTER_CRITICAL(&s_lock);
+    *status = s_tl;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,439 @@
+#include "capture_svc.h"
+#include "dvr.h"
+#include "recorder.h"
+#include "pacer.h"
+#include "frame_bus.h"
+#include "sd_hal.h"
+#include "catalog.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "DVR";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define NVS_NAMESPACE_DVR   "dvr"
+#define NVS_KEY_DVR_SEGMENT "segment"
+#define NVS_KEY_DVR_RESERVE "reserve"
+
+#define DVR_MOUNT_POINT     "/sdcard"
+#define DVR_PREFIX          "DVR_"
+#define DVR_DONE_SUFFIX     ".avi.enc"
+#define DVR_PART_SUFFIX     ".part.enc"
+
+#define DVR_TASK_STACK      4096
+#define DVR_TASK_PRIO       (tskIDLE_PRIORITY + 2)  // Como la tarea de captura
+#define DVR_TASK_CORE       0
+#define DVR_FRAME_WAIT_MS   500
+#define DVR_RETRY_MS        1000
+#define DVR_PAUSE_POLL_MS   50
+#define DVR_PAUSE_TIMEOUT_MS 10000
+
+#define DVR_ROOM_TASK_STACK 3072
+#define DVR_ROOM_TASK_PRIO  (tskIDLE_PRIORITY + 1)  // Debajo de captura y grabador: borrar no frena frames
+
+// Segmento abierto; lo libera el callback de cierre
+typedef struct {
+    char name[CAPTURE_FILE_LEN];    // DVR_<n>, sin sufijo
+    int64_t span_us;
+    uint32_t paced_drops;
+    uint32_t max_jitter_us;
+} dvr_segment_t;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static capture_dvr_status_t s_dvr;                  // Bajo s_lock
+static TaskHandle_t s_task = NULL;
+static TaskHandle_t s_room_task = NULL;
+static volatile bool s_active = false;
+static volatile bool s_stopped = true;              // La tarea DVR no tiene segmento ni suscripción
+static volatile bool s_room_busy = false;           // make_room() en curso
+static int s_closing = 0;                           // Cierres asíncronos pendientes, bajo s_lock
+static uint32_t s_next_seq = 1;                     // Solo la tarea DVR
+static uint64_t s_total_span_us = 0;                // Bajo s_lock
+static uint64_t s_total_close_ms = 0;
+static uint32_t s_closed = 0;
+
+// ============================================================================
+// NVS
+// ============================================================================
+static void load_dvr_config(void) {
+    s_dvr.cfg.segment_s = CAPTURE_DVR_DEFAULT_SEGMENT_S;
+    s_dvr.cfg.reserve_mb = CAPTURE_DVR_DEFAULT_RESERVE_MB;
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_DVR, NVS_READONLY, &nvs_handle) != ESP_OK) return;
+    int32_t val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_DVR_SEGMENT, &val) == ESP_OK &&
+        val >= CAPTURE_DVR_MIN_SEGMENT_S && val <= CAPTURE_DVR_MAX_SEGMENT_S) {
+        s_dvr.cfg.segment_s = val;
+    }
+    if (nvs_get_i32(nvs_handle, NVS_KEY_DVR_RESERVE, &val) == ESP_OK &&
+        val >= CAPTURE_DVR_MIN_RESERVE_MB && val <= CAPTURE_DVR_MAX_RESERVE_MB) {
+        s_dvr.cfg.reserve_mb = val;
+    }
+    nvs_close(nvs_handle);
+}
+
+static esp_err_t save_dvr_config(const capture_dvr_config_t *cfg) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_DVR, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_DVR_SEGMENT, cfg->segment_s);
+    nvs_set_i32(nvs_handle, NVS_KEY_DVR_RESERVE, cfg->reserve_mb);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err;
+}
+
+// ============================================================================
+// ESPACIO EN LA SD
+// ============================================================================
+// Número de un segmento DVR_<n><suffix>; 0 si el nombre no corresponde
+static uint32_t segment_seq(const char *name, const char *suffix) {
+    if (strncmp(name, DVR_PREFIX, sizeof(DVR_PREFIX) - 1) != 0) return 0;
+    char *end;
+    unsigned long seq = strtoul(name + sizeof(DVR_PREFIX) - 1, &end, 10);
+    return strcmp(end, suffix) == 0 ? (uint32_t)seq : 0;
+}
+
+// Al arrancar: seguir la numeración y borrar segmentos que quedaron a medias
+// (corte de luz: sin índice ni cabecera)
+static void scan_segments(void) {
+    DIR *dir = opendir(DVR_MOUNT_POINT);
+    if (!dir) return;
+
+    struct dirent *entry;
+    char filepath[300];
+    while ((entry = readdir(dir)) != NULL) {
+        uint32_t seq = segment_seq(entry->d_name, DVR_DONE_SUFFIX);
+        if (seq >= s_next_seq) s_next_seq = seq + 1;
+
+        seq = segment_seq(entry->d_name, DVR_PART_SUFFIX);
+        if (seq) {
+            if (seq >= s_next_seq) s_next_seq = seq + 1;
+            snprintf(filepath, sizeof(filepath), DVR_MOUNT_POINT "/%s", entry->d_name);
+            remove(filepath);
+            ESP_LOGW(TAG, "Segmento incompleto borrado: %s", entry->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+// El más viejo sale del catálogo, sin recorrer el directorio
+static bool delete_oldest_segment(void) {
+    char name[CATALOG_NAME_LEN];
+    if (!catalog_oldest(CATALOG_TYPE_DVR, name, sizeof(name))) return false;
+
+    char filepath[64];
+    snprintf(filepath, sizeof(filepath), DVR_MOUNT_POINT "/%s", name);
+    bool removed = remove(filepath) == 0;
+    // Aunque no se haya podido borrar (ya no estaba), la entrada sale del
+    // catálogo: la próxima vuelta prueba con el siguiente
+    catalog_remove(name);
+    if (!removed) {
+        ESP_LOGW(TAG, "No se pudo borrar %s", filepath);
+        return true;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_dvr.deleted++;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "Sin espacio: borrado %s", filepath);
+    return true;
+}
+
+// Borra segmentos viejos hasta dejar libre la reserva configurada
+static void make_room(void) {
+    portENTER_CRITICAL(&s_lock);
+    uint64_t reserve = (uint64_t)s_dvr.cfg.reserve_mb * 1024 * 1024;
+    portEXIT_CRITICAL(&s_lock);
+
+    uint64_t total, free_bytes;
+    while (esp_vfs_fat_info(DVR_MOUNT_POINT, &total, &free_bytes) == ESP_OK) {
+        portENTER_CRITICAL(&s_lock);
+        s_dvr.free_mb = (uint32_t)(free_bytes / (1024 * 1024));
+        portEXIT_CRITICAL(&s_lock);
+
+        if (free_bytes >= reserve) return;
+        if (!delete_oldest_segment()) {
+            ESP_LOGW(TAG, "Libre %llu MB bajo la reserva y sin segmentos para borrar",
+                     (unsigned long long)(free_bytes / (1024 * 1024)));
+            return;
+        }
+    }
+}
+
+// Tarea de baja prioridad: la despiertan el cierre de cada segmento y el
+// arranque. Borrar un archivo grande en FAT recorre su cadena de clusters y
+// no debe demorar ni al grabador ni a la tarea DVR.
+static void room_task(void *arg) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        s_room_busy = true;                 // Antes de mirar s_active (ver capture_svc_pause_dvr)
+        if (s_active && sd_card_is_mounted()) make_room();
+        s_room_busy = false;
+    }
+}
+
+// ============================================================================
+// SEGMENTOS
+// ============================================================================
+// Desde la tarea del grabador, con el archivo ya cerrado
+static void segment_closed(esp_err_t err, const capture_rec_stats_t *rs, void *ctx) {
+    dvr_segment_t *seg = ctx;
+    char part[64];
+    char done[64];
+    snprintf(part, sizeof(part), DVR_MOUNT_POINT "/%s" DVR_PART_SUFFIX, seg->name);
+    snprintf(done, sizeof(done), DVR_MOUNT_POINT "/%s" DVR_DONE_SUFFIX, seg->name);
+
+    // Aun con error de escritura, lo que llegó a la SD tiene índice y cabecera
+    bool ok = rs->frames > 0 && rename(part, done) == 0;
+    if (ok) catalog_add(done + sizeof(DVR_MOUNT_POINT));
+    else remove(part);
+
+    portENTER_CRITICAL(&s_lock);
+    if (ok) {
+        s_dvr.segments++;
+        s_dvr.frames += rs->frames;
+        s_dvr.bytes += rs->bytes;
+        s_total_span_us += seg->span_us;
+        if (s_total_span_us > 0) {
+            s_dvr.write_fps_x100 = (uint32_t)(s_dvr.frames * 100 * 1000000 / s_total_span_us);
+            s_dvr.write_kbps = (uint32_t)(s_dvr.bytes * 1000 / s_total_span_us);
+        }
+    }
+    if (!ok || err != ESP_OK) s_dvr.failed++;
+    s_closing--;
+    s_dvr.dropped += rs->dropped_large + rs->dropped_busy;
+    s_dvr.stall_ms += rs->stall_ms;
+    s_dvr.paced_drops += seg->paced_drops;
+    if (seg->max_jitter_us > s_dvr.max_jitter_us) s_dvr.max_jitter_us = seg->max_jitter_us;
+    if (rs->max_slot_wait_ms > s_dvr.max_stall_ms) s_dvr.max_stall_ms = rs->max_slot_wait_ms;
+    s_closed++;
+    s_total_close_ms += rs->close_ms;
+    s_dvr.avg_close_ms = (uint32_t)(s_total_close_ms / s_closed);
+    if (rs->close_ms > s_dvr.max_close_ms) s_dvr.max_close_ms = rs->close_ms;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (ok) {
+        ESP_LOGI(TAG, "Segmento %s: %lu frames, %llu KB, cierre %lu ms, espera SD %lu ms",
+                 seg->name, (unsigned long)rs->frames, (unsigned long long)(rs->bytes / 1024),
+                 (unsigned long)rs->close_ms, (unsigned long)rs->stall_ms);
+    } else {
+        ESP_LOGE(TAG, "Segmento %s descartado", seg->name);
+    }
+    free(seg);
+
+    if (ok) xTaskNotifyGive(s_room_task);
+}
+
+static recorder_t *open_segment(dvr_segment_t **out) {
+    dvr_segment_t *seg = calloc(1, sizeof(dvr_segment_t));
+    if (!seg) return NULL;
+    snprintf(seg->name, sizeof(seg->name), DVR_PREFIX "%08lu", (unsigned long)s_next_seq++);
+
+    char filename[CAPTURE_FILE_LEN];
+    snprintf(filename, sizeof(filename), "%s.part", seg->name);
+    recorder_t *rec = recorder_open(filename);
+    if (!rec) {
+        ESP_LOGE(TAG, "No se pudo abrir %s.enc", filename);
+        free(seg);
+        return NULL;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    memcpy(s_dvr.file, filename, sizeof(s_dvr.file));
+    portEXIT_CRITICAL(&s_lock);
+    *out = seg;
+    return rec;
+}
+
+static void close_segment(recorder_t *rec, dvr_segment_t *seg, int64_t span_us, const pacer_t *pacer) {
+    char comment[96];
+    pacer_describe(pacer, comment, sizeof(comment));
+    recorder_set_comment(rec, comment);
+
+    seg->span_us = span_us;
+    seg->paced_drops = pacer->drops;
+    seg->max_jitter_us = pacer->max_jitter_us;
+    portENTER_CRITICAL(&s_lock);
+    s_closing++;
+    portEXIT_CRITICAL(&s_lock);
+    recorder_close_async(rec, segment_closed, seg);
+}
+
+// ============================================================================
+// TAREA
+// ============================================================================
+static void dvr_task(void *arg) {
+    frame_bus_sub_t *sub = NULL;
+    recorder_t *rec = NULL;
+    dvr_segment_t *seg = NULL;
+    int64_t seg_start = 0;
+    pacer_t pacer;
+
+    while (true) {
+        if (!s_active || !sd_card_is_mounted()) {
+            if (rec) {
+                close_segment(rec, seg, esp_timer_get_time() - seg_start, &pacer);
+                rec = NULL;
+            }
+            if (sub) {
+                frame_bus_unsubscribe(sub);
+                sub = NULL;
+                portENTER_CRITICAL(&s_lock);
+                s_dvr.file[0] = '\0';
+                portEXIT_CRITICAL(&s_lock);
+                ESP_LOGI(TAG, "Grabación continua detenida");
+            }
+            s_stopped = true;
+            if (s_active) vTaskDelay(pdMS_TO_TICKS(DVR_RETRY_MS));    // Esperando la SD
+            else ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        s_stopped = false;
+
+        if (!sub) {
+            sub = frame_bus_subscribe("dvr");
+            if (!sub) {
+                vTaskDelay(pdMS_TO_TICKS(DVR_RETRY_MS));
+                continue;
+            }
+            xTaskNotifyGive(s_room_task);
+            ESP_LOGI(TAG, "Grabación continua: segmentos de %lu s", (unsigned long)s_dvr.cfg.segment_s);
+        }
+        if (!rec) {
+            rec = open_segment(&seg);
+            seg_start = esp_timer_get_time();
+            pacer_start(&pacer, capture_svc_get_record_fps(), seg_start);
+            if (!rec) {
+                vTaskDelay(pdMS_TO_TICKS(DVR_RETRY_MS));
+                continue;
+            }
+        }
+
+        pacer_sleep(&pacer);
+        // Primero el slot: si la SD va atrás se espera sin retener un frame
+        esp_err_t err = recorder_reserve(rec, DVR_FRAME_WAIT_MS);
+        const frame_t *fb = err == ESP_OK ? frame_bus_acquire(sub, pdMS_TO_TICKS(DVR_FRAME_WAIT_MS)) : NULL;
+        if (fb) {
+            if (!pacer_offer(&pacer, fb->timestamp_us)) {
+                frame_bus_done(sub, fb);
+                continue;
+            }
+            err = recorder_add_frame(rec, fb);
+            frame_bus_done(sub, fb);
+        }
+        if (err == ESP_FAIL) {
+            // Se cierra lo escrito y la próxima vuelta abre otro segmento
+            ESP_LOGE(TAG, "Error escribiendo %s", seg->name);
+            close_segment(rec, seg, esp_timer_get_time() - seg_start, &pacer);
+            rec = NULL;
+            continue;
+        }
+
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&s_lock);
+        int64_t segment_us = (int64_t)s_dvr.cfg.segment_s * 1000000;
+        portEXIT_CRITICAL(&s_lock);
+        if (now - seg_start >= segment_us) {
+            // El siguiente queda abierto antes de cerrar el actual: el próximo
+            // frame ya va al segmento nuevo y no hay hueco en el borde
+            dvr_segment_t *next_seg = NULL;
+            recorder_t *next = open_segment(&next_seg);
+            close_segment(rec, seg, now - seg_start, &pacer);
+            rec = next;
+            seg = next_seg;
+            seg_start = now;
+
+            // Mismo reloj de deadlines: el segmento nuevo sigue el ritmo sin
+            // salto, con sus propias estadísticas (y el FPS nuevo si cambió)
+            int64_t next_deadline = pacer.anchor_us + (int64_t)pacer.next_slot * pacer.period_us;
+            pacer_start(&pacer, capture_svc_get_record_fps(), next_deadline);
+        }
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t dvr_init(void) {
+    if (s_task) return ESP_OK;
+
+    load_dvr_config();
+    if (sd_card_is_mounted()) scan_segments();
+
+    if (xTaskCreatePinnedToCore(room_task, "dvr_room", DVR_ROOM_TASK_STACK, NULL,
+                                DVR_ROOM_TASK_PRIO, &s_room_task, DVR_TASK_CORE) != pdPASS ||
+        xTaskCreatePinnedToCore(dvr_task, "dvr", DVR_TASK_STACK, NULL,
+                                DVR_TASK_PRIO, &s_task, DVR_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de grabación continua");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void capture_svc_get_dvr_config(capture_dvr_config_t *cfg) {
+    portENTER_CRITICAL(&s_lock);
+    *cfg = s_dvr.cfg;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t capture_svc_configure_dvr(const capture_dvr_config_t *cfg) {
+    if (!cfg ||
+        cfg->segment_s < CAPTURE_DVR_MIN_SEGMENT_S || cfg->segment_s > CAPTURE_DVR_MAX_SEGMENT_S ||
+        cfg->reserve_mb < CAPTURE_DVR_MIN_RESERVE_MB || cfg->reserve_mb > CAPTURE_DVR_MAX_RESERVE_MB) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_dvr.cfg = *cfg;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "Segmentos de %lu s, reserva %lu MB",
+             (unsigned long)cfg->segment_s, (unsigned long)cfg->reserve_mb);
+    return save_dvr_config(cfg);
+}
+
+void capture_svc_set_dvr_active(bool active) {
+    if (!s_task) return;
+
+    portENTER_CRITICAL(&s_lock);
+    s_dvr.active = active;
+    portEXIT_CRITICAL(&s_lock);
+    s_active = active;
+    xTaskNotifyGive(s_task);
+}
+
+bool capture_svc_pause_dvr(void) {
+    if (!s_task) return false;
+
+    bool was_active = s_active;
+    capture_svc_set_dvr_active(false);
+
+    // Segmento cerrado y renombrado, y sin borrados a medias
+    int64_t deadline = esp_timer_get_time() + (int64_t)DVR_PAUSE_TIMEOUT_MS * 1000;
+    while (esp_timer_get_time() < deadline) {
+        portENTER_CRITICAL(&s_lock);
+        bool idle = s_stopped && s_closing == 0 && !s_room_busy;
+        portEXIT_CRITICAL(&s_lock);
+        if (idle) return was_active;
+        vTaskDelay(pdMS_TO_TICKS(DVR_PAUSE_POLL_MS));
+    }
+    ESP_LOGW(TAG, "El segmento no terminó de cerrarse en %d ms", DVR_PAUSE_TIMEOUT_MS);
+    return was_active;
+}
+
+void capture_svc_get_dvr_status(capture_dvr_status_t *status) {
+    portENTER_CRITICAL(&s_lock);
+    *status = s_dvr;
+    portEXIT_CRITICAL(&s_lock);
+}
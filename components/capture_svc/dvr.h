@@ -0,0 +1,6 @@
+#pragma once
+#include "esp_err.h"
+
+// Carga la configuración y crea la tarea de grabación continua (queda
+// dormida hasta capture_svc_set_dvr_active)
+esp_err_t dvr_init(void);
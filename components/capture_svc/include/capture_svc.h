@@ -0,0 +1,249 @@
+#pragma once
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// SERVICIO DE CAPTURA: COLA DE TRABAJOS CON PRIORIDAD
+// ============================================================================
+// Una tarea propia (core 0) toma fotos, videos y ráfagas de una cola. Encolar
+// no bloquea: el detector de movimiento y la API HTTP reciben un ID al
+// instante y consultan el estado después. Un pedido igual a uno que todavía
+// espera se fusiona con él (mismo ID) en vez de duplicar la captura.
+//
+// Time-lapse: un esp_timer periódico encola una toma de prioridad baja; cada
+// toma se cifra por separado y se agrega a un contenedor .tlx que rota cada N
+// tomas. Las tomas se juntan en PSRAM y se escriben de a lotes, así la SD y
+// la FAT no cargan con miles de archivos chicos.
+//
+// Ráfaga: N frames seguidos del bus, copiados a PSRAM al ritmo del sensor;
+// otra tarea de menor prioridad los cifra y escribe después (BST_<n>_<i>.enc).
+//
+// Grabación continua (DVR): segmentos AVI de largo fijo uno detrás de otro.
+// El siguiente ya está grabando cuando la tarea de escritura cierra el
+// anterior; recién cerrado se renombra de .part a .avi. Si el espacio libre
+// baja de la reserva se borran los segmentos DVR más viejos (solo esos).
+//
+// Contenedor .tlx: "TLX1" y después registros
+//   [capture_tl_record_t][IV 16][AES-256-CBC del JPEG con PKCS7]
+
+#define CAPTURE_QUEUE_LEN        8
+#define CAPTURE_HISTORY_LEN      16     // Trabajos terminados que se recuerdan
+#define CAPTURE_VIDEO_MIN_S      5
+#define CAPTURE_VIDEO_MAX_S      60
+#define CAPTURE_BURST_MIN        2
+#define CAPTURE_BURST_MAX        10
+#define CAPTURE_BURST_PENDING    2      // Ráfagas en PSRAM esperando escritura
+#define CAPTURE_FILE_LEN         24
+
+#define CAPTURE_REC_DEFAULT_FPS         10      // Videos y grabación continua
+#define CAPTURE_REC_MIN_FPS             1
+#define CAPTURE_REC_MAX_FPS             25
+
+#define CAPTURE_TL_DEFAULT_INTERVAL_S   60
+#define CAPTURE_TL_MIN_INTERVAL_S       2
+#define CAPTURE_TL_MAX_INTERVAL_S       86400
+#define CAPTURE_TL_DEFAULT_ROLL         1440    // Un día a una toma por minuto
+#define CAPTURE_TL_MIN_ROLL             10
+#define CAPTURE_TL_MAX_ROLL             100000
+#define CAPTURE_TL_BATCH_FRAMES         8       // Tomas por escritura a la SD
+#define CAPTURE_TL_BATCH_BYTES          (512 * 1024)
+
+#define CAPTURE_DVR_DEFAULT_SEGMENT_S   60
+#define CAPTURE_DVR_MIN_SEGMENT_S       10
+#define CAPTURE_DVR_MAX_SEGMENT_S       600
+#define CAPTURE_DVR_DEFAULT_RESERVE_MB  256     // Libre que se mantiene en la SD
+#define CAPTURE_DVR_MIN_RESERVE_MB      32
+#define CAPTURE_DVR_MAX_RESERVE_MB      8192
+
+typedef enum {
+    CAPTURE_JOB_PHOTO = 0,
+    CAPTURE_JOB_VIDEO = 1,
+    CAPTURE_JOB_BURST = 2,
+    CAPTURE_JOB_TIMELAPSE = 3,      // Una toma al contenedor en curso
+} capture_job_type_t;
+
+typedef enum {
+    CAPTURE_PRIO_LOW    = 0,
+    CAPTURE_PRIO_NORMAL = 1,
+    CAPTURE_PRIO_HIGH   = 2,        // Movimiento
+} capture_prio_t;
+
+typedef enum {
+    CAPTURE_STATE_QUEUED = 0,
+    CAPTURE_STATE_RUNNING,
+    CAPTURE_STATE_DONE,
+    CAPTURE_STATE_FAILED,
+    CAPTURE_STATE_DROPPED,          // Desplazado de la cola por uno más prioritario
+    CAPTURE_STATE_WRITING,          // Ráfaga capturada, cifrando/escribiendo
+} capture_state_t;
+
+typedef struct {
+    capture_job_type_t type;
+    capture_prio_t prio;
+    uint16_t duration_s;            // Video
+    uint8_t count;                  // Ráfaga
+} capture_request_t;
+
+typedef struct {
+    uint32_t id;
+    capture_request_t req;
+    capture_state_t state;
+    uint16_t merged;                // Pedidos fusionados en este trabajo
+    int64_t queued_us;
+    int64_t started_us;
+    int64_t finished_us;
+    char file[CAPTURE_FILE_LEN];    // Primer archivo escrito (sin .enc)
+    uint16_t files;
+    uint16_t frames;                // Ráfaga: frames capturados
+    uint32_t spacing_avg_us;        // Ráfaga: separación entre frames
+    uint32_t spacing_min_us;
+    uint32_t spacing_max_us;
+} capture_job_t;
+
+// Cabecera de cada toma dentro del contenedor (little-endian)
+typedef struct __attribute__((packed)) {
+    char magic[4];                  // "TLR1"
+    uint32_t orig_len;              // JPEG sin cifrar
+    uint32_t enc_len;               // IV + datos cifrados que siguen
+    uint32_t seq;                   // Frame del bus
+    int64_t unix_us;                // Hora de pared al capturar
+} capture_tl_record_t;
+
+typedef struct {
+    uint32_t interval_s;
+    uint32_t roll_frames;           // Tomas por contenedor
+} capture_timelapse_config_t;
+
+typedef struct {
+    capture_timelapse_config_t cfg;
+    bool active;
+    char file[CAPTURE_FILE_LEN];    // Contenedor en curso (sin .tlx)
+    uint32_t file_frames;           // Tomas en el contenedor (incluye el lote pendiente)
+    uint32_t pending_frames;        // En PSRAM, esperando el próximo lote
+    uint32_t pending_bytes;
+    uint32_t shots;                 // Disparos del timer
+    uint32_t written;               // Tomas que llegaron a la SD
+    uint32_t skipped;               // Disparos fusionados o fallidos
+    uint32_t flushes;
+    uint32_t avg_flush_ms;
+    uint32_t avg_late_ms;           // Disparo → frame capturado
+    uint32_t max_late_ms;
+} capture_timelapse_status_t;
+
+// Última grabación de video (grabador por streaming)
+typedef struct {
+    uint32_t frames;
+    uint32_t dropped_large;         // No entraban en un slot
+    uint32_t dropped_busy;          // Sin slot libre a tiempo (SD lenta)
+    uint64_t bytes;
+    uint32_t max_slot_wait_ms;      // Lo más que esperó la captura por un slot
+    uint32_t stall_ms;              // Total esperado por slots
+    uint32_t avg_write_ms;          // Cifrar + escribir un frame
+    uint32_t max_write_ms;
+    uint32_t peak_kb;               // Memoria del grabador (constante)
+    uint32_t close_ms;              // Índice + cabecera + fsync al cerrar
+    uint32_t target_fps;            // Ritmo pedido (ver pacer.h)
+    uint32_t fps_x100;              // Ritmo logrado en la parte en vivo
+    uint32_t jitter_avg_us;         // Desvío de los frames respecto del deadline
+    uint32_t jitter_max_us;
+    uint32_t paced_drops;           // Deadlines salteados por ir atrasado
+} capture_rec_stats_t;
+
+typedef struct {
+    uint32_t segment_s;
+    uint32_t reserve_mb;
+} capture_dvr_config_t;
+
+typedef struct {
+    capture_dvr_config_t cfg;
+    bool active;
+    char file[CAPTURE_FILE_LEN];    // Segmento en curso (sin .enc)
+    uint32_t segments;              // Cerrados y renombrados
+    uint32_t failed;
+    uint32_t deleted;               // Pisados por falta de espacio
+    uint64_t frames;                // Escritos en segmentos cerrados
+    uint64_t bytes;
+    uint32_t dropped;               // Sin slot o demasiado grandes
+    uint32_t write_fps_x100;        // Frames escritos por segundo grabado
+    uint32_t write_kbps;
+    uint32_t stall_ms;              // Captura esperando a la SD
+    uint32_t max_stall_ms;
+    uint32_t paced_drops;           // Deadlines salteados por ir atrasado
+    uint32_t max_jitter_us;
+    uint32_t avg_close_ms;
+    uint32_t max_close_ms;
+    uint32_t free_mb;               // Última medición
+} capture_dvr_status_t;
+
+typedef struct {
+    int depth;                      // Trabajos esperando
+    int max_depth;
+    bool busy;
+    uint32_t submitted;
+    uint32_t merged;
+    uint32_t rejected;              // Cola llena o sin SD
+    uint32_t dropped;
+    uint32_t done;
+    uint32_t failed;
+    uint32_t avg_wait_ms;           // Encolado → inicio
+    uint32_t max_wait_ms;
+    uint32_t avg_run_ms;
+    capture_rec_stats_t last_recording;
+} capture_svc_stats_t;
+
+// Carga el contador de archivos y crea la tarea
+esp_err_t capture_svc_start(void);
+
+// Encola un trabajo. ESP_ERR_INVALID_STATE sin SD, ESP_ERR_NO_MEM con la
+// cola llena de trabajos de igual o mayor prioridad. merged (opcional)
+// indica que se sumó a un trabajo que ya esperaba.
+esp_err_t capture_svc_submit(const capture_request_t *req, uint32_t *job_id, bool *merged);
+
+// Estado de un trabajo en cola, en curso o en el historial
+bool capture_svc_get_job(uint32_t id, capture_job_t *job);
+
+// En curso, en cola y terminados, del más nuevo al más viejo
+int capture_svc_get_jobs(capture_job_t *out, int max);
+
+void capture_svc_get_stats(capture_svc_stats_t *stats);
+
+// true si name (relativo a /sdcard) es un archivo que se está escribiendo:
+// el video en curso, el segmento DVR abierto o el contenedor time-lapse.
+// Borrarlo deja al handle abierto escribiendo en clusters liberados.
+bool capture_svc_file_in_use(const char *name);
+
+// Ritmo de grabación de videos y segmentos continuos (NVS)
+uint32_t capture_svc_get_record_fps(void);
+esp_err_t capture_svc_set_record_fps(uint32_t fps);
+
+void capture_svc_get_timelapse_config(capture_timelapse_config_t *cfg);
+
+// Aplica (reprograma el timer si está activo) y guarda en NVS
+esp_err_t capture_svc_configure_timelapse(const capture_timelapse_config_t *cfg);
+
+// Arranca/detiene el timer. Al detener se escribe el lote pendiente.
+void capture_svc_set_timelapse_active(bool active);
+
+void capture_svc_get_timelapse_status(capture_timelapse_status_t *status);
+
+void capture_svc_get_dvr_config(capture_dvr_config_t *cfg);
+
+// Aplica desde el próximo segmento y guarda en NVS
+esp_err_t capture_svc_configure_dvr(const capture_dvr_config_t *cfg);
+
+// Arranca/detiene la grabación continua. Al detener se cierra el segmento.
+void capture_svc_set_dvr_active(bool active);
+
+// Detiene la grabación continua y espera a que el segmento abierto quede
+// cerrado y renombrado (antes de formatear o remontar la SD). Devuelve si
+// estaba activa, para reanudarla con capture_svc_set_dvr_active(true).
+bool capture_svc_pause_dvr(void);
+
+void capture_svc_get_dvr_status(capture_dvr_status_t *status);
+
+const char *capture_job_type_name(capture_job_type_t type);
+const char *capture_prio_name(capture_prio_t prio);
+const char *capture_state_name(capture_state_t state);
+bool capture_parse_job_type(const char *s, capture_job_type_t *type);
+bool capture_parse_prio(const char *s, capture_prio_t *prio);
@@ -0,0 +1,62 @@
+#include "pacer.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+
+void pacer_start(pacer_t *p, uint32_t fps, int64_t now_us) {
+    *p = (pacer_t){
+        .anchor_us = now_us,
+        .period_us = 1000000 / (fps ? fps : 1),
+        .target_fps = fps,
+    };
+}
+
+void pacer_sleep(const pacer_t *p) {
+    // La ventana de un deadline abre medio periodo antes
+    int64_t wake_us = p->anchor_us + (int64_t)p->next_slot * p->period_us - p->period_us / 2;
+    int64_t wait_us = wake_us - esp_timer_get_time();
+    TickType_t ticks = pdMS_TO_TICKS(wait_us / 1000);
+    if (wait_us > 0 && ticks > 0) vTaskDelay(ticks);
+}
+
+bool pacer_offer(pacer_t *p, int64_t timestamp_us) {
+    int64_t rel = timestamp_us - p->anchor_us;
+    if (rel < -p->period_us / 2) return false;
+
+    // Deadline más cercano al momento real de captura
+    uint32_t slot = rel < 0 ? 0 : (uint32_t)((rel + p->period_us / 2) / p->period_us);
+    if (slot < p->next_slot) return false;
+
+    p->drops += slot - p->next_slot;
+    p->next_slot = slot + 1;
+
+    int64_t dev = timestamp_us - (p->anchor_us + (int64_t)slot * p->period_us);
+    uint32_t jitter = (uint32_t)(dev < 0 ? -dev : dev);
+    p->total_jitter_us += jitter;
+    if (jitter > p->max_jitter_us) p->max_jitter_us = jitter;
+
+    if (p->frames == 0) p->first_us = timestamp_us;
+    p->last_us = timestamp_us;
+    p->frames++;
+    return true;
+}
+
+uint32_t pacer_fps_x100(const pacer_t *p) {
+    int64_t span_us = p->last_us - p->first_us;
+    if (p->frames < 2 || span_us <= 0) return 0;
+    return (uint32_t)((uint64_t)(p->frames - 1) * 100 * 1000000 / span_us);
+}
+
+uint32_t pacer_avg_jitter_us(const pacer_t *p) {
+    return p->frames ? (uint32_t)(p->total_jitter_us / p->frames) : 0;
+}
+
+void pacer_describe(const pacer_t *p, char *buf, size_t len) {
+    uint32_t fps = pacer_fps_x100(p);
+    snprintf(buf, len, "target_fps=%lu fps=%lu.%02lu jitter_avg_ms=%lu.%01lu jitter_max_ms=%lu.%01lu drops=%lu",
+             (unsigned long)p->target_fps, (unsigned long)(fps / 100), (unsigned long)(fps % 100),
+             (unsigned long)(pacer_avg_jitter_us(p) / 1000), (unsigned long)(pacer_avg_jitter_us(p) / 100 % 10),
+             (unsigned long)(p->max_jitter_us / 1000), (unsigned long)(p->max_jitter_us / 100 % 10),
+             (unsigned long)p->drops);
+}
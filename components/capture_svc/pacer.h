@@ -0,0 +1,42 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// RITMO DE GRABACIÓN POR DEADLINES ABSOLUTOS
+// ============================================================================
+// El frame n va en anchor + n * periodo. La espera se calcula siempre contra
+// ese reloj (no "periodo después del último"), así el tiempo de captura y de
+// copia no se acumula como deriva. Cada frame ocupa el deadline más cercano a
+// su timestamp; si la cadena se atrasa y pasa de largo deadlines, se saltean
+// a propósito y se cuentan como descartes.
+
+typedef struct {
+    int64_t anchor_us;
+    int64_t period_us;
+    uint32_t next_slot;             // Primer deadline todavía libre
+    uint32_t target_fps;
+    uint32_t frames;
+    uint32_t drops;                 // Deadlines salteados
+    int64_t first_us;
+    int64_t last_us;
+    uint64_t total_jitter_us;       // |timestamp - deadline|
+    uint32_t max_jitter_us;
+} pacer_t;
+
+void pacer_start(pacer_t *p, uint32_t fps, int64_t now_us);
+
+// Duerme hasta que abre la ventana del próximo deadline
+void pacer_sleep(const pacer_t *p);
+
+// true si el frame va a la grabación (ya contado); false si llegó antes de
+// la ventana y hay que esperar otro
+bool pacer_offer(pacer_t *p, int64_t timestamp_us);
+
+// FPS logrado en centésimas (0 con menos de dos frames)
+uint32_t pacer_fps_x100(const pacer_t *p);
+uint32_t pacer_avg_jitter_us(const pacer_t *p);
+
+// Resumen de texto para los metadatos del archivo
+void pacer_describe(const pacer_t *p, char *buf, size_t len);
@@ -0,0 +1,227 @@
+#include "recorder.h"
+#include "avi.h"
+#include "cam_hal.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "RECORDER";
+
+#define REC_TASK_STACK  4096
+#define REC_TASK_PRIO   (tskIDLE_PRIORITY + 3)  // Por encima de la captura: vacía los slots apenas se llenan
+#define REC_TASK_CORE   0
+
+// Frame armado en un slot, listo para el contenedor
+typedef struct {
+    size_t jpeg_len;
+    uint16_t width;
+    uint16_t height;
+    int64_t timestamp_us;
+} rec_slot_info_t;
+
+struct recorder {
+    avi_writer_t *avi;
+    uint8_t *slot[REC_SLOTS];
+    rec_slot_info_t info[REC_SLOTS];
+    QueueHandle_t free_q;               // Índices de slots libres
+    int reserved;                       // Slot tomado por recorder_reserve() (-1 = ninguno)
+    SemaphoreHandle_t done;             // La tarea terminó de escribir todo
+    recorder_closed_cb_t on_closed;     // Cierre asíncrono: lo finaliza la tarea
+    void *on_closed_ctx;
+    volatile bool write_error;
+    uint64_t total_write_us;
+    capture_rec_stats_t stats;
+};
+
+// Slot lleno (o cierre si slot < 0) para la tarea de escritura
+typedef struct {
+    recorder_t *rec;
+    int slot;
+} rec_item_t;
+
+static QueueHandle_t s_filled_q = NULL;
+
+static void recorder_free(recorder_t *rec);
+
+// Índice, cabecera y fsync; completa las estadísticas y libera
+static esp_err_t recorder_finish(recorder_t *rec, capture_rec_stats_t *stats) {
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = avi_writer_close(rec->avi);
+    if (rec->write_error) err = ESP_FAIL;
+    rec->stats.close_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+
+    if (rec->stats.frames) rec->stats.avg_write_ms = (uint32_t)(rec->total_write_us / rec->stats.frames / 1000);
+    if (stats) *stats = rec->stats;
+    recorder_free(rec);
+    cam_hal_hold_size(false);
+    return err;
+}
+
+// ============================================================================
+// TAREA DE ESCRITURA
+// ============================================================================
+static void recorder_task(void *arg) {
+    rec_item_t item;
+    while (true) {
+        if (xQueueReceive(s_filled_q, &item, portMAX_DELAY) != pdTRUE) continue;
+        recorder_t *rec = item.rec;
+
+        if (item.slot < 0) {
+            if (rec->on_closed) {
+                recorder_closed_cb_t cb = rec->on_closed;
+                void *ctx = rec->on_closed_ctx;
+                capture_rec_stats_t stats;
+                esp_err_t err = recorder_finish(rec, &stats);
+                cb(err, &stats, ctx);
+            } else {
+                xSemaphoreGive(rec->done);
+            }
+            continue;
+        }
+
+        if (!rec->write_error) {
+            const rec_slot_info_t *info = &rec->info[item.slot];
+            int64_t t0 = esp_timer_get_time();
+            if (avi_writer_add_frame(rec->avi, rec->slot[item.slot], info->jpeg_len,
+                                     info->width, info->height, info->timestamp_us) != ESP_OK) {
+                rec->write_error = true;
+            } else {
+                uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+                rec->stats.frames++;
+                rec->stats.bytes += avi_chunk_len(info->jpeg_len);
+                rec->total_write_us += us;
+                if (us / 1000 > rec->stats.max_write_ms) rec->stats.max_write_ms = us / 1000;
+            }
+        }
+        xQueueSend(rec->free_q, &item.slot, portMAX_DELAY);
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t recorder_init(void) {
+    if (s_filled_q) return ESP_OK;
+
+    s_filled_q = xQueueCreate(REC_SLOTS + 1, sizeof(rec_item_t));
+    if (!s_filled_q) return ESP_ERR_NO_MEM;
+    if (xTaskCreatePinnedToCore(recorder_task, "recorder", REC_TASK_STACK, NULL,
+                                REC_TASK_PRIO, NULL, REC_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea del grabador");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void recorder_free(recorder_t *rec) {
+    for (int i = 0; i < REC_SLOTS; i++) heap_caps_free(rec->slot[i]);
+    if (rec->free_q) vQueueDelete(rec->free_q);
+    if (rec->done) vSemaphoreDelete(rec->done);
+    free(rec);
+}
+
+recorder_t *recorder_open(const char *filename) {
+    if (!s_filled_q) return NULL;
+
+    recorder_t *rec = calloc(1, sizeof(recorder_t));
+    if (!rec) return NULL;
+    rec->reserved = -1;
+    rec->free_q = xQueueCreate(REC_SLOTS, sizeof(int));
+    rec->done = xSemaphoreCreateBinary();
+    bool ok = rec->free_q && rec->done;
+    for (int i = 0; ok && i < REC_SLOTS; i++) {
+        rec->slot[i] = heap_caps_malloc(REC_SLOT_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        ok = rec->slot[i] != NULL;
+        if (ok) xQueueSend(rec->free_q, &i, 0);
+    }
+    if (!ok) {
+        ESP_LOGE(TAG, "Sin PSRAM para %d slots de %u KB", REC_SLOTS, REC_SLOT_BYTES / 1024);
+        recorder_free(rec);
+        return NULL;
+    }
+
+    rec->avi = avi_writer_open(filename);
+    if (!rec->avi) {
+        recorder_free(rec);
+        return NULL;
+    }
+    rec->stats.peak_kb = REC_SLOTS * REC_SLOT_BYTES / 1024;
+    // El AVI fija ancho y alto con el primer frame: el ABR no cambia la
+    // resolución hasta que se cierre
+    cam_hal_hold_size(true);
+    return rec;
+}
+
+esp_err_t recorder_reserve(recorder_t *rec, uint32_t wait_ms) {
+    if (rec->write_error) return ESP_FAIL;
+    if (rec->reserved >= 0) return ESP_OK;
+
+    int64_t t0 = esp_timer_get_time();
+    if (xQueueReceive(rec->free_q, &rec->reserved, pdMS_TO_TICKS(wait_ms)) != pdTRUE) {
+        rec->reserved = -1;
+        rec->stats.dropped_busy++;
+        return ESP_ERR_TIMEOUT;
+    }
+    uint32_t waited_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    rec->stats.stall_ms += waited_ms;
+    if (waited_ms > rec->stats.max_slot_wait_ms) rec->stats.max_slot_wait_ms = waited_ms;
+    return ESP_OK;
+}
+
+esp_err_t recorder_add_frame(recorder_t *rec, const frame_t *frame) {
+    if (rec->write_error) return ESP_FAIL;
+
+    if (avi_chunk_len(frame->len) > REC_SLOT_BYTES) {
+        rec->stats.dropped_large++;
+        return ESP_OK;
+    }
+
+    // Sin reserva previa no se espera: quien llama puede tener el frame
+    // retenido en el bus
+    int slot = rec->reserved;
+    rec->reserved = -1;
+    if (slot < 0 && xQueueReceive(rec->free_q, &slot, 0) != pdTRUE) {
+        rec->stats.dropped_busy++;
+        return ESP_OK;
+    }
+
+    memcpy(rec->slot[slot] + AVI_CHUNK_HEADER, frame->buf, frame->len);
+    avi_chunk_frame(rec->slot[slot], frame->len);
+    rec->info[slot] = (rec_slot_info_t){
+        .jpeg_len = frame->len,
+        .width = frame->width,
+        .height = frame->height,
+        .timestamp_us = frame->timestamp_us,
+    };
+
+    rec_item_t item = { .rec = rec, .slot = slot };
+    xQueueSend(s_filled_q, &item, portMAX_DELAY);
+    return ESP_OK;
+}
+
+void recorder_set_comment(recorder_t *rec, const char *text) {
+    avi_writer_set_comment(rec->avi, text);
+}
+
+esp_err_t recorder_close(recorder_t *rec, capture_rec_stats_t *stats) {
+    if (!rec) return ESP_ERR_INVALID_ARG;
+
+    // La marca de cierre llega después de todos los slots encolados
+    rec_item_t item = { .rec = rec, .slot = -1 };
+    xQueueSend(s_filled_q, &item, portMAX_DELAY);
+    xSemaphoreTake(rec->done, portMAX_DELAY);
+    return recorder_finish(rec, stats);
+}
+
+void recorder_close_async(recorder_t *rec, recorder_closed_cb_t cb, void *ctx) {
+    rec->on_closed = cb;
+    rec->on_closed_ctx = ctx;
+    rec_item_t item = { .rec = rec, .slot = -1 };
+    xQueueSend(s_filled_q, &item, portMAX_DELAY);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "esp_err.h"
+#include "frame_bus.h"
+#include "capture_svc.h"
+
+// ============================================================================
+// GRABADOR POR STREAMING
+// ============================================================================
+// El archivo se abre al empezar. Cada frame se copia a uno de REC_SLOTS
+// buffers fijos en PSRAM, ya armado como chunk AVI, y la tarea de escritura
+// lo cifra (CTR, en el lugar) y lo agrega al archivo (ver avi.h). La memoria
+// no depende del largo del clip, salvo el índice: 8 bytes por frame.
+
+#define REC_SLOTS        3
+#define REC_SLOT_BYTES   (192 * 1024)   // Chunk AVI con el frame; más grande se descarta
+#define REC_SLOT_WAIT_MS 1000           // Espera máxima por un slot libre (recorder_reserve)
+
+typedef struct recorder recorder_t;
+
+// Crea la tarea de escritura (una vez)
+esp_err_t recorder_init(void);
+
+// Abre /sdcard/<filename>.enc y reserva los slots. NULL si falla.
+recorder_t *recorder_open(const char *filename);
+
+// Espera hasta wait_ms por un slot libre y lo deja reservado para el próximo
+// recorder_add_frame(). Llamarla antes de tomar el frame del bus, así la
+// espera por la SD no retiene un buffer de la cámara. ESP_ERR_TIMEOUT si la
+// SD va atrás (cuenta como dropped_busy), ESP_FAIL si la escritura ya falló.
+esp_err_t recorder_reserve(recorder_t *rec, uint32_t wait_ms);
+
+// Copia el frame al slot reservado, o a uno libre si lo hay (sin esperar;
+// si no hay, se descarta como dropped_busy). ESP_FAIL si la escritura ya
+// falló: cortar la grabación.
+esp_err_t recorder_add_frame(recorder_t *rec, const frame_t *frame);
+
+// Texto para los metadatos del contenedor (antes de cerrar)
+void recorder_set_comment(recorder_t *rec, const char *text);
+
+// Espera a que se escriba todo, cierra y libera. stats es opcional.
+esp_err_t recorder_close(recorder_t *rec, capture_rec_stats_t *stats);
+
+typedef void (*recorder_closed_cb_t)(esp_err_t err, const capture_rec_stats_t *stats, void *ctx);
+
+// Cierra sin esperar: la tarea de escritura finaliza el archivo cuando
+// termina con los slots pendientes y llama a cb desde esa tarea. Mientras
+// tanto se puede estar llenando otro grabador.
+void recorder_close_async(recorder_t *rec, recorder_closed_cb_t cb, void *ctx);
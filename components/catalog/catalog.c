@@ -0,0 +1,490 @@
+#include "catalog.h"
+#include "sd_hal.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "ff.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+static const char *TAG = "CATALOG";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define CATALOG_MOUNT_POINT "/sdcard"
+#define CATALOG_FATFS_DRIVE "0:/"                   // Mismo volumen que monta sd_hal
+#define CATALOG_PATH        CATALOG_MOUNT_POINT "/.catalog"
+#define CATALOG_TMP_PATH    CATALOG_MOUNT_POINT "/.catalog.tmp"
+
+#define CATALOG_GROW        256                     // Entradas por ampliación
+#define CATALOG_MAX_ENTRIES 100000                  // Cota al leer un archivo dañado
+#define CATALOG_IO_BATCH    32                      // Entradas por fread/fwrite
+#define CATALOG_COMPACT_MIN 64                      // Cambios en el diario antes de compactar
+
+#define CATALOG_OP_ADD      'A'
+#define CATALOG_OP_DEL      'D'
+
+#define CATALOG_MAGIC       "CAT2"                  // CAT1 ordenaba por mtime: se reconstruye
+
+// Cabecera de .catalog: detrás van 'count' entradas y después el diario
+typedef struct {
+    char magic[4];                  // CATALOG_MAGIC
+    uint32_t entry_size;            // sizeof(catalog_entry_t)
+    uint32_t count;
+    uint32_t next_seq;              // Próximo seq a asignar
+} catalog_file_header_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t reserved[3];
+    catalog_entry_t entry;
+} catalog_journal_t;
+
+static SemaphoreHandle_t s_mutex = NULL;
+static catalog_entry_t *s_entries = NULL;          // PSRAM, por seq ascendente
+static uint32_t s_count = 0;
+static uint32_t s_next_seq = 1;
+static uint32_t s_cap = 0;
+static uint32_t s_journal = 0;
+static uint32_t s_rebuild_ms = 0;
+static bool s_ready = false;
+
+// ============================================================================
+// NOMBRES
+// ============================================================================
+static const char *const TYPE_NAMES[] = { "photo", "video", "burst", "timelapse", "dvr", "other" };
+static const char *const TYPE_PREFIXES[] = { "IMG_", "VID_", "BST_", "TLX_", "DVR_" };
+static const char *const SORT_NAMES[] = { "date", "name", "size" };
+
+const char *catalog_type_name(catalog_type_t type) {
+    return type <= CATALOG_TYPE_OTHER ? TYPE_NAMES[type] : "?";
+}
+
+bool catalog_parse_type(const char *s, catalog_type_t *type) {
+    if (strcmp(s, "all") == 0) {
+        *type = CATALOG_TYPE_ALL;
+        return true;
+    }
+    for (int i = 0; i <= CATALOG_TYPE_OTHER; i++) {
+        if (strcmp(s, TYPE_NAMES[i]) == 0) {
+            *type = (catalog_type_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool catalog_parse_sort(const char *s, catalog_sort_t *sort) {
+    for (int i = 0; i <= CATALOG_SORT_SIZE; i++) {
+        if (strcmp(s, SORT_NAMES[i]) == 0) {
+            *sort = (catalog_sort_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static catalog_type_t type_from_name(const char *name) {
+    for (int i = 0; i < CATALOG_TYPE_OTHER; i++) {
+        if (strncmp(name, TYPE_PREFIXES[i], 4) == 0) return (catalog_type_t)i;
+    }
+    return CATALOG_TYPE_OTHER;
+}
+
+// Ocultos (el propio catálogo), segmentos DVR a medio grabar y nombres que
+// no entran en la entrada
+static bool listable(const char *name) {
+    return name[0] != '.' && strlen(name) < CATALOG_NAME_LEN && !strstr(name, ".part.");
+}
+
+// ============================================================================
+// ARREGLO EN MEMORIA (con s_mutex tomado)
+// ============================================================================
+static bool reserve(uint32_t n) {
+    if (n <= s_cap) return true;
+    uint32_t cap = ((n / CATALOG_GROW) + 1) * CATALOG_GROW;
+    catalog_entry_t *e = heap_caps_realloc(s_entries, cap * sizeof(catalog_entry_t),
+                                           MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!e) {
+        ESP_LOGE(TAG, "Sin memoria para %lu entradas", (unsigned long)n);
+        return false;
+    }
+    s_entries = e;
+    s_cap = cap;
+    return true;
+}
+
+static int find(const char *name) {
+    // Desde el final: lo que se toca suele ser lo más nuevo
+    for (int i = (int)s_count - 1; i >= 0; i--) {
+        if (strcmp(s_entries[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static void remove_at(int i) {
+    memmove(&s_entries[i], &s_entries[i + 1], (s_count - i - 1) * sizeof(catalog_entry_t));
+    s_count--;
+}
+
+// Mantiene el orden por seq; lo normal es agregar al final
+static bool insert(const catalog_entry_t *e) {
+    if (!reserve(s_count + 1)) return false;
+    if (e->seq >= s_next_seq) s_next_seq = e->seq + 1;
+    uint32_t pos = s_count;
+    while (pos > 0 && s_entries[pos - 1].seq > e->seq) pos--;
+    memmove(&s_entries[pos + 1], &s_entries[pos], (s_count - pos) * sizeof(catalog_entry_t));
+    s_entries[pos] = *e;
+    s_count++;
+    return true;
+}
+
+static void apply(const catalog_journal_t *rec) {
+    int i = find(rec->entry.name);
+    if (i >= 0) remove_at(i);
+    if (rec->op == CATALOG_OP_ADD) insert(&rec->entry);
+}
+
+// ============================================================================
+// PERSISTENCIA (con s_mutex tomado)
+// ============================================================================
+// Base compacta a un temporal y rename: un corte deja el archivo viejo entero
+static esp_err_t save(void) {
+    FILE *f = fopen(CATALOG_TMP_PATH, "wb");
+    if (!f) return ESP_FAIL;
+
+    catalog_file_header_t hdr = {
+        .entry_size = sizeof(catalog_entry_t),
+        .count = s_count,
+        .next_seq = s_next_seq,
+    };
+    memcpy(hdr.magic, CATALOG_MAGIC, sizeof(hdr.magic));
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    for (uint32_t i = 0; ok && i < s_count; i += CATALOG_IO_BATCH) {
+        uint32_t n = s_count - i < CATALOG_IO_BATCH ? s_count - i : CATALOG_IO_BATCH;
+        ok = fwrite(&s_entries[i], sizeof(catalog_entry_t), n, f) == n;
+    }
+    ok = fclose(f) == 0 && ok;
+
+    if (ok) {
+        remove(CATALOG_PATH);
+        ok = rename(CATALOG_TMP_PATH, CATALOG_PATH) == 0;
+    }
+    if (!ok) {
+        remove(CATALOG_TMP_PATH);
+        ESP_LOGE(TAG, "No se pudo guardar el catálogo");
+        return ESP_FAIL;
+    }
+    s_journal = 0;
+    return ESP_OK;
+}
+
+static esp_err_t load(void) {
+    FILE *f = fopen(CATALOG_PATH, "rb");
+    if (!f) return ESP_ERR_NOT_FOUND;
+
+    catalog_file_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, CATALOG_MAGIC, 4) != 0 ||
+        hdr.entry_size != sizeof(catalog_entry_t) || hdr.count > CATALOG_MAX_ENTRIES ||
+        !reserve(hdr.count)) {
+        fclose(f);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (uint32_t i = 0; i < hdr.count; i += CATALOG_IO_BATCH) {
+        uint32_t n = hdr.count - i < CATALOG_IO_BATCH ? hdr.count - i : CATALOG_IO_BATCH;
+        if (fread(&s_entries[i], sizeof(catalog_entry_t), n, f) != n) {
+            fclose(f);
+            s_count = 0;
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    s_count = hdr.count;
+    s_next_seq = hdr.next_seq ? hdr.next_seq : 1;
+    for (uint32_t i = 0; i < s_count; i++) {
+        s_entries[i].name[CATALOG_NAME_LEN - 1] = '\0';
+        if (s_entries[i].seq >= s_next_seq) s_next_seq = s_entries[i].seq + 1;
+    }
+
+    // Diario: un registro cortado al final (corte de luz) se ignora
+    catalog_journal_t rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        if (rec.op != CATALOG_OP_ADD && rec.op != CATALOG_OP_DEL) break;
+        rec.entry.name[CATALOG_NAME_LEN - 1] = '\0';
+        apply(&rec);
+        s_journal++;
+    }
+    fclose(f);
+    return ESP_OK;
+}
+
+static void journal(uint8_t op, const catalog_entry_t *e) {
+    // Con el diario más largo que la mitad de la base, conviene reescribir
+    if (s_journal >= CATALOG_COMPACT_MIN && s_journal > s_count / 2) {
+        save();
+        return;
+    }
+
+    catalog_journal_t rec = { .op = op, .entry = *e };
+    FILE *f = fopen(CATALOG_PATH, "ab");
+    if (!f || fwrite(&rec, sizeof(rec), 1, f) != 1) {
+        if (f) fclose(f);
+        save();
+        return;
+    }
+    fclose(f);
+    s_journal++;
+}
+
+// FAT guarda fecha y hora local con resolución de 2 s
+static uint32_t fat_time(uint16_t fdate, uint16_t ftime) {
+    struct tm tm = {
+        .tm_year = ((fdate >> 9) & 0x7F) + 80,
+        .tm_mon = ((fdate >> 5) & 0x0F) - 1,
+        .tm_mday = fdate & 0x1F,
+        .tm_hour = (ftime >> 11) & 0x1F,
+        .tm_min = (ftime >> 5) & 0x3F,
+        .tm_sec = (ftime & 0x1F) * 2,
+        .tm_isdst = -1,
+    };
+    time_t t = mktime(&tm);
+    return t > 0 ? (uint32_t)t : 0;
+}
+
+// Contador del nombre (IMG_00000042 -> 42); 0 si no tiene
+static uint32_t name_counter(const char *name) {
+    if (type_from_name(name) == CATALOG_TYPE_OTHER) return 0;
+    return (uint32_t)strtoul(name + 4, NULL, 10);
+}
+
+static int compare_name(const void *a, const void *b) {
+    return strcmp(((const catalog_entry_t *)a)->name, ((const catalog_entry_t *)b)->name);
+}
+
+// Los que ya tenían seq, en ese orden; detrás los nuevos (seq 0) por contador
+static int compare_rebuild(const void *a, const void *b) {
+    const catalog_entry_t *ea = a;
+    const catalog_entry_t *eb = b;
+    if ((ea->seq == 0) != (eb->seq == 0)) return ea->seq == 0 ? 1 : -1;
+    if (ea->seq != eb->seq) return ea->seq < eb->seq ? -1 : 1;
+    uint32_t ca = name_counter(ea->name);
+    uint32_t cb = name_counter(eb->name);
+    if (ca != cb) return ca < cb ? -1 : 1;
+    return strcmp(ea->name, eb->name);
+}
+
+// Una pasada por el directorio con FatFs: el tamaño y la fecha vienen en la
+// entrada, sin el stat por archivo que vuelve a buscar el nombre
+static esp_err_t rebuild_locked(void) {
+    int64_t t0 = esp_timer_get_time();
+    FF_DIR dir;
+    FILINFO *fno = malloc(sizeof(FILINFO));
+    if (!fno) return ESP_ERR_NO_MEM;
+    if (f_opendir(&dir, CATALOG_FATFS_DRIVE) != FR_OK) {
+        free(fno);
+        return ESP_FAIL;
+    }
+
+    // Seq ya asignados, por nombre, para no reordenar lo que ya estaba
+    catalog_entry_t *known = s_count ? heap_caps_malloc(s_count * sizeof(catalog_entry_t),
+                                                        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : NULL;
+    uint32_t known_count = known ? s_count : 0;
+    if (known) {
+        memcpy(known, s_entries, known_count * sizeof(catalog_entry_t));
+        qsort(known, known_count, sizeof(catalog_entry_t), compare_name);
+    }
+
+    s_count = 0;
+    esp_err_t err = ESP_OK;
+    while (f_readdir(&dir, fno) == FR_OK && fno->fname[0] != '\0') {
+        if ((fno->fattrib & (AM_DIR | AM_HID)) || !listable(fno->fname)) continue;
+        if (!reserve(s_count + 1)) {
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+        catalog_entry_t *e = &s_entries[s_count++];
+        memset(e, 0, sizeof(*e));
+        snprintf(e->name, sizeof(e->name), "%s", fno->fname);
+        e->size = fno->fsize;
+        e->mtime = fat_time(fno->fdate, fno->ftime);
+        e->type = type_from_name(e->name);
+        const catalog_entry_t *k = known_count
+            ? bsearch(e, known, known_count, sizeof(catalog_entry_t), compare_name) : NULL;
+        if (k) e->seq = k->seq;
+    }
+    f_closedir(&dir);
+    free(fno);
+    heap_caps_free(known);
+
+    qsort(s_entries, s_count, sizeof(catalog_entry_t), compare_rebuild);
+    for (uint32_t i = 0; i < s_count; i++) {
+        if (s_entries[i].seq == 0) s_entries[i].seq = s_next_seq++;
+    }
+    s_rebuild_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    ESP_LOGI(TAG, "Catálogo reconstruido: %lu archivos en %lu ms",
+             (unsigned long)s_count, (unsigned long)s_rebuild_ms);
+
+    if (save() != ESP_OK && err == ESP_OK) err = ESP_FAIL;
+    return err;
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t catalog_mount(void) {
+    if (!s_mutex) {
+        s_mutex = xSemaphoreCreateMutex();
+        if (!s_mutex) return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_ready = false;
+    s_count = 0;
+    s_journal = 0;
+    s_next_seq = 1;
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    if (sd_card_is_mounted()) {
+        int64_t t0 = esp_timer_get_time();
+        err = load();
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "Catálogo cargado: %lu archivos (%lu cambios en el diario) en %lu ms",
+                     (unsigned long)s_count, (unsigned long)s_journal,
+                     (unsigned long)((esp_timer_get_time() - t0) / 1000));
+        } else {
+            if (err != ESP_ERR_NOT_FOUND) ESP_LOGW(TAG, "Catálogo dañado, se reconstruye");
+            err = rebuild_locked();
+        }
+        s_ready = err == ESP_OK;
+    }
+    xSemaphoreGive(s_mutex);
+    return err;
+}
+
+esp_err_t catalog_rebuild(void) {
+    if (!s_mutex || !sd_card_is_mounted()) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    esp_err_t err = rebuild_locked();
+    s_ready = err == ESP_OK;
+    xSemaphoreGive(s_mutex);
+    return err;
+}
+
+void catalog_add(const char *name) {
+    if (!s_ready || !listable(name)) return;
+
+    char filepath[64];
+    struct stat st;
+    snprintf(filepath, sizeof(filepath), CATALOG_MOUNT_POINT "/%s", name);
+    if (stat(filepath, &st) != 0) return;
+
+    catalog_entry_t e = { .size = (uint32_t)st.st_size, .mtime = (uint32_t)st.st_mtime };
+    snprintf(e.name, sizeof(e.name), "%s", name);
+    e.type = type_from_name(name);
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    // Una actualización (el archivo creció) conserva su lugar
+    int i = find(name);
+    if (i >= 0) {
+        e.seq = s_entries[i].seq;
+        remove_at(i);
+    } else {
+        e.seq = s_next_seq++;
+    }
+    if (insert(&e)) journal(CATALOG_OP_ADD, &e);
+    xSemaphoreGive(s_mutex);
+}
+
+void catalog_remove(const char *name) {
+    if (!s_ready) return;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int i = find(name);
+    if (i >= 0) {
+        catalog_entry_t e = s_entries[i];
+        remove_at(i);
+        journal(CATALOG_OP_DEL, &e);
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+void catalog_clear(void) {
+    if (!s_ready) return;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_count = 0;
+    save();
+    xSemaphoreGive(s_mutex);
+}
+
+bool catalog_oldest(catalog_type_t type, char *name, size_t len) {
+    if (!s_ready) return false;
+
+    bool found = false;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (uint32_t i = 0; i < s_count; i++) {
+        if (type != CATALOG_TYPE_ALL && s_entries[i].type != type) continue;
+        snprintf(name, len, "%s", s_entries[i].name);
+        found = true;
+        break;
+    }
+    xSemaphoreGive(s_mutex);
+    return found;
+}
+
+// Orden para las vistas que no son por fecha (solo con s_mutex tomado)
+static int compare_name_idx(const void *a, const void *b) {
+    return strcmp(s_entries[*(const uint32_t *)a].name, s_entries[*(const uint32_t *)b].name);
+}
+
+static int compare_size_idx(const void *a, const void *b) {
+    const catalog_entry_t *ea = &s_entries[*(const uint32_t *)a];
+    const catalog_entry_t *eb = &s_entries[*(const uint32_t *)b];
+    if (ea->size != eb->size) return ea->size > eb->size ? -1 : 1;
+    return strcmp(ea->name, eb->name);
+}
+
+int catalog_query(const catalog_query_t *q, catalog_entry_t *out, catalog_summary_t *summary) {
+    memset(summary, 0, sizeof(*summary));
+    if (!s_mutex) return 0;
+
+    int n = 0;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    summary->entries = s_count;
+    summary->rebuild_ms = s_rebuild_ms;
+    summary->journal = s_journal;
+
+    if (q->sort == CATALOG_SORT_DATE) {
+        // El arreglo ya está en orden de creación: la página sale sin ordenar nada
+        for (int i = (int)s_count - 1; i >= 0; i--) {
+            const catalog_entry_t *e = &s_entries[i];
+            if (q->type != CATALOG_TYPE_ALL && e->type != q->type) continue;
+            if (summary->matched >= q->offset && (uint32_t)n < q->limit) out[n++] = *e;
+            summary->matched++;
+            summary->matched_size += e->size;
+        }
+    } else {
+        uint32_t *idx = s_count ? heap_caps_malloc(s_count * sizeof(uint32_t),
+                                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : NULL;
+        uint32_t m = 0;
+        for (uint32_t i = 0; idx && i < s_count; i++) {
+            if (q->type != CATALOG_TYPE_ALL && s_entries[i].type != q->type) continue;
+            idx[m++] = i;
+            summary->matched_size += s_entries[i].size;
+        }
+        summary->matched = m;
+        if (idx) {
+            qsort(idx, m, sizeof(uint32_t), q->sort == CATALOG_SORT_NAME ? compare_name_idx : compare_size_idx);
+            for (uint32_t i = q->offset; i < m && (uint32_t)n < q->limit; i++) out[n++] = s_entries[idx[i]];
+            heap_caps_free(idx);
+        }
+    }
+    xSemaphoreGive(s_mutex);
+    return n;
+}
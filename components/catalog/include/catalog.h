@@ -0,0 +1,89 @@
+#pragma once
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// CATÁLOGO DE GRABACIONES
+// ============================================================================
+// Índice en PSRAM de los archivos de /sdcard, en orden de creación. Lo
+// actualizan los que escriben o borran archivos, así listar no recorre el
+// directorio ni hace un stat por archivo.
+//
+// El orden lo da un número de secuencia propio que se guarda con cada entrada
+// (base y diario), no la fecha: sin hora de red FAT fecha los archivos en
+// 1980 + el tiempo desde el arranque, y eso se repite en cada reinicio.
+//
+// Se guarda en /sdcard/.catalog: una base compacta y, detrás, un diario de
+// altas y bajas que se agrega con cada cambio. Al montar se carga la base y se
+// reaplica el diario; si falta o está dañado se reconstruye con una sola
+// pasada de f_readdir (tamaño y fecha salen de la entrada del directorio).
+// Lo copiado desde una PC con la SD afuera aparece con un rescan.
+
+#define CATALOG_NAME_LEN    32
+
+typedef enum {
+    CATALOG_TYPE_PHOTO = 0,         // IMG_
+    CATALOG_TYPE_VIDEO,             // VID_
+    CATALOG_TYPE_BURST,             // BST_
+    CATALOG_TYPE_TIMELAPSE,         // TLX_
+    CATALOG_TYPE_DVR,               // DVR_
+    CATALOG_TYPE_OTHER,
+    CATALOG_TYPE_ALL = 0xFF,        // Solo para filtrar
+} catalog_type_t;
+
+typedef enum {
+    CATALOG_SORT_DATE = 0,          // Más reciente primero (por seq)
+    CATALOG_SORT_NAME,
+    CATALOG_SORT_SIZE,              // Más grande primero
+} catalog_sort_t;
+
+typedef struct {
+    char name[CATALOG_NAME_LEN];
+    uint32_t size;
+    uint32_t mtime;                 // Solo informativo (ver arriba)
+    uint32_t seq;                   // Orden de alta, creciente y persistido
+    uint8_t type;
+    uint8_t reserved[3];
+} catalog_entry_t;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t limit;
+    catalog_sort_t sort;
+    catalog_type_t type;
+} catalog_query_t;
+
+typedef struct {
+    uint32_t matched;               // Que pasan el filtro (para paginar)
+    uint64_t matched_size;
+    uint32_t entries;               // Total del catálogo
+    uint32_t rebuild_ms;            // Última reconstrucción
+    uint32_t journal;               // Cambios en el diario desde la última compactación
+} catalog_summary_t;
+
+// Llamar después de cada montaje de la SD (arranque, reinit, formateo)
+esp_err_t catalog_mount(void);
+
+// Recorre el directorio de nuevo y reescribe el archivo. Los archivos ya
+// catalogados conservan su seq; los nuevos van detrás, ordenados por el
+// contador del nombre (IMG_<n>, DVR_<n>...).
+esp_err_t catalog_rebuild(void);
+
+// Alta o actualización (stat del archivo); nombre relativo a /sdcard
+void catalog_add(const char *name);
+void catalog_remove(const char *name);
+
+// Después de borrar todo
+void catalog_clear(void);
+
+// Nombre del archivo más viejo del tipo dado, sin tocar la SD. false si no hay.
+bool catalog_oldest(catalog_type_t type, char *name, size_t len);
+
+// Copia una página a out (hasta q->limit entradas). Devuelve las copiadas.
+int catalog_query(const catalog_query_t *q, catalog_entry_t *out, catalog_summary_t *summary);
+
+const char *catalog_type_name(catalog_type_t type);
+bool catalog_parse_type(const char *s, catalog_type_t *type);
+bool catalog_parse_sort(const char *s, catalog_sort_t *sort);
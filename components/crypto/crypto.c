@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 static const char *TAG = "CRYPTO";
 
@@ -247,3 +248,197 @@ esp_err_t crypto_save_file(const char *filename, const uint8_t *data, size_t len
              filename, (unsigned)len, enc_len);
     return ESP_OK;
 }
+
+// ============================================================================
+// ARCHIVOS CIFRADOS POR PARTES (AES-256-CTR)
+// ============================================================================
+struct crypto_stream {
+    FILE *f;
+    mbedtls_aes_context aes;
+    uint8_t nonce[16];
+    uint8_t counter[16];        // Contador en el final del archivo
+    uint8_t stream_block[16];
+    size_t nc_off;
+    uint64_t size;
+    bool error;
+};
+
+// Posiciona un contador CTR en 'offset' (nonce + offset/16, big-endian)
+static void ctr_seek(mbedtls_aes_context *aes, const uint8_t nonce[16], uint64_t offset,
+                     uint8_t counter[16], uint8_t stream_block[16], size_t *nc_off) {
+    memcpy(counter, nonce, 16);
+    uint64_t blocks = offset / 16;
+    for (int i = 15; i >= 0 && blocks; i--) {
+        uint32_t sum = counter[i] + (uint32_t)(blocks & 0xFF);
+        counter[i] = (uint8_t)sum;
+        blocks = (blocks >> 8) + (sum >> 8);
+    }
+    *nc_off = 0;
+    size_t rem = offset % 16;
+    if (rem) {
+        // Generar el bloque de keystream y saltear los bytes ya usados
+        uint8_t zero[16] = {0};
+        uint8_t scratch[16];
+        mbedtls_aes_crypt_ctr(aes, rem, nc_off, counter, stream_block, zero, scratch);
+    }
+}
+
+crypto_stream_t *crypto_stream_open(const char *filename) {
+    if (!crypto_initialized) {
+        ESP_LOGE(TAG, "Crypto no inicializado");
+        return NULL;
+    }
+
+    crypto_stream_t *s = calloc(1, sizeof(crypto_stream_t));
+    if (!s) return NULL;
+    if (generate_random_key(s->nonce, sizeof(s->nonce)) != ESP_OK) {
+        free(s);
+        return NULL;
+    }
+
+    char filepath[64];
+    snprintf(filepath, sizeof(filepath), "/sdcard/%s.enc", filename);
+    s->f = fopen(filepath, "w+b");
+    if (!s->f) {
+        ESP_LOGE(TAG, "fopen fallo: %s (errno: %d)", filepath, errno);
+        free(s);
+        return NULL;
+    }
+
+    // Cabecera con largo 0: se completa al cerrar
+    uint8_t header[CRYPTO_STREAM_HEADER_LEN] = {0};
+    memcpy(header, CRYPTO_STREAM_MAGIC, 4);
+    memcpy(header + 16, s->nonce, 16);
+    if (fwrite(header, 1, sizeof(header), s->f) != sizeof(header)) {
+        fclose(s->f);
+        remove(filepath);
+        free(s);
+        return NULL;
+    }
+
+    mbedtls_aes_init(&s->aes);
+    mbedtls_aes_setkey_enc(&s->aes, aes_key, 256);
+    memcpy(s->counter, s->nonce, 16);
+    return s;
+}
+
+esp_err_t crypto_stream_write(crypto_stream_t *s, uint8_t *data, size_t len) {
+    if (!s || s->error) return ESP_FAIL;
+
+    // CTR: el cifrado en el lugar no necesita buffer extra
+    if (mbedtls_aes_crypt_ctr(&s->aes, len, &s->nc_off, s->counter, s->stream_block, data, data) != 0 ||
+        fwrite(data, 1, len, s->f) != len) {
+        ESP_LOGE(TAG, "Error escribiendo stream cifrado (errno: %d)", errno);
+        s->error = true;
+        return ESP_FAIL;
+    }
+    s->size += len;
+    return ESP_OK;
+}
+
+esp_err_t crypto_stream_patch(crypto_stream_t *s, uint64_t offset, const uint8_t *data, size_t len) {
+    if (!s || s->error || offset + len > s->size) return ESP_ERR_INVALID_ARG;
+
+    uint8_t counter[16];
+    uint8_t stream_block[16];
+    size_t nc_off;
+    ctr_seek(&s->aes, s->nonce, offset, counter, stream_block, &nc_off);
+
+    esp_err_t err = ESP_OK;
+    if (fseek(s->f, CRYPTO_STREAM_HEADER_LEN + offset, SEEK_SET) != 0) err = ESP_FAIL;
+    uint8_t chunk[64];
+    while (err == ESP_OK && len > 0) {
+        size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        mbedtls_aes_crypt_ctr(&s->aes, n, &nc_off, counter, stream_block, data, chunk);
+        if (fwrite(chunk, 1, n, s->f) != n) err = ESP_FAIL;
+        data += n;
+        len -= n;
+    }
+    // Volver al final para seguir agregando
+    if (fseek(s->f, 0, SEEK_END) != 0) err = ESP_FAIL;
+    if (err != ESP_OK) s->error = true;
+    return err;
+}
+
+uint64_t crypto_stream_size(const crypto_stream_t *s) {
+    return s ? s->size : 0;
+}
+
+esp_err_t crypto_stream_close(crypto_stream_t *s) {
+    if (!s) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = s->error ? ESP_FAIL : ESP_OK;
+    if (fseek(s->f, 8, SEEK_SET) == 0) {
+        uint64_t size = s->size;
+        if (fwrite(&size, sizeof(size), 1, s->f) != 1) err = ESP_FAIL;
+    } else {
+        err = ESP_FAIL;
+    }
+    if (fflush(s->f) != 0) err = ESP_FAIL;
+    fsync(fileno(s->f));
+    fclose(s->f);
+    mbedtls_aes_free(&s->aes);
+    free(s);
+    return err;
+}
+
+// ============================================================================
+// LECTURA CON ACCESO ALEATORIO (descargas con Range)
+// ============================================================================
+struct crypto_reader {
+    FILE *f;
+    mbedtls_aes_context aes;
+    uint8_t nonce[16];
+    uint64_t size;
+};
+
+crypto_reader_t *crypto_reader_open(const char *path) {
+    if (!crypto_initialized) return NULL;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    uint8_t header[CRYPTO_STREAM_HEADER_LEN];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+        memcmp(header, CRYPTO_STREAM_MAGIC, 4) != 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    crypto_reader_t *r = calloc(1, sizeof(crypto_reader_t));
+    if (!r) {
+        fclose(f);
+        return NULL;
+    }
+    r->f = f;
+    memcpy(&r->size, header + 8, sizeof(r->size));
+    memcpy(r->nonce, header + 16, 16);
+    mbedtls_aes_init(&r->aes);
+    mbedtls_aes_setkey_enc(&r->aes, aes_key, 256);  // CTR descifra cifrando
+    return r;
+}
+
+uint64_t crypto_reader_size(const crypto_reader_t *r) {
+    return r ? r->size : 0;
+}
+
+int crypto_reader_read(crypto_reader_t *r, uint64_t offset, uint8_t *buf, size_t len) {
+    if (!r || offset >= r->size) return 0;
+    if (len > r->size - offset) len = (size_t)(r->size - offset);
+    if (fseek(r->f, CRYPTO_STREAM_HEADER_LEN + offset, SEEK_SET) != 0) return -1;
+
+    size_t n = fread(buf, 1, len, r->f);
+    uint8_t counter[16];
+    uint8_t stream_block[16];
+    size_t nc_off;
+    ctr_seek(&r->aes, r->nonce, offset, counter, stream_block, &nc_off);
+    mbedtls_aes_crypt_ctr(&r->aes, n, &nc_off, counter, stream_block, buf, buf);
+    return (int)n;
+}
+
+void crypto_reader_close(crypto_reader_t *r) {
+    if (!r) return;
+    fclose(r->f);
+    mbedtls_aes_free(&r->aes);
+    free(r);
+}
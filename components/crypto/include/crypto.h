@@ -14,3 +14,48 @@ int crypto_encrypt(const uint8_t *input, size_t input_len,
 
 // Guarda archivo encriptado en SD
 esp_err_t crypto_save_file(const char *filename, const uint8_t *data, size_t len);
+
+// ============================================================================
+// ARCHIVOS CIFRADOS POR PARTES (AES-256-CTR)
+// ============================================================================
+// Para grabaciones de largo desconocido: se abre el archivo al empezar y se
+// cifra y agrega de a bloques, sin juntar todo en memoria. CTR no tiene
+// padding y permite reescribir cualquier tramo (cabeceras que se completan
+// al cerrar).
+//
+// Formato (.enc): se distingue del de crypto_save_file por la firma, que como
+// tamaño original serían ~800MB
+//   "ENC2" | u32 flags (0) | u64 largo en claro | nonce 16 | datos CTR
+#define CRYPTO_STREAM_MAGIC      "ENC2"
+#define CRYPTO_STREAM_HEADER_LEN 32
+
+typedef struct crypto_stream crypto_stream_t;
+
+// Crea /sdcard/<filename>.enc. NULL si falla.
+crypto_stream_t *crypto_stream_open(const char *filename);
+
+// Cifra EN EL LUGAR (data queda cifrado) y agrega al final
+esp_err_t crypto_stream_write(crypto_stream_t *stream, uint8_t *data, size_t len);
+
+// Reescribe un tramo ya escrito (offset en claro)
+esp_err_t crypto_stream_patch(crypto_stream_t *stream, uint64_t offset, const uint8_t *data, size_t len);
+
+// Bytes en claro escritos hasta ahora
+uint64_t crypto_stream_size(const crypto_stream_t *stream);
+
+// Completa la cabecera, sincroniza y cierra. Libera el stream siempre.
+esp_err_t crypto_stream_close(crypto_stream_t *stream);
+
+// Lectura de un archivo ENC2 con acceso aleatorio. NULL si no existe o no es
+// ENC2 (los .enc de crypto_save_file no se leen por acá).
+typedef struct crypto_reader crypto_reader_t;
+
+crypto_reader_t *crypto_reader_open(const char *path);
+
+// Largo en claro (0 si la grabación no se cerró)
+uint64_t crypto_reader_size(const crypto_reader_t *reader);
+
+// Descifra len bytes desde offset (en claro). Devuelve los leídos, -1 si error.
+int crypto_reader_read(crypto_reader_t *reader, uint64_t offset, uint8_t *buf, size_t len);
+
+void crypto_reader_close(crypto_reader_t *reader);
@@ -0,0 +1,326 @@
+#include "frame_bus.h"
+#include "esp_log.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "FRAME_BUS";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+// cam_hal reserva 4 buffers en PSRAM (2 en DRAM). Retenemos como máximo
+// fb_count - 1 para que el DMA siempre tenga uno libre donde escribir (si no,
+// fb_get se bloquea). Cada suscriptor fija a lo sumo UN slot (pendiente o en
+// uso), así un consumidor lento no deja a la captura sin buffers.
+#if CONFIG_SPIRAM
+#define FRAME_BUS_MAX_IN_FLIGHT 3
+#else
+#define FRAME_BUS_MAX_IN_FLIGHT 1
+#endif
+#define CAPTURE_TASK_STACK      4096
+#define CAPTURE_TASK_PRIO       (tskIDLE_PRIORITY + 5)
+#define CAPTURE_TASK_CORE       0   // El servidor HTTP corre en el core 1
+
+// Frame interno: la parte pública va primero para poder castear
+typedef struct {
+    frame_t pub;
+    camera_fb_t *fb;
+    int refs;
+} frame_slot_t;
+
+struct frame_bus_sub {
+    bool in_use;
+    char name[FRAME_BUS_NAME_LEN];
+    frame_slot_t *pending;          // Último frame no consumido
+    frame_slot_t *held;             // Frame adquirido y aún no devuelto
+    int64_t held_since_us;
+    SemaphoreHandle_t ready;        // Señal "hay frame pendiente"
+    uint32_t delivered;
+    uint32_t dropped;
+    uint32_t holds;                 // Frames devueltos con frame_bus_done()
+    uint64_t hold_total_us;
+    uint32_t hold_max_us;
+};
+
+static frame_slot_t s_slots[FRAME_BUS_MAX_IN_FLIGHT];
+static struct frame_bus_sub s_subs[FRAME_BUS_MAX_SUBSCRIBERS];
+static int s_sub_count = 0;
+
+static portMUX_TYPE s_ref_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_subs_lock = NULL;    // Protege s_subs
+static SemaphoreHandle_t s_free_slots = NULL;   // Cuenta buffers disponibles
+static TaskHandle_t s_capture_task = NULL;
+
+static volatile uint32_t s_seq = 0;
+static volatile uint32_t s_captured = 0;
+static volatile uint32_t s_errors = 0;
+
+// ============================================================================
+// REFERENCIAS
+// ============================================================================
+const frame_t *frame_bus_ref(const frame_t *frame) {
+    if (!frame) return NULL;
+    frame_slot_t *slot = (frame_slot_t *)frame;
+    portENTER_CRITICAL(&s_ref_lock);
+    slot->refs++;
+    portEXIT_CRITICAL(&s_ref_lock);
+    return frame;
+}
+
+void frame_bus_release(const frame_t *frame) {
+    if (!frame) return;
+    frame_slot_t *slot = (frame_slot_t *)frame;
+    camera_fb_t *fb = NULL;
+
+    portENTER_CRITICAL(&s_ref_lock);
+    if (--slot->refs == 0) {
+        fb = slot->fb;
+        slot->fb = NULL;
+    }
+    portEXIT_CRITICAL(&s_ref_lock);
+
+    // Último consumidor: el buffer vuelve al driver
+    if (fb) {
+        esp_camera_fb_return(fb);
+        xSemaphoreGive(s_free_slots);
+    }
+}
+
+static frame_slot_t *take_free_slot(void) {
+    frame_slot_t *found = NULL;
+    portENTER_CRITICAL(&s_ref_lock);
+    for (int i = 0; i < FRAME_BUS_MAX_IN_FLIGHT; i++) {
+        if (s_slots[i].fb == NULL && s_slots[i].refs == 0) {
+            found = &s_slots[i];
+            found->refs = 1;    // Referencia de la tarea de captura
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_ref_lock);
+    return found;
+}
+
+// ============================================================================
+// PUBLICACIÓN
+// ============================================================================
+static void publish(frame_slot_t *slot) {
+    xSemaphoreTake(s_subs_lock, portMAX_DELAY);
+    for (int i = 0; i < FRAME_BUS_MAX_SUBSCRIBERS; i++) {
+        struct frame_bus_sub *sub = &s_subs[i];
+        if (!sub->in_use) continue;
+        if (sub->held) {
+            // Todavía procesa el anterior: no se le fija un segundo slot
+            sub->dropped++;
+            continue;
+        }
+
+        frame_bus_ref(&slot->pub);
+        frame_slot_t *old = sub->pending;
+        sub->pending = slot;
+        if (old) {
+            // El consumidor no alcanzó a leer el anterior
+            sub->dropped++;
+            frame_bus_release(&old->pub);
+        }
+        xSemaphoreGive(sub->ready);
+    }
+    xSemaphoreGive(s_subs_lock);
+}
+
+static void capture_task(void *arg) {
+    ESP_LOGI(TAG, "Tarea de captura iniciada (core %d)", CAPTURE_TASK_CORE);
+
+    while (true) {
+        // Sin consumidores no tiene sentido ocupar la cámara
+        if (s_sub_count == 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        // Esperar a que algún consumidor devuelva un buffer
+        if (xSemaphoreTake(s_free_slots, pdMS_TO_TICKS(1000)) != pdTRUE) {
+            continue;
+        }
+
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb) {
+            s_errors++;
+            ESP_LOGE(TAG, "Fallo camara");
+            xSemaphoreGive(s_free_slots);
+            vTaskDelay(pdMS_TO_TICKS(50));
+            continue;
+        }
+
+        frame_slot_t *slot = take_free_slot();
+        if (!slot) {
+            // No debería pasar: el semáforo garantiza un slot libre
+            esp_camera_fb_return(fb);
+            xSemaphoreGive(s_free_slots);
+            continue;
+        }
+
+        slot->fb = fb;
+        slot->pub.buf = fb->buf;
+        slot->pub.len = fb->len;
+        slot->pub.width = (uint16_t)fb->width;
+        slot->pub.height = (uint16_t)fb->height;
+        slot->pub.seq = ++s_seq;
+        slot->pub.timestamp_us = esp_timer_get_time();
+        s_captured++;
+
+        publish(slot);
+        frame_bus_release(&slot->pub);
+    }
+}
+
+// ============================================================================
+// API PÚBLICA
+// ============================================================================
+esp_err_t frame_bus_start(void) {
+    if (s_capture_task) return ESP_OK;
+
+    s_subs_lock = xSemaphoreCreateMutex();
+    s_free_slots = xSemaphoreCreateCounting(FRAME_BUS_MAX_IN_FLIGHT, FRAME_BUS_MAX_IN_FLIGHT);
+    if (!s_subs_lock || !s_free_slots) {
+        ESP_LOGE(TAG, "Sin memoria para frame bus");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < FRAME_BUS_MAX_SUBSCRIBERS; i++) {
+        s_subs[i].ready = xSemaphoreCreateBinary();
+        if (!s_subs[i].ready) return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreatePinnedToCore(capture_task, "frame_bus", CAPTURE_TASK_STACK, NULL,
+                                CAPTURE_TASK_PRIO, &s_capture_task, CAPTURE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de captura");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+frame_bus_sub_t *frame_bus_subscribe(const char *name) {
+    if (!s_subs_lock) return NULL;
+
+    frame_bus_sub_t *sub = NULL;
+    xSemaphoreTake(s_subs_lock, portMAX_DELAY);
+    for (int i = 0; i < FRAME_BUS_MAX_SUBSCRIBERS; i++) {
+        if (!s_subs[i].in_use) {
+            sub = &s_subs[i];
+            sub->in_use = true;
+            strncpy(sub->name, name ? name : "?", sizeof(sub->name) - 1);
+            sub->name[sizeof(sub->name) - 1] = '\0';
+            sub->pending = NULL;
+            sub->held = NULL;
+            sub->delivered = 0;
+            sub->dropped = 0;
+            sub->holds = 0;
+            sub->hold_total_us = 0;
+            sub->hold_max_us = 0;
+            xSemaphoreTake(sub->ready, 0);  // Limpiar señal vieja
+            s_sub_count++;
+            break;
+        }
+    }
+    xSemaphoreGive(s_subs_lock);
+
+    if (!sub) {
+        ESP_LOGW(TAG, "Sin lugar para consumidor '%s'", name ? name : "?");
+        return NULL;
+    }
+    xTaskNotifyGive(s_capture_task);
+    ESP_LOGI(TAG, "Consumidor '%s' registrado (%d activos)", sub->name, s_sub_count);
+    return sub;
+}
+
+void frame_bus_unsubscribe(frame_bus_sub_t *sub) {
+    if (!sub) return;
+
+    xSemaphoreTake(s_subs_lock, portMAX_DELAY);
+    frame_slot_t *pending = sub->pending;
+    sub->pending = NULL;
+    sub->held = NULL;       // Si aún lo retiene, lo devolverá con frame_bus_done()
+    if (sub->in_use) {
+        sub->in_use = false;
+        s_sub_count--;
+    }
+    xSemaphoreGive(s_subs_lock);
+
+    if (pending) frame_bus_release(&pending->pub);
+    ESP_LOGI(TAG, "Consumidor '%s' liberado (entregados: %lu, descartados: %lu)",
+             sub->name, (unsigned long)sub->delivered, (unsigned long)sub->dropped);
+}
+
+const frame_t *frame_bus_acquire(frame_bus_sub_t *sub, TickType_t timeout) {
+    if (!sub) return NULL;
+    if (xSemaphoreTake(sub->ready, timeout) != pdTRUE) return NULL;
+
+    xSemaphoreTake(s_subs_lock, portMAX_DELAY);
+    frame_slot_t *slot = sub->pending;
+    sub->pending = NULL;
+    if (slot) {
+        sub->delivered++;
+        sub->held = slot;
+        sub->held_since_us = esp_timer_get_time();
+    }
+    xSemaphoreGive(s_subs_lock);
+
+    // La referencia que tomó publish() pasa al llamador
+    return slot ? &slot->pub : NULL;
+}
+
+void frame_bus_done(frame_bus_sub_t *sub, const frame_t *frame) {
+    if (!frame) return;
+    if (sub) {
+        xSemaphoreTake(s_subs_lock, portMAX_DELAY);
+        if (sub->held == (frame_slot_t *)frame) {
+            int64_t held_us = esp_timer_get_time() - sub->held_since_us;
+            sub->held = NULL;
+            sub->holds++;
+            sub->hold_total_us += (uint64_t)held_us;
+            if (held_us > (int64_t)sub->hold_max_us) sub->hold_max_us = (uint32_t)held_us;
+        }
+        xSemaphoreGive(s_subs_lock);
+    }
+    frame_bus_release(frame);
+}
+
+void frame_bus_get_stats(frame_bus_stats_t *stats) {
+    if (!stats) return;
+    stats->captured = s_captured;
+    stats->errors = s_errors;
+    stats->subscribers = s_sub_count;
+
+    int in_flight = 0;
+    portENTER_CRITICAL(&s_ref_lock);
+    for (int i = 0; i < FRAME_BUS_MAX_IN_FLIGHT; i++) {
+        if (s_slots[i].fb) in_flight++;
+    }
+    portEXIT_CRITICAL(&s_ref_lock);
+    stats->in_flight = in_flight;
+}
+
+int frame_bus_get_sub_stats(frame_bus_sub_stats_t *out, int max) {
+    if (!out || !s_subs_lock) return 0;
+
+    int n = 0;
+    xSemaphoreTake(s_subs_lock, portMAX_DELAY);
+    for (int i = 0; i < FRAME_BUS_MAX_SUBSCRIBERS && n < max; i++) {
+        if (!s_subs[i].in_use) continue;
+        memcpy(out[n].name, s_subs[i].name, sizeof(out[n].name));
+        out[n].delivered = s_subs[i].delivered;
+        out[n].dropped = s_subs[i].dropped;
+        out[n].hold_avg_us = s_subs[i].holds ?
+            (uint32_t)(s_subs[i].hold_total_us / s_subs[i].holds) : 0;
+        out[n].hold_max_us = s_subs[i].hold_max_us;
+        out[n].holding = s_subs[i].held != NULL;
+        n++;
+    }
+    xSemaphoreGive(s_subs_lock);
+    return n;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// FRAME BUS: una sola tarea captura cada frame y lo reparte a N consumidores
+// ============================================================================
+// Los frames se cuentan por referencia: el buffer vuelve al driver de la
+// cámara cuando el último consumidor llama a frame_bus_release().
+// Cada suscriptor fija como máximo UN frame: el pendiente o el que adquirió.
+// Si llega uno nuevo antes de que lo consuma, el viejo se descarta; si todavía
+// retiene el adquirido, el nuevo se lo salta. Ambos casos cuentan como "drop".
+// Quien necesite un frame más de un período debe copiarlo y devolverlo.
+
+#define FRAME_BUS_MAX_SUBSCRIBERS 8
+#define FRAME_BUS_NAME_LEN        16
+
+// Frame publicado (solo lectura para los consumidores)
+typedef struct {
+    const uint8_t *buf;     // JPEG
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    uint32_t seq;           // Número de secuencia (creciente)
+    int64_t timestamp_us;   // esp_timer_get_time() al capturar
+} frame_t;
+
+typedef struct frame_bus_sub frame_bus_sub_t;
+
+// Estadísticas por consumidor
+typedef struct {
+    char name[FRAME_BUS_NAME_LEN];
+    uint32_t delivered;     // Frames entregados
+    uint32_t dropped;       // Frames descartados por consumidor lento
+    uint32_t hold_avg_us;   // Tiempo medio entre acquire y frame_bus_done()
+    uint32_t hold_max_us;
+    bool holding;           // Retiene un frame en este momento
+} frame_bus_sub_stats_t;
+
+// Estadísticas globales
+typedef struct {
+    uint32_t captured;      // Frames capturados desde el arranque
+    uint32_t errors;        // Fallos de esp_camera_fb_get()
+    int subscribers;        // Consumidores activos
+    int in_flight;          // Frames retenidos por consumidores
+} frame_bus_stats_t;
+
+// Inicia la tarea de captura (llamar después de camera_init_hardware)
+esp_err_t frame_bus_start(void);
+
+// Registra un consumidor. Devuelve NULL si no hay lugar.
+frame_bus_sub_t *frame_bus_subscribe(const char *name);
+
+// Da de baja un consumidor (libera su frame pendiente si lo hay)
+void frame_bus_unsubscribe(frame_bus_sub_t *sub);
+
+// Espera el próximo frame para este consumidor. El llamador queda dueño de
+// una referencia y DEBE devolverla con frame_bus_done(). NULL si timeout.
+const frame_t *frame_bus_acquire(frame_bus_sub_t *sub, TickType_t timeout);
+
+// Devuelve el frame obtenido con frame_bus_acquire() y registra cuánto se
+// retuvo. Hasta llamarla el consumidor no recibe frames nuevos. Si el
+// consumidor ya se dio de baja, el frame se devuelve con frame_bus_release().
+void frame_bus_done(frame_bus_sub_t *sub, const frame_t *frame);
+
+// Toma una referencia extra sobre un frame ya adquirido
+const frame_t *frame_bus_ref(const frame_t *frame);
+
+// Devuelve una referencia tomada con frame_bus_ref() (o un frame adquirido
+// por un consumidor que ya se dio de baja)
+void frame_bus_release(const frame_t *frame);
+
+// Estadísticas
+void frame_bus_get_stats(frame_bus_stats_t *stats);
+int frame_bus_get_sub_stats(frame_bus_sub_stats_t *out, int max);
@@ -0,0 +1,185 @@
+#include "abr.h"
+#include "cam_hal.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "ABR";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define NVS_NAMESPACE_STREAM "stream_cfg"
+#define NVS_KEY_ABR_ENABLED  "abr_on"
+#define NVS_KEY_ABR_FPS      "abr_fps"
+
+// Histéresis: bajar rápido, subir despacio
+#define ABR_DOWN_WINDOWS   2    // Ventanas malas seguidas para bajar un paso
+#define ABR_UP_WINDOWS     5    // Ventanas buenas seguidas para subir un paso
+#define ABR_BAD_SEND_PCT   90   // Envío > 90% del período de frame = malo
+#define ABR_GOOD_SEND_PCT  50   // Envío < 50% del período = hay margen
+#define ABR_BAD_SKIP_PCT   25
+#define ABR_GOOD_SKIP_PCT  5
+
+// Configuración, histéresis y última ventana: abr_configure y abr_get_status
+// corren en la tarea httpd, abr_update y abr_reset en la del motor
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_enabled = true;
+static int s_target_fps = ABR_DEFAULT_TARGET_FPS;
+
+// Acumuladores de la ventana (solo los toca la tarea del motor)
+static uint64_t s_send_sum_us = 0;
+static uint32_t s_send_count = 0;
+static uint32_t s_skip_count = 0;
+static uint32_t s_backlog_max = 0;
+
+static int s_bad_windows = 0;
+static int s_good_windows = 0;
+static uint32_t s_changes = 0;
+static abr_status_t s_last;
+
+void abr_init(void) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_STREAM, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        int32_t val;
+        if (nvs_get_i32(nvs_handle, NVS_KEY_ABR_ENABLED, &val) == ESP_OK) {
+            s_enabled = (val != 0);
+        }
+        if (nvs_get_i32(nvs_handle, NVS_KEY_ABR_FPS, &val) == ESP_OK && val >= 1 && val <= 30) {
+            s_target_fps = val;
+        }
+        nvs_close(nvs_handle);
+    }
+    ESP_LOGI(TAG, "ABR %s, objetivo %d fps", s_enabled ? "activo" : "desactivado", s_target_fps);
+}
+
+void abr_sample_send(uint32_t send_us) {
+    s_send_sum_us += send_us;
+    s_send_count++;
+}
+
+void abr_sample_skip(uint32_t skipped) {
+    s_skip_count += skipped;
+}
+
+void abr_sample_backlog(size_t pending_bytes) {
+    if (pending_bytes > s_backlog_max) s_backlog_max = (uint32_t)pending_bytes;
+}
+
+// Con una grabación abierta cam_hal rechaza los pasos que cambian la
+// resolución: en la escalera los pasos de igual tamaño son contiguos, así
+// que el ABR queda limitado a la calidad JPEG hasta que se cierre.
+static void change_step(int step) {
+    esp_err_t err = cam_hal_set_profile(step);
+    portENTER_CRITICAL(&s_lock);
+    if (err == ESP_OK) s_changes++;
+    s_bad_windows = 0;
+    s_good_windows = 0;
+    portEXIT_CRITICAL(&s_lock);
+    if (err == ESP_ERR_INVALID_STATE) {
+        ESP_LOGI(TAG, "Grabando: se mantiene la resolucion (paso %d omitido)", step);
+    }
+}
+
+void abr_update(void) {
+    uint32_t sent = s_send_count;
+    uint32_t avg_send = sent ? (uint32_t)(s_send_sum_us / sent) : 0;
+    uint32_t offered = sent + s_skip_count;
+    uint32_t skip_pct = offered ? (s_skip_count * 100) / offered : 0;
+
+    s_send_sum_us = 0;
+    s_send_count = 0;
+    s_skip_count = 0;
+
+    portENTER_CRITICAL(&s_lock);
+    s_last.avg_send_us = avg_send;
+    s_last.skip_pct = skip_pct;
+    s_last.max_backlog = s_backlog_max;
+    s_backlog_max = 0;
+    bool enabled = s_enabled;
+    uint32_t period_us = 1000000 / s_target_fps;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!enabled || sent == 0) return;
+
+    bool bad = (avg_send * 100 > period_us * ABR_BAD_SEND_PCT) || (skip_pct > ABR_BAD_SKIP_PCT);
+    bool good = (avg_send * 100 < period_us * ABR_GOOD_SEND_PCT) && (skip_pct < ABR_GOOD_SKIP_PCT);
+
+    int step = cam_hal_get_profile();
+    int next = step;
+    portENTER_CRITICAL(&s_lock);
+    if (bad) {
+        s_good_windows = 0;
+        if (++s_bad_windows >= ABR_DOWN_WINDOWS && step < cam_hal_profile_count() - 1) next = step + 1;
+    } else if (good) {
+        s_bad_windows = 0;
+        if (++s_good_windows >= ABR_UP_WINDOWS && step > 0) next = step - 1;
+    } else {
+        // Zona intermedia: mantener el paso actual
+        s_bad_windows = 0;
+        s_good_windows = 0;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (next > step) {
+        ESP_LOGW(TAG, "Enlace lento (envio %lu us, omitidos %lu%%) - bajando calidad",
+                 (unsigned long)avg_send, (unsigned long)skip_pct);
+        change_step(next);
+    } else if (next < step) {
+        ESP_LOGI(TAG, "Enlace con margen (envio %lu us) - subiendo calidad",
+                 (unsigned long)avg_send);
+        change_step(next);
+    }
+}
+
+void abr_reset(void) {
+    portENTER_CRITICAL(&s_lock);
+    s_bad_windows = 0;
+    s_good_windows = 0;
+    portEXIT_CRITICAL(&s_lock);
+    // Si se está grabando, el perfil por defecto se aplica al cerrar
+    if (cam_hal_get_profile() != cam_hal_default_profile()) {
+        cam_hal_defer_profile(cam_hal_default_profile());
+    }
+}
+
+void abr_get_status(abr_status_t *status) {
+    if (!status) return;
+    portENTER_CRITICAL(&s_lock);
+    *status = s_last;
+    status->enabled = s_enabled;
+    status->target_fps = s_target_fps;
+    status->changes = s_changes;
+    portEXIT_CRITICAL(&s_lock);
+    status->step = cam_hal_get_profile();
+    status->step_count = cam_hal_profile_count();
+    status->size_held = cam_hal_size_held();
+
+    const cam_profile_t *p = cam_hal_profile_info(status->step);
+    if (p) status->quality = p->quality;
+    // Tamaño real de salida: con ROI activa no es el del paso
+    cam_hal_get_roi(NULL, &status->width, &status->height);
+}
+
+esp_err_t abr_configure(bool enabled, int target_fps) {
+    if (target_fps < 1 || target_fps > 30) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_lock);
+    s_enabled = enabled;
+    s_target_fps = target_fps;
+    s_bad_windows = 0;
+    s_good_windows = 0;
+    portEXIT_CRITICAL(&s_lock);
+    if (!enabled) abr_reset();
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_STREAM, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_ABR_ENABLED, enabled ? 1 : 0);
+    nvs_set_i32(nvs_handle, NVS_KEY_ABR_FPS, target_fps);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+
+    ESP_LOGI(TAG, "ABR %s, objetivo %d fps", enabled ? "activo" : "desactivado", target_fps);
+    return err;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// CONTROL ADAPTATIVO DE BITRATE (uso interno del componente http_server)
+// ============================================================================
+// El motor de streaming informa cuánto tarda cada envío y cuántos frames se
+// pierden por clientes lentos. Cada ventana de medición se decide si bajar o
+// subir un paso de la escalera de cam_hal, con histéresis para no oscilar.
+
+#define ABR_DEFAULT_TARGET_FPS 10
+
+typedef struct {
+    bool enabled;
+    int target_fps;
+    int step;               // Paso actual de cam_hal
+    int step_count;
+    uint16_t width;         // Tamaño real de salida (con ROI, el recorte)
+    uint16_t height;
+    int quality;
+    bool size_held;         // Grabando: solo pasos de calidad
+    uint32_t avg_send_us;   // Promedio de la última ventana
+    uint32_t skip_pct;      // Frames omitidos / ofrecidos (%)
+    uint32_t max_backlog;   // Mayor cola pendiente observada (bytes)
+    uint32_t changes;       // Cambios de paso desde el arranque
+} abr_status_t;
+
+// Carga configuración desde NVS
+void abr_init(void);
+
+// Muestras desde el motor de streaming
+void abr_sample_send(uint32_t send_us);
+void abr_sample_skip(uint32_t skipped);
+void abr_sample_backlog(size_t pending_bytes);
+
+// Evaluar la ventana actual (llamar periódicamente desde el motor)
+void abr_update(void);
+
+// Sin clientes: volver al perfil por defecto (para no degradar grabaciones)
+void abr_reset(void);
+
+void abr_get_status(abr_status_t *status);
+
+// Cambia la configuración y la persiste en NVS
+esp_err_t abr_configure(bool enabled, int target_fps);
@@ -0,0 +1,135 @@
+#include "admission.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include <string.h>
+
+static const char *TAG = "ADMISSION";
+
+typedef struct {
+    bool in_use;
+    bool stream;                // De larga duración: nunca se purga
+    int fd;
+    int64_t opened_us;
+} admission_slot_t;
+
+static httpd_handle_t s_server = NULL;
+static admission_slot_t s_slots[ADMISSION_MAX_SOCKETS];
+static int s_open = 0;
+static int s_streams = 0;
+static uint32_t s_rejected = 0;
+static uint32_t s_evicted = 0;
+
+// ============================================================================
+// SESIONES (callbacks de httpd)
+// ============================================================================
+static admission_slot_t *slot_find(int fd) {
+    for (int i = 0; i < ADMISSION_MAX_SOCKETS; i++) {
+        if (s_slots[i].in_use && s_slots[i].fd == fd) return &s_slots[i];
+    }
+    return NULL;
+}
+
+// La conexión de control abierta hace más tiempo (sin contar new_fd)
+static void evict_oldest_control(int new_fd) {
+    admission_slot_t *oldest = NULL;
+    for (int i = 0; i < ADMISSION_MAX_SOCKETS; i++) {
+        admission_slot_t *s = &s_slots[i];
+        if (!s->in_use || s->stream || s->fd == new_fd) continue;
+        if (!oldest || s->opened_us < oldest->opened_us) oldest = s;
+    }
+    if (oldest && s_server) {
+        ESP_LOGD(TAG, "Sin lugar: cerrando conexion de control fd=%d", oldest->fd);
+        httpd_sess_trigger_close(s_server, oldest->fd);
+        s_evicted++;
+    }
+}
+
+static esp_err_t on_open(httpd_handle_t hd, int sockfd) {
+    admission_slot_t *slot = NULL;
+    for (int i = 0; i < ADMISSION_MAX_SOCKETS && !slot; i++) {
+        if (!s_slots[i].in_use) slot = &s_slots[i];
+    }
+    if (!slot) return ESP_FAIL;     // No debería pasar: httpd tiene el mismo tope
+
+    slot->in_use = true;
+    slot->stream = false;
+    slot->fd = sockfd;
+    slot->opened_us = esp_timer_get_time();
+    s_open++;
+
+    // Se ocupó el último lugar: liberar uno para la próxima conexión
+    if (s_open >= ADMISSION_MAX_SOCKETS) evict_oldest_control(sockfd);
+    return ESP_OK;
+}
+
+// Con close_fn definido httpd delega el cierre del socket
+static void on_close(httpd_handle_t hd, int sockfd) {
+    admission_slot_t *slot = slot_find(sockfd);
+    if (slot) {
+        if (slot->stream) s_streams--;
+        memset(slot, 0, sizeof(*slot));
+        s_open--;
+    }
+    close(sockfd);
+}
+
+// ============================================================================
+// API (interna del componente)
+// ============================================================================
+void admission_configure(httpd_config_t *config) {
+    // La purga LRU elige por uso: los streams (atendidos fuera de httpd)
+    // parecen ociosos. La reemplaza evict_oldest_control().
+    config->max_open_sockets = ADMISSION_MAX_SOCKETS;
+    config->lru_purge_enable = false;
+    config->open_fn = on_open;
+    config->close_fn = on_close;
+}
+
+void admission_set_server(httpd_handle_t server) {
+    s_server = server;
+}
+
+bool admission_stream_mark(int fd) {
+    admission_slot_t *slot = slot_find(fd);
+    if (!slot) return false;
+    if (slot->stream) return true;
+    if (s_streams >= ADMISSION_STREAM_BUDGET) {
+        s_rejected++;
+        return false;
+    }
+    slot->stream = true;
+    s_streams++;
+    return true;
+}
+
+void admission_stream_cancel(int fd) {
+    admission_slot_t *slot = slot_find(fd);
+    if (slot && slot->stream) {
+        slot->stream = false;
+        s_streams--;
+    }
+}
+
+// Respuesta corta: el cliente reintenta y el socket queda para control
+void admission_reply_busy(httpd_req_t *req, const char *msg) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Retry-After", ADMISSION_RETRY_AFTER_S);
+    httpd_resp_set_hdr(req, "Connection", "close");
+    httpd_resp_sendstr(req, msg);
+}
+
+bool admission_stream_begin(httpd_req_t *req, const char *busy_msg) {
+    if (admission_stream_mark(httpd_req_to_sockfd(req))) return true;
+    admission_reply_busy(req, busy_msg);
+    return false;
+}
+
+void admission_get_stats(admission_stats_t *stats) {
+    if (!stats) return;
+    stats->open = s_open;
+    stats->streams = s_streams;
+    stats->rejected = s_rejected;
+    stats->evicted = s_evicted;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// CONTROL DE ADMISIÓN (uso interno del componente http_server)
+// ============================================================================
+// Los sockets de httpd se reparten en dos presupuestos:
+//  - larga duración (/stream, /ws/stream, /api/events): como máximo
+//    ADMISSION_MAX_SOCKETS - ADMISSION_CONTROL_RESERVE. Los que no entran
+//    reciben un 503 inmediato con Retry-After.
+//  - control (API, UI): el resto. Cuando se ocupa el último lugar se cierra
+//    la conexión de control más vieja, así siempre queda uno libre para
+//    administrar el equipo. Las conexiones de streaming nunca se purgan.
+// Todo corre en la tarea httpd (open_fn / close_fn / handlers).
+
+#define ADMISSION_MAX_SOCKETS      13   // CONFIG_LWIP_MAX_SOCKETS - 3 (httpd) - 8 (RTSP + multicast)
+#define ADMISSION_CONTROL_RESERVE  2    // La petición en curso + uno libre
+#define ADMISSION_STREAM_BUDGET    (ADMISSION_MAX_SOCKETS - ADMISSION_CONTROL_RESERVE)
+#define ADMISSION_RETRY_AFTER_S    "5"
+
+typedef struct {
+    int open;                   // Sockets abiertos en httpd
+    int streams;                // De larga duración
+    uint32_t rejected;          // 503 por presupuesto agotado
+    uint32_t evicted;           // Conexiones de control cerradas para hacer lugar
+} admission_stats_t;
+
+// Completa max_open_sockets, open_fn y close_fn (desactiva la purga LRU)
+void admission_configure(httpd_config_t *config);
+
+// Llamar tras httpd_start (necesario para cerrar conexiones)
+void admission_set_server(httpd_handle_t server);
+
+// Pide lugar para una conexión de larga duración. Si devuelve false ya
+// respondió 503 + Retry-After y el handler debe retornar ESP_OK.
+bool admission_stream_begin(httpd_req_t *req, const char *busy_msg);
+
+// Marca el socket como de larga duración sin responder nada (WebSocket:
+// el handshake ya fue respondido). false = presupuesto agotado.
+bool admission_stream_mark(int fd);
+
+// Devuelve el lugar si el alta falló después de admitir (el socket vuelve a control)
+void admission_stream_cancel(int fd);
+
+// 503 + Retry-After (también para los topes propios de cada servicio)
+void admission_reply_busy(httpd_req_t *req, const char *msg);
+
+void admission_get_stats(admission_stats_t *stats);
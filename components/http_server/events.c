@@ -0,0 +1,243 @@
+#include "events.h"
+#include "admission.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "lwip/sockets.h"
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+static const char *TAG = "EVENTS";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define EVENTS_TASK_STACK   3072
+#define EVENTS_TASK_PRIO    (tskIDLE_PRIORITY + 3)
+#define EVENTS_TASK_CORE    1
+#define EVENTS_POLL_MS      250     // Cada cuánto se compara el estado
+#define EVENTS_KEEPALIVE_MS 15000   // Comentario SSE para que no corten la conexión
+#define EVENTS_STATUS_LEN   256
+
+static const char *SSE_HTTP_HEADER =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "retry: 3000\n\n";
+
+typedef struct {
+    bool in_use;
+    httpd_req_t *req;
+    int fd;
+} event_client_t;
+
+static httpd_handle_t s_server = NULL;
+static events_status_fn_t s_status_fn = NULL;
+static QueueHandle_t s_new_clients = NULL;
+static event_client_t s_clients[EVENTS_MAX_CLIENTS];
+static volatile int s_client_count = 0;
+static portMUX_TYPE s_count_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static char s_last_status[EVENTS_STATUS_LEN];
+
+// ============================================================================
+// CLIENTES
+// ============================================================================
+static void client_close(event_client_t *c) {
+    httpd_req_async_handler_complete(c->req);
+    httpd_sess_trigger_close(s_server, c->fd);
+    memset(c, 0, sizeof(*c));
+
+    portENTER_CRITICAL(&s_count_lock);
+    s_client_count--;
+    portEXIT_CRITICAL(&s_count_lock);
+}
+
+// Los mensajes son chicos: si no entran enteros el cliente está muerto
+static bool client_write(event_client_t *c, const char *data, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        int n = send(c->fd, data + off, len - off, MSG_DONTWAIT);
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+
+static void client_attach(httpd_req_t *req) {
+    event_client_t *c = NULL;
+    for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+        if (!s_clients[i].in_use) {
+            c = &s_clients[i];
+            break;
+        }
+    }
+    int fd = httpd_req_to_sockfd(req);
+    if (!c || fd < 0) {
+        httpd_req_async_handler_complete(req);
+        if (fd >= 0) httpd_sess_trigger_close(s_server, fd);
+        portENTER_CRITICAL(&s_count_lock);
+        s_client_count--;
+        portEXIT_CRITICAL(&s_count_lock);
+        return;
+    }
+
+    c->in_use = true;
+    c->req = req;
+    c->fd = fd;
+
+    // Cabecera + estado actual para que la página arranque sin esperar cambios
+    char msg[EVENTS_STATUS_LEN + 32];
+    char status[EVENTS_STATUS_LEN];
+    s_status_fn(status, sizeof(status));
+    int len = snprintf(msg, sizeof(msg), "event: status\ndata: %s\n\n", status);
+    if (!client_write(c, SSE_HTTP_HEADER, strlen(SSE_HTTP_HEADER)) ||
+        !client_write(c, msg, len)) {
+        client_close(c);
+        return;
+    }
+    ESP_LOGI(TAG, "Cliente SSE fd=%d conectado (%d activos)", fd, s_client_count);
+}
+
+static void broadcast(const char *msg, size_t len) {
+    for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+        event_client_t *c = &s_clients[i];
+        if (c->in_use && !client_write(c, msg, len)) {
+            ESP_LOGI(TAG, "Cliente SSE fd=%d desconectado", c->fd);
+            client_close(c);
+        }
+    }
+}
+
+// ============================================================================
+// TAREA
+// ============================================================================
+static void events_task(void *arg) {
+    int64_t last_send = esp_timer_get_time();
+
+    while (true) {
+        httpd_req_t *req = NULL;
+        TickType_t wait = (s_client_count > 0) ? 0 : portMAX_DELAY;
+        while (xQueueReceive(s_new_clients, &req, wait) == pdTRUE) {
+            client_attach(req);
+            wait = 0;
+        }
+        if (s_client_count == 0) {
+            s_last_status[0] = '\0';
+            continue;
+        }
+
+        // Esperar EVENTS_POLL_MS; si algún socket se vuelve legible el
+        // navegador cerró la pestaña (SSE no manda nada del cliente)
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        int maxfd = -1;
+        for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+            if (s_clients[i].in_use) {
+                FD_SET(s_clients[i].fd, &rfds);
+                if (s_clients[i].fd > maxfd) maxfd = s_clients[i].fd;
+            }
+        }
+        struct timeval tv = { .tv_sec = 0, .tv_usec = EVENTS_POLL_MS * 1000 };
+        if (select(maxfd + 1, &rfds, NULL, NULL, &tv) > 0) {
+            for (int i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+                event_client_t *c = &s_clients[i];
+                if (!c->in_use || !FD_ISSET(c->fd, &rfds)) continue;
+                char tmp[32];
+                int n = recv(c->fd, tmp, sizeof(tmp), MSG_DONTWAIT);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    ESP_LOGI(TAG, "Cliente SSE fd=%d cerrado", c->fd);
+                    client_close(c);
+                }
+            }
+        }
+
+        char status[EVENTS_STATUS_LEN];
+        s_status_fn(status, sizeof(status));
+        int64_t now = esp_timer_get_time();
+
+        if (strcmp(status, s_last_status) != 0) {
+            char msg[EVENTS_STATUS_LEN + 32];
+            int len = snprintf(msg, sizeof(msg), "event: status\ndata: %s\n\n", status);
+            broadcast(msg, len);
+            strncpy(s_last_status, status, sizeof(s_last_status) - 1);
+            last_send = now;
+        } else if (now - last_send >= (int64_t)EVENTS_KEEPALIVE_MS * 1000) {
+            broadcast(": ping\n\n", 8);
+            last_send = now;
+        }
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t events_start(httpd_handle_t server, events_status_fn_t status_fn) {
+    if (s_new_clients) return ESP_OK;
+
+    s_server = server;
+    s_status_fn = status_fn;
+    s_new_clients = xQueueCreate(EVENTS_MAX_CLIENTS, sizeof(httpd_req_t *));
+    if (!s_new_clients) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreatePinnedToCore(events_task, "sse_events", EVENTS_TASK_STACK, NULL,
+                                EVENTS_TASK_PRIO, NULL, EVENTS_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de eventos");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t events_handler(httpd_req_t *req) {
+    bool reserved = false;
+    portENTER_CRITICAL(&s_count_lock);
+    if (s_client_count < EVENTS_MAX_CLIENTS) {
+        s_client_count++;
+        reserved = true;
+    }
+    portEXIT_CRITICAL(&s_count_lock);
+
+    // Cuenta en el presupuesto de sockets de larga duración (se libera al
+    // cerrar el socket)
+    if (!s_new_clients || !reserved || !admission_stream_mark(httpd_req_to_sockfd(req))) {
+        if (reserved) {
+            portENTER_CRITICAL(&s_count_lock);
+            s_client_count--;
+            portEXIT_CRITICAL(&s_count_lock);
+        }
+        // Con un código distinto de 200 el EventSource se cierra y no
+        // reintenta: app.js lo vuelve a abrir pasado este Retry-After
+        // (EVENTS_RETRY_MS) y mientras tanto sondea /api/motion/status cada segundo
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "10");
+        httpd_resp_sendstr(req, "Demasiados clientes de eventos");
+        return ESP_OK;
+    }
+
+    httpd_req_t *async_req = NULL;
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        portENTER_CRITICAL(&s_count_lock);
+        s_client_count--;
+        portEXIT_CRITICAL(&s_count_lock);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No se pudo abrir el canal");
+        return ESP_FAIL;
+    }
+    // La cola tiene lugar para EVENTS_MAX_CLIENTS: no debería fallar
+    if (xQueueSend(s_new_clients, &async_req, 0) != pdTRUE) {
+        httpd_req_async_handler_complete(async_req);
+        portENTER_CRITICAL(&s_count_lock);
+        s_client_count--;
+        portEXIT_CRITICAL(&s_count_lock);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int events_client_count(void) {
+    return s_client_count;
+}
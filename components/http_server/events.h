@@ -0,0 +1,22 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stddef.h>
+
+// ============================================================================
+// CANAL DE EVENTOS SSE (uso interno del componente http_server)
+// ============================================================================
+// /api/events deja una conexión abierta por pestaña y empuja el estado
+// (stream, movimiento, tiempo restante, SD, WiFi) solo cuando cambia.
+
+#define EVENTS_MAX_CLIENTS 3
+
+// Arma el JSON de estado en buf. Devuelve la longitud escrita.
+typedef int (*events_status_fn_t)(char *buf, size_t len);
+
+esp_err_t events_start(httpd_handle_t server, events_status_fn_t status_fn);
+
+// GET /api/events
+esp_err_t events_handler(httpd_req_t *req);
+
+int events_client_count(void);
@@ -11,6 +11,21 @@
 #include "nvs.h"
 #include "wifi_net.h"
 #include "sd_hal.h"
+#include "frame_bus.h"
+#include "cam_hal.h"
+#include "mcast_stream.h"
+#include "motion_detect.h"
+#include "preroll.h"
+#include "capture_svc.h"
+#include "catalog.h"
+#include "admission.h"
+#include "stream_engine.h"
+#include "transcode.h"
+#include "abr.h"
+#include "still.h"
+#include "snapshot.h"
+#include "events.h"
+#include "web_assets.h"
 #include <dirent.h>
 #include <sys/stat.h>
 #include <string.h>
@@ -24,7 +39,8 @@ static httpd_handle_t server_httpd = NULL;
 // CONFIGURACIÓN
 // ============================================================================
 #define MOUNT_POINT "/sdcard"
-#define MAX_FILES 50
+#define FILES_PAGE_DEFAULT 50
+#define FILES_PAGE_MAX     200
 
 // NVS para configuración de movimiento
 #define NVS_NAMESPACE_MOTION "motion_cfg"
@@ -53,6 +69,15 @@ static volatile int g_video_duration_sec = DEFAULT_VIDEO_DURATION;
 // ============================================================================
 // FUNCIONES DE CONFIGURACIÓN NVS
 // ============================================================================
+static const char *capture_mode_name(capture_mode_t mode) {
+    switch (mode) {
+        case CAPTURE_MODE_VIDEO: return "VIDEO";
+        case CAPTURE_MODE_TIMELAPSE: return "TIMELAPSE";
+        case CAPTURE_MODE_CONTINUOUS: return "CONTINUOUS";
+        default: return "FOTO";
+    }
+}
+
 static void load_motion_config(void) {
     nvs_handle_t nvs_handle;
     esp_err_t err = nvs_open(NVS_NAMESPACE_MOTION, NVS_READONLY, &nvs_handle);
@@ -74,9 +99,9 @@ static void load_motion_config(void) {
         // Cargar modo de captura
         int32_t mode_val = CAPTURE_MODE_PHOTO;
         err = nvs_get_i32(nvs_handle, NVS_KEY_CAPTURE_MODE, &mode_val);
-        if (err == ESP_OK && (mode_val == CAPTURE_MODE_PHOTO || mode_val == CAPTURE_MODE_VIDEO)) {
+        if (err == ESP_OK && mode_val >= CAPTURE_MODE_PHOTO && mode_val <= CAPTURE_MODE_CONTINUOUS) {
             g_capture_mode = (capture_mode_t)mode_val;
-            ESP_LOGI(TAG, "Modo de captura: %s", g_capture_mode == CAPTURE_MODE_VIDEO ? "VIDEO" : "FOTO");
+            ESP_LOGI(TAG, "Modo de captura: %s", capture_mode_name(g_capture_mode));
         }
         
         // Cargar duración de video
@@ -102,7 +127,7 @@ static void save_motion_config(void) {
         nvs_commit(nvs_handle);
         nvs_close(nvs_handle);
         ESP_LOGI(TAG, "Config guardada - Modo: %s, Emisión: %ds, Video: %ds", 
-                 g_capture_mode == CAPTURE_MODE_VIDEO ? "VIDEO" : "FOTO",
+                 capture_mode_name(g_capture_mode),
                  g_emission_time_sec, g_video_duration_sec);
     }
 }
@@ -157,427 +182,418 @@ int http_server_get_emission_time(void) {
     return g_emission_time_sec;
 }
 
-// Boundary para MJPEG
-#define PART_BOUNDARY "123456789000000000000987654321"
-static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
-static const char* _STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
+// ============================================================================
+// HANDLER: STREAM MJPEG (Con control de movimiento)
+// ============================================================================
+// ?fps=N de /stream y /ws/stream (-1 = usar el tope por defecto)
+static int stream_query_fps(httpd_req_t *req) {
+    char query[48] = {0};
+    char value[8] = {0};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "fps", value, sizeof(value)) == ESP_OK) {
+        int fps = atoi(value);
+        return fps < 0 ? 0 : fps;
+    }
+    return -1;
+}
+
+// ?size=qvga|qqvga: sub-stream reducido (sin parámetro = tamaño del sensor)
+static stream_size_t stream_query_size(httpd_req_t *req) {
+    char query[48] = {0};
+    char value[8] = {0};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "size", value, sizeof(value)) == ESP_OK) {
+        return transcode_parse_size(value);
+    }
+    return STREAM_SIZE_FULL;
+}
+
+static esp_err_t stream_handler(httpd_req_t *req) {
+    // Verificar si el streaming está permitido
+    if (!http_server_is_streaming_active()) {
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_send(req, "Stream inactivo - esperando movimiento", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    
+    // Presupuesto de sockets de larga duración (siempre queda lugar para la API)
+    if (!admission_stream_begin(req, "Servidor ocupado - reintentar")) {
+        return ESP_OK;
+    }
+
+    // Entregar el socket al motor de streaming: la tarea httpd queda libre
+    // para atender el resto de la API mientras alguien mira el video.
+    esp_err_t err = stream_engine_add_client(req, stream_query_fps(req), stream_query_size(req));
+    if (err != ESP_OK) admission_stream_cancel(httpd_req_to_sockfd(req));
+    if (err == ESP_ERR_NO_MEM) {
+        admission_reply_busy(req, "Demasiados clientes de stream");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No se pudo iniciar el stream");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Stream iniciado (%d clientes)", stream_engine_client_count());
+    return ESP_OK;
+}
 
 // ============================================================================
-// ESTRUCTURA PARA LISTA DE ARCHIVOS
+// HANDLER: STREAM WEBSOCKET (frames binarios con ACK del navegador)
 // ============================================================================
-typedef struct {
-    char name[64];
-    size_t size;
-    time_t mtime;
-} file_info_t;
+static esp_err_t stream_ws_handler(httpd_req_t *req) {
+    // Los mensajes posteriores al handshake son ACKs
+    if (req->method != HTTP_GET) {
+        return stream_engine_ws_recv(req);
+    }
+
+    // Handshake ya respondido por httpd: devolver error cierra la sesión
+    if (!http_server_is_streaming_active()) {
+        ESP_LOGW(TAG, "WS rechazado - stream inactivo");
+        return ESP_FAIL;
+    }
+    int fd = httpd_req_to_sockfd(req);
+    if (!admission_stream_mark(fd)) {
+        ESP_LOGW(TAG, "WS rechazado - sin lugar para streams");
+        return ESP_FAIL;
+    }
+    esp_err_t err = stream_engine_add_ws_client(req, stream_query_fps(req), stream_query_size(req));
+    if (err != ESP_OK) {
+        admission_stream_cancel(fd);
+        ESP_LOGW(TAG, "WS rechazado (%s)", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
 
 // ============================================================================
-// PÁGINA HTML PRINCIPAL (Con control de movimiento, WiFi y modo captura)
+// HANDLER: ESTADÍSTICAS DE CAPTURA (frame bus)
 // ============================================================================
-static const char* HTML_INDEX = 
-"<!DOCTYPE html><html><head><meta charset='UTF-8'><meta name='viewport' content='width=device-width,initial-scale=1'>"
-"<title>Vigilante ESP32</title><style>"
-"*{box-sizing:border-box;margin:0;padding:0}"
-"body{font-family:Arial,sans-serif;background:#1a1a2e;color:#eee;padding:10px}"
-"h1{color:#0f0;font-size:1.2em;margin-bottom:10px}"
-".btn{background:#16213e;border:1px solid #0f3460;color:#eee;padding:8px 12px;margin:3px;cursor:pointer;border-radius:4px;text-decoration:none;display:inline-block;font-size:0.9em}"
-".btn:hover{background:#0f3460}.btn-danger{background:#a00;border-color:#f00}"
-".btn-danger:hover{background:#c00}.btn-success{background:#0a0;border-color:#0f0}"
-"#stream{width:100%;max-width:640px;border:2px solid #0f3460;margin:10px 0}"
-"#stream-placeholder{width:100%;max-width:640px;height:300px;border:2px solid #0f3460;margin:10px 0;display:flex;align-items:center;justify-content:center;background:#0a0a1a;flex-direction:column}"
-".files{margin-top:15px}.file{background:#16213e;padding:8px;margin:5px 0;border-radius:4px;display:flex;justify-content:space-between;align-items:center;flex-wrap:wrap}"
-".file-name{flex:1;min-width:150px;word-break:break-all;cursor:pointer}.file-name:hover{color:#4af}.file-info{color:#888;font-size:0.8em;margin:0 10px}"
-".file-actions{display:flex;gap:5px}"
-"#viewer-modal{display:none;position:fixed;top:0;left:0;width:100%;height:100%;background:rgba(0,0,0,0.95);z-index:1000;align-items:center;justify-content:center;flex-direction:column}"
-"#viewer-modal.show{display:flex}"
-"#viewer-close{position:absolute;top:20px;right:30px;font-size:40px;color:#fff;cursor:pointer;z-index:1001}"
-"#viewer-close:hover{color:#f00}"
-"#viewer-content{max-width:90%;max-height:80%;display:flex;align-items:center;justify-content:center}"
-"#viewer-img{max-width:100%;max-height:80vh;border:2px solid #0f3460}"
-"#viewer-title{color:#fff;font-size:1.2em;margin-bottom:10px}"
-"#viewer-nav{display:flex;gap:20px;margin-top:15px}"
-"#viewer-nav button{padding:10px 20px;font-size:1em}"
-".tab{display:inline-block;padding:10px 15px;cursor:pointer;background:#16213e;border-radius:4px 4px 0 0}"
-".tab.active{background:#0f3460}.panel{display:none;padding:15px;background:#16213e;border-radius:0 4px 4px 4px}"
-".panel.active{display:block}.status{padding:5px 10px;border-radius:4px;margin:5px 0;font-size:0.85em}"
-".status-on{background:#0a0}.status-off{background:#a00}.status-warn{background:#a60}"
-".config-box{background:#0a0a1a;padding:15px;border-radius:8px;margin:10px 0}"
-".config-row{display:flex;align-items:center;gap:10px;margin:10px 0;flex-wrap:wrap}"
-".config-row label{min-width:150px}.config-row input,.config-row select{padding:8px;border-radius:4px;border:1px solid #0f3460;background:#16213e;color:#eee;width:180px}"
-".config-row input[type=number]{width:80px}"
-".radio-group{display:flex;gap:15px;margin:10px 0}.radio-group label{display:flex;align-items:center;gap:5px;cursor:pointer;min-width:auto}"
-".pass-container{position:relative;display:inline-flex;align-items:center}.pass-toggle{position:absolute;right:8px;background:none;border:none;color:#888;cursor:pointer;font-size:1.1em;padding:0}.pass-toggle:hover{color:#fff}"
-"@keyframes pulse{0%,100%{transform:scale(1);opacity:1}50%{transform:scale(1.2);opacity:0.7}}"
-"</style></head><body>"
-"<h1>🎥 Cámara Vigía</h1>"
-"<div><span class='tab active' onclick='showTab(0)'>📹 Stream</span><span class='tab' onclick='showTab(1)'>⚙️ Captura</span><span class='tab' onclick='showTab(2)'>📶 WiFi</span><span class='tab' onclick='showTab(3)'>📁 Archivos</span></div>"
-
-"<div class='panel active' id='p0'>"
-"<div class='status' id='stream-status'>Verificando...</div>"
-"<div id='stream-container'></div>"
-"<button class='btn btn-success' id='btn-live' onclick='forceStream()'>🔴 Ver en Vivo</button>"
-"<button class='btn' onclick='stopForce()'>⏹️ Detener</button>"
-"<button class='btn' onclick='checkStatus()'>🔄 Actualizar</button>"
-"</div>"
-
-"<div class='panel' id='p1'>"
-"<div class='config-box'>"
-"<h3>📷 Modo de Captura</h3>"
-"<div class='radio-group'>"
-"<label><input type='radio' name='cap-mode' value='0' checked> 📸 Foto</label>"
-"<label><input type='radio' name='cap-mode' value='1'> 🎬 Video</label>"
-"</div>"
-"<div id='video-opts' style='display:none'>"
-"<div class='config-row'><label>Duración video:</label><input type='number' id='vid-dur' min='5' max='60' value='10'><span style='color:#888'>segundos</span></div>"
-"<p style='color:#888;font-size:0.8em'>Graba secuencia de frames como video MJPEG. Mín 5s, máx 60s.</p>"
-"</div>"
-"</div>"
-"<div class='config-box'>"
-"<h3>⏱️ Tiempo de Emisión tras Movimiento</h3>"
-"<div class='config-row'><label>Segundos:</label><input type='number' id='emit-time' min='5' max='300' value='30'></div>"
-"<p style='color:#888;font-size:0.8em;margin-top:5px'>Tiempo de streaming cuando el PIR detecta movimiento. Mín 5s, máx 300s.</p>"
-"</div>"
-"<div class='config-box'>"
-"<h3>🔴 Tiempo de Vista en Vivo</h3>"
-"<div class='config-row'><label>Segundos:</label><input type='number' id='live-time' min='10' max='600' value='60'></div>"
-"<p style='color:#888;font-size:0.8em;margin-top:5px'>Tiempo máximo de transmisión manual. Mín 10s, máx 600s.</p>"
-"</div>"
-"<div style='text-align:center;margin:15px 0'><button class='btn btn-success' onclick='saveConfig()'>💾 Guardar Configuración</button></div>"
-"<div class='config-box'><h3>📊 Estado Actual</h3><div id='config-status'>Cargando...</div></div>"
-"</div>"
-
-"<div class='panel' id='p2'>"
-"<div class='status' id='wifi-status'>Cargando...</div>"
-"<div class='config-box'>"
-"<h3>� Modo de Red</h3>"
-"<div class='radio-group'>"
-"<label><input type='radio' name='wifi-mode' value='0'> 📶 WiFi (conectar a red)</label>"
-"<label><input type='radio' name='wifi-mode' value='1'> 📡 AP (crear red propia)</label>"
-"</div>"
-"</div>"
-"<div id='sta-config' class='config-box'>"
-"<h3>📶 Configurar WiFi (Estación)</h3>"
-"<div class='config-row'><label>SSID (Red):</label><input type='text' id='wifi-ssid' maxlength='32' placeholder='Nombre de red WiFi' pattern='[a-zA-Z0-9\\s\\-_]*' title='Permite letras, números, espacios y guiones'></div>"
-"<div class='config-row'><label>Contraseña:</label><div class='pass-container'><input type='password' id='wifi-pass' maxlength='64' placeholder='Contraseña WiFi'><button type='button' class='pass-toggle' onclick='togglePass(\"wifi-pass\")'>👁️</button></div></div>"
-"</div>"
-"<div id='ap-config' class='config-box' style='display:none'>"
-"<h3>📡 Configurar Access Point</h3>"
-"<div class='config-row'><label>Nombre de Red:</label><input type='text' id='ap-ssid' maxlength='32' placeholder='Nombre del AP' pattern='[a-zA-Z0-9\\s\\-_]*' title='Permite letras, números, espacios y guiones'></div>"
-"<div class='config-row'><label>Contraseña:</label><div class='pass-container'><input type='password' id='ap-pass' maxlength='64' placeholder='Contraseña (mín 8 chars)'><button type='button' class='pass-toggle' onclick='togglePass(\"ap-pass\")'>👁️</button></div></div>"
-"<p style='color:#888;font-size:0.8em'>IP del dispositivo en modo AP: 192.168.4.1</p>"
-"<button class='btn btn-danger' onclick='resetApCredentials()' style='margin-top:10px'>🔄 Resetear a valores por defecto</button>"
-"</div>"
-"<div style='text-align:center;margin:15px 0'>"
-"<button class='btn btn-success' onclick='saveWifi()'>💾 Guardar WiFi</button>"
-"<button class='btn' onclick='tryConnectWifi()' style='background:#06a'>📶 Conectar a WiFi</button>"
-"<button class='btn btn-danger' onclick='restartDevice()'>🔄 Reiniciar</button>"
-"</div>"
-"<p style='color:#f80;font-size:0.8em'>⚠️ Guarda la config primero, luego presiona 'Conectar a WiFi' para intentar conexión.</p>"
-"<div class='config-box'><h3>✅ Datos Guardados</h3><div id='wifi-saved-data' style='background:#0a0a1a;padding:10px;border-radius:4px;border-left:4px solid #0f0'></div></div>"
-"<div class='config-box'><h3>ℹ️ Info Actual</h3><div id='wifi-info'>Cargando...</div></div>"
-"</div>"
-
-"<div class='panel' id='p3'><div class='status' id='files-status'>Cargando...</div>"
-"<button class='btn' onclick='loadFiles()'>🔄 Actualizar</button>"
-"<button class='btn' onclick='mountSd()' style='background:#2a5'>💾 Montar SD</button>"
-"<button class='btn btn-danger' onclick='deleteAll()'>🗑️ Borrar Todo</button>"
-"<div class='config-box'>"
-"<h3>Formatear microSD (FAT32)</h3>"
-"<div class='status status-warn' id='format-warning'>ADVERTENCIA: Esto borra TODOS los archivos. No desconectes la camara durante el formateo.</div>"
-"<p style='color:#888;font-size:0.8em;margin-top:5px'>Usalo solo cuando la tarjeta tenga errores o antes de empezar un nuevo ciclo.</p>"
-"<button class='btn btn-danger' onclick='formatSd()' style='margin-top:8px'>Formatear microSD</button>"
-"<div class='status' id='format-result' style='display:none;margin-top:8px'></div>"
-"</div>"
-"<div class='files' id='files'></div></div>"
-
-"<div id='viewer-modal'>"
-"<span id='viewer-close' onclick='closeViewer()'>&times;</span>"
-"<div id='viewer-title'></div>"
-"<div id='viewer-content'>"
-"<img id='viewer-img' src='' alt='Visor'>"
-"</div>"
-"<div id='viewer-nav'>"
-"<button class='btn' onclick='viewerPrev()'>⬅️ Anterior</button>"
-"<button class='btn' onclick='viewerDownload()'>⬇️ Descargar</button>"
-"<button class='btn' onclick='viewerNext()'>Siguiente ➡️</button>"
-"</div>"
-"</div>"
-
-"<script>"
-"let streamActive=false,forceMode=false,statusInterval=null;"
-"let viewerFiles=[],viewerIndex=0;"
-
-"document.querySelectorAll('input[name=cap-mode]').forEach(r=>r.addEventListener('change',e=>{"
-"document.getElementById('video-opts').style.display=e.target.value=='1'?'block':'none';}));"
-
-"function showTab(n){document.querySelectorAll('.tab').forEach((t,i)=>t.classList.toggle('active',i==n));"
-"document.querySelectorAll('.panel').forEach((p,i)=>p.classList.toggle('active',i==n));"
-"if(n==0)checkStatus();if(n==1)loadConfig();if(n==2)loadWifi();if(n==3)loadFiles();}"
-
-"function checkStatus(){let ctrl=new AbortController();setTimeout(()=>ctrl.abort(),2000);"
-"fetch('/api/motion/status',{signal:ctrl.signal,cache:'no-store'}).then(r=>r.json()).then(d=>{"
-"streamActive=d.active;let st=document.getElementById('stream-status');"
-"let container=document.getElementById('stream-container');"
-"if(d.active){"
-"let modeStr=d.is_live?' (Vista en vivo)':' (Movimiento)';"
-"st.className='status status-on';st.textContent='🟢 TRANSMITIENDO'+modeStr;"
-"if(!container.innerHTML||container.innerHTML.indexOf('placeholder')>-1){"
-"container.innerHTML='<img id=\"stream\" src=\"/stream?t='+Date.now()+'\" alt=\"Video\">';}"
-"}else{"
-"st.className='status status-off';st.textContent='🔴 SIN TRANSMISIÓN - Esperando movimiento...';"
-"container.innerHTML='<div id=\"stream-placeholder\"><span style=\"font-size:3em\">📷</span><p>Cámara en espera</p><p style=\"color:#888;font-size:0.8em\">El video se activará cuando el sensor detecte movimiento</p></div>';"
-"}}).catch(e=>{if(e.name!=='AbortError')console.error(e);});}"
-
-"function forceStream(){fetch('/api/motion/force',{method:'POST'}).then(r=>r.json()).then(d=>{if(d.ok){forceMode=true;checkStatus();}});}"
-"function stopForce(){fetch('/api/motion/stop',{method:'POST'}).then(r=>r.json()).then(d=>checkStatus());}"
-
-"function loadConfig(){fetch('/api/motion/config').then(r=>r.json()).then(d=>{"
-"document.getElementById('emit-time').value=d.emission_time;"
-"document.getElementById('live-time').value=d.live_time;"
-"document.getElementById('vid-dur').value=d.video_duration||10;"
-"document.querySelectorAll('input[name=cap-mode]').forEach(r=>r.checked=(r.value==d.capture_mode));"
-"document.getElementById('video-opts').style.display=d.capture_mode==1?'block':'none';"
-"let modeStr=d.capture_mode==1?'🎬 Video ('+d.video_duration+'s)':'📸 Foto';"
-"document.getElementById('config-status').innerHTML="
-"'<p>Modo: <b>'+modeStr+'</b></p>'+"
-"'<p>⏱️ Movimiento: <b>'+d.emission_time+'</b>s | 🔴 En vivo: <b>'+d.live_time+'</b>s</p>'+"
-"'<p>Estado: '+(d.active?'<span style=\"color:#0f0\">Transmitiendo</span>':'<span style=\"color:#f00\">En espera</span>')+'</p>';});}"
-
-"function saveConfig(){let t=parseInt(document.getElementById('emit-time').value);"
-"let l=parseInt(document.getElementById('live-time').value);"
-"let m=document.querySelector('input[name=cap-mode]:checked').value;"
-"let v=parseInt(document.getElementById('vid-dur').value);"
-"if(t<5||t>300){showToast('❌ Tiempo movimiento: 5-300s','#a00');return;}"
-"if(l<10||l>600){showToast('❌ Tiempo en vivo: 10-600s','#a00');return;}"
-"if(m==1&&(v<5||v>60)){showToast('❌ Duración video: 5-60s','#a00');return;}"
-"fetch('/api/motion/config',{method:'POST',headers:{'Content-Type':'application/x-www-form-urlencoded'},"
-"body:'time='+t+'&live='+l+'&mode='+m+'&vdur='+v}).then(r=>r.json()).then(d=>{if(d.ok){"
-"showToast('✅ Configuración guardada','#0a0');"
-"}loadConfig();});}"
-
-"function loadWifi(){fetch('/api/wifi/status').then(r=>r.json()).then(d=>{"
-"let st=document.getElementById('wifi-status');"
-"if(d.connected){st.className='status status-on';st.textContent='✅ Conectado a: '+d.ssid;}"
-"else if(d.ap_mode){st.className='status status-warn';st.textContent='📡 Modo AP: '+d.ap_ssid;}"
-"else{st.className='status status-off';st.textContent='❌ Desconectado';}"
-"document.getElementById('wifi-ssid').value=d.ssid||'';"
-"document.getElementById('ap-ssid').value=d.ap_ssid||'';"
-"document.querySelectorAll('input[name=wifi-mode]').forEach(r=>r.checked=(r.value==d.preferred_mode));"
-"updateWifiForm(d.preferred_mode);"
-"let modeStr=d.preferred_mode==0?'📶 WiFi (Estación)':'📡 Access Point';"
-"let savedSsid=d.preferred_mode==0?d.ssid:d.ap_ssid;"
-"document.getElementById('wifi-saved-data').innerHTML="
-"'<p style=\"margin:5px 0\"><b>Modo:</b> '+modeStr+'</p>'+"
-"'<p style=\"margin:5px 0\"><b>SSID guardado:</b> '+(savedSsid||'(no configurado)')+'</p>'+"
-"'<p style=\"margin:5px 0;color:#f80\">ℹ️ Los datos fueron guardados en la memoria del dispositivo</p>';"
-"document.getElementById('wifi-info').innerHTML="
-"'<p>IP: <b>'+d.ip+'</b></p>'+"
-"'<p>Modo actual: <b>'+(d.ap_mode?'📡 Access Point':'📶 Estación')+'</b></p>'+"
-"'<p>Modo preferido: <b>'+(d.preferred_mode==1?'📡 AP (Red propia)':'📶 WiFi (Red externa)')+'</b></p>'+"
-"'<p>'+(d.ap_mode?'AP SSID: <b>'+d.ap_ssid+'</b>':'WiFi SSID: <b>'+d.ssid+'</b>')+'</p>';});}"
-
-"function updateWifiForm(mode){document.getElementById('sta-config').style.display=mode==0?'block':'none';"
-"document.getElementById('ap-config').style.display=mode==1?'block':'none';}"
-
-"document.querySelectorAll('input[name=wifi-mode]').forEach(r=>r.addEventListener('change',e=>updateWifiForm(e.target.value)));"
-
-"function saveWifi(){let mode=document.querySelector('input[name=wifi-mode]:checked').value;"
-"let s,p;"
-"if(mode=='0'){s=document.getElementById('wifi-ssid').value.trim();p=document.getElementById('wifi-pass').value;}"
-"else{s=document.getElementById('ap-ssid').value.trim();p=document.getElementById('ap-pass').value;}"
-"if(!s||s.length<1||s.length>32){showToast('❌ SSID inválido (1-32 caracteres)','#a00');return;}"
-"if(p.length>0&&p.length<8){showToast('❌ Contraseña muy corta (mín 8)','#a00');return;}"
-"fetch('/api/wifi/config',{method:'POST',headers:{'Content-Type':'application/x-www-form-urlencoded'},"
-"body:'mode='+mode+'&ssid='+encodeURIComponent(s)+'&pass='+encodeURIComponent(p)}).then(r=>r.json()).then(d=>{"
-"if(d.ok){showToast('✅ Configuración guardada\\nReinicie para aplicar','#0a0');"
-"let modeStr=mode==0?'📶 WiFi (Estación)':'📡 Access Point';"
-"let passDisplay=p?'••••••••':'(vacía)';"
-"document.getElementById('wifi-saved-data').innerHTML="
-"'<p style=\"margin:5px 0\"><b>Modo:</b> '+modeStr+'</p>'+"
-"'<p style=\"margin:5px 0\"><b>SSID:</b> '+s+'</p>'+"
-"'<p style=\"margin:5px 0\"><b>Contraseña:</b> '+passDisplay+'</p>'+"
-"'<p style=\"margin:5px 0;color:#0f0\">✅ Guardado correctamente</p>';"
-"loadWifi();}"
-"else{showToast('❌ Error guardando','#a00');}});}"
-
-"function restartDevice(){if(confirm('¿Reiniciar el dispositivo?')){"
-"fetch('/api/restart',{method:'POST'}).then(()=>showToast('🔄 Reiniciando...','#06a'));}}"
-
-"function togglePass(id){let inp=document.getElementById(id);if(inp.type==='password'){inp.type='text';}else{inp.type='password';}}"
-
-"function resetApCredentials(){if(confirm('¿Restaurar credenciales AP a valores por defecto?\\n\\nSSID: CamaraVigia_AP\\nContraseña: seguridad123')){"
-"fetch('/api/wifi/reset_ap',{method:'POST'}).then(r=>r.json()).then(d=>{if(d.ok){"
-"showToast('✅ Credenciales AP reseteadas\\nReinicie para aplicar','#0a0');loadWifi();}"
-"else{showToast('❌ Error reseteando','#a00');}});}}"
-
-"function tryConnectWifi(){showToast('📶 Intentando conectar a WiFi...','#06a');"
-"fetch('/api/wifi/connect',{method:'POST'}).then(r=>r.json()).then(d=>{if(d.ok){"
-"showConnectingBanner();checkWifiConnection(0);}"
-"else{showToast('❌ Error: '+d.error,'#a00');}});}"
-
-"function showConnectingBanner(){let b=document.createElement('div');b.id='connect-banner';"
-"b.style.cssText='position:fixed;top:0;left:0;width:100%;height:100%;background:rgba(0,0,0,0.85);display:flex;flex-direction:column;align-items:center;justify-content:center;z-index:10000';"
-"b.innerHTML='<div style=\"font-size:4em;animation:pulse 1s infinite\">📶</div><h2 style=\"color:#fff;margin:20px\">Conectando a WiFi...</h2><p id=\"connect-status\" style=\"color:#888\">Intento 1 de 10</p><p style=\"color:#666;font-size:0.8em\">Por favor espera...</p>';"
-"document.body.appendChild(b);}"
-
-"function checkWifiConnection(attempt){if(attempt>=10){"
-"document.getElementById('connect-banner').remove();"
-"showToast('❌ No se pudo conectar\\nVerifica las credenciales','#a00');loadWifi();return;}"
-"document.getElementById('connect-status').textContent='Intento '+(attempt+1)+' de 10';"
-"fetch('/api/wifi/status').then(r=>r.json()).then(d=>{if(d.connected){"
-"document.getElementById('connect-banner').innerHTML='<div style=\"font-size:4em\">✅</div><h2 style=\"color:#0f0;margin:20px\">¡CONECTADO!</h2><p style=\"color:#fff;font-size:1.2em\">Red: <b>'+d.ssid+'</b></p><p style=\"color:#0f0;font-size:1.5em\">IP: '+d.ip+'</p><p style=\"color:#888;margin-top:20px\">Esta ventana se cerrará en 3 segundos...</p>';"
-"setTimeout(()=>{document.getElementById('connect-banner').remove();loadWifi();},3000);}"
-"else{setTimeout(()=>checkWifiConnection(attempt+1),2000);}});}"
-
-"function showToast(msg,bg){let toast=document.createElement('div');"
-"toast.style.cssText='position:fixed;top:20px;left:50%;transform:translateX(-50%);background:'+(bg||'#0a0')+';color:#fff;padding:15px 25px;border-radius:8px;z-index:9999;font-size:1em;white-space:pre-line;text-align:center;box-shadow:0 4px 15px rgba(0,0,0,0.3);animation:fadeIn 0.3s';"
-"toast.textContent=msg;document.body.appendChild(toast);"
-"setTimeout(()=>{toast.style.opacity='0';toast.style.transition='opacity 0.5s';setTimeout(()=>toast.remove(),500);},3000);}"
-
-"function setFormatResult(msg,cls){let el=document.getElementById('format-result');"
-"if(!el)return;el.style.display='block';el.className='status '+cls;el.textContent=msg;}"
-
-"function formatSd(){"
-"let warn='FORMATEAR microSD?\\n\\nSe borraran TODOS los archivos.\\nNo desconectes la camara durante el proceso.';"
-"if(!confirm(warn))return;"
-"setFormatResult('Formateando microSD...','status-warn');"
-"fetch('/api/format_sd',{method:'POST'}).then(r=>r.json()).then(d=>{"
-"if(d&&d.ok){setFormatResult('RESULTADO: Formateo completo','status-on');loadFiles();return;}"
-"let err=(d&&d.error)?d.error:'no se pudo formatear';"
-"if(err==='ESP_ERR_INVALID_STATE')err='No se puede formatear durante streaming/captura';"
-"if(err==='ESP_ERR_TIMEOUT')err='Tiempo agotado. Revisa microSD y conexiones.';"
-"if(err==='ESP_ERR_NOT_SUPPORTED')err='MKFS no habilitado en FATFS';"
-"setFormatResult('RESULTADO: Error - '+err,'status-off');"
-"}).catch(()=>{setFormatResult('RESULTADO: Error de conexion','status-off');});}"
-
-
-"function loadFiles(){fetch('/api/files').then(r=>r.json()).then(d=>{"
-"if(d.error){"
-"document.getElementById('files-status').className='status status-off';"
-"document.getElementById('files-status').textContent=d.error;"
-"document.getElementById('files').innerHTML='';viewerFiles=[];return;}"
-"document.getElementById('files-status').className='status status-on';"
-"document.getElementById('files-status').textContent='Encontrados: '+d.count+' archivos ('+formatSize(d.total_size)+')';"
-"viewerFiles=d.files;"
-"let h='';d.files.forEach((f,i)=>{"
-"let icon=f.name.startsWith('VID_')?'🎬':'📷';"
-"h+='<div class=\"file\"><span class=\"file-name\" onclick=\"openViewer('+i+')\">'+icon+' '+f.name+'</span>';"
-"h+='<span class=\"file-info\">'+formatSize(f.size)+' | '+formatDate(f.mtime)+'</span>';"
-"h+='<div class=\"file-actions\"><button class=\"btn\" onclick=\"openViewer('+i+')\">👁️</button>';"
-"h+='<a class=\"btn\" href=\"/file?name='+encodeURIComponent(f.name)+'\" download>⬇️</a>';"
-"h+='<button class=\"btn btn-danger\" onclick=\"deleteFile(\\''+f.name+'\\');\">🗑️</button></div></div>';});"
-"document.getElementById('files').innerHTML=h||'<p>No hay archivos guardados</p>';}).catch(e=>{"
-"document.getElementById('files-status').className='status status-off';"
-"document.getElementById('files-status').textContent='❌ Error de conexión';});}"
-
-"function openViewer(idx){viewerIndex=idx;let f=viewerFiles[idx];if(!f)return;"
-"document.getElementById('viewer-title').textContent=f.name+' ('+formatSize(f.size)+')';"
-"document.getElementById('viewer-img').src='/file?name='+encodeURIComponent(f.name);"
-"document.getElementById('viewer-modal').classList.add('show');}"
-"function closeViewer(){document.getElementById('viewer-modal').classList.remove('show');document.getElementById('viewer-img').src='';}"
-"function viewerPrev(){if(viewerIndex>0)openViewer(viewerIndex-1);}"
-"function viewerNext(){if(viewerIndex<viewerFiles.length-1)openViewer(viewerIndex+1);}"
-"function viewerDownload(){let f=viewerFiles[viewerIndex];if(f)window.open('/file?name='+encodeURIComponent(f.name),'_blank');}"
-"document.addEventListener('keydown',e=>{if(document.getElementById('viewer-modal').classList.contains('show')){"
-"if(e.key==='Escape')closeViewer();if(e.key==='ArrowLeft')viewerPrev();if(e.key==='ArrowRight')viewerNext();}});"
-
-"function deleteFile(n){if(confirm('¿Borrar '+n+'?'))fetch('/api/delete?name='+encodeURIComponent(n),{method:'DELETE'})"
-".then(r=>r.json()).then(d=>{if(d&&d.ok){loadFiles();closeViewer();}else{alert('Error: '+(d.error||'No se pudo borrar'));}}).catch(()=>alert('Error de conexión'));}"
-"function mountSd(){document.getElementById('files-status').textContent='Montando SD...';"
-"fetch('/api/sd/reinit',{method:'POST'}).then(r=>r.json()).then(d=>{if(d&&d.ok){showToast('SD montada');loadFiles();}"
-"else{alert('Error: '+(d.error||'No se pudo montar'));}}).catch(()=>alert('Error de conexi\u00f3n'));"
-"document.getElementById('files-status').textContent='Listo';}"
-"function deleteAll(){if(confirm('¿BORRAR TODOS los archivos?'))fetch('/api/delete_all',{method:'DELETE'})"
-".then(r=>r.json()).then(d=>{if(d&&d.ok){loadFiles();showToast('Borrados '+d.deleted+' archivos');}else{alert('Error: '+(d.error||'No se pudo borrar'));}}).catch(()=>alert('Error de conexión'));}"
-"function formatSize(b){if(b<1024)return b+'B';if(b<1048576)return(b/1024).toFixed(1)+'KB';return(b/1048576).toFixed(1)+'MB';}"
-"function formatDate(t){let d=new Date(t*1000);return d.toLocaleDateString()+' '+d.toLocaleTimeString();}"
-
-"checkStatus();statusInterval=setInterval(checkStatus,1000);"
-"</script></body></html>";
+static esp_err_t camera_stats_handler(httpd_req_t *req) {
+    frame_bus_stats_t stats;
+    frame_bus_sub_stats_t subs[FRAME_BUS_MAX_SUBSCRIBERS];
+    frame_bus_get_stats(&stats);
+    int n = frame_bus_get_sub_stats(subs, FRAME_BUS_MAX_SUBSCRIBERS);
+
+    snapshot_stats_t snap;
+    snapshot_get_stats(&snap);
+
+    char response[1280];
+    int pos = snprintf(response, sizeof(response),
+        "{\"captured\":%lu,\"errors\":%lu,\"in_flight\":%d,"
+        "\"snapshot\":{\"hits\":%lu,\"captures\":%lu,\"stale\":%lu,\"waits\":%lu,\"errors\":%lu},\"subscribers\":[",
+        (unsigned long)stats.captured, (unsigned long)stats.errors, stats.in_flight,
+        (unsigned long)snap.hits, (unsigned long)snap.captures, (unsigned long)snap.stale,
+        (unsigned long)snap.waits, (unsigned long)snap.errors);
+    for (int i = 0; i < n && pos < (int)sizeof(response) - 160; i++) {
+        pos += snprintf(response + pos, sizeof(response) - pos,
+            "%s{\"name\":\"%s\",\"delivered\":%lu,\"dropped\":%lu,"
+            "\"hold_avg_us\":%lu,\"hold_max_us\":%lu,\"holding\":%s}",
+            i > 0 ? "," : "", subs[i].name,
+            (unsigned long)subs[i].delivered, (unsigned long)subs[i].dropped,
+            (unsigned long)subs[i].hold_avg_us, (unsigned long)subs[i].hold_max_us,
+            subs[i].holding ? "true" : "false");
+    }
+    pos += snprintf(response + pos, sizeof(response) - pos, "]}");
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, pos);
+    return ESP_OK;
+}
 
 // ============================================================================
-// COMPARADOR PARA ORDENAR POR FECHA (MÁS RECIENTE PRIMERO)
+// HANDLER: REGIÓN DE INTERÉS (recorte en el sensor)
 // ============================================================================
-static int compare_by_date(const void *a, const void *b) {
-    file_info_t *fa = (file_info_t *)a;
-    file_info_t *fb = (file_info_t *)b;
-    // Orden descendente (más reciente primero)
-    return (fb->mtime - fa->mtime);
+static esp_err_t camera_roi_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "enabled=0|1&x=N&y=N&w=N&h=N&zoom=1|2" (píxeles del frame 640x480)
+        char content[96] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
+        }
+
+        cam_roi_t roi;
+        cam_hal_get_roi(&roi, NULL, NULL);
+        char value[8];
+        if (httpd_query_key_value(content, "enabled", value, sizeof(value)) == ESP_OK) roi.enabled = atoi(value) != 0;
+        if (httpd_query_key_value(content, "x", value, sizeof(value)) == ESP_OK) roi.x = atoi(value);
+        if (httpd_query_key_value(content, "y", value, sizeof(value)) == ESP_OK) roi.y = atoi(value);
+        if (httpd_query_key_value(content, "w", value, sizeof(value)) == ESP_OK) roi.width = atoi(value);
+        if (httpd_query_key_value(content, "h", value, sizeof(value)) == ESP_OK) roi.height = atoi(value);
+        if (httpd_query_key_value(content, "zoom", value, sizeof(value)) == ESP_OK) roi.zoom = atoi(value);
+
+        esp_err_t err = cam_hal_set_roi(&roi);
+        if (err == ESP_ERR_INVALID_STATE) {
+            httpd_resp_set_status(req, "409 Conflict");
+            httpd_resp_sendstr(req, "Grabacion en curso: la region no se puede cambiar");
+            return ESP_OK;
+        }
+        if (err == ESP_ERR_NOT_SUPPORTED) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sensor sin soporte de ventana");
+            return ESP_FAIL;
+        }
+        if (err != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
+    }
+
+    cam_roi_t roi;
+    uint16_t out_w, out_h;
+    cam_hal_get_roi(&roi, &out_w, &out_h);
+
+    char response[160];
+    snprintf(response, sizeof(response),
+        "{\"enabled\":%s,\"x\":%u,\"y\":%u,\"w\":%u,\"h\":%u,\"zoom\":%u,"
+        "\"out_width\":%u,\"out_height\":%u}",
+        roi.enabled ? "true" : "false", roi.x, roi.y, roi.width, roi.height, roi.zoom,
+        out_w, out_h);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
 }
 
 // ============================================================================
-// HANDLER: PÁGINA PRINCIPAL
+// HANDLER: THROUGHPUT DEL STREAMING
 // ============================================================================
-static esp_err_t index_handler(httpd_req_t *req) {
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, HTML_INDEX, strlen(HTML_INDEX));
+static esp_err_t stream_stats_handler(httpd_req_t *req) {
+    stream_engine_stats_t st;
+    stream_engine_get_stats(&st);
+
+    admission_stats_t adm;
+    admission_get_stats(&adm);
+
+    char response[768];
+    int pos = snprintf(response, sizeof(response),
+        "{\"clients\":%d,\"ws_clients\":%d,\"width\":%u,\"height\":%u,\"frame_bytes\":%u,"
+        "\"fps\":%lu.%lu,\"bytes_per_sec\":%lu,\"total_frames\":%llu,\"total_bytes\":%llu,"
+        "\"substreams\":{",
+        st.clients, st.ws_clients, st.width, st.height, (unsigned)st.last_frame_len,
+        (unsigned long)(st.fps_x10 / 10), (unsigned long)(st.fps_x10 % 10),
+        (unsigned long)st.bytes_per_sec,
+        (unsigned long long)st.total_frames, (unsigned long long)st.total_bytes);
+    for (int size = STREAM_SIZE_QVGA; size < STREAM_SIZE_COUNT; size++) {
+        transcode_stats_t tc;
+        transcode_get_stats(size, &tc);
+        pos += snprintf(response + pos, sizeof(response) - pos,
+            "%s\"%s\":{\"clients\":%d,\"width\":%u,\"height\":%u,\"produced\":%lu,"
+            "\"busy_skips\":%lu,\"errors\":%lu,\"avg_us\":%lu}",
+            size > STREAM_SIZE_QVGA ? "," : "", transcode_size_name(size), tc.clients,
+            tc.width, tc.height, (unsigned long)tc.produced, (unsigned long)tc.busy_skips,
+            (unsigned long)tc.errors, (unsigned long)tc.avg_us);
+    }
+    snprintf(response + pos, sizeof(response) - pos,
+        "},\"sockets\":{\"max\":%d,\"open\":%d,\"streams\":%d,\"stream_budget\":%d,"
+        "\"rejected\":%lu,\"evicted\":%lu}}",
+        ADMISSION_MAX_SOCKETS, adm.open, adm.streams, ADMISSION_STREAM_BUDGET,
+        (unsigned long)adm.rejected, (unsigned long)adm.evicted);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
     return ESP_OK;
 }
 
 // ============================================================================
-// HANDLER: STREAM MJPEG (Con control de movimiento)
+// HANDLER: SESIONES DE STREAMING (quién consume el ancho de banda)
 // ============================================================================
-static esp_err_t stream_handler(httpd_req_t *req) {
-    // Verificar si el streaming está permitido
-    if (!http_server_is_streaming_active()) {
-        httpd_resp_set_type(req, "text/plain");
-        httpd_resp_send(req, "Stream inactivo - esperando movimiento", HTTPD_RESP_USE_STRLEN);
-        return ESP_OK;
+static esp_err_t stream_sessions_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "default_fps=N" (0 = sin tope)
+        char content[32] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        char *fps_str = (ret > 0) ? strstr(content, "default_fps=") : NULL;
+        if (!fps_str || stream_engine_set_default_fps(atoi(fps_str + 12)) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
     }
-    
-    camera_fb_t *fb = NULL;
-    esp_err_t res = ESP_OK;
-    char part_buf[128];
-    
-    // TCP_NODELAY para baja latencia
-    int sockfd = httpd_req_to_sockfd(req);
-    int nodelay = 1;
-    if (sockfd != -1) {
-        setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    stream_session_t sessions[STREAM_MAX_CLIENTS];
+    int n = stream_engine_get_sessions(sessions, STREAM_MAX_CLIENTS);
+
+    httpd_resp_set_type(req, "application/json");
+    char buf[320];
+    snprintf(buf, sizeof(buf), "{\"default_fps\":%d,\"sessions\":[", stream_engine_get_default_fps());
+    httpd_resp_sendstr_chunk(req, buf);
+    for (int i = 0; i < n; i++) {
+        const stream_session_t *ss = &sessions[i];
+        snprintf(buf, sizeof(buf),
+            "%s{\"fd\":%d,\"type\":\"%s\",\"size\":\"%s\",\"ip\":\"%s\",\"fps_cap\":%d,\"connected_s\":%lu,"
+            "\"frames_sent\":%lu,\"frames_skipped\":%lu,\"frames_capped\":%lu,\"frames_suppressed\":%lu,"
+            "\"frames_copied\":%lu,\"bytes_sent\":%llu,\"avg_send_us\":%lu}",
+            i ? "," : "", ss->fd, ss->ws ? "ws" : "mjpeg", transcode_size_name(ss->size), ss->ip, ss->fps_cap,
+            (unsigned long)ss->connected_s, (unsigned long)ss->frames_sent,
+            (unsigned long)ss->frames_skipped, (unsigned long)ss->frames_capped,
+            (unsigned long)ss->frames_suppressed, (unsigned long)ss->frames_copied,
+            (unsigned long long)ss->bytes_sent, (unsigned long)ss->avg_send_us);
+        httpd_resp_sendstr_chunk(req, buf);
     }
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_sendstr_chunk(req, NULL);
+    return ESP_OK;
+}
 
-    res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-    if(res != ESP_OK) return res;
+// ============================================================================
+// HANDLER: SUPRESIÓN DE ESCENA ESTÁTICA
+// ============================================================================
+static esp_err_t stream_static_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "enabled=0|1&tolerance=N&keepalive=S"
+        char content[64] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
+        }
 
-    ESP_LOGI(TAG, "Stream iniciado");
+        still_status_t cur;
+        still_get_status(&cur);
+        bool enabled = cur.enabled;
+        int tolerance = cur.tolerance_permille;
+        int keepalive = cur.keepalive_s;
+
+        char *en_str = strstr(content, "enabled=");
+        char *tol_str = strstr(content, "tolerance=");
+        char *ka_str = strstr(content, "keepalive=");
+        if (en_str) enabled = atoi(en_str + 8) != 0;
+        if (tol_str) tolerance = atoi(tol_str + 10);
+        if (ka_str) keepalive = atoi(ka_str + 10);
+
+        esp_err_t err = still_configure(enabled, tolerance, keepalive);
+        if (err == ESP_ERR_INVALID_STATE) {
+            httpd_resp_set_status(req, "409 Conflict");
+            httpd_resp_sendstr(req, "Requiere el detector de movimiento activo");
+            return ESP_OK;
+        }
+        if (err != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
+    }
+
+    still_status_t st;
+    still_get_status(&st);
+
+    char response[192];
+    snprintf(response, sizeof(response),
+        "{\"enabled\":%s,\"active\":%s,\"tolerance_permille\":%d,\"keepalive_s\":%d,"
+        "\"frames_suppressed\":%lu,\"bytes_saved\":%llu}",
+        st.enabled ? "true" : "false", st.active ? "true" : "false",
+        st.tolerance_permille, st.keepalive_s,
+        (unsigned long)st.frames_suppressed, (unsigned long long)st.bytes_saved);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
 
-    while(true) {
-        // Verificar si debemos seguir transmitiendo
-        if (!http_server_is_streaming_active()) {
-            ESP_LOGI(TAG, "Stream detenido - tiempo de emisión expirado");
-            break;
+// ============================================================================
+// HANDLER: MULTICAST UDP
+// ============================================================================
+static esp_err_t multicast_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "enabled=0|1&group=239.x.x.x&port=N&ttl=N"
+        char content[96] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
         }
-        
-        fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGE(TAG, "Fallo camara");
-            res = ESP_FAIL;
-            break;
+
+        mcast_stream_status_t cur;
+        mcast_stream_get_status(&cur);
+        bool enabled = cur.enabled;
+        int port = cur.port;
+        int ttl = cur.ttl;
+        char group[16];
+        strncpy(group, cur.group, sizeof(group));
+
+        char value[16];
+        if (httpd_query_key_value(content, "enabled", value, sizeof(value)) == ESP_OK) enabled = atoi(value) != 0;
+        if (httpd_query_key_value(content, "group", value, sizeof(value)) == ESP_OK) strncpy(group, value, sizeof(group));
+        if (httpd_query_key_value(content, "port", value, sizeof(value)) == ESP_OK) port = atoi(value);
+        if (httpd_query_key_value(content, "ttl", value, sizeof(value)) == ESP_OK) ttl = atoi(value);
+        group[sizeof(group) - 1] = '\0';
+
+        if (port <= 0 || port > 65535 || ttl <= 0 || ttl > 255 ||
+            mcast_stream_configure(enabled, group, port, ttl) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
         }
+    }
 
-        size_t hlen = snprintf(part_buf, sizeof(part_buf), 
-            "%sContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", 
-            _STREAM_BOUNDARY, fb->len);
-        
-        if(res == ESP_OK) res = httpd_resp_send_chunk(req, part_buf, hlen);
-        if(res == ESP_OK) res = httpd_resp_send_chunk(req, (const char *)fb->buf, fb->len);
+    mcast_stream_status_t st;
+    mcast_stream_get_status(&st);
+
+    char response[256];
+    snprintf(response, sizeof(response),
+        "{\"enabled\":%s,\"group\":\"%s\",\"port\":%u,\"ttl\":%u,\"frames_sent\":%lu,"
+        "\"datagrams_sent\":%lu,\"datagrams_dropped\":%lu,\"bytes_sent\":%llu}",
+        st.enabled ? "true" : "false", st.group, st.port, st.ttl,
+        (unsigned long)st.frames_sent, (unsigned long)st.datagrams_sent,
+        (unsigned long)st.datagrams_dropped, (unsigned long long)st.bytes_sent);
 
-        esp_camera_fb_return(fb);
-        fb = NULL;
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
 
-        if(res != ESP_OK) break;
+// ============================================================================
+// HANDLER: CONTROL ADAPTATIVO DE BITRATE
+// ============================================================================
+static esp_err_t stream_abr_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "enabled=0|1&fps=N"
+        char content[64] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
+        }
+
+        abr_status_t cur;
+        abr_get_status(&cur);
+        bool enabled = cur.enabled;
+        int fps = cur.target_fps;
+
+        char *en_str = strstr(content, "enabled=");
+        char *fps_str = strstr(content, "fps=");
+        if (en_str) enabled = atoi(en_str + 8) != 0;
+        if (fps_str) fps = atoi(fps_str + 4);
+
+        if (abr_configure(enabled, fps) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
     }
-    
-    ESP_LOGI(TAG, "Stream terminado");
-    return res;
+
+    abr_status_t st;
+    abr_get_status(&st);
+
+    char response[320];
+    snprintf(response, sizeof(response),
+        "{\"enabled\":%s,\"target_fps\":%d,\"step\":%d,\"steps\":%d,\"width\":%u,\"height\":%u,"
+        "\"quality\":%d,\"size_held\":%s,\"avg_send_us\":%lu,\"skip_pct\":%lu,\"max_backlog\":%lu,"
+        "\"changes\":%lu}",
+        st.enabled ? "true" : "false", st.target_fps, st.step, st.step_count,
+        st.width, st.height, st.quality, st.size_held ? "true" : "false", (unsigned long)st.avg_send_us,
+        (unsigned long)st.skip_pct, (unsigned long)st.max_backlog, (unsigned long)st.changes);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
 }
 
 // ============================================================================
 // HANDLER: LISTAR ARCHIVOS (JSON)
 // ============================================================================
+// Sale del catálogo (ver catalog.h), no del directorio: una página cuesta lo
+// mismo con 10 archivos que con 10000.
+// ?offset=N&limit=N&sort=date|name|size&type=all|photo|video|burst|timelapse|dvr|other&rescan=1
 static esp_err_t files_handler(httpd_req_t *req) {
-    ESP_LOGI(TAG, "Solicitud de lista de archivos recibida");
-    
     // Verificar primero si la SD está montada
     if (!sd_card_is_mounted()) {
         ESP_LOGW(TAG, "SD no montada - respondiendo error");
@@ -585,78 +601,149 @@ static esp_err_t files_handler(httpd_req_t *req) {
         httpd_resp_sendstr(req, "{\"count\":0,\"total_size\":0,\"files\":[],\"error\":\"💾 Tarjeta SD no montada. Verifica que esté insertada.\"}");
         return ESP_OK;
     }
-    
-    DIR *dir = opendir(MOUNT_POINT);
-    if (!dir) {
-        ESP_LOGW(TAG, "No se pudo abrir %s - SD no disponible", MOUNT_POINT);
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"count\":0,\"total_size\":0,\"files\":[],\"error\":\"💾 Error al acceder a la tarjeta SD.\"}");
-        return ESP_OK;
+
+    catalog_query_t q = {
+        .offset = 0,
+        .limit = FILES_PAGE_DEFAULT,
+        .sort = CATALOG_SORT_DATE,
+        .type = CATALOG_TYPE_ALL,
+    };
+    char query[128];
+    char value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "offset", value, sizeof(value)) == ESP_OK) q.offset = strtoul(value, NULL, 10);
+        if (httpd_query_key_value(query, "limit", value, sizeof(value)) == ESP_OK) q.limit = strtoul(value, NULL, 10);
+        if (httpd_query_key_value(query, "sort", value, sizeof(value)) == ESP_OK &&
+            !catalog_parse_sort(value, &q.sort)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "sort invalido");
+            return ESP_FAIL;
+        }
+        if (httpd_query_key_value(query, "type", value, sizeof(value)) == ESP_OK &&
+            !catalog_parse_type(value, &q.type)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "type invalido");
+            return ESP_FAIL;
+        }
+        if (httpd_query_key_value(query, "rescan", value, sizeof(value)) == ESP_OK && atoi(value)) {
+            catalog_rebuild();
+        }
     }
-    ESP_LOGI(TAG, "Directorio %s abierto correctamente", MOUNT_POINT);
+    if (q.limit == 0 || q.limit > FILES_PAGE_MAX) q.limit = FILES_PAGE_MAX;
 
-    file_info_t *files = malloc(sizeof(file_info_t) * MAX_FILES);
-    if (!files) {
-        closedir(dir);
+    catalog_entry_t *page = malloc(sizeof(catalog_entry_t) * q.limit);
+    if (!page) {
         httpd_resp_set_type(req, "application/json");
         httpd_resp_sendstr(req, "{\"count\":0,\"total_size\":0,\"files\":[],\"error\":\"⚠️ Sin memoria disponible\"}");
         return ESP_OK;
     }
+    catalog_summary_t sum;
+    int n = catalog_query(&q, page, &sum);
 
-    int count = 0;
-    size_t total_size = 0;
-    struct dirent *entry;
-    struct stat st;
-    char filepath[320];
+    // Generar JSON en chunks de ~1 KB
+    httpd_resp_set_type(req, "application/json");
+    char buf[1024];
+    int pos = snprintf(buf, sizeof(buf),
+        "{\"count\":%lu,\"total_size\":%llu,\"offset\":%lu,\"limit\":%lu,\"entries\":%lu,"
+        "\"rebuild_ms\":%lu,\"files\":[",
+        (unsigned long)sum.matched, (unsigned long long)sum.matched_size, (unsigned long)q.offset,
+        (unsigned long)q.limit, (unsigned long)sum.entries, (unsigned long)sum.rebuild_ms);
+
+    for (int i = 0; i < n; i++) {
+        if (pos > (int)sizeof(buf) - 160) {
+            httpd_resp_send_chunk(req, buf, pos);
+            pos = 0;
+        }
+        pos += snprintf(buf + pos, sizeof(buf) - pos,
+            "%s{\"name\":\"%s\",\"size\":%lu,\"mtime\":%lu,\"seq\":%lu,\"type\":\"%s\"}",
+            i > 0 ? "," : "", page[i].name, (unsigned long)page[i].size,
+            (unsigned long)page[i].mtime, (unsigned long)page[i].seq, catalog_type_name(page[i].type));
+    }
+    pos += snprintf(buf + pos, sizeof(buf) - pos, "]}");
+    httpd_resp_send_chunk(req, buf, pos);
+    httpd_resp_send_chunk(req, NULL, 0);
 
-    while ((entry = readdir(dir)) != NULL && count < MAX_FILES) {
-        // Ignorar directorios y archivos ocultos
-        if (entry->d_type == DT_DIR || entry->d_name[0] == '.') continue;
-        
-        snprintf(filepath, sizeof(filepath), "%s/%s", MOUNT_POINT, entry->d_name);
-        if (stat(filepath, &st) == 0) {
-            strncpy(files[count].name, entry->d_name, sizeof(files[count].name) - 1);
-            files[count].size = st.st_size;
-            files[count].mtime = st.st_mtime;
-            total_size += st.st_size;
-            count++;
+    free(page);
+    return ESP_OK;
+}
+
+// ============================================================================
+// HANDLER: DESCARGAR/VER ARCHIVO
+// ============================================================================
+// Grabación ENC2 (cifrado CTR): se descifra al vuelo y acepta Range, así un
+// reproductor puede saltar usando el índice del AVI sin bajar todo el archivo.
+static esp_err_t send_stream_file(httpd_req_t *req, crypto_reader_t *reader, const char *filename) {
+    uint64_t size = crypto_reader_size(reader);
+    uint64_t start = 0;
+    uint64_t end = size ? size - 1 : 0;
+    bool partial = false;
+
+    char range[48];
+    if (size && httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) == ESP_OK &&
+        strncmp(range, "bytes=", 6) == 0) {
+        char *dash = strchr(range + 6, '-');
+        if (dash) {
+            *dash = '\0';
+            if (range[6]) {
+                start = strtoull(range + 6, NULL, 10);
+                if (dash[1]) end = strtoull(dash + 1, NULL, 10);
+            } else if (dash[1]) {
+                // "bytes=-N": los últimos N bytes
+                uint64_t n = strtoull(dash + 1, NULL, 10);
+                start = n < size ? size - n : 0;
+            }
+            if (end >= size) end = size - 1;
+            if (start > end) {
+                char cr[48];
+                snprintf(cr, sizeof(cr), "bytes */%llu", (unsigned long long)size);
+                httpd_resp_set_status(req, "416 Range Not Satisfiable");
+                httpd_resp_set_hdr(req, "Content-Range", cr);
+                httpd_resp_send(req, NULL, 0);
+                crypto_reader_close(reader);
+                return ESP_OK;
+            }
+            partial = true;
         }
     }
-    closedir(dir);
 
-    // Ordenar por fecha (más reciente primero)
-    qsort(files, count, sizeof(file_info_t), compare_by_date);
+    // Tipo según el nombre sin .enc (VID_00000012.avi.enc → .avi)
+    char inner[64];
+    snprintf(inner, sizeof(inner), "%s", filename);
+    char *dot = strrchr(inner, '.');
+    if (dot) *dot = '\0';
+    const char *ext = strrchr(inner, '.');
+    httpd_resp_set_type(req, ext && strcasecmp(ext, ".avi") == 0 ? "video/x-msvideo"
+                           : "application/octet-stream");
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+
+    char cr[64];
+    if (partial) {
+        snprintf(cr, sizeof(cr), "bytes %llu-%llu/%llu", (unsigned long long)start,
+                 (unsigned long long)end, (unsigned long long)size);
+        httpd_resp_set_status(req, "206 Partial Content");
+        httpd_resp_set_hdr(req, "Content-Range", cr);
+    }
 
-    // Generar JSON
-    httpd_resp_set_type(req, "application/json");
-    
-    char *json = malloc(4096);
-    if (!json) {
-        free(files);
+    uint8_t *buf = malloc(4096);
+    if (!buf) {
+        crypto_reader_close(reader);
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Sin memoria");
         return ESP_FAIL;
     }
 
-    int pos = snprintf(json, 4096, "{\"count\":%d,\"total_size\":%zu,\"files\":[", count, total_size);
-    
-    for (int i = 0; i < count && pos < 3900; i++) {
-        pos += snprintf(json + pos, 4096 - pos, 
-            "%s{\"name\":\"%s\",\"size\":%zu,\"mtime\":%ld}",
-            i > 0 ? "," : "", files[i].name, files[i].size, (long)files[i].mtime);
+    uint64_t pos = start;
+    while (size && pos <= end) {
+        size_t want = (end - pos + 1) > 4096 ? 4096 : (size_t)(end - pos + 1);
+        int n = crypto_reader_read(reader, pos, buf, want);
+        if (n <= 0) break;
+        if (httpd_resp_send_chunk(req, (const char *)buf, n) != ESP_OK) break;
+        pos += n;
     }
-    
-    pos += snprintf(json + pos, 4096 - pos, "]}");
-    
-    httpd_resp_send(req, json, pos);
-    
-    free(json);
-    free(files);
+    httpd_resp_send_chunk(req, NULL, 0);
+
+    free(buf);
+    crypto_reader_close(reader);
     return ESP_OK;
 }
 
-// ============================================================================
-// HANDLER: DESCARGAR/VER ARCHIVO
-// ============================================================================
 static esp_err_t file_handler(httpd_req_t *req) {
     char filepath[320];
     char query[64] = {0};
@@ -681,11 +768,17 @@ static esp_err_t file_handler(httpd_req_t *req) {
     // Detectar extensión del archivo
     const char *ext = strrchr(filename, '.');
     
-    // Archivo normal (no encriptado)
     snprintf(filepath, sizeof(filepath), "%s/%s", MOUNT_POINT, filename);
-    
+
+    if (ext && strcasecmp(ext, ".enc") == 0) {
+        crypto_reader_t *reader = crypto_reader_open(filepath);
+        if (reader) return send_stream_file(req, reader, filename);
+    }
+
+    // Archivo normal (no encriptado)
     FILE *f = fopen(filepath, "rb");
     if (!f) {
+        catalog_remove(filename);   // Ya no está: que no vuelva a listarse
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Archivo no encontrado");
         return ESP_FAIL;
     }
@@ -740,10 +833,17 @@ static esp_err_t delete_handler(httpd_req_t *req) {
         return ESP_OK;
     }
 
+    // FatFs sin FF_FS_LOCK no impide borrar un archivo abierto
+    if (capture_svc_file_in_use(filename)) {
+        httpd_resp_sendstr(req, "{\"ok\":false,\"error\":\"El archivo se esta grabando\"}");
+        return ESP_OK;
+    }
+
     snprintf(filepath, sizeof(filepath), "%s/%s", MOUNT_POINT, filename);
     
     if (remove(filepath) == 0) {
         ESP_LOGI(TAG, "Archivo borrado: %s", filename);
+        catalog_remove(filename);
         httpd_resp_sendstr(req, "{\"ok\":true}");
     } else {
         ESP_LOGW(TAG, "No se pudo borrar: %s", filename);
@@ -758,10 +858,22 @@ static esp_err_t delete_handler(httpd_req_t *req) {
 // ============================================================================
 static esp_err_t delete_all_handler(httpd_req_t *req) {
     httpd_resp_set_type(req, "application/json");
-    
+
+    // Un video en curso tiene el archivo abierto hasta el final del clip
+    capture_svc_stats_t cs;
+    capture_svc_get_stats(&cs);
+    if (cs.busy) {
+        httpd_resp_sendstr(req, "{\"ok\":false,\"error\":\"Captura en curso, reintentar al terminar\",\"deleted\":0}");
+        return ESP_OK;
+    }
+
+    // El segmento DVR abierto se cierra antes de borrar
+    bool dvr_was_active = capture_svc_pause_dvr();
+
     DIR *dir = opendir(MOUNT_POINT);
     if (!dir) {
         ESP_LOGW(TAG, "delete_all: No se puede abrir SD");
+        if (dvr_was_active) capture_svc_set_dvr_active(true);
         httpd_resp_sendstr(req, "{\"ok\":false,\"error\":\"Tarjeta SD no disponible\",\"deleted\":0}");
         return ESP_OK;
     }
@@ -769,9 +881,15 @@ static esp_err_t delete_all_handler(httpd_req_t *req) {
     struct dirent *entry;
     char filepath[320];
     int deleted = 0;
+    int kept = 0;
 
     while ((entry = readdir(dir)) != NULL) {
         if (entry->d_type == DT_REG && entry->d_name[0] != '.') {
+            // Lo que haya empezado en el medio (time-lapse, un video recién arrancado)
+            if (capture_svc_file_in_use(entry->d_name)) {
+                kept++;
+                continue;
+            }
             snprintf(filepath, sizeof(filepath), "%s/%s", MOUNT_POINT, entry->d_name);
             if (remove(filepath) == 0) {
                 deleted++;
@@ -779,6 +897,9 @@ static esp_err_t delete_all_handler(httpd_req_t *req) {
         }
     }
     closedir(dir);
+    if (kept) catalog_rebuild();
+    else catalog_clear();
+    if (dvr_was_active) capture_svc_set_dvr_active(true);
 
     ESP_LOGI(TAG, "Borrados %d archivos", deleted);
     
@@ -800,7 +921,11 @@ static esp_err_t format_sd_handler(httpd_req_t *req) {
         return ESP_OK;
     }
 
+    // Sin archivos abiertos en la SD mientras se formatea
+    bool dvr_was_active = capture_svc_pause_dvr();
     esp_err_t ret = sd_card_format();
+    catalog_mount();    // sd_card_format remonta aun si falla
+    if (dvr_was_active) capture_svc_set_dvr_active(true);
     if (ret == ESP_OK) {
         httpd_resp_sendstr(req, "{\"ok\":true}");
         return ESP_OK;
@@ -825,7 +950,11 @@ static esp_err_t sd_reinit_handler(httpd_req_t *req) {
         return ESP_OK;
     }
 
+    bool dvr_was_active = capture_svc_pause_dvr();
     esp_err_t ret = sd_card_reinit();
+    if (ret == ESP_OK) catalog_mount();
+    // Si la SD no volvió, la tarea DVR espera el montaje por su cuenta
+    if (dvr_was_active) capture_svc_set_dvr_active(true);
     if (ret == ESP_OK) {
         httpd_resp_sendstr(req, "{\"ok\":true,\"msg\":\"SD reconectada exitosamente\"}");
         return ESP_OK;
@@ -860,16 +989,27 @@ static esp_err_t favicon_handler(httpd_req_t *req) {
 // HANDLERS: API DE CONTROL DE MOVIMIENTO
 // ============================================================================
 
-// Estado del streaming
-static esp_err_t motion_status_handler(httpd_req_t *req) {
-    char response[128];
+// Estado completo (lo usan /api/motion/status y el canal SSE)
+static int build_status_json(char *buf, size_t len) {
+    char ip[16] = {0};
+    wifi_net_get_ip(ip, sizeof(ip));
     bool active = http_server_is_streaming_active();
     int remaining = http_server_get_remaining_time();
-    
-    snprintf(response, sizeof(response), 
-        "{\"active\":%s,\"remaining\":%d,\"is_live\":%s,\"emission_time\":%d}",
-        active ? "true" : "false", remaining, 
-        g_force_stream ? "true" : "false", g_emission_time_sec);
+
+    return snprintf(buf, len,
+        "{\"active\":%s,\"remaining\":%d,\"is_live\":%s,\"emission_time\":%d,"
+        "\"sd\":%s,\"wifi_connected\":%s,\"ap_mode\":%s,\"ip\":\"%s\"}",
+        active ? "true" : "false", remaining,
+        g_force_stream ? "true" : "false", g_emission_time_sec,
+        sd_card_is_mounted() ? "true" : "false",
+        wifi_net_is_connected() ? "true" : "false",
+        wifi_net_is_ap_mode() ? "true" : "false", ip);
+}
+
+// Estado del streaming
+static esp_err_t motion_status_handler(httpd_req_t *req) {
+    char response[256];
+    build_status_json(response, sizeof(response));
     
     httpd_resp_set_type(req, "application/json");
     httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
@@ -882,10 +1022,11 @@ static esp_err_t motion_status_handler(httpd_req_t *req) {
 static esp_err_t motion_config_handler(httpd_req_t *req) {
     if (req->method == HTTP_GET) {
         // GET: Devolver configuración actual
-        char response[200];
+        char response[220];
         snprintf(response, sizeof(response), 
-            "{\"emission_time\":%d,\"live_time\":%d,\"capture_mode\":%d,\"video_duration\":%d,\"active\":%s}",
+            "{\"emission_time\":%d,\"live_time\":%d,\"capture_mode\":%d,\"video_duration\":%d,\"record_fps\":%lu,\"active\":%s}",
             g_emission_time_sec, g_live_time_sec, (int)g_capture_mode, g_video_duration_sec,
+            (unsigned long)capture_svc_get_record_fps(),
             http_server_is_streaming_active() ? "true" : "false");
         
         httpd_resp_set_type(req, "application/json");
@@ -899,11 +1040,12 @@ static esp_err_t motion_config_handler(httpd_req_t *req) {
             return ESP_FAIL;
         }
         
-        // Parsear "time=XX&live=YY&mode=Z&vdur=W"
+        // Parsear "time=XX&live=YY&mode=Z&vdur=W&rfps=F"
         char *time_str = strstr(content, "time=");
         char *live_str = strstr(content, "live=");
         char *mode_str = strstr(content, "mode=");
         char *vdur_str = strstr(content, "vdur=");
+        char *rfps_str = strstr(content, "rfps=");
         
         bool updated = false;
         if (time_str) {
@@ -922,8 +1064,10 @@ static esp_err_t motion_config_handler(httpd_req_t *req) {
         }
         if (mode_str) {
             int new_mode = atoi(mode_str + 5);
-            if (new_mode == 0 || new_mode == 1) {
+            if (new_mode >= CAPTURE_MODE_PHOTO && new_mode <= CAPTURE_MODE_CONTINUOUS) {
                 g_capture_mode = (capture_mode_t)new_mode;
+                capture_svc_set_timelapse_active(g_capture_mode == CAPTURE_MODE_TIMELAPSE);
+                capture_svc_set_dvr_active(g_capture_mode == CAPTURE_MODE_CONTINUOUS);
                 updated = true;
             }
         }
@@ -934,6 +1078,10 @@ static esp_err_t motion_config_handler(httpd_req_t *req) {
                 updated = true;
             }
         }
+        // Lo guarda el servicio de captura (también lo usa la grabación continua)
+        if (rfps_str && capture_svc_set_record_fps(atoi(rfps_str + 5)) == ESP_OK) {
+            updated = true;
+        }
         
         if (updated) {
             save_motion_config();
@@ -947,6 +1095,344 @@ static esp_err_t motion_config_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// ============================================================================
+// HANDLER: DETECTOR DE MOVIMIENTO POR SOFTWARE
+// ============================================================================
+// La máscara viaja como 12 filas de 4 dígitos hex (bit x = celda x ignorada)
+static bool parse_motion_mask(const char *hex, uint16_t *mask) {
+    if (strlen(hex) != MOTION_GRID_H * 4) return false;
+    for (int row = 0; row < MOTION_GRID_H; row++) {
+        char digits[5] = {0};
+        memcpy(digits, hex + row * 4, 4);
+        char *end;
+        unsigned long v = strtoul(digits, &end, 16);
+        if (*end != '\0') return false;
+        mask[row] = (uint16_t)v;
+    }
+    return true;
+}
+
+static void format_motion_mask(const uint16_t *mask, char *out) {
+    for (int row = 0; row < MOTION_GRID_H; row++) {
+        sprintf(out + row * 4, "%04x", mask[row]);
+    }
+}
+
+static esp_err_t motion_detector_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "enabled=0|1&threshold=N&area=‰&frames=N&learn=N&mask=<48 hex>"
+        char content[160] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
+        }
+
+        motion_detect_config_t cfg;
+        motion_detect_get_config(&cfg);
+        char value[MOTION_GRID_H * 4 + 1];
+        bool ok = true;
+        if (httpd_query_key_value(content, "enabled", value, sizeof(value)) == ESP_OK) cfg.enabled = atoi(value) != 0;
+        if (httpd_query_key_value(content, "threshold", value, sizeof(value)) == ESP_OK) cfg.params.pixel_threshold = atoi(value);
+        if (httpd_query_key_value(content, "area", value, sizeof(value)) == ESP_OK) cfg.params.area_permille = atoi(value);
+        if (httpd_query_key_value(content, "frames", value, sizeof(value)) == ESP_OK) cfg.params.min_frames = atoi(value);
+        if (httpd_query_key_value(content, "learn", value, sizeof(value)) == ESP_OK) cfg.params.learn_shift = atoi(value);
+        if (httpd_query_key_value(content, "mask", value, sizeof(value)) == ESP_OK) ok = parse_motion_mask(value, cfg.params.mask);
+
+        if (!ok || motion_detect_configure(&cfg) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
+    }
+
+    motion_detect_config_t cfg;
+    motion_detect_status_t st;
+    motion_detect_get_config(&cfg);
+    motion_detect_get_status(&st);
+    char mask[MOTION_GRID_H * 4 + 1];
+    char cells[MOTION_GRID_H * 4 + 1];
+    format_motion_mask(cfg.params.mask, mask);
+    format_motion_mask(st.cells, cells);
+
+    char response[512];
+    snprintf(response, sizeof(response),
+        "{\"enabled\":%s,\"threshold\":%u,\"area\":%u,\"frames\":%u,\"learn\":%u,\"mask\":\"%s\","
+        "\"motion\":%s,\"area_now\":%u,\"cells\":\"%s\",\"width\":%u,\"height\":%u,"
+        "\"analyzed\":%lu,\"events\":%lu,\"light_resets\":%lu,\"errors\":%lu,\"avg_us\":%lu}",
+        cfg.enabled ? "true" : "false", cfg.params.pixel_threshold, cfg.params.area_permille,
+        cfg.params.min_frames, cfg.params.learn_shift, mask,
+        st.motion ? "true" : "false", st.area_permille, cells, st.width, st.height,
+        (unsigned long)st.frames, (unsigned long)st.events, (unsigned long)st.light_resets,
+        (unsigned long)st.errors, (unsigned long)st.avg_us);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
+
+// ============================================================================
+// HANDLER: PRE-EVENTO (anillo en PSRAM volcado al inicio de cada video)
+// ============================================================================
+static esp_err_t preroll_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "seconds=N&budget_kb=N&policy=drop_oldest|keep_span"
+        char content[96] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
+        }
+
+        preroll_config_t cfg;
+        preroll_get_config(&cfg);
+        char value[16];
+        bool ok = true;
+        if (httpd_query_key_value(content, "seconds", value, sizeof(value)) == ESP_OK) cfg.seconds = atoi(value);
+        if (httpd_query_key_value(content, "budget_kb", value, sizeof(value)) == ESP_OK) cfg.budget_kb = atoi(value);
+        if (httpd_query_key_value(content, "policy", value, sizeof(value)) == ESP_OK) {
+            if (strcmp(value, "drop_oldest") == 0) cfg.policy = PREROLL_POLICY_DROP_OLDEST;
+            else if (strcmp(value, "keep_span") == 0) cfg.policy = PREROLL_POLICY_KEEP_SPAN;
+            else ok = false;
+        }
+
+        if (!ok || preroll_configure(&cfg) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
+    }
+
+    preroll_status_t st;
+    preroll_get_status(&st);
+
+    char response[320];
+    snprintf(response, sizeof(response),
+        "{\"seconds\":%u,\"budget_kb\":%u,\"policy\":\"%s\",\"allocated\":%s,"
+        "\"frames\":%d,\"bytes_used\":%lu,\"span_ms\":%lu,\"stride\":%u,"
+        "\"stored\":%lu,\"evicted\":%lu,\"busy_drops\":%lu}",
+        st.cfg.seconds, st.cfg.budget_kb,
+        st.cfg.policy == PREROLL_POLICY_KEEP_SPAN ? "keep_span" : "drop_oldest",
+        st.allocated ? "true" : "false", st.frames, (unsigned long)st.bytes_used,
+        (unsigned long)st.span_ms, st.stride, (unsigned long)st.stored,
+        (unsigned long)st.evicted, (unsigned long)st.busy_drops);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
+
+// ============================================================================
+// HANDLER: CAPTURAS BAJO DEMANDA (cola del servicio de captura)
+// ============================================================================
+static int format_capture_job(char *buf, size_t len, const capture_job_t *job) {
+    int64_t now = esp_timer_get_time();
+    int64_t wait_end = job->started_us ? job->started_us : now;
+    int64_t run_end = job->finished_us ? job->finished_us : now;
+    return snprintf(buf, len,
+        "{\"id\":%lu,\"type\":\"%s\",\"priority\":\"%s\",\"state\":\"%s\",\"merged\":%u,"
+        "\"wait_ms\":%lu,\"run_ms\":%lu,\"file\":\"%s\",\"files\":%u,"
+        "\"frames\":%u,\"spacing_us\":{\"avg\":%lu,\"min\":%lu,\"max\":%lu}}",
+        (unsigned long)job->id, capture_job_type_name(job->req.type), capture_prio_name(job->req.prio),
+        capture_state_name(job->state), job->merged,
+        (unsigned long)((wait_end - job->queued_us) / 1000),
+        (unsigned long)(job->started_us ? (run_end - job->started_us) / 1000 : 0),
+        job->file, job->files, job->frames, (unsigned long)job->spacing_avg_us,
+        (unsigned long)job->spacing_min_us, (unsigned long)job->spacing_max_us);
+}
+
+static esp_err_t capture_handler(httpd_req_t *req) {
+    char buf[400];
+
+    if (req->method == HTTP_POST) {
+        // Parsear "type=photo|video|burst&duration=s&count=N&priority=low|normal|high"
+        char content[96] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
+        }
+
+        capture_request_t creq = {
+            .type = CAPTURE_JOB_PHOTO,
+            .prio = CAPTURE_PRIO_NORMAL,
+            .duration_s = g_video_duration_sec,
+            .count = 5,
+        };
+        char value[16];
+        bool ok = true;
+        if (httpd_query_key_value(content, "type", value, sizeof(value)) == ESP_OK) ok &= capture_parse_job_type(value, &creq.type);
+        if (httpd_query_key_value(content, "priority", value, sizeof(value)) == ESP_OK) ok &= capture_parse_prio(value, &creq.prio);
+        if (httpd_query_key_value(content, "duration", value, sizeof(value)) == ESP_OK) creq.duration_s = atoi(value);
+        if (httpd_query_key_value(content, "count", value, sizeof(value)) == ESP_OK) creq.count = atoi(value);
+
+        uint32_t id = 0;
+        bool merged = false;
+        esp_err_t err = ok ? capture_svc_submit(&creq, &id, &merged) : ESP_ERR_INVALID_ARG;
+        if (err == ESP_ERR_INVALID_ARG) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
+        if (err != ESP_OK) {
+            // Sin SD o cola llena: reintentar más tarde
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            httpd_resp_set_hdr(req, "Retry-After", "5");
+            httpd_resp_set_type(req, "application/json");
+            httpd_resp_sendstr(req, err == ESP_ERR_INVALID_STATE ? "{\"error\":\"sd\"}" : "{\"error\":\"queue_full\"}");
+            return ESP_OK;
+        }
+
+        capture_svc_stats_t st;
+        capture_svc_get_stats(&st);
+        snprintf(buf, sizeof(buf), "{\"id\":%lu,\"merged\":%s,\"depth\":%d}",
+                 (unsigned long)id, merged ? "true" : "false", st.depth);
+        httpd_resp_set_status(req, "202 Accepted");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, buf);
+        return ESP_OK;
+    }
+
+    // GET ?id=N: un trabajo
+    char query[32];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "id", value, sizeof(value)) == ESP_OK) {
+        capture_job_t job;
+        if (!capture_svc_get_job(strtoul(value, NULL, 10), &job)) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Trabajo no encontrado");
+            return ESP_FAIL;
+        }
+        format_capture_job(buf, sizeof(buf), &job);
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, buf);
+        return ESP_OK;
+    }
+
+    // GET: cola, latencias y trabajos recientes
+    capture_svc_stats_t st;
+    capture_svc_get_stats(&st);
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf),
+        "{\"depth\":%d,\"max_depth\":%d,\"busy\":%s,\"submitted\":%lu,\"merged\":%lu,"
+        "\"rejected\":%lu,\"dropped\":%lu,\"done\":%lu,\"failed\":%lu,"
+        "\"avg_wait_ms\":%lu,\"max_wait_ms\":%lu,\"avg_run_ms\":%lu,\"last_recording\":",
+        st.depth, st.max_depth, st.busy ? "true" : "false", (unsigned long)st.submitted,
+        (unsigned long)st.merged, (unsigned long)st.rejected, (unsigned long)st.dropped,
+        (unsigned long)st.done, (unsigned long)st.failed, (unsigned long)st.avg_wait_ms,
+        (unsigned long)st.max_wait_ms, (unsigned long)st.avg_run_ms);
+    httpd_resp_sendstr_chunk(req, buf);
+    const capture_rec_stats_t *rs = &st.last_recording;
+    snprintf(buf, sizeof(buf),
+        "{\"frames\":%lu,\"bytes\":%llu,\"dropped_large\":%lu,\"dropped_busy\":%lu,"
+        "\"max_slot_wait_ms\":%lu,\"avg_write_ms\":%lu,\"max_write_ms\":%lu,\"peak_kb\":%lu,"
+        "\"target_fps\":%lu,\"fps\":%lu.%02lu,\"jitter_avg_ms\":%lu,\"jitter_max_ms\":%lu,"
+        "\"paced_drops\":%lu},\"jobs\":[",
+        (unsigned long)rs->frames, (unsigned long long)rs->bytes, (unsigned long)rs->dropped_large,
+        (unsigned long)rs->dropped_busy, (unsigned long)rs->max_slot_wait_ms,
+        (unsigned long)rs->avg_write_ms, (unsigned long)rs->max_write_ms, (unsigned long)rs->peak_kb,
+        (unsigned long)rs->target_fps, (unsigned long)(rs->fps_x100 / 100), (unsigned long)(rs->fps_x100 % 100),
+        (unsigned long)(rs->jitter_avg_us / 1000), (unsigned long)(rs->jitter_max_us / 1000),
+        (unsigned long)rs->paced_drops);
+    httpd_resp_sendstr_chunk(req, buf);
+
+    capture_job_t *jobs = malloc(sizeof(capture_job_t) * (CAPTURE_QUEUE_LEN + 1 + CAPTURE_HISTORY_LEN));
+    int n = jobs ? capture_svc_get_jobs(jobs, CAPTURE_QUEUE_LEN + 1 + CAPTURE_HISTORY_LEN) : 0;
+    for (int i = 0; i < n; i++) {
+        if (i) httpd_resp_sendstr_chunk(req, ",");
+        format_capture_job(buf, sizeof(buf), &jobs[i]);
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    free(jobs);
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_sendstr_chunk(req, NULL);
+    return ESP_OK;
+}
+
+// Time-lapse: intervalo, rotación del contenedor y estado de los lotes
+static esp_err_t capture_timelapse_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "interval=s&roll=N"
+        char content[64] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
+        }
+
+        capture_timelapse_config_t cfg;
+        capture_svc_get_timelapse_config(&cfg);
+        char value[16];
+        if (httpd_query_key_value(content, "interval", value, sizeof(value)) == ESP_OK) cfg.interval_s = strtoul(value, NULL, 10);
+        if (httpd_query_key_value(content, "roll", value, sizeof(value)) == ESP_OK) cfg.roll_frames = strtoul(value, NULL, 10);
+        if (capture_svc_configure_timelapse(&cfg) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
+    }
+
+    capture_timelapse_status_t st;
+    capture_svc_get_timelapse_status(&st);
+
+    char response[384];
+    snprintf(response, sizeof(response),
+        "{\"active\":%s,\"interval\":%lu,\"roll\":%lu,\"file\":\"%s\",\"file_frames\":%lu,"
+        "\"pending_frames\":%lu,\"pending_bytes\":%lu,\"shots\":%lu,\"written\":%lu,\"skipped\":%lu,"
+        "\"flushes\":%lu,\"avg_flush_ms\":%lu,\"avg_late_ms\":%lu,\"max_late_ms\":%lu}",
+        st.active ? "true" : "false", (unsigned long)st.cfg.interval_s, (unsigned long)st.cfg.roll_frames,
+        st.file, (unsigned long)st.file_frames, (unsigned long)st.pending_frames,
+        (unsigned long)st.pending_bytes, (unsigned long)st.shots, (unsigned long)st.written,
+        (unsigned long)st.skipped, (unsigned long)st.flushes, (unsigned long)st.avg_flush_ms,
+        (unsigned long)st.avg_late_ms, (unsigned long)st.max_late_ms);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
+
+// Grabación continua: largo de segmento, reserva de espacio y rendimiento sostenido
+static esp_err_t capture_dvr_handler(httpd_req_t *req) {
+    if (req->method == HTTP_POST) {
+        // Parsear "segment=s&reserve=MB"
+        char content[64] = {0};
+        int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Sin datos");
+            return ESP_FAIL;
+        }
+
+        capture_dvr_config_t cfg;
+        capture_svc_get_dvr_config(&cfg);
+        char value[16];
+        if (httpd_query_key_value(content, "segment", value, sizeof(value)) == ESP_OK) cfg.segment_s = strtoul(value, NULL, 10);
+        if (httpd_query_key_value(content, "reserve", value, sizeof(value)) == ESP_OK) cfg.reserve_mb = strtoul(value, NULL, 10);
+        if (capture_svc_configure_dvr(&cfg) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Parametros invalidos");
+            return ESP_FAIL;
+        }
+    }
+
+    capture_dvr_status_t st;
+    capture_svc_get_dvr_status(&st);
+
+    char response[640];
+    snprintf(response, sizeof(response),
+        "{\"active\":%s,\"segment\":%lu,\"reserve_mb\":%lu,\"file\":\"%s\",\"segments\":%lu,"
+        "\"failed\":%lu,\"deleted\":%lu,\"frames\":%llu,\"bytes\":%llu,\"dropped\":%lu,"
+        "\"write_fps\":%lu.%02lu,\"write_kbps\":%lu,\"stall_ms\":%lu,\"max_stall_ms\":%lu,"
+        "\"avg_close_ms\":%lu,\"max_close_ms\":%lu,\"free_mb\":%lu,\"fps\":%lu,"
+        "\"paced_drops\":%lu,\"max_jitter_ms\":%lu}",
+        st.active ? "true" : "false", (unsigned long)st.cfg.segment_s, (unsigned long)st.cfg.reserve_mb,
+        st.file, (unsigned long)st.segments, (unsigned long)st.failed, (unsigned long)st.deleted,
+        (unsigned long long)st.frames, (unsigned long long)st.bytes, (unsigned long)st.dropped,
+        (unsigned long)(st.write_fps_x100 / 100), (unsigned long)(st.write_fps_x100 % 100),
+        (unsigned long)st.write_kbps, (unsigned long)st.stall_ms, (unsigned long)st.max_stall_ms,
+        (unsigned long)st.avg_close_ms, (unsigned long)st.max_close_ms, (unsigned long)st.free_mb,
+        (unsigned long)capture_svc_get_record_fps(), (unsigned long)st.paced_drops,
+        (unsigned long)(st.max_jitter_us / 1000));
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
+
 // Forzar stream (vista en vivo) con timeout
 static esp_err_t motion_force_handler(httpd_req_t *req) {
     g_force_stream = true;
@@ -1137,14 +1623,17 @@ static esp_err_t wifi_connect_handler(httpd_req_t *req) {
 esp_err_t start_webserver(void) {
     // Cargar configuración de movimiento desde NVS
     load_motion_config();
+    abr_init();
+    still_init();
     
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
     config.task_priority = tskIDLE_PRIORITY + 5;
     config.stack_size = 10240;  // Aumentado para operaciones SD
     config.core_id = 1;
-    config.max_uri_handlers = 20;
-    config.lru_purge_enable = true;
+    config.max_uri_handlers = 48;
+    // Sockets, purga y presupuestos de streaming / control
+    admission_configure(&config);
     config.recv_wait_timeout = 10;  // 10 segundos timeout recepción
     config.send_wait_timeout = 10;  // 10 segundos timeout envío
 
@@ -1154,13 +1643,26 @@ esp_err_t start_webserver(void) {
         ESP_LOGE(TAG, "Error iniciando servidor");
         return ESP_FAIL;
     }
+    admission_set_server(server_httpd);
+
+    if (stream_engine_start(server_httpd) != ESP_OK) {
+        ESP_LOGE(TAG, "Error iniciando motor de streaming");
+        return ESP_FAIL;
+    }
+    if (transcode_start() != ESP_OK) {
+        ESP_LOGW(TAG, "Sub-streams reducidos no disponibles");
+    }
+    snapshot_init(server_httpd);
+    if (events_start(server_httpd, build_status_json) != ESP_OK) {
+        ESP_LOGW(TAG, "Canal de eventos no disponible - la UI usara sondeo");
+    }
 
     // Handler para favicon (evita 404)
     httpd_uri_t uri_favicon = { .uri = "/favicon.ico", .method = HTTP_GET, .handler = favicon_handler };
 
     // Registrar endpoints principales
-    httpd_uri_t uri_index = { .uri = "/", .method = HTTP_GET, .handler = index_handler };
     httpd_uri_t uri_stream = { .uri = "/stream", .method = HTTP_GET, .handler = stream_handler };
+    httpd_uri_t uri_snapshot = { .uri = "/snapshot", .method = HTTP_GET, .handler = snapshot_handler };
     httpd_uri_t uri_files = { .uri = "/api/files", .method = HTTP_GET, .handler = files_handler };
     httpd_uri_t uri_file = { .uri = "/file", .method = HTTP_GET, .handler = file_handler };
     httpd_uri_t uri_delete = { .uri = "/api/delete", .method = HTTP_DELETE, .handler = delete_handler };
@@ -1168,11 +1670,41 @@ esp_err_t start_webserver(void) {
     httpd_uri_t uri_format_sd = { .uri = "/api/format_sd", .method = HTTP_POST, .handler = format_sd_handler };
     httpd_uri_t uri_sd_reinit = { .uri = "/api/sd/reinit", .method = HTTP_POST, .handler = sd_reinit_handler };
     httpd_uri_t uri_sd_status = { .uri = "/api/sd/status", .method = HTTP_GET, .handler = sd_status_handler };
+    httpd_uri_t uri_camera_stats = { .uri = "/api/camera/stats", .method = HTTP_GET, .handler = camera_stats_handler };
+    httpd_uri_t uri_camera_roi_get = { .uri = "/api/camera/roi", .method = HTTP_GET, .handler = camera_roi_handler };
+    httpd_uri_t uri_camera_roi_post = { .uri = "/api/camera/roi", .method = HTTP_POST, .handler = camera_roi_handler };
+    httpd_uri_t uri_stream_ws = {
+        .uri = "/ws/stream",
+        .method = HTTP_GET,
+        .handler = stream_ws_handler,
+        .is_websocket = true,
+        .handle_ws_control_frames = true    // Ver CLOSE para liberar el cupo enseguida
+    };
+    httpd_uri_t uri_stream_stats = { .uri = "/api/stream/stats", .method = HTTP_GET, .handler = stream_stats_handler };
+    httpd_uri_t uri_stream_sessions_get = { .uri = "/api/stream/sessions", .method = HTTP_GET, .handler = stream_sessions_handler };
+    httpd_uri_t uri_stream_sessions_post = { .uri = "/api/stream/sessions", .method = HTTP_POST, .handler = stream_sessions_handler };
+    httpd_uri_t uri_stream_static_get = { .uri = "/api/stream/static", .method = HTTP_GET, .handler = stream_static_handler };
+    httpd_uri_t uri_stream_static_post = { .uri = "/api/stream/static", .method = HTTP_POST, .handler = stream_static_handler };
+    httpd_uri_t uri_multicast_get = { .uri = "/api/multicast", .method = HTTP_GET, .handler = multicast_handler };
+    httpd_uri_t uri_multicast_post = { .uri = "/api/multicast", .method = HTTP_POST, .handler = multicast_handler };
+    httpd_uri_t uri_stream_abr_get = { .uri = "/api/stream/abr", .method = HTTP_GET, .handler = stream_abr_handler };
+    httpd_uri_t uri_stream_abr_post = { .uri = "/api/stream/abr", .method = HTTP_POST, .handler = stream_abr_handler };
 
     // Endpoints de control de movimiento
     httpd_uri_t uri_motion_status = { .uri = "/api/motion/status", .method = HTTP_GET, .handler = motion_status_handler };
+    httpd_uri_t uri_events = { .uri = "/api/events", .method = HTTP_GET, .handler = events_handler };
     httpd_uri_t uri_motion_config_get = { .uri = "/api/motion/config", .method = HTTP_GET, .handler = motion_config_handler };
     httpd_uri_t uri_motion_config_post = { .uri = "/api/motion/config", .method = HTTP_POST, .handler = motion_config_handler };
+    httpd_uri_t uri_motion_detector_get = { .uri = "/api/motion/detector", .method = HTTP_GET, .handler = motion_detector_handler };
+    httpd_uri_t uri_motion_detector_post = { .uri = "/api/motion/detector", .method = HTTP_POST, .handler = motion_detector_handler };
+    httpd_uri_t uri_preroll_get = { .uri = "/api/preroll", .method = HTTP_GET, .handler = preroll_handler };
+    httpd_uri_t uri_preroll_post = { .uri = "/api/preroll", .method = HTTP_POST, .handler = preroll_handler };
+    httpd_uri_t uri_capture_get = { .uri = "/api/capture", .method = HTTP_GET, .handler = capture_handler };
+    httpd_uri_t uri_capture_post = { .uri = "/api/capture", .method = HTTP_POST, .handler = capture_handler };
+    httpd_uri_t uri_timelapse_get = { .uri = "/api/capture/timelapse", .method = HTTP_GET, .handler = capture_timelapse_handler };
+    httpd_uri_t uri_timelapse_post = { .uri = "/api/capture/timelapse", .method = HTTP_POST, .handler = capture_timelapse_handler };
+    httpd_uri_t uri_dvr_get = { .uri = "/api/capture/dvr", .method = HTTP_GET, .handler = capture_dvr_handler };
+    httpd_uri_t uri_dvr_post = { .uri = "/api/capture/dvr", .method = HTTP_POST, .handler = capture_dvr_handler };
     httpd_uri_t uri_motion_force = { .uri = "/api/motion/force", .method = HTTP_POST, .handler = motion_force_handler };
     httpd_uri_t uri_motion_stop = { .uri = "/api/motion/stop", .method = HTTP_POST, .handler = motion_stop_handler };
 
@@ -1184,8 +1716,9 @@ esp_err_t start_webserver(void) {
     httpd_uri_t uri_restart = { .uri = "/api/restart", .method = HTTP_POST, .handler = restart_handler };
 
     httpd_register_uri_handler(server_httpd, &uri_favicon);
-    httpd_register_uri_handler(server_httpd, &uri_index);
+    web_assets_register(server_httpd);
     httpd_register_uri_handler(server_httpd, &uri_stream);
+    httpd_register_uri_handler(server_httpd, &uri_snapshot);
     httpd_register_uri_handler(server_httpd, &uri_files);
     httpd_register_uri_handler(server_httpd, &uri_file);
     httpd_register_uri_handler(server_httpd, &uri_delete);
@@ -1193,9 +1726,33 @@ esp_err_t start_webserver(void) {
     httpd_register_uri_handler(server_httpd, &uri_format_sd);
     httpd_register_uri_handler(server_httpd, &uri_sd_reinit);
     httpd_register_uri_handler(server_httpd, &uri_sd_status);
+    httpd_register_uri_handler(server_httpd, &uri_camera_stats);
+    httpd_register_uri_handler(server_httpd, &uri_camera_roi_get);
+    httpd_register_uri_handler(server_httpd, &uri_camera_roi_post);
+    httpd_register_uri_handler(server_httpd, &uri_stream_ws);
+    httpd_register_uri_handler(server_httpd, &uri_stream_stats);
+    httpd_register_uri_handler(server_httpd, &uri_stream_sessions_get);
+    httpd_register_uri_handler(server_httpd, &uri_stream_sessions_post);
+    httpd_register_uri_handler(server_httpd, &uri_stream_static_get);
+    httpd_register_uri_handler(server_httpd, &uri_stream_static_post);
+    httpd_register_uri_handler(server_httpd, &uri_multicast_get);
+    httpd_register_uri_handler(server_httpd, &uri_multicast_post);
+    httpd_register_uri_handler(server_httpd, &uri_stream_abr_get);
+    httpd_register_uri_handler(server_httpd, &uri_stream_abr_post);
     httpd_register_uri_handler(server_httpd, &uri_motion_status);
+    httpd_register_uri_handler(server_httpd, &uri_events);
     httpd_register_uri_handler(server_httpd, &uri_motion_config_get);
     httpd_register_uri_handler(server_httpd, &uri_motion_config_post);
+    httpd_register_uri_handler(server_httpd, &uri_motion_detector_get);
+    httpd_register_uri_handler(server_httpd, &uri_motion_detector_post);
+    httpd_register_uri_handler(server_httpd, &uri_preroll_get);
+    httpd_register_uri_handler(server_httpd, &uri_preroll_post);
+    httpd_register_uri_handler(server_httpd, &uri_capture_get);
+    httpd_register_uri_handler(server_httpd, &uri_capture_post);
+    httpd_register_uri_handler(server_httpd, &uri_timelapse_get);
+    httpd_register_uri_handler(server_httpd, &uri_timelapse_post);
+    httpd_register_uri_handler(server_httpd, &uri_dvr_get);
+    httpd_register_uri_handler(server_httpd, &uri_dvr_post);
     httpd_register_uri_handler(server_httpd, &uri_motion_force);
     httpd_register_uri_handler(server_httpd, &uri_motion_stop);
     httpd_register_uri_handler(server_httpd, &uri_wifi_status);
@@ -1205,7 +1762,7 @@ esp_err_t start_webserver(void) {
     httpd_register_uri_handler(server_httpd, &uri_restart);
 
     ESP_LOGI(TAG, "Servidor listo - Modo: %s, Tiempo: %ds", 
-             g_capture_mode == CAPTURE_MODE_VIDEO ? "VIDEO" : "FOTO", g_emission_time_sec);
+             capture_mode_name(g_capture_mode), g_emission_time_sec);
     return ESP_OK;
 }
 
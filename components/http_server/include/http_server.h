@@ -30,7 +30,9 @@ int http_server_get_emission_time(void);
 // ============================================================================
 typedef enum {
     CAPTURE_MODE_PHOTO = 0,   // Capturar fotos individuales
-    CAPTURE_MODE_VIDEO = 1    // Grabar video (secuencia de frames)
+    CAPTURE_MODE_VIDEO = 1,   // Grabar video (secuencia de frames)
+    CAPTURE_MODE_TIMELAPSE = 2, // Tomas a intervalo fijo en un contenedor (el movimiento no graba)
+    CAPTURE_MODE_CONTINUOUS = 3 // Segmentos AVI sin pausa, pisando los más viejos (el movimiento no graba)
 } capture_mode_t;
 
 // Obtener modo de captura actual
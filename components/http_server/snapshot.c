@@ -0,0 +1,238 @@
+#include "snapshot.h"
+#include "frame_bus.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "SNAPSHOT";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+// Mientras llegan peticiones seguidas (NVR sondeando cada segundo) el
+// consumidor queda registrado y un timer copia el frame pendiente a la caché
+// cada SNAPSHOT_POLL_MS, así la caché sigue al sensor entre peticiones.
+// Si nadie pide nada durante SNAPSHOT_LINGER_MS se da de baja del frame bus.
+// El handler nunca bloquea la tarea httpd: si no hay un frame lo bastante
+// nuevo, la petición queda en espera (async) y la completa el próximo sondeo.
+#define SNAPSHOT_LINGER_MS      3000
+#define SNAPSHOT_POLL_MS        50
+#define SNAPSHOT_WAIT_MS        2000    // Tope de una petición en espera
+#define SNAPSHOT_MAX_WAITERS    4       // Cada una retiene un socket
+#define SNAPSHOT_RETRY_AFTER_S  "1"
+
+// Petición async esperando un frame más nuevo que max_age
+typedef struct {
+    httpd_req_t *req;
+    int64_t max_age_us;
+    int64_t deadline_us;
+} snap_waiter_t;
+
+static httpd_handle_t s_server = NULL;
+static frame_bus_sub_t *s_sub = NULL;
+static esp_timer_handle_t s_linger_timer = NULL;
+static esp_timer_handle_t s_poll_timer = NULL;
+static volatile bool s_poll_queued = false;        // Un solo sondeo en la cola de httpd
+static snap_waiter_t s_waiters[SNAPSHOT_MAX_WAITERS];
+
+// Caché (solo se toca desde la tarea httpd)
+static uint8_t *s_buf = NULL;
+static size_t s_cap = 0;
+static size_t s_len = 0;
+static int64_t s_timestamp_us = 0;
+static uint32_t s_seq = 0;
+
+static snapshot_stats_t s_stats;
+
+static void serve_waiters(bool flush);
+
+// ============================================================================
+// BAJA DIFERIDA DEL FRAME BUS
+// ============================================================================
+// Corre en la tarea httpd (via httpd_queue_work) para no competir con el handler
+static void linger_expired_work(void *arg) {
+    if (s_sub) {
+        if (s_poll_timer) esp_timer_stop(s_poll_timer);
+        serve_waiters(true);
+        frame_bus_unsubscribe(s_sub);
+        s_sub = NULL;
+    }
+}
+
+static void linger_timer_cb(void *arg) {
+    httpd_queue_work(s_server, linger_expired_work, NULL);
+}
+
+static void touch_subscription(void) {
+    if (!s_sub) {
+        s_sub = frame_bus_subscribe("snapshot");
+        if (s_sub && s_poll_timer) {
+            esp_timer_start_periodic(s_poll_timer, (uint64_t)SNAPSHOT_POLL_MS * 1000);
+        }
+    }
+    if (s_linger_timer) {
+        esp_timer_stop(s_linger_timer);
+        esp_timer_start_once(s_linger_timer, (uint64_t)SNAPSHOT_LINGER_MS * 1000);
+    }
+}
+
+// ============================================================================
+// CACHÉ
+// ============================================================================
+static esp_err_t cache_store(const frame_t *frame) {
+    if (frame->len > s_cap) {
+        uint8_t *nb = heap_caps_realloc(s_buf, frame->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!nb) return ESP_ERR_NO_MEM;
+        s_buf = nb;
+        s_cap = frame->len;
+    }
+    memcpy(s_buf, frame->buf, frame->len);
+    s_len = frame->len;
+    s_timestamp_us = frame->timestamp_us;
+    s_seq = frame->seq;
+    return ESP_OK;
+}
+
+// Copia a la caché el frame pendiente del bus, si hay uno (sin esperar).
+// El bus reemplaza el pendiente en cada captura: siempre es el último.
+static void cache_poll(void) {
+    if (!s_sub) return;
+    const frame_t *frame = frame_bus_acquire(s_sub, 0);
+    if (!frame) return;
+    if (frame->seq != s_seq && cache_store(frame) == ESP_OK) s_stats.captures++;
+    frame_bus_done(s_sub, frame);
+}
+
+static bool cache_fresh(int64_t max_age_us) {
+    return s_len > 0 && (esp_timer_get_time() - s_timestamp_us) <= max_age_us;
+}
+
+// ============================================================================
+// RESPUESTA
+// ============================================================================
+static esp_err_t send_cached(httpd_req_t *req, int64_t max_age_us) {
+    if (s_len == 0) {
+        // Ni siquiera la espera trajo un frame (cámara parada)
+        s_stats.errors++;
+        ESP_LOGW(TAG, "Sin frame para snapshot todavia");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", SNAPSHOT_RETRY_AFTER_S);
+        return httpd_resp_sendstr(req, "Sin frame disponible");
+    }
+
+    // Si no hay nada más nuevo se sirve lo que hay: la edad va en la cabecera
+    int64_t age_us = esp_timer_get_time() - s_timestamp_us;
+    bool stale = age_us > max_age_us;
+    if (stale) s_stats.stale++;
+
+    char age_str[16];
+    char seq_str[16];
+    snprintf(age_str, sizeof(age_str), "%lld", (long long)(age_us / 1000));
+    snprintf(seq_str, sizeof(seq_str), "%lu", (unsigned long)s_seq);
+
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "X-Frame-Age-Ms", age_str);
+    if (stale) httpd_resp_set_hdr(req, "X-Frame-Stale", "1");
+    httpd_resp_set_hdr(req, "X-Frame-Seq", seq_str);
+    return httpd_resp_send(req, (const char *)s_buf, s_len);
+}
+
+// Completa las peticiones en espera que ya tienen un frame lo bastante nuevo
+// o se quedaron sin tiempo (flush: todas). Solo desde la tarea httpd.
+static void serve_waiters(bool flush) {
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < SNAPSHOT_MAX_WAITERS; i++) {
+        snap_waiter_t *w = &s_waiters[i];
+        if (!w->req) continue;
+        if (!flush && !cache_fresh(w->max_age_us) && now < w->deadline_us) continue;
+        send_cached(w->req, w->max_age_us);
+        httpd_req_async_handler_complete(w->req);
+        w->req = NULL;
+    }
+}
+
+// ============================================================================
+// SONDEO PERIÓDICO
+// ============================================================================
+static void poll_work(void *arg) {
+    s_poll_queued = false;
+    cache_poll();
+    serve_waiters(false);
+}
+
+// Desde la tarea de esp_timer: solo encola, el trabajo va en la tarea httpd
+static void poll_timer_cb(void *arg) {
+    if (s_poll_queued) return;
+    s_poll_queued = true;
+    if (httpd_queue_work(s_server, poll_work, NULL) != ESP_OK) s_poll_queued = false;
+}
+
+static bool park_request(httpd_req_t *req, int64_t max_age_us) {
+    for (int i = 0; i < SNAPSHOT_MAX_WAITERS; i++) {
+        snap_waiter_t *w = &s_waiters[i];
+        if (w->req) continue;
+        if (httpd_req_async_handler_begin(req, &w->req) != ESP_OK) {
+            w->req = NULL;
+            return false;
+        }
+        w->max_age_us = max_age_us;
+        w->deadline_us = esp_timer_get_time() + (int64_t)SNAPSHOT_WAIT_MS * 1000;
+        s_stats.waits++;
+        return true;
+    }
+    return false;
+}
+
+// ============================================================================
+// API
+// ============================================================================
+void snapshot_init(httpd_handle_t server) {
+    s_server = server;
+    if (!s_linger_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = linger_timer_cb,
+            .name = "snap_linger"
+        };
+        esp_timer_create(&args, &s_linger_timer);
+    }
+    if (!s_poll_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = poll_timer_cb,
+            .name = "snap_poll"
+        };
+        esp_timer_create(&args, &s_poll_timer);
+    }
+}
+
+esp_err_t snapshot_handler(httpd_req_t *req) {
+    int max_age_ms = SNAPSHOT_DEFAULT_MAX_AGE_MS;
+    char query[48] = {0};
+    char value[12] = {0};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "max_age", value, sizeof(value)) == ESP_OK) {
+        max_age_ms = atoi(value);
+        if (max_age_ms < 0) max_age_ms = 0;
+        if (max_age_ms > SNAPSHOT_MAX_AGE_LIMIT_MS) max_age_ms = SNAPSHOT_MAX_AGE_LIMIT_MS;
+    }
+    int64_t max_age_us = (int64_t)max_age_ms * 1000;
+
+    touch_subscription();
+    if (cache_fresh(max_age_us)) {
+        s_stats.hits++;
+        return send_cached(req, max_age_us);
+    }
+    cache_poll();
+
+    // Primera petición tras un rato sin uso (consumidor recién registrado) o
+    // caché más vieja que max_age: esperar al próximo frame sin bloquear
+    if (!cache_fresh(max_age_us) && s_sub && park_request(req, max_age_us)) return ESP_OK;
+    return send_cached(req, max_age_us);
+}
+
+void snapshot_get_stats(snapshot_stats_t *stats) {
+    if (stats) *stats = s_stats;
+}
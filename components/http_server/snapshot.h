@@ -0,0 +1,35 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdint.h>
+
+// ============================================================================
+// SNAPSHOT CACHEADO (uso interno del componente http_server)
+// ============================================================================
+// /snapshot sirve el último frame copiado en PSRAM mientras sea más nuevo
+// que max_age. Todos los handlers corren en la tarea httpd, así que las
+// peticiones que llegan dentro del mismo período de frame encuentran la
+// caché fresca y comparten una sola captura. Mientras hay peticiones la
+// caché se refresca sola desde el frame bus. Si aun así es más vieja que
+// max_age (o está vacía tras un rato sin uso), la petición pasa a async y se
+// completa con el próximo frame; a los SNAPSHOT_WAIT_MS se responde con lo
+// que haya (X-Frame-Age-Ms, X-Frame-Stale: 1), o 503 + Retry-After si la
+// cámara no entregó ninguno.
+
+#define SNAPSHOT_DEFAULT_MAX_AGE_MS 1000
+#define SNAPSHOT_MAX_AGE_LIMIT_MS   60000
+
+typedef struct {
+    uint32_t hits;          // Respuestas servidas desde la caché
+    uint32_t captures;      // Frames nuevos tomados del bus
+    uint32_t stale;         // Respuestas con un frame más viejo que max_age
+    uint32_t waits;         // Peticiones que esperaron (async) al próximo frame
+    uint32_t errors;        // 503: ningún frame todavía
+} snapshot_stats_t;
+
+void snapshot_init(httpd_handle_t server);
+
+// GET /snapshot[?max_age=ms]
+esp_err_t snapshot_handler(httpd_req_t *req);
+
+void snapshot_get_stats(snapshot_stats_t *stats);
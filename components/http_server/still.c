@@ -0,0 +1,125 @@
+#include "still.h"
+#include "motion_detect.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "STILL";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define NVS_NAMESPACE_STREAM "stream_cfg"
+#define NVS_KEY_STILL_ON     "still_on"
+#define NVS_KEY_STILL_TOL    "still_tol"
+#define NVS_KEY_STILL_KA     "still_ka"
+
+#define STILL_MAX_TOLERANCE  200    // 20%
+#define STILL_MAX_KEEPALIVE  60
+
+static bool s_enabled = false;
+static int s_tolerance = STILL_DEFAULT_TOLERANCE_PERMILLE;
+static int s_keepalive_s = STILL_DEFAULT_KEEPALIVE_S;
+
+// Contadores (solo los toca la tarea del motor)
+static uint32_t s_suppressed = 0;
+static uint64_t s_bytes_saved = 0;
+
+void still_init(void) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_STREAM, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        int32_t val;
+        if (nvs_get_i32(nvs_handle, NVS_KEY_STILL_ON, &val) == ESP_OK) {
+            s_enabled = (val != 0);
+        }
+        if (nvs_get_i32(nvs_handle, NVS_KEY_STILL_TOL, &val) == ESP_OK &&
+            val >= 0 && val <= STILL_MAX_TOLERANCE) {
+            s_tolerance = val;
+        }
+        if (nvs_get_i32(nvs_handle, NVS_KEY_STILL_KA, &val) == ESP_OK &&
+            val >= 1 && val <= STILL_MAX_KEEPALIVE) {
+            s_keepalive_s = val;
+        }
+        nvs_close(nvs_handle);
+    }
+    if (s_enabled) {
+        ESP_LOGI(TAG, "Supresion de escena estatica activa (tolerancia %d/1000, keepalive %d s)",
+                 s_tolerance, s_keepalive_s);
+    }
+}
+
+bool still_enabled(void) {
+    return s_enabled;
+}
+
+void still_signature(const frame_t *frame, still_sig_t *sig) {
+    sig->len = frame->len;
+    sig->scene_valid = motion_detect_scene_rev(&sig->scene_rev);
+}
+
+bool still_should_skip(const still_ref_t *ref, const still_sig_t *sig, int64_t now_us) {
+    if (!s_enabled || ref->sent_us == 0) return false;
+    if (now_us - ref->sent_us >= (int64_t)s_keepalive_s * 1000000) return false;
+
+    // Filtro previo por tamaño. Se compara contra el último enviado, no
+    // contra el anterior: un cambio lento se acumula hasta pasar la
+    // tolerancia y se manda.
+    uint32_t diff = (sig->len > ref->sig.len) ? sig->len - ref->sig.len : ref->sig.len - sig->len;
+    bool same = (uint64_t)diff * 1000 <= (uint64_t)ref->sig.len * s_tolerance;
+
+    // Y además el contenido: que ninguna celda se haya apartado del fondo
+    // desde el último envío (la luma DC tolera el ruido del sensor). Sin el
+    // detector no hay forma barata de saberlo: los bytes del JPEG cambian en
+    // cada frame por el ruido, así que no se omite nada.
+    same = same && sig->scene_valid && ref->sig.scene_valid &&
+           sig->scene_rev == ref->sig.scene_rev;
+    if (same) {
+        s_suppressed++;
+        s_bytes_saved += sig->len;
+    }
+    return same;
+}
+
+void still_mark_sent(still_ref_t *ref, const still_sig_t *sig, int64_t now_us) {
+    ref->sig = *sig;
+    ref->sent_us = now_us;
+}
+
+void still_get_status(still_status_t *status) {
+    if (!status) return;
+    uint32_t rev;
+    status->enabled = s_enabled;
+    status->active = s_enabled && motion_detect_scene_rev(&rev);
+    status->tolerance_permille = s_tolerance;
+    status->keepalive_s = s_keepalive_s;
+    status->frames_suppressed = s_suppressed;
+    status->bytes_saved = s_bytes_saved;
+}
+
+esp_err_t still_configure(bool enabled, int tolerance_permille, int keepalive_s) {
+    if (tolerance_permille < 0 || tolerance_permille > STILL_MAX_TOLERANCE ||
+        keepalive_s < 1 || keepalive_s > STILL_MAX_KEEPALIVE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (enabled) {
+        motion_detect_config_t md;
+        motion_detect_get_config(&md);
+        if (!md.enabled) return ESP_ERR_INVALID_STATE;
+    }
+
+    s_enabled = enabled;
+    s_tolerance = tolerance_permille;
+    s_keepalive_s = keepalive_s;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_STREAM, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_STILL_ON, enabled ? 1 : 0);
+    nvs_set_i32(nvs_handle, NVS_KEY_STILL_TOL, tolerance_permille);
+    nvs_set_i32(nvs_handle, NVS_KEY_STILL_KA, keepalive_s);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+
+    ESP_LOGI(TAG, "Supresion %s (tolerancia %d/1000, keepalive %d s)",
+             enabled ? "activa" : "desactivada", tolerance_permille, keepalive_s);
+    return err;
+}
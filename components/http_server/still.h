@@ -0,0 +1,63 @@
+#pragma once
+#include "esp_err.h"
+#include "frame_bus.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// SUPRESIÓN DE ESCENA ESTÁTICA (uso interno del componente http_server)
+// ============================================================================
+// Cada frame se resume en una firma barata: tamaño del JPEG y la revisión de
+// escena del detector de movimiento. Se omite si el tamaño está dentro de la
+// tolerancia Y la escena no cambió desde el último frame enviado a ese
+// cliente (luma DC, inmune al ruido del sensor). Igual se manda un keepalive
+// cada N segundos.
+//
+// Requiere el detector de movimiento: con el detector apagado no se puede
+// activar (ESP_ERR_INVALID_STATE) y, si se apaga después, no se omite nada
+// (status.active = false). Comparar bytes del JPEG no sirve: el ruido del
+// sensor cambia los datos comprimidos en todos los frames.
+
+#define STILL_DEFAULT_TOLERANCE_PERMILLE 3     // 0.3% de diferencia de tamaño
+#define STILL_DEFAULT_KEEPALIVE_S        5
+
+typedef struct {
+    uint32_t len;
+    uint32_t scene_rev;
+    bool scene_valid;       // El detector de movimiento está analizando
+} still_sig_t;
+
+// Referencia por cliente: firma del último frame enviado
+typedef struct {
+    still_sig_t sig;
+    int64_t sent_us;
+} still_ref_t;
+
+typedef struct {
+    bool enabled;
+    bool active;            // Habilitada y con el detector analizando
+    int tolerance_permille;
+    int keepalive_s;
+    uint32_t frames_suppressed;
+    uint64_t bytes_saved;
+} still_status_t;
+
+// Carga configuración desde NVS
+void still_init(void);
+
+bool still_enabled(void);
+
+// Firma del frame (una vez por frame, no por cliente)
+void still_signature(const frame_t *frame, still_sig_t *sig);
+
+// true si el frame no aporta nada nuevo para este cliente (y lo cuenta)
+bool still_should_skip(const still_ref_t *ref, const still_sig_t *sig, int64_t now_us);
+
+// Registrar que el frame se envió al cliente
+void still_mark_sent(still_ref_t *ref, const still_sig_t *sig, int64_t now_us);
+
+void still_get_status(still_status_t *status);
+
+// Cambia la configuración y la persiste en NVS. ESP_ERR_INVALID_STATE si se
+// pide activar con el detector de movimiento apagado.
+esp_err_t still_configure(bool enabled, int tolerance_permille, int keepalive_s);
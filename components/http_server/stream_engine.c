@@ -0,0 +1,898 @@
+#include "stream_engine.h"
+#include "http_server.h"
+#include "frame_bus.h"
+#include "abr.h"
+#include "still.h"
+#include "transcode.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "lwip/sockets.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "STREAM_ENG";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define ENGINE_TASK_STACK   4096
+#define ENGINE_TASK_PRIO    (tskIDLE_PRIORITY + 5)
+#define ENGINE_TASK_CORE    1
+#define SELECT_TIMEOUT_MS   20      // Espera máxima por socket escribible
+#define FRAME_WAIT_MS       50      // Espera por frame cuando nadie está enviando
+
+// Un envío que dura más de un período de cámara pasa a salir de una copia
+// propia del cliente, así la referencia vuelve enseguida al frame bus
+#define DETACH_DEFAULT_US   100000  // Período supuesto hasta medir el real
+#define DETACH_MIN_US       20000
+
+#define STATS_WINDOW_MS     2000    // Ventana para calcular FPS / bytes por segundo
+#define EVENT_QUEUE_LEN     16      // Altas, ACKs y bajas de WebSocket
+
+// WebSocket: como máximo WS_ACK_WINDOW frames enviados sin confirmar. Si el
+// navegador no confirma nada en WS_ACK_TIMEOUT_MS se lo da por colgado.
+#define WS_ACK_WINDOW       2
+#define WS_ACK_TIMEOUT_MS   5000
+#define WS_FRAME_HDR_LEN    12      // [seq u32 LE][timestamp_us u64 LE]
+
+// Tope de FPS por cliente: token bucket con lugar para dos frames, así el
+// promedio llega al tope aunque los frames de la cámara no caigan justo
+#define NVS_NAMESPACE_STREAM "stream_cfg"
+#define NVS_KEY_DEFAULT_FPS  "def_fps"
+#define TOKEN_UNIT           1000000    // Un frame, en millonésimas
+#define TOKEN_BUCKET_MAX     (2 * TOKEN_UNIT)
+
+// Respuesta delimitada por cierre: sin Content-Length ni chunked, así cada
+// frame viaja como [cabecera de parte][JPEG] sin framing extra.
+#define PART_BOUNDARY "123456789000000000000987654321"
+static const char *STREAM_HTTP_HEADER =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY "\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+// Vector de escritura: [0] cabecera de parte, [1] JPEG (directo desde PSRAM)
+#define IOV_MAX_SEGS 2
+
+// Todo lo que llega desde la tarea httpd pasa por una sola cola, así el
+// estado de los clientes solo lo modifica la tarea del motor.
+typedef enum {
+    ENGINE_EV_ADD_MJPEG,        // req async de /stream
+    ENGINE_EV_ADD_WS,           // Handshake de /ws/stream completado
+    ENGINE_EV_WS_ACK,           // El navegador mostró el frame 'value'
+    ENGINE_EV_WS_CLOSED,        // La sesión WebSocket se cerró
+} engine_event_type_t;
+
+// En los eventos de alta 'value' lleva el tope de FPS (0 = sin tope)
+
+typedef struct {
+    engine_event_type_t type;
+    httpd_req_t *req;
+    int fd;
+    uint32_t token;             // Distingue sesiones que reutilizan el mismo fd
+    uint32_t value;
+    stream_size_t size;         // Solo en los eventos de alta
+} engine_event_t;
+
+// Contexto de sesión WebSocket: httpd lo libera al cerrar el socket
+typedef struct {
+    int fd;
+    uint32_t token;
+} ws_sess_t;
+
+typedef struct {
+    bool in_use;
+    bool ws;                    // WebSocket binario en vez de multipart
+    httpd_req_t *req;           // Petición async: mantiene el socket vivo (solo MJPEG)
+    int fd;
+    uint32_t ws_token;
+    uint32_t ws_inflight[WS_ACK_WINDOW];    // Seqs enviados sin ACK
+    int ws_inflight_cnt;
+    int64_t ws_last_ack_us;
+    stream_size_t size;         // FULL = frame del bus; el resto sale de transcode
+    const frame_t *frame;       // Frame en envío (referencia propia) o NULL
+    bool sending;               // Hay un frame en curso (con referencia o copiado)
+    uint32_t sending_seq;
+    uint8_t *copy;              // Resto del JPEG cuando el envío se alargó
+    size_t copy_cap;
+    uint32_t offered_seq;       // Último frame reducido considerado (sub-streams)
+    uint32_t last_seq;          // Último frame enviado completo
+    int64_t frame_start_us;     // Inicio del envío actual (para el ABR)
+    char hdr[128];
+    struct iovec iov[IOV_MAX_SEGS];
+    int iov_idx;                // Primer segmento con datos pendientes
+    int iov_cnt;
+    int fps_cap;                // 0 = sin tope
+    uint32_t tokens;            // TOKEN_UNIT = un frame disponible (tope TOKEN_BUCKET_MAX)
+    int64_t tokens_us;          // Última recarga del bucket
+    uint32_t held_gap;          // Frames retenidos a propósito (tope, escena estática) desde el último envío
+    still_ref_t still;          // Firma del último frame enviado
+    int64_t connected_us;
+    uint32_t frames_sent;
+    uint32_t frames_skipped;    // Frames que no alcanzó a recibir
+    uint32_t frames_capped;     // Frames no enviados por el tope de FPS
+    uint32_t frames_suppressed; // Frames no enviados por escena estática
+    uint32_t frames_copied;     // Envíos que pasaron a la copia propia
+    uint64_t bytes_sent;
+    uint64_t send_us_total;
+} stream_client_t;
+
+static httpd_handle_t s_server = NULL;
+static QueueHandle_t s_events = NULL;
+static stream_client_t s_clients[STREAM_MAX_CLIENTS];
+static volatile int s_client_count = 0;     // Activos + encolados
+static int s_default_fps = 0;
+static int64_t s_frame_period_us = DETACH_DEFAULT_US;  // Promedio entre frames del bus
+static int64_t s_last_frame_us = 0;
+
+// Copia de las sesiones para la API (se publica bajo s_count_lock)
+static stream_session_t s_sessions[STREAM_MAX_CLIENTS];
+static int s_session_count = 0;
+
+// Medición de throughput (solo la tarea del motor escribe)
+static stream_engine_stats_t s_stats;
+static int64_t s_window_start = 0;
+static uint32_t s_window_frames = 0;
+static uint64_t s_window_bytes = 0;
+static portMUX_TYPE s_count_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// El contador se toca desde la tarea httpd (alta) y desde el motor (baja)
+static bool client_count_reserve(void) {
+    bool ok = false;
+    portENTER_CRITICAL(&s_count_lock);
+    if (s_client_count < STREAM_MAX_CLIENTS) {
+        s_client_count++;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&s_count_lock);
+    return ok;
+}
+
+static void client_count_release(void) {
+    portENTER_CRITICAL(&s_count_lock);
+    s_client_count--;
+    portEXIT_CRITICAL(&s_count_lock);
+}
+
+// Vuelca el estado de los clientes para /api/stream/sessions
+static void publish_sessions(void) {
+    stream_session_t tmp[STREAM_MAX_CLIENTS];
+    int n = 0;
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        const stream_client_t *c = &s_clients[i];
+        if (!c->in_use) continue;
+        stream_session_t *o = &tmp[n++];
+        memset(o, 0, sizeof(*o));
+        o->fd = c->fd;
+        o->ws = c->ws;
+        o->size = c->size;
+        o->fps_cap = c->fps_cap;
+        o->connected_s = (uint32_t)((now - c->connected_us) / 1000000);
+        o->frames_sent = c->frames_sent;
+        o->frames_skipped = c->frames_skipped;
+        o->frames_capped = c->frames_capped;
+        o->frames_suppressed = c->frames_suppressed;
+        o->frames_copied = c->frames_copied;
+        o->bytes_sent = c->bytes_sent;
+        o->avg_send_us = c->frames_sent ? (uint32_t)(c->send_us_total / c->frames_sent) : 0;
+
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if (getpeername(c->fd, (struct sockaddr *)&addr, &len) == 0) {
+            if (addr.ss_family == AF_INET) {
+                inet_ntop(AF_INET, &((struct sockaddr_in *)&addr)->sin_addr, o->ip, sizeof(o->ip));
+            } else if (addr.ss_family == AF_INET6) {
+                // httpd escucha en IPv6: los clientes IPv4 llegan mapeados
+                struct sockaddr_in6 *a6 = (struct sockaddr_in6 *)&addr;
+                inet_ntop(AF_INET, &a6->sin6_addr.s6_addr[12], o->ip, sizeof(o->ip));
+            }
+        }
+    }
+
+    portENTER_CRITICAL(&s_count_lock);
+    memcpy(s_sessions, tmp, sizeof(tmp));
+    s_session_count = n;
+    portEXIT_CRITICAL(&s_count_lock);
+}
+
+// ============================================================================
+// GESTIÓN DE CLIENTES
+// ============================================================================
+static bool client_busy(const stream_client_t *c) {
+    return c->iov_idx < c->iov_cnt;
+}
+
+// Un WebSocket puede recibir otro frame solo si hay lugar en la ventana
+static bool client_ready(const stream_client_t *c) {
+    return !client_busy(c) && (!c->ws || c->ws_inflight_cnt < WS_ACK_WINDOW);
+}
+
+// Recarga el bucket y dice si el cliente tiene un frame disponible
+static bool client_has_token(stream_client_t *c, int64_t now) {
+    if (c->fps_cap <= 0) return true;
+    uint64_t add = (uint64_t)(now - c->tokens_us) * c->fps_cap;
+    c->tokens_us = now;
+    c->tokens = (add >= TOKEN_BUCKET_MAX || c->tokens + add >= TOKEN_BUCKET_MAX)
+                ? TOKEN_BUCKET_MAX : c->tokens + (uint32_t)add;
+    return c->tokens >= TOKEN_UNIT;
+}
+
+// Los frames reducidos tienen su propio conteo de referencias
+static const frame_t *client_frame_ref(const stream_client_t *c, const frame_t *frame) {
+    return c->size == STREAM_SIZE_FULL ? frame_bus_ref(frame) : transcode_ref(frame);
+}
+
+static void client_frame_release(const stream_client_t *c, const frame_t *frame) {
+    if (c->size == STREAM_SIZE_FULL) {
+        frame_bus_release(frame);
+    } else {
+        transcode_release(frame);
+    }
+}
+
+// Cierre de un WebSocket pedido por el motor. Corre en la tarea httpd y
+// solo cierra si el fd sigue siendo la misma sesión: si el cliente ya se fue,
+// el fd puede estar reutilizado por otra conexión.
+typedef struct {
+    int fd;
+    uint32_t token;
+} ws_close_req_t;
+
+static void ws_close_work(void *arg) {
+    ws_close_req_t *r = (ws_close_req_t *)arg;
+    ws_sess_t *sess = (ws_sess_t *)httpd_sess_get_ctx(s_server, r->fd);
+    if (sess && sess->token == r->token) httpd_sess_trigger_close(s_server, r->fd);
+    free(r);
+}
+
+static void ws_trigger_close(int fd, uint32_t token) {
+    ws_close_req_t *r = malloc(sizeof(ws_close_req_t));
+    if (!r) return;
+    r->fd = fd;
+    r->token = token;
+    if (httpd_queue_work(s_server, ws_close_work, r) != ESP_OK) free(r);
+}
+
+static void client_set_cap(stream_client_t *c, int fps) {
+    c->fps_cap = fps;
+    c->tokens = TOKEN_UNIT;
+    c->tokens_us = esp_timer_get_time();
+    c->connected_us = c->tokens_us;
+}
+
+// peer_gone: httpd ya cerró la sesión (el fd puede estar reutilizado)
+static void client_release(stream_client_t *c, const char *reason, bool peer_gone) {
+    if (c->frame) {
+        client_frame_release(c, c->frame);
+        c->frame = NULL;
+    }
+    heap_caps_free(c->copy);
+    // Después de soltar el frame, así transcode puede liberar sus buffers
+    transcode_demand(c->size, -1);
+    ESP_LOGI(TAG, "Cliente %s fd=%d cerrado (%s) - enviados: %lu frames / %llu bytes, omitidos: %lu",
+             c->ws ? "WS" : "MJPEG", c->fd, reason, (unsigned long)c->frames_sent,
+             (unsigned long long)c->bytes_sent, (unsigned long)c->frames_skipped);
+
+    if (!peer_gone) {
+        // Antes de completar la petición async: mientras no se completa,
+        // httpd no cierra la sesión y el fd no puede pasar a otro cliente.
+        // Completarla primero dejaría una ventana en la que el cierre
+        // pegaría sobre una conexión nueva con el mismo fd.
+        if (c->ws) {
+            ws_trigger_close(c->fd, c->ws_token);
+        } else {
+            httpd_sess_trigger_close(s_server, c->fd);
+        }
+    }
+    if (c->req) httpd_req_async_handler_complete(c->req);
+    memset(c, 0, sizeof(*c));
+    client_count_release();
+    publish_sessions();
+}
+
+static void client_close(stream_client_t *c, const char *reason) {
+    client_release(c, reason, false);
+}
+
+static stream_client_t *client_find_ws(int fd, uint32_t token) {
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        stream_client_t *c = &s_clients[i];
+        if (c->in_use && c->ws && c->fd == fd && c->ws_token == token) return c;
+    }
+    return NULL;
+}
+
+static stream_client_t *client_alloc(void) {
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (!s_clients[i].in_use) return &s_clients[i];
+    }
+    return NULL;
+}
+
+static void socket_setup(int fd) {
+    // Socket no bloqueante + TCP_NODELAY para baja latencia
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+}
+
+static void client_attach(httpd_req_t *req, int fps, stream_size_t size) {
+    stream_client_t *c = client_alloc();
+    int fd = httpd_req_to_sockfd(req);
+    if (!c || fd < 0) {
+        // Mismo orden que client_release(): cerrar antes de soltar la petición
+        if (fd >= 0) httpd_sess_trigger_close(s_server, fd);
+        httpd_req_async_handler_complete(req);
+        client_count_release();
+        return;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->in_use = true;
+    c->req = req;
+    c->fd = fd;
+    c->size = size;
+    client_set_cap(c, fps);
+    transcode_demand(size, +1);
+
+    socket_setup(fd);
+
+    // El primer envío es la cabecera HTTP de la respuesta
+    c->iov[0].iov_base = (void *)STREAM_HTTP_HEADER;
+    c->iov[0].iov_len = strlen(STREAM_HTTP_HEADER);
+    c->iov_idx = 0;
+    c->iov_cnt = 1;
+
+    ESP_LOGI(TAG, "Cliente fd=%d conectado (%d activos, tope %d fps, %s)", fd, s_client_count, fps,
+             transcode_size_name(size));
+    publish_sessions();
+}
+
+// El handshake ya lo respondió httpd: no hay cabecera HTTP que mandar
+static void client_attach_ws(int fd, uint32_t token, int fps, stream_size_t size) {
+    stream_client_t *c = client_alloc();
+    if (!c) {
+        ws_trigger_close(fd, token);
+        client_count_release();
+        return;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->in_use = true;
+    c->ws = true;
+    c->fd = fd;
+    c->ws_token = token;
+    c->ws_last_ack_us = esp_timer_get_time();
+    c->size = size;
+    client_set_cap(c, fps);
+    transcode_demand(size, +1);
+    socket_setup(fd);
+
+    ESP_LOGI(TAG, "Cliente WS fd=%d conectado (%d activos, tope %d fps, %s)", fd, s_client_count, fps,
+             transcode_size_name(size));
+    publish_sessions();
+}
+
+// ACK acumulativo: confirma 'seq' y todos los anteriores
+static void client_ws_ack(stream_client_t *c, uint32_t seq) {
+    int keep = 0;
+    for (int i = 0; i < c->ws_inflight_cnt; i++) {
+        if (c->ws_inflight[i] > seq) c->ws_inflight[keep++] = c->ws_inflight[i];
+    }
+    c->ws_inflight_cnt = keep;
+    c->ws_last_ack_us = esp_timer_get_time();
+}
+
+static void process_event(const engine_event_t *ev) {
+    switch (ev->type) {
+    case ENGINE_EV_ADD_MJPEG:
+        client_attach(ev->req, (int)ev->value, ev->size);
+        break;
+    case ENGINE_EV_ADD_WS:
+        client_attach_ws(ev->fd, ev->token, (int)ev->value, ev->size);
+        break;
+    case ENGINE_EV_WS_ACK: {
+        stream_client_t *c = client_find_ws(ev->fd, ev->token);
+        if (c) client_ws_ack(c, ev->value);
+        break;
+    }
+    case ENGINE_EV_WS_CLOSED: {
+        stream_client_t *c = client_find_ws(ev->fd, ev->token);
+        if (c) client_release(c, "WS cerrado por el cliente", true);
+        break;
+    }
+    }
+}
+
+// Cabecera de trama WebSocket (servidor -> cliente, sin máscara) + la propia
+static int ws_build_header(uint8_t *out, const frame_t *frame) {
+    uint64_t payload = WS_FRAME_HDR_LEN + frame->len;
+    int n = 0;
+    out[n++] = 0x82;                // FIN + binario
+    if (payload < 126) {
+        out[n++] = (uint8_t)payload;
+    } else if (payload <= 0xFFFF) {
+        out[n++] = 126;
+        out[n++] = (uint8_t)(payload >> 8);
+        out[n++] = (uint8_t)payload;
+    } else {
+        out[n++] = 127;
+        for (int i = 7; i >= 0; i--) out[n++] = (uint8_t)(payload >> (i * 8));
+    }
+
+    uint32_t seq = frame->seq;
+    uint64_t ts = (uint64_t)frame->timestamp_us;
+    for (int i = 0; i < 4; i++) out[n++] = (uint8_t)(seq >> (i * 8));
+    for (int i = 0; i < 8; i++) out[n++] = (uint8_t)(ts >> (i * 8));
+    return n;
+}
+
+// Prepara los segmentos para enviar un frame (toma una referencia)
+static void client_start_frame(stream_client_t *c, const frame_t *frame) {
+    // Los huecos que dejamos a propósito no son culpa del enlace. En los
+    // sub-streams los huecos los marca el ritmo de transcode, no la red.
+    if (c->size == STREAM_SIZE_FULL && c->last_seq && frame->seq > c->last_seq + 1 + c->held_gap) {
+        uint32_t skipped = frame->seq - c->last_seq - 1 - c->held_gap;
+        c->frames_skipped += skipped;
+        abr_sample_skip(skipped);
+    }
+    c->held_gap = 0;
+    if (c->fps_cap > 0) c->tokens -= TOKEN_UNIT;
+    c->frame = client_frame_ref(c, frame);
+    c->sending = true;
+    c->sending_seq = frame->seq;
+    c->frame_start_us = esp_timer_get_time();
+
+    int hlen;
+    if (c->ws) {
+        hlen = ws_build_header((uint8_t *)c->hdr, frame);
+        // El plazo del ACK corre desde el frame más viejo sin confirmar
+        if (c->ws_inflight_cnt == 0) c->ws_last_ack_us = c->frame_start_us;
+        c->ws_inflight[c->ws_inflight_cnt++] = frame->seq;
+    } else {
+        hlen = snprintf(c->hdr, sizeof(c->hdr),
+            "\r\n--" PART_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
+            (unsigned)frame->len);
+    }
+
+    c->iov[0].iov_base = c->hdr;
+    c->iov[0].iov_len = hlen;
+    c->iov[1].iov_base = (void *)frame->buf;
+    c->iov[1].iov_len = frame->len;
+    c->iov_idx = 0;
+    c->iov_cnt = 2;
+}
+
+// Escribe todo lo posible sin bloquear. false si el socket falló.
+static bool client_flush(stream_client_t *c) {
+    while (client_busy(c)) {
+        // Cabecera + JPEG en una sola llamada (un solo segmento TCP si entra)
+        int n = lwip_writev(c->fd, &c->iov[c->iov_idx], c->iov_cnt - c->iov_idx);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            return false;
+        }
+        c->bytes_sent += n;
+        s_window_bytes += n;
+
+        // Avanzar sobre lo enviado (puede cortar en medio de un segmento)
+        while (n > 0 && client_busy(c)) {
+            struct iovec *v = &c->iov[c->iov_idx];
+            if ((size_t)n >= v->iov_len) {
+                n -= v->iov_len;
+                v->iov_len = 0;
+                c->iov_idx++;
+            } else {
+                v->iov_base = (uint8_t *)v->iov_base + n;
+                v->iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+
+    // Frame completo: liberar la referencia (si no se copió antes)
+    if (c->sending) {
+        c->sending = false;
+        c->last_seq = c->sending_seq;
+        uint32_t send_us = (uint32_t)(esp_timer_get_time() - c->frame_start_us);
+        c->frames_sent++;
+        c->send_us_total += send_us;
+        s_window_frames++;
+        // El ABR ajusta la calidad del sensor: solo lo alimentan los envíos a tamaño completo
+        if (c->size == STREAM_SIZE_FULL) abr_sample_send(send_us);
+        if (c->frame) {
+            client_frame_release(c, c->frame);
+            c->frame = NULL;
+        }
+    }
+    return true;
+}
+
+// Envío que ya lleva más de un período: lo que falta del JPEG se copia al
+// buffer del cliente y la referencia vuelve al bus (o a transcode). El
+// buffer se reutiliza entre frames. false si no hay memoria.
+static bool client_detach(stream_client_t *c) {
+    struct iovec *jpeg = &c->iov[1];
+    if (jpeg->iov_len > c->copy_cap) {
+        uint8_t *nb = heap_caps_realloc(c->copy, jpeg->iov_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!nb) return false;
+        c->copy = nb;
+        c->copy_cap = jpeg->iov_len;
+    }
+    if (jpeg->iov_len > 0) {
+        memcpy(c->copy, jpeg->iov_base, jpeg->iov_len);
+        jpeg->iov_base = c->copy;
+    }
+    client_frame_release(c, c->frame);
+    c->frame = NULL;
+    c->frames_copied++;
+    return true;
+}
+
+// Período de cámara medido sobre los frames que entrega el bus
+static void track_frame_period(const frame_t *frame) {
+    int64_t delta = frame->timestamp_us - s_last_frame_us;
+    if (s_last_frame_us && delta > 0 && delta < 1000000) {
+        s_frame_period_us = (s_frame_period_us * 7 + delta) / 8;
+    }
+    s_last_frame_us = frame->timestamp_us;
+}
+
+// Cada STATS_WINDOW_MS recalcula FPS y bytes por segundo del motor
+static void update_stats(const frame_t *last_frame) {
+    if (last_frame) {
+        s_stats.width = last_frame->width;
+        s_stats.height = last_frame->height;
+        s_stats.last_frame_len = last_frame->len;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (s_window_start == 0) {
+        s_window_start = now;
+        return;
+    }
+    int64_t elapsed = now - s_window_start;
+    if (elapsed < (int64_t)STATS_WINDOW_MS * 1000) return;
+
+    s_stats.clients = s_client_count;
+    s_stats.ws_clients = 0;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (s_clients[i].in_use && s_clients[i].ws) s_stats.ws_clients++;
+    }
+    s_stats.fps_x10 = (uint32_t)((uint64_t)s_window_frames * 10000000ULL / elapsed);
+    s_stats.bytes_per_sec = (uint32_t)((uint64_t)s_window_bytes * 1000000ULL / elapsed);
+    s_stats.total_frames += s_window_frames;
+    s_stats.total_bytes += s_window_bytes;
+
+    if (s_window_frames > 0) {
+        ESP_LOGI(TAG, "%ux%u: %lu.%lu fps (envios), %lu KB/s, %d clientes",
+                 s_stats.width, s_stats.height,
+                 (unsigned long)(s_stats.fps_x10 / 10), (unsigned long)(s_stats.fps_x10 % 10),
+                 (unsigned long)(s_stats.bytes_per_sec / 1024), s_stats.clients);
+    }
+    s_window_frames = 0;
+    s_window_bytes = 0;
+    s_window_start = now;
+
+    abr_update();
+    publish_sessions();
+}
+
+// Bytes que le quedan por enviar a un cliente ocupado
+static size_t client_pending(const stream_client_t *c) {
+    size_t pending = 0;
+    for (int i = c->iov_idx; i < c->iov_cnt; i++) pending += c->iov[i].iov_len;
+    return pending;
+}
+
+// ============================================================================
+// TAREA PRINCIPAL
+// ============================================================================
+static void engine_task(void *arg) {
+    frame_bus_sub_t *sub = NULL;
+
+    while (true) {
+        // Sin clientes: soltar el frame bus y dormir hasta que llegue uno
+        engine_event_t ev;
+        TickType_t wait = (s_client_count > 0) ? 0 : portMAX_DELAY;
+        if (sub && s_client_count == 0) {
+            frame_bus_unsubscribe(sub);
+            sub = NULL;
+            s_window_start = 0;     // No contar el tiempo ocioso en la próxima ventana
+            abr_reset();
+        }
+        while (xQueueReceive(s_events, &ev, wait) == pdTRUE) {
+            process_event(&ev);
+            wait = 0;
+        }
+        if (s_client_count == 0) continue;
+
+        if (!sub) {
+            sub = frame_bus_subscribe("stream");
+            if (!sub) {
+                vTaskDelay(pdMS_TO_TICKS(100));
+                continue;
+            }
+        }
+
+        if (!http_server_is_streaming_active()) {
+            for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+                if (s_clients[i].in_use) client_close(&s_clients[i], "emision expirada");
+            }
+            continue;
+        }
+
+        bool any_busy = false;
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            stream_client_t *c = &s_clients[i];
+            if (!c->in_use) continue;
+            if (c->ws && c->ws_inflight_cnt > 0 &&
+                now - c->ws_last_ack_us > (int64_t)WS_ACK_TIMEOUT_MS * 1000) {
+                client_close(c, "sin ACK");
+                continue;
+            }
+            if (!client_busy(c)) continue;
+            any_busy = true;
+            int64_t limit = s_frame_period_us > DETACH_MIN_US ? s_frame_period_us : DETACH_MIN_US;
+            if (c->frame && now - c->frame_start_us > limit && !client_detach(c)) {
+                client_close(c, "sin memoria para copia");
+            }
+        }
+
+        // Repartir el frame nuevo a los clientes que están libres. Los que
+        // siguen enviando el anterior, o los WebSocket con la ventana de ACK
+        // llena, lo omiten (no frenan a los demás).
+        const frame_t *frame = frame_bus_acquire(sub, any_busy ? 0 : pdMS_TO_TICKS(FRAME_WAIT_MS));
+        update_stats(frame);
+        if (frame) {
+            track_frame_period(frame);
+            now = esp_timer_get_time();
+            still_sig_t sig;
+            bool check_still = still_enabled();
+            if (check_still) still_signature(frame, &sig);
+
+            for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+                stream_client_t *c = &s_clients[i];
+                if (!c->in_use || c->size != STREAM_SIZE_FULL) continue;
+                if (client_ready(c)) {
+                    if (check_still && still_should_skip(&c->still, &sig, now)) {
+                        // Nada nuevo que mostrar: no cuenta como omitido para el ABR
+                        c->frames_suppressed++;
+                        c->held_gap++;
+                    } else if (client_has_token(c, now)) {
+                        client_start_frame(c, frame);
+                        if (check_still) still_mark_sent(&c->still, &sig, now);
+                        any_busy = true;
+                    } else {
+                        // Tope de FPS: tampoco cuenta como omitido
+                        c->frames_capped++;
+                        c->held_gap++;
+                    }
+                } else if (client_busy(c)) {
+                    abr_sample_backlog(client_pending(c));
+                }
+            }
+            frame_bus_done(sub, frame);
+        }
+
+        // Sub-streams: el último frame reducido, si es más nuevo que el que
+        // ya se le ofreció al cliente (transcode lo publica con el seq de origen)
+        now = esp_timer_get_time();
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            stream_client_t *c = &s_clients[i];
+            if (!c->in_use || c->size == STREAM_SIZE_FULL || !client_ready(c)) continue;
+            const frame_t *small = transcode_acquire(c->size, c->offered_seq);
+            if (!small) continue;
+            c->offered_seq = small->seq;
+            if (client_has_token(c, now)) {
+                client_start_frame(c, small);
+                any_busy = true;
+            } else {
+                c->frames_capped++;
+            }
+            transcode_release(small);
+        }
+        if (!any_busy) continue;
+
+        // Esperar a que algún socket acepte datos
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        int maxfd = -1;
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            stream_client_t *c = &s_clients[i];
+            if (c->in_use && client_busy(c)) {
+                FD_SET(c->fd, &wfds);
+                if (c->fd > maxfd) maxfd = c->fd;
+            }
+        }
+        struct timeval tv = { .tv_sec = 0, .tv_usec = SELECT_TIMEOUT_MS * 1000 };
+        int ready = select(maxfd + 1, NULL, &wfds, NULL, &tv);
+        if (ready <= 0) continue;
+
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+            stream_client_t *c = &s_clients[i];
+            if (c->in_use && FD_ISSET(c->fd, &wfds) && !client_flush(c)) {
+                client_close(c, "socket cerrado");
+            }
+        }
+    }
+}
+
+// ============================================================================
+// API (interna del componente)
+// ============================================================================
+static void load_default_fps(void) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_STREAM, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        int32_t val;
+        if (nvs_get_i32(nvs_handle, NVS_KEY_DEFAULT_FPS, &val) == ESP_OK &&
+            val >= 0 && val <= STREAM_MAX_FPS_CAP) {
+            s_default_fps = val;
+        }
+        nvs_close(nvs_handle);
+    }
+}
+
+esp_err_t stream_engine_start(httpd_handle_t server) {
+    if (s_events) return ESP_OK;
+
+    s_server = server;
+    load_default_fps();
+    s_events = xQueueCreate(EVENT_QUEUE_LEN, sizeof(engine_event_t));
+    if (!s_events) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreatePinnedToCore(engine_task, "stream_eng", ENGINE_TASK_STACK, NULL,
+                                ENGINE_TASK_PRIO, NULL, ENGINE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de streaming");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static int resolve_fps(int fps) {
+    if (fps < 0) return s_default_fps;
+    return fps > STREAM_MAX_FPS_CAP ? STREAM_MAX_FPS_CAP : fps;
+}
+
+esp_err_t stream_engine_add_client(httpd_req_t *req, int fps, stream_size_t size) {
+    if (!s_events) return ESP_ERR_INVALID_STATE;
+    if (!client_count_reserve()) return ESP_ERR_NO_MEM;
+
+    httpd_req_t *async_req = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &async_req);
+    if (err != ESP_OK) {
+        client_count_release();
+        return err;
+    }
+
+    engine_event_t ev = { .type = ENGINE_EV_ADD_MJPEG, .req = async_req, .value = resolve_fps(fps),
+                          .size = size };
+    if (xQueueSend(s_events, &ev, 0) != pdTRUE) {
+        client_count_release();
+        httpd_req_async_handler_complete(async_req);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// ============================================================================
+// WEBSOCKET (corre en la tarea httpd)
+// ============================================================================
+static uint32_t s_ws_next_token = 1;
+
+static void ws_sess_free(void *ctx) {
+    ws_sess_t *sess = (ws_sess_t *)ctx;
+    engine_event_t ev = { .type = ENGINE_EV_WS_CLOSED, .fd = sess->fd, .token = sess->token };
+    // La baja no se puede perder: si el motor no la ve, sigue usando un fd
+    // que httpd puede reasignar. El motor vacía la cola en cada vuelta
+    // (como mucho SELECT_TIMEOUT_MS o FRAME_WAIT_MS), así que la espera es corta.
+    xQueueSend(s_events, &ev, portMAX_DELAY);
+    free(sess);
+}
+
+esp_err_t stream_engine_add_ws_client(httpd_req_t *req, int fps, stream_size_t size) {
+    if (!s_events) return ESP_ERR_INVALID_STATE;
+    if (!client_count_reserve()) return ESP_ERR_NO_MEM;
+
+    ws_sess_t *sess = malloc(sizeof(ws_sess_t));
+    if (!sess) {
+        client_count_release();
+        return ESP_ERR_NO_MEM;
+    }
+    sess->fd = httpd_req_to_sockfd(req);
+    sess->token = s_ws_next_token++;
+
+    engine_event_t ev = { .type = ENGINE_EV_ADD_WS, .fd = sess->fd, .token = sess->token,
+                          .value = resolve_fps(fps), .size = size };
+    if (xQueueSend(s_events, &ev, 0) != pdTRUE) {
+        client_count_release();
+        free(sess);
+        return ESP_ERR_NO_MEM;
+    }
+    // httpd llama a ws_sess_free cuando se cierra la sesión
+    req->sess_ctx = sess;
+    req->free_ctx = ws_sess_free;
+    return ESP_OK;
+}
+
+esp_err_t stream_engine_ws_recv(httpd_req_t *req) {
+    httpd_ws_frame_t pkt = {0};
+    esp_err_t err = httpd_ws_recv_frame(req, &pkt, 0);
+    if (err != ESP_OK) return err;
+
+    // Los ACK son cortos: el seq en texto decimal o como u32 LE
+    uint8_t buf[16] = {0};
+    if (pkt.len >= sizeof(buf)) return ESP_FAIL;
+    pkt.payload = buf;
+    if (pkt.len > 0) {
+        err = httpd_ws_recv_frame(req, &pkt, pkt.len);
+        if (err != ESP_OK) return err;
+    }
+
+    ws_sess_t *sess = (ws_sess_t *)req->sess_ctx;
+    if (pkt.type == HTTPD_WS_TYPE_CLOSE) {
+        // Devolver ESP_FAIL cierra la sesión; ws_sess_free avisa al motor
+        return ESP_FAIL;
+    }
+    if (!sess || (pkt.type != HTTPD_WS_TYPE_TEXT && pkt.type != HTTPD_WS_TYPE_BINARY)) {
+        return ESP_OK;      // PING/PONG: se ignoran (los navegadores no los mandan)
+    }
+
+    uint32_t seq;
+    if (pkt.type == HTTPD_WS_TYPE_BINARY && pkt.len == 4) {
+        seq = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+    } else {
+        seq = strtoul((const char *)buf, NULL, 10);
+    }
+    engine_event_t ev = { .type = ENGINE_EV_WS_ACK, .fd = sess->fd, .token = sess->token, .value = seq };
+    // ACK acumulativo: si se pierde uno, el siguiente lo cubre
+    xQueueSend(s_events, &ev, 0);
+    return ESP_OK;
+}
+
+int stream_engine_client_count(void) {
+    return s_client_count;
+}
+
+void stream_engine_get_stats(stream_engine_stats_t *stats) {
+    if (!stats) return;
+    *stats = s_stats;
+    stats->clients = s_client_count;
+}
+
+int stream_engine_get_sessions(stream_session_t *out, int max) {
+    portENTER_CRITICAL(&s_count_lock);
+    int n = s_session_count < max ? s_session_count : max;
+    memcpy(out, s_sessions, n * sizeof(stream_session_t));
+    portEXIT_CRITICAL(&s_count_lock);
+    return n;
+}
+
+int stream_engine_get_default_fps(void) {
+    return s_default_fps;
+}
+
+esp_err_t stream_engine_set_default_fps(int fps) {
+    if (fps < 0 || fps > STREAM_MAX_FPS_CAP) return ESP_ERR_INVALID_ARG;
+    s_default_fps = fps;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_STREAM, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_DEFAULT_FPS, fps);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+
+    ESP_LOGI(TAG, "Tope de FPS por defecto: %d (0 = sin tope)", fps);
+    return err;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "transcode.h"
+
+// ============================================================================
+// MOTOR DE STREAMING MJPEG (uso interno del componente http_server)
+// ============================================================================
+// Una sola tarea atiende todos los sockets de /stream con escrituras no
+// bloqueantes y select(). El handler HTTP solo entrega el socket (API async
+// de esp_http_server) y vuelve enseguida, así la tarea httpd queda libre.
+//
+// /ws/stream usa el mismo motor: cada JPEG va en un mensaje binario
+// [seq u32 LE][timestamp_us u64 LE][JPEG] y el navegador responde con el
+// seq ya mostrado. Con dos frames sin confirmar el cliente deja de recibir
+// hasta ponerse al día, así la latencia no se acumula en el buffer TCP.
+//
+// Con size = QVGA / QQVGA el cliente recibe los frames reducidos que genera
+// transcode.c en lugar de los del sensor (mismo seq y timestamp).
+
+#define STREAM_MAX_CLIENTS 4
+#define STREAM_MAX_FPS_CAP 30
+
+// Throughput medido en la última ventana (para comparar VGA / SVGA)
+typedef struct {
+    int clients;
+    int ws_clients;
+    uint16_t width;
+    uint16_t height;
+    size_t last_frame_len;
+    uint32_t fps_x10;           // Frames enviados por segundo x10 (suma de clientes)
+    uint32_t bytes_per_sec;
+    uint64_t total_frames;
+    uint64_t total_bytes;
+} stream_engine_stats_t;
+
+// Una fila de /api/stream/sessions
+typedef struct {
+    int fd;
+    bool ws;
+    stream_size_t size;
+    char ip[16];
+    int fps_cap;                // 0 = sin tope
+    uint32_t connected_s;
+    uint32_t frames_sent;
+    uint32_t frames_skipped;    // Por enlace lento
+    uint32_t frames_capped;     // Por el tope de FPS
+    uint32_t frames_suppressed; // Por escena estática
+    uint32_t frames_copied;     // Envíos largos que salieron de una copia propia
+    uint64_t bytes_sent;
+    uint32_t avg_send_us;
+} stream_session_t;
+
+// Crea la tarea del motor (llamar una vez tras httpd_start)
+esp_err_t stream_engine_start(httpd_handle_t server);
+
+// Toma posesión del socket de la petición. Si devuelve ESP_OK el handler
+// debe retornar ESP_OK sin enviar nada más por req.
+// fps: tope del cliente (0 = sin tope, < 0 = el tope por defecto)
+esp_err_t stream_engine_add_client(httpd_req_t *req, int fps, stream_size_t size);
+
+// Alta de un WebSocket tras el handshake (req->method == HTTP_GET).
+// Comparte el cupo de STREAM_MAX_CLIENTS con /stream.
+esp_err_t stream_engine_add_ws_client(httpd_req_t *req, int fps, stream_size_t size);
+
+// Mensajes entrantes del WebSocket (ACKs). ESP_FAIL cierra la sesión.
+esp_err_t stream_engine_ws_recv(httpd_req_t *req);
+
+// Clientes conectados (incluye los que esperan ser atendidos)
+int stream_engine_client_count(void);
+
+// Copia las estadísticas de throughput
+void stream_engine_get_stats(stream_engine_stats_t *stats);
+
+// Copia hasta max sesiones (se actualizan cada ventana de estadísticas)
+int stream_engine_get_sessions(stream_session_t *out, int max);
+
+// Tope de FPS para clientes que no piden ?fps= (persistido en NVS)
+int stream_engine_get_default_fps(void);
+esp_err_t stream_engine_set_default_fps(int fps);
@@ -0,0 +1,344 @@
+#include "transcode.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "jpeg_decoder.h"
+#include "img_converters.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+
+static const char *TAG = "TRANSCODE";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define TC_TASK_STACK       8192        // fmt2jpg usa bastante pila
+#define TC_TASK_PRIO        (tskIDLE_PRIORITY + 2)
+#define TC_TASK_CORE        0           // El core 1 queda para red y streaming
+#define TC_FRAME_WAIT_MS    200
+#define TC_QUALITY          60          // Escala de fmt2jpg (0-100, mayor = mejor)
+
+// Buffers por tamaño: el último publicado + los que aún envían clientes lentos
+#define TC_SLOTS            3
+
+typedef struct {
+    frame_t pub;
+    uint8_t *jpg;               // Salida de fmt2jpg (malloc)
+    int refs;
+} tc_slot_t;
+
+static const uint16_t s_max_width[STREAM_SIZE_COUNT] = { 0, 320, 160 };
+static const char *s_size_names[STREAM_SIZE_COUNT] = { "full", "qvga", "qqvga" };
+
+static tc_slot_t s_slots[STREAM_SIZE_COUNT][TC_SLOTS];
+static tc_slot_t *s_latest[STREAM_SIZE_COUNT];      // El caché guarda una referencia
+static int s_demand[STREAM_SIZE_COUNT];
+static transcode_stats_t s_stats[STREAM_SIZE_COUNT];
+static uint64_t s_total_us[STREAM_SIZE_COUNT];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_task = NULL;
+
+// Destino del decodificador RGB565, uno por tamaño: se decodifican todos
+// los tamaños pedidos y el frame del bus se devuelve antes de recodificar
+// (solo los usa la tarea)
+static uint8_t *s_rgb[STREAM_SIZE_COUNT];
+static size_t s_rgb_cap[STREAM_SIZE_COUNT];
+
+// Un tamaño a medio producir: decodificado (o copiado) y esperando fmt2jpg
+typedef struct {
+    tc_slot_t *slot;
+    uint16_t width;
+    uint16_t height;
+    size_t rgb_len;             // 0 = el JPEG de origen se copió tal cual
+    uint8_t *copy;
+    size_t copy_len;
+    int64_t t0;
+} tc_stage_t;
+
+// ============================================================================
+// REFERENCIAS
+// ============================================================================
+static tc_slot_t *slot_of(const frame_t *frame) {
+    // pub es el primer campo del slot
+    return (tc_slot_t *)frame;
+}
+
+static void slot_unref_locked(tc_slot_t *slot) {
+    if (slot->refs > 0) slot->refs--;
+}
+
+const frame_t *transcode_ref(const frame_t *frame) {
+    portENTER_CRITICAL(&s_lock);
+    slot_of(frame)->refs++;
+    portEXIT_CRITICAL(&s_lock);
+    return frame;
+}
+
+void transcode_release(const frame_t *frame) {
+    if (!frame) return;
+    portENTER_CRITICAL(&s_lock);
+    slot_unref_locked(slot_of(frame));
+    portEXIT_CRITICAL(&s_lock);
+}
+
+const frame_t *transcode_acquire(stream_size_t size, uint32_t newer_than) {
+    if (size <= STREAM_SIZE_FULL || size >= STREAM_SIZE_COUNT) return NULL;
+
+    const frame_t *out = NULL;
+    portENTER_CRITICAL(&s_lock);
+    tc_slot_t *slot = s_latest[size];
+    if (slot && slot->pub.seq > newer_than) {
+        slot->refs++;
+        out = &slot->pub;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return out;
+}
+
+// ============================================================================
+// RECODIFICACIÓN
+// ============================================================================
+static esp_jpeg_image_scale_t pick_scale(uint16_t src_width, uint16_t max_width, int *divisor) {
+    static const esp_jpeg_image_scale_t scales[] = {
+        JPEG_IMAGE_SCALE_0, JPEG_IMAGE_SCALE_1_2, JPEG_IMAGE_SCALE_1_4, JPEG_IMAGE_SCALE_1_8
+    };
+    int i = 0;
+    while (i < 3 && (src_width >> i) > max_width) i++;
+    *divisor = 1 << i;
+    return scales[i];
+}
+
+// Slot libre: sin referencias (el publicado siempre tiene la del caché)
+static tc_slot_t *find_free_slot(stream_size_t size) {
+    tc_slot_t *found = NULL;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < TC_SLOTS; i++) {
+        if (s_slots[size][i].refs == 0) {
+            found = &s_slots[size][i];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return found;
+}
+
+// Primera mitad: lo único que lee el frame del bus
+static esp_err_t decode_stage(stream_size_t size, const frame_t *src, tc_stage_t *st) {
+    int divisor;
+    esp_jpeg_image_scale_t scale = pick_scale(src->width, s_max_width[size], &divisor);
+
+    st->width = src->width / divisor;
+    st->height = src->height / divisor;
+    st->rgb_len = 0;
+    st->copy = NULL;
+
+    if (divisor == 1) {
+        // El sensor ya entrega ese tamaño: copiar sin recodificar
+        st->copy = malloc(src->len);
+        if (!st->copy) return ESP_ERR_NO_MEM;
+        memcpy(st->copy, src->buf, src->len);
+        st->copy_len = src->len;
+        return ESP_OK;
+    }
+
+    size_t need = (size_t)st->width * st->height * 2;
+    if (need > s_rgb_cap[size]) {
+        uint8_t *nb = heap_caps_realloc(s_rgb[size], need, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!nb) return ESP_ERR_NO_MEM;
+        s_rgb[size] = nb;
+        s_rgb_cap[size] = need;
+    }
+
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = (uint8_t *)src->buf,
+        .indata_size = src->len,
+        .outbuf = s_rgb[size],
+        .outbuf_size = s_rgb_cap[size],
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .out_scale = scale,
+        .flags = {
+            .swap_color_bytes = 1,  // fmt2jpg espera RGB565 big-endian como el sensor
+        },
+    };
+    esp_jpeg_image_output_t img;
+    esp_err_t err = esp_jpeg_decode(&cfg, &img);
+    if (err != ESP_OK) return err;
+
+    st->width = img.width;
+    st->height = img.height;
+    st->rgb_len = img.output_len;
+    return ESP_OK;
+}
+
+// Segunda mitad: trabaja solo sobre el RGB (el frame del bus ya se devolvió)
+static esp_err_t encode_stage(stream_size_t size, tc_stage_t *st, uint32_t seq, int64_t timestamp_us) {
+    uint8_t *jpg = st->copy;
+    size_t jpg_len = st->copy_len;
+    if (!jpg && !fmt2jpg(s_rgb[size], st->rgb_len, st->width, st->height, PIXFORMAT_RGB565,
+                         TC_QUALITY, &jpg, &jpg_len)) {
+        return ESP_FAIL;
+    }
+
+    tc_slot_t *slot = st->slot;
+    free(slot->jpg);
+    slot->jpg = jpg;
+    slot->pub.buf = jpg;
+    slot->pub.len = jpg_len;
+    slot->pub.width = st->width;
+    slot->pub.height = st->height;
+    slot->pub.seq = seq;                    // Mismo seq que el origen
+    slot->pub.timestamp_us = timestamp_us;
+    return ESP_OK;
+}
+
+static void publish(stream_size_t size, tc_slot_t *slot) {
+    portENTER_CRITICAL(&s_lock);
+    if (s_latest[size]) slot_unref_locked(s_latest[size]);
+    slot->refs = 1;
+    s_latest[size] = slot;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Sin clientes de un tamaño: soltar el publicado para poder liberar memoria
+static void drop_idle_sizes(void) {
+    for (int size = 1; size < STREAM_SIZE_COUNT; size++) {
+        if (s_demand[size] > 0) continue;
+        portENTER_CRITICAL(&s_lock);
+        if (s_latest[size]) {
+            slot_unref_locked(s_latest[size]);
+            s_latest[size] = NULL;
+        }
+        uint8_t *to_free[TC_SLOTS] = { 0 };
+        for (int i = 0; i < TC_SLOTS; i++) {
+            tc_slot_t *slot = &s_slots[size][i];
+            if (slot->refs == 0 && slot->jpg) {
+                to_free[i] = slot->jpg;
+                memset(slot, 0, sizeof(*slot));
+            }
+        }
+        portEXIT_CRITICAL(&s_lock);
+        for (int i = 0; i < TC_SLOTS; i++) free(to_free[i]);
+    }
+}
+
+static void transcode_task(void *arg) {
+    frame_bus_sub_t *sub = NULL;
+
+    while (true) {
+        int total = 0;
+        for (int size = 1; size < STREAM_SIZE_COUNT; size++) total += s_demand[size];
+
+        if (total == 0) {
+            if (sub) {
+                frame_bus_unsubscribe(sub);
+                sub = NULL;
+                drop_idle_sizes();
+                for (int size = 1; size < STREAM_SIZE_COUNT; size++) {
+                    free(s_rgb[size]);
+                    s_rgb[size] = NULL;
+                    s_rgb_cap[size] = 0;
+                }
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (!sub) {
+            sub = frame_bus_subscribe("transcode");
+            if (!sub) {
+                vTaskDelay(pdMS_TO_TICKS(500));
+                continue;
+            }
+        }
+
+        // Si la recodificación tarda más que un frame, el bus descarta los
+        // intermedios: siempre se trabaja sobre el más reciente.
+        const frame_t *src = frame_bus_acquire(sub, pdMS_TO_TICKS(TC_FRAME_WAIT_MS));
+        if (!src) continue;
+
+        // Decodificar todos los tamaños pedidos y devolver el frame enseguida:
+        // fmt2jpg es lo lento y no necesita el buffer de la cámara
+        tc_stage_t stage[STREAM_SIZE_COUNT] = { 0 };
+        for (int size = 1; size < STREAM_SIZE_COUNT; size++) {
+            if (s_demand[size] <= 0) continue;
+
+            tc_slot_t *slot = find_free_slot(size);
+            if (!slot) {
+                s_stats[size].busy_skips++;
+                continue;
+            }
+            stage[size].t0 = esp_timer_get_time();
+            esp_err_t err = decode_stage(size, src, &stage[size]);
+            if (err != ESP_OK) {
+                s_stats[size].errors++;
+                ESP_LOGW(TAG, "Error decodificando para %s: %s", s_size_names[size], esp_err_to_name(err));
+                continue;
+            }
+            stage[size].slot = slot;
+        }
+        uint32_t seq = src->seq;
+        int64_t timestamp_us = src->timestamp_us;
+        frame_bus_done(sub, src);
+
+        for (int size = 1; size < STREAM_SIZE_COUNT; size++) {
+            tc_stage_t *st = &stage[size];
+            if (!st->slot) continue;
+            esp_err_t err = encode_stage(size, st, seq, timestamp_us);
+            if (err != ESP_OK) {
+                s_stats[size].errors++;
+                ESP_LOGW(TAG, "Error recodificando a %s: %s", s_size_names[size], esp_err_to_name(err));
+                continue;
+            }
+            publish(size, st->slot);
+
+            s_total_us[size] += esp_timer_get_time() - st->t0;
+            s_stats[size].produced++;
+            s_stats[size].avg_us = (uint32_t)(s_total_us[size] / s_stats[size].produced);
+            s_stats[size].width = st->slot->pub.width;
+            s_stats[size].height = st->slot->pub.height;
+        }
+        drop_idle_sizes();
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t transcode_start(void) {
+    if (s_task) return ESP_OK;
+    if (xTaskCreatePinnedToCore(transcode_task, "transcode", TC_TASK_STACK, NULL,
+                                TC_TASK_PRIO, &s_task, TC_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de recodificacion");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+stream_size_t transcode_parse_size(const char *name) {
+    if (!name) return STREAM_SIZE_FULL;
+    for (int size = 0; size < STREAM_SIZE_COUNT; size++) {
+        if (strcasecmp(name, s_size_names[size]) == 0) return (stream_size_t)size;
+    }
+    return STREAM_SIZE_FULL;
+}
+
+const char *transcode_size_name(stream_size_t size) {
+    return (size < STREAM_SIZE_COUNT) ? s_size_names[size] : "?";
+}
+
+void transcode_demand(stream_size_t size, int delta) {
+    if (size <= STREAM_SIZE_FULL || size >= STREAM_SIZE_COUNT) return;
+    portENTER_CRITICAL(&s_lock);
+    s_demand[size] += delta;
+    if (s_demand[size] < 0) s_demand[size] = 0;
+    portEXIT_CRITICAL(&s_lock);
+    if (s_task) xTaskNotifyGive(s_task);
+}
+
+void transcode_get_stats(stream_size_t size, transcode_stats_t *stats) {
+    if (!stats || size >= STREAM_SIZE_COUNT) return;
+    *stats = s_stats[size];
+    stats->clients = s_demand[size];
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "esp_err.h"
+#include "frame_bus.h"
+#include <stdint.h>
+
+// ============================================================================
+// SUB-STREAMS REDUCIDOS (uso interno del componente http_server)
+// ============================================================================
+// Una tarea decodifica el JPEG del sensor a 1/2, 1/4 o 1/8 con esp_jpeg y lo
+// vuelve a comprimir. Cada tamaño se genera como máximo una vez por frame
+// de origen y todos los clientes de ese tamaño comparten el resultado, así
+// el costo de CPU depende de cuántos tamaños se piden, no de cuántos clientes.
+
+typedef enum {
+    STREAM_SIZE_FULL = 0,       // Lo que entrega el sensor (sin recodificar)
+    STREAM_SIZE_QVGA,           // Ancho <= 320
+    STREAM_SIZE_QQVGA,          // Ancho <= 160
+    STREAM_SIZE_COUNT
+} stream_size_t;
+
+typedef struct {
+    uint32_t produced;          // Frames recodificados
+    uint32_t busy_skips;        // Frames no procesados (todos los buffers en uso)
+    uint32_t errors;
+    uint32_t avg_us;            // Decodificar + codificar, promedio
+    uint16_t width;
+    uint16_t height;
+    int clients;
+} transcode_stats_t;
+
+esp_err_t transcode_start(void);
+
+// "qvga" / "qqvga" / "full" (NULL o desconocido = FULL)
+stream_size_t transcode_parse_size(const char *name);
+const char *transcode_size_name(stream_size_t size);
+
+// El motor avisa cuántos clientes piden cada tamaño (+1 / -1)
+void transcode_demand(stream_size_t size, int delta);
+
+// Último frame reducido con seq > newer_than, con una referencia para el
+// llamador (devolver con transcode_release). NULL si no hay uno más nuevo.
+const frame_t *transcode_acquire(stream_size_t size, uint32_t newer_than);
+const frame_t *transcode_ref(const frame_t *frame);
+void transcode_release(const frame_t *frame);
+
+void transcode_get_stats(stream_size_t size, transcode_stats_t *stats);
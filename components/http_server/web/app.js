@@ -0,0 +1,231 @@
+let streamActive=false,forceMode=false,statusInterval=null,lastStatus=null;
+let viewerFiles=[],viewerIndex=0,wsStream=null;
+let filesOffset=0,filesTotal=0;const FILES_PAGE=50;
+
+document.querySelectorAll('input[name=cap-mode]').forEach(r=>r.addEventListener('change',e=>{
+document.getElementById('video-opts').style.display=e.target.value=='1'?'block':'none';
+document.getElementById('rec-opts').style.display=e.target.value=='1'||e.target.value=='3'?'block':'none';}));
+
+function showTab(n){document.querySelectorAll('.tab').forEach((t,i)=>t.classList.toggle('active',i==n));
+document.querySelectorAll('.panel').forEach((p,i)=>p.classList.toggle('active',i==n));
+if(n==0)checkStatus();if(n==1)loadConfig();if(n==2)loadWifi();if(n==3)loadFiles();}
+
+function checkStatus(){let ctrl=new AbortController();setTimeout(()=>ctrl.abort(),2000);
+fetch('/api/motion/status',{signal:ctrl.signal,cache:'no-store'}).then(r=>r.json()).then(applyStatus)
+.catch(e=>{if(e.name!=='AbortError')console.error(e);});}
+
+function applyStatus(d){
+if(lastStatus&&lastStatus.sd!==d.sd&&document.getElementById('p3').classList.contains('active'))loadFiles();
+if(lastStatus&&(lastStatus.wifi_connected!==d.wifi_connected||lastStatus.ap_mode!==d.ap_mode)
+&&document.getElementById('p2').classList.contains('active'))loadWifi();
+lastStatus=d;streamActive=d.active;let st=document.getElementById('stream-status');
+let container=document.getElementById('stream-container');
+if(d.active){
+let modeStr=d.is_live?' (Vista en vivo)':' (Movimiento)';
+st.className='status status-on';st.textContent='🟢 TRANSMITIENDO'+modeStr;
+if(!container.innerHTML||container.innerHTML.indexOf('placeholder')>-1){
+if(!startWsStream(container))startMjpeg(container);}
+}else{
+stopWsStream();st.className='status status-off';st.textContent='🔴 SIN TRANSMISIÓN - Esperando movimiento...';
+container.innerHTML='<div id="stream-placeholder"><span style="font-size:3em">📷</span><p>Cámara en espera</p><p style="color:#888;font-size:0.8em">El video se activará cuando el sensor detecte movimiento</p></div>';
+}}
+
+function startMjpeg(container){container.innerHTML='<img id="stream" src="/stream?t='+Date.now()+'" alt="Video">';}
+
+// WebSocket: [seq u32][ts u64][JPEG]; se confirma cada frame recién cuando se dibujó
+function startWsStream(container){if(!window.WebSocket)return false;
+container.innerHTML='<img id="stream" alt="Video">';let img=document.getElementById('stream');
+let ws=new WebSocket((location.protocol==='https:'?'wss://':'ws://')+location.host+'/ws/stream');
+ws.binaryType='arraybuffer';wsStream=ws;
+ws.onmessage=e=>{let seq=new DataView(e.data).getUint32(0,true);
+let url=URL.createObjectURL(new Blob([new Uint8Array(e.data,12)],{type:'image/jpeg'}));let prev=img.src;
+img.onload=img.onerror=()=>{if(prev.startsWith('blob:'))URL.revokeObjectURL(prev);if(ws.readyState===1)ws.send(String(seq));};
+img.src=url;};
+ws.onclose=()=>{if(wsStream!==ws)return;wsStream=null;if(streamActive)startMjpeg(container);};
+return true;}
+function stopWsStream(){if(wsStream){let ws=wsStream;wsStream=null;ws.close();}}
+
+const EVENTS_RETRY_MS=10000;  // = Retry-After de /api/events (events.c)
+function startEvents(){if(!window.EventSource){statusInterval=setInterval(checkStatus,1000);checkStatus();return;}
+let es=new EventSource('/api/events');
+es.addEventListener('status',e=>{if(statusInterval){clearInterval(statusInterval);statusInterval=null;}applyStatus(JSON.parse(e.data));});
+// Un 503 (cupo lleno) cierra el EventSource para siempre: se vuelve a abrir
+// pasado el Retry-After del servidor y mientras tanto se sondea cada 1 s
+es.onerror=()=>{if(!statusInterval){statusInterval=setInterval(checkStatus,1000);checkStatus();}
+if(es.readyState===EventSource.CLOSED)setTimeout(startEvents,EVENTS_RETRY_MS);};}
+
+function forceStream(){fetch('/api/motion/force',{method:'POST'}).then(r=>r.json()).then(d=>{if(d.ok){forceMode=true;checkStatus();}});}
+function stopForce(){fetch('/api/motion/stop',{method:'POST'}).then(r=>r.json()).then(d=>checkStatus());}
+
+function loadConfig(){fetch('/api/motion/config').then(r=>r.json()).then(d=>{
+document.getElementById('emit-time').value=d.emission_time;
+document.getElementById('live-time').value=d.live_time;
+document.getElementById('vid-dur').value=d.video_duration||10;
+document.querySelectorAll('input[name=cap-mode]').forEach(r=>r.checked=(r.value==d.capture_mode));
+document.getElementById('video-opts').style.display=d.capture_mode==1?'block':'none';
+document.getElementById('rec-opts').style.display=d.capture_mode==1||d.capture_mode==3?'block':'none';
+document.getElementById('rec-fps').value=d.record_fps||10;
+let modeStr=d.capture_mode==1?'🎬 Video ('+d.video_duration+'s)':d.capture_mode==2?'⏱️ Time-lapse':d.capture_mode==3?'🔁 Continuo':'📸 Foto';
+document.getElementById('config-status').innerHTML=
+'<p>Modo: <b>'+modeStr+'</b></p>'+
+'<p>⏱️ Movimiento: <b>'+d.emission_time+'</b>s | 🔴 En vivo: <b>'+d.live_time+'</b>s</p>'+
+'<p>Estado: '+(d.active?'<span style="color:#0f0">Transmitiendo</span>':'<span style="color:#f00">En espera</span>')+'</p>';});}
+
+function saveConfig(){let t=parseInt(document.getElementById('emit-time').value);
+let l=parseInt(document.getElementById('live-time').value);
+let m=document.querySelector('input[name=cap-mode]:checked').value;
+let v=parseInt(document.getElementById('vid-dur').value);
+let f=parseInt(document.getElementById('rec-fps').value);
+if(t<5||t>300){showToast('❌ Tiempo movimiento: 5-300s','#a00');return;}
+if(l<10||l>600){showToast('❌ Tiempo en vivo: 10-600s','#a00');return;}
+if(m==1&&(v<5||v>60)){showToast('❌ Duración video: 5-60s','#a00');return;}
+if((m==1||m==3)&&(f<1||f>25)){showToast('❌ FPS grabación: 1-25','#a00');return;}
+fetch('/api/motion/config',{method:'POST',headers:{'Content-Type':'application/x-www-form-urlencoded'},
+body:'time='+t+'&live='+l+'&mode='+m+'&vdur='+v+'&rfps='+f}).then(r=>r.json()).then(d=>{if(d.ok){
+showToast('✅ Configuración guardada','#0a0');
+}loadConfig();});}
+
+function loadWifi(){fetch('/api/wifi/status').then(r=>r.json()).then(d=>{
+let st=document.getElementById('wifi-status');
+if(d.connected){st.className='status status-on';st.textContent='✅ Conectado a: '+d.ssid;}
+else if(d.ap_mode){st.className='status status-warn';st.textContent='📡 Modo AP: '+d.ap_ssid;}
+else{st.className='status status-off';st.textContent='❌ Desconectado';}
+document.getElementById('wifi-ssid').value=d.ssid||'';
+document.getElementById('ap-ssid').value=d.ap_ssid||'';
+document.querySelectorAll('input[name=wifi-mode]').forEach(r=>r.checked=(r.value==d.preferred_mode));
+updateWifiForm(d.preferred_mode);
+let modeStr=d.preferred_mode==0?'📶 WiFi (Estación)':'📡 Access Point';
+let savedSsid=d.preferred_mode==0?d.ssid:d.ap_ssid;
+document.getElementById('wifi-saved-data').innerHTML=
+'<p style="margin:5px 0"><b>Modo:</b> '+modeStr+'</p>'+
+'<p style="margin:5px 0"><b>SSID guardado:</b> '+(savedSsid||'(no configurado)')+'</p>'+
+'<p style="margin:5px 0;color:#f80">ℹ️ Los datos fueron guardados en la memoria del dispositivo</p>';
+document.getElementById('wifi-info').innerHTML=
+'<p>IP: <b>'+d.ip+'</b></p>'+
+'<p>Modo actual: <b>'+(d.ap_mode?'📡 Access Point':'📶 Estación')+'</b></p>'+
+'<p>Modo preferido: <b>'+(d.preferred_mode==1?'📡 AP (Red propia)':'📶 WiFi (Red externa)')+'</b></p>'+
+'<p>'+(d.ap_mode?'AP SSID: <b>'+d.ap_ssid+'</b>':'WiFi SSID: <b>'+d.ssid+'</b>')+'</p>';});}
+
+function updateWifiForm(mode){document.getElementById('sta-config').style.display=mode==0?'block':'none';
+document.getElementById('ap-config').style.display=mode==1?'block':'none';}
+
+document.querySelectorAll('input[name=wifi-mode]').forEach(r=>r.addEventListener('change',e=>updateWifiForm(e.target.value)));
+
+function saveWifi(){let mode=document.querySelector('input[name=wifi-mode]:checked').value;
+let s,p;
+if(mode=='0'){s=document.getElementById('wifi-ssid').value.trim();p=document.getElementById('wifi-pass').value;}
+else{s=document.getElementById('ap-ssid').value.trim();p=document.getElementById('ap-pass').value;}
+if(!s||s.length<1||s.length>32){showToast('❌ SSID inválido (1-32 caracteres)','#a00');return;}
+if(p.length>0&&p.length<8){showToast('❌ Contraseña muy corta (mín 8)','#a00');return;}
+fetch('/api/wifi/config',{method:'POST',headers:{'Content-Type':'application/x-www-form-urlencoded'},
+body:'mode='+mode+'&ssid='+encodeURIComponent(s)+'&pass='+encodeURIComponent(p)}).then(r=>r.json()).then(d=>{
+if(d.ok){showToast('✅ Configuración guardada\nReinicie para aplicar','#0a0');
+let modeStr=mode==0?'📶 WiFi (Estación)':'📡 Access Point';
+let passDisplay=p?'••••••••':'(vacía)';
+document.getElementById('wifi-saved-data').innerHTML=
+'<p style="margin:5px 0"><b>Modo:</b> '+modeStr+'</p>'+
+'<p style="margin:5px 0"><b>SSID:</b> '+s+'</p>'+
+'<p style="margin:5px 0"><b>Contraseña:</b> '+passDisplay+'</p>'+
+'<p style="margin:5px 0;color:#0f0">✅ Guardado correctamente</p>';
+loadWifi();}
+else{showToast('❌ Error guardando','#a00');}});}
+
+function restartDevice(){if(confirm('¿Reiniciar el dispositivo?')){
+fetch('/api/restart',{method:'POST'}).then(()=>showToast('🔄 Reiniciando...','#06a'));}}
+
+function togglePass(id){let inp=document.getElementById(id);if(inp.type==='password'){inp.type='text';}else{inp.type='password';}}
+
+function resetApCredentials(){if(confirm('¿Restaurar credenciales AP a valores por defecto?\n\nSSID: CamaraVigia_AP\nContraseña: seguridad123')){
+fetch('/api/wifi/reset_ap',{method:'POST'}).then(r=>r.json()).then(d=>{if(d.ok){
+showToast('✅ Credenciales AP reseteadas\nReinicie para aplicar','#0a0');loadWifi();}
+else{showToast('❌ Error reseteando','#a00');}});}}
+
+function tryConnectWifi(){showToast('📶 Intentando conectar a WiFi...','#06a');
+fetch('/api/wifi/connect',{method:'POST'}).then(r=>r.json()).then(d=>{if(d.ok){
+showConnectingBanner();checkWifiConnection(0);}
+else{showToast('❌ Error: '+d.error,'#a00');}});}
+
+function showConnectingBanner(){let b=document.createElement('div');b.id='connect-banner';
+b.style.cssText='position:fixed;top:0;left:0;width:100%;height:100%;background:rgba(0,0,0,0.85);display:flex;flex-direction:column;align-items:center;justify-content:center;z-index:10000';
+b.innerHTML='<div style="font-size:4em;animation:pulse 1s infinite">📶</div><h2 style="color:#fff;margin:20px">Conectando a WiFi...</h2><p id="connect-status" style="color:#888">Intento 1 de 10</p><p style="color:#666;font-size:0.8em">Por favor espera...</p>';
+document.body.appendChild(b);}
+
+function checkWifiConnection(attempt){if(attempt>=10){
+document.getElementById('connect-banner').remove();
+showToast('❌ No se pudo conectar\nVerifica las credenciales','#a00');loadWifi();return;}
+document.getElementById('connect-status').textContent='Intento '+(attempt+1)+' de 10';
+fetch('/api/wifi/status').then(r=>r.json()).then(d=>{if(d.connected){
+document.getElementById('connect-banner').innerHTML='<div style="font-size:4em">✅</div><h2 style="color:#0f0;margin:20px">¡CONECTADO!</h2><p style="color:#fff;font-size:1.2em">Red: <b>'+d.ssid+'</b></p><p style="color:#0f0;font-size:1.5em">IP: '+d.ip+'</p><p style="color:#888;margin-top:20px">Esta ventana se cerrará en 3 segundos...</p>';
+setTimeout(()=>{document.getElementById('connect-banner').remove();loadWifi();},3000);}
+else{setTimeout(()=>checkWifiConnection(attempt+1),2000);}});}
+
+function showToast(msg,bg){let toast=document.createElement('div');
+toast.style.cssText='position:fixed;top:20px;left:50%;transform:translateX(-50%);background:'+(bg||'#0a0')+';color:#fff;padding:15px 25px;border-radius:8px;z-index:9999;font-size:1em;white-space:pre-line;text-align:center;box-shadow:0 4px 15px rgba(0,0,0,0.3);animation:fadeIn 0.3s';
+toast.textContent=msg;document.body.appendChild(toast);
+setTimeout(()=>{toast.style.opacity='0';toast.style.transition='opacity 0.5s';setTimeout(()=>toast.remove(),500);},3000);}
+
+function setFormatResult(msg,cls){let el=document.getElementById('format-result');
+if(!el)return;el.style.display='block';el.className='status '+cls;el.textContent=msg;}
+
+function formatSd(){
+let warn='FORMATEAR microSD?\n\nSe borraran TODOS los archivos.\nNo desconectes la camara durante el proceso.';
+if(!confirm(warn))return;
+setFormatResult('Formateando microSD...','status-warn');
+fetch('/api/format_sd',{method:'POST'}).then(r=>r.json()).then(d=>{
+if(d&&d.ok){setFormatResult('RESULTADO: Formateo completo','status-on');loadFiles();return;}
+let err=(d&&d.error)?d.error:'no se pudo formatear';
+if(err==='ESP_ERR_INVALID_STATE')err='No se puede formatear durante streaming/captura';
+if(err==='ESP_ERR_TIMEOUT')err='Tiempo agotado. Revisa microSD y conexiones.';
+if(err==='ESP_ERR_NOT_SUPPORTED')err='MKFS no habilitado en FATFS';
+setFormatResult('RESULTADO: Error - '+err,'status-off');
+}).catch(()=>{setFormatResult('RESULTADO: Error de conexion','status-off');});}
+
+
+function filesPage(dir){let o=filesOffset+dir*FILES_PAGE;if(o<0||o>=filesTotal)return;filesOffset=o;loadFiles();}
+
+function loadFiles(){fetch('/api/files?offset='+filesOffset+'&limit='+FILES_PAGE+
+'&type='+document.getElementById('files-type').value+'&sort='+document.getElementById('files-sort').value).then(r=>r.json()).then(d=>{
+if(d.error){
+document.getElementById('files-status').className='status status-off';
+document.getElementById('files-status').textContent=d.error;
+document.getElementById('files').innerHTML='';viewerFiles=[];return;}
+document.getElementById('files-status').className='status status-on';
+document.getElementById('files-status').textContent='Encontrados: '+d.count+' archivos ('+formatSize(d.total_size)+')';
+filesTotal=d.count;
+if(d.count&&filesOffset>=d.count){filesOffset=Math.floor((d.count-1)/FILES_PAGE)*FILES_PAGE;loadFiles();return;}
+document.getElementById('files-page').textContent=d.count?(filesOffset+1)+'-'+(filesOffset+d.files.length)+' de '+d.count:'';
+viewerFiles=d.files;
+let h='';d.files.forEach((f,i)=>{
+let icon=f.name.startsWith('VID_')||f.name.startsWith('DVR_')?'🎬':'📷';
+h+='<div class="file"><span class="file-name" onclick="openViewer('+i+')">'+icon+' '+f.name+'</span>';
+h+='<span class="file-info">'+formatSize(f.size)+' | '+formatDate(f.mtime)+'</span>';
+h+='<div class="file-actions"><button class="btn" onclick="openViewer('+i+')">👁️</button>';
+h+='<a class="btn" href="/file?name='+encodeURIComponent(f.name)+'" download>⬇️</a>';
+h+='<button class="btn btn-danger" onclick="deleteFile(\''+f.name+'\');">🗑️</button></div></div>';});
+document.getElementById('files').innerHTML=h||'<p>No hay archivos guardados</p>';}).catch(e=>{
+document.getElementById('files-status').className='status status-off';
+document.getElementById('files-status').textContent='❌ Error de conexión';});}
+
+function openViewer(idx){viewerIndex=idx;let f=viewerFiles[idx];if(!f)return;
+document.getElementById('viewer-title').textContent=f.name+' ('+formatSize(f.size)+')';
+document.getElementById('viewer-img').src='/file?name='+encodeURIComponent(f.name);
+document.getElementById('viewer-modal').classList.add('show');}
+function closeViewer(){document.getElementById('viewer-modal').classList.remove('show');document.getElementById('viewer-img').src='';}
+function viewerPrev(){if(viewerIndex>0)openViewer(viewerIndex-1);}
+function viewerNext(){if(viewerIndex<viewerFiles.length-1)openViewer(viewerIndex+1);}
+function viewerDownload(){let f=viewerFiles[viewerIndex];if(f)window.open('/file?name='+encodeURIComponent(f.name),'_blank');}
+document.addEventListener('keydown',e=>{if(document.getElementById('viewer-modal').classList.contains('show')){
+if(e.key==='Escape')closeViewer();if(e.key==='ArrowLeft')viewerPrev();if(e.key==='ArrowRight')viewerNext();}});
+
+function deleteFile(n){if(confirm('¿Borrar '+n+'?'))fetch('/api/delete?name='+encodeURIComponent(n),{method:'DELETE'})
+.then(r=>r.json()).then(d=>{if(d&&d.ok){loadFiles();closeViewer();}else{alert('Error: '+(d.error||'No se pudo borrar'));}}).catch(()=>alert('Error de conexión'));}
+function mountSd(){document.getElementById('files-status').textContent='Montando SD...';
+fetch('/api/sd/reinit',{method:'POST'}).then(r=>r.json()).then(d=>{if(d&&d.ok){showToast('SD montada');loadFiles();}
+else{alert('Error: '+(d.error||'No se pudo montar'));}}).catch(()=>alert('Error de conexión'));
+document.getElementById('files-status').textContent='Listo';}
+function deleteAll(){if(confirm('¿BORRAR TODOS los archivos?'))fetch('/api/delete_all',{method:'DELETE'})
+.then(r=>r.json()).then(d=>{if(d&&d.ok){loadFiles();showToast('Borrados '+d.deleted+' archivos');}else{alert('Error: '+(d.error||'No se pudo borrar'));}}).catch(()=>alert('Error de conexión'));}
+function formatSize(b){if(b<1024)return b+'B';if(b<1048576)return(b/1024).toFixed(1)+'KB';return(b/1048576).toFixed(1)+'MB';}
+function formatDate(t){let d=new Date(t*1000);return d.toLocaleDateString()+' '+d.toLocaleTimeString();}
+
+startEvents();
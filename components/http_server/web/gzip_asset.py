@@ -0,0 +1,13 @@
+#!/usr/bin/env python
+# Comprime un asset de la UI para embeberlo en flash.
+# mtime=0 y sin nombre de archivo: la salida solo depende del contenido,
+# así el ETag no cambia entre compilaciones si el asset no cambió.
+import gzip
+import sys
+
+src, dst = sys.argv[1], sys.argv[2]
+with open(src, 'rb') as f:
+    data = f.read()
+with open(dst, 'wb') as f:
+    with gzip.GzipFile(filename='', mode='wb', fileobj=f, compresslevel=9, mtime=0) as gz:
+        gz.write(data)
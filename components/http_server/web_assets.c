@@ -0,0 +1,91 @@
+#include "web_assets.h"
+#include "esp_log.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "WEB_ASSETS";
+
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[]   asm("_binary_index_html_gz_end");
+extern const uint8_t app_css_gz_start[]    asm("_binary_app_css_gz_start");
+extern const uint8_t app_css_gz_end[]      asm("_binary_app_css_gz_end");
+extern const uint8_t app_js_gz_start[]     asm("_binary_app_js_gz_start");
+extern const uint8_t app_js_gz_end[]       asm("_binary_app_js_gz_end");
+
+typedef struct {
+    const char *uri;
+    const char *type;
+    const uint8_t *start;
+    const uint8_t *end;
+    char etag[12];          // "xxxxxxxx" con comillas
+} web_asset_t;
+
+static web_asset_t s_assets[] = {
+    { "/",        "text/html; charset=utf-8",              index_html_gz_start, index_html_gz_end },
+    { "/app.css", "text/css",                              app_css_gz_start,    app_css_gz_end },
+    { "/app.js",  "application/javascript; charset=utf-8", app_js_gz_start,     app_js_gz_end },
+};
+#define WEB_ASSET_COUNT (sizeof(s_assets) / sizeof(s_assets[0]))
+
+// FNV-1a sobre los bytes comprimidos: cambia solo si cambia el asset
+static uint32_t fnv1a(const uint8_t *data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+    size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+    if (len == 0 || len > 128) return false;
+
+    char value[129];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, len + 1) != ESP_OK) {
+        return false;
+    }
+    // Puede venir una lista o "*"
+    return strstr(value, etag) != NULL || strcmp(value, "*") == 0;
+}
+
+static esp_err_t asset_handler(httpd_req_t *req) {
+    const web_asset_t *asset = (const web_asset_t *)req->user_ctx;
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    // Siempre revalidar: el 304 cuesta unos pocos bytes
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    if (etag_matches(req, asset->etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    return httpd_resp_send(req, (const char *)asset->start, asset->end - asset->start);
+}
+
+esp_err_t web_assets_register(httpd_handle_t server) {
+    for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+        web_asset_t *asset = &s_assets[i];
+        size_t len = asset->end - asset->start;
+        snprintf(asset->etag, sizeof(asset->etag), "\"%08lx\"",
+                 (unsigned long)fnv1a(asset->start, len));
+
+        httpd_uri_t uri = {
+            .uri = asset->uri,
+            .method = HTTP_GET,
+            .handler = asset_handler,
+            .user_ctx = asset
+        };
+        esp_err_t err = httpd_register_uri_handler(server, &uri);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "No se pudo registrar %s: %s", asset->uri, esp_err_to_name(err));
+            return err;
+        }
+        ESP_LOGI(TAG, "%s: %u bytes gzip, ETag %s", asset->uri, (unsigned)len, asset->etag);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// ============================================================================
+// UI WEB EMBEBIDA (uso interno del componente http_server)
+// ============================================================================
+// index.html, app.css y app.js se comprimen con gzip al compilar (ver
+// CMakeLists.txt) y se sirven tal cual desde flash con un ETag fuerte.
+// Si el navegador ya tiene la versión actual responde 304 sin cuerpo.
+
+// Calcula los ETag y registra un handler GET por asset
+esp_err_t web_assets_register(httpd_handle_t server);
@@ -0,0 +1,61 @@
+#pragma once
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// DISTRIBUCIÓN MULTICAST UDP
+// ============================================================================
+// Cada JPEG se parte en datagramas a un grupo multicast: la cámara transmite
+// una sola vez sin importar cuántos monitores miran. Opcional (apagado por
+// defecto) y persistido en NVS.
+//
+// Formato de cada datagrama (big-endian), cabecera de MCAST_HDR_LEN bytes:
+//   0  'V' 'M'          magic
+//   2  u8  versión      (MCAST_VERSION)
+//   3  u8  flags        bit0 = último fragmento del frame
+//   4  u32 frame_seq    número de frame (creciente)
+//   8  u32 frame_len    tamaño total del JPEG
+//  12  u32 offset       posición de este fragmento dentro del JPEG
+//  16  u16 frag_index
+//  18  u16 frag_count
+//  20  u32 timestamp_ms captura (reloj de la cámara)
+//  24  ... datos del JPEG (hasta MCAST_MAX_PAYLOAD bytes)
+//
+// Reensamblado en el receptor:
+//   - Reservar frame_len bytes al ver un frame_seq nuevo; copiar cada
+//     fragmento en 'offset' y marcar frag_index como recibido.
+//   - El frame está completo cuando llegaron los frag_count fragmentos.
+//   - Si llega un frame_seq mayor con el actual incompleto, descartarlo
+//     (UDP no retransmite: se espera al próximo frame).
+//   - Ignorar datagramas con magic/versión desconocidos.
+
+#define MCAST_VERSION        1
+#define MCAST_HDR_LEN        24
+#define MCAST_MAX_PAYLOAD    (1400 - MCAST_HDR_LEN)
+
+#define MCAST_DEFAULT_GROUP  "239.255.0.1"
+#define MCAST_DEFAULT_PORT   5004
+#define MCAST_DEFAULT_TTL    1
+
+// Devuelve true mientras se permite emitir video (misma regla que /stream)
+typedef bool (*mcast_gate_fn_t)(void);
+
+typedef struct {
+    bool enabled;
+    char group[16];
+    uint16_t port;
+    uint8_t ttl;
+    uint32_t frames_sent;
+    uint32_t datagrams_sent;
+    uint32_t datagrams_dropped;     // lwIP sin buffers
+    uint64_t bytes_sent;
+} mcast_stream_status_t;
+
+// Carga la configuración y crea la tarea (emite solo si estaba habilitado)
+esp_err_t mcast_stream_init(mcast_gate_fn_t gate);
+
+// Cambia grupo/puerto/TTL y encendido. Persiste en NVS.
+esp_err_t mcast_stream_configure(bool enabled, const char *group, uint16_t port, uint8_t ttl);
+
+void mcast_stream_get_status(mcast_stream_status_t *status);
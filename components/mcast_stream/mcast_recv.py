@@ -0,0 +1,44 @@
+#!/usr/bin/env python
+# Receptor de referencia para el multicast de la cámara (ver mcast_stream.h).
+# Guarda cada frame completo como latest.jpg:
+#   python mcast_recv.py [grupo] [puerto]
+import socket
+import struct
+import sys
+
+HDR = struct.Struct('>2sBBIIIHHI')
+
+group = sys.argv[1] if len(sys.argv) > 1 else '239.255.0.1'
+port = int(sys.argv[2]) if len(sys.argv) > 2 else 5004
+
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+sock.bind(('', port))
+mreq = struct.pack('4s4s', socket.inet_aton(group), socket.inet_aton('0.0.0.0'))
+sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+
+cur_seq, buf, got, count, complete = None, None, set(), 0, False
+done = lost = 0
+while True:
+    data = sock.recv(2048)
+    if len(data) < HDR.size:
+        continue
+    magic, ver, flags, seq, length, offset, idx, n, ts = HDR.unpack_from(data)
+    if magic != b'VM' or ver != 1:
+        continue
+    if seq != cur_seq:
+        if cur_seq is not None and seq < cur_seq:
+            continue                    # Fragmento de un frame ya descartado
+        if cur_seq is not None and not complete:
+            lost += 1
+        cur_seq, buf, got, count, complete = seq, bytearray(length), set(), n, False
+    if complete:
+        continue
+    buf[offset:offset + len(data) - HDR.size] = data[HDR.size:]
+    got.add(idx)
+    if len(got) == count:
+        complete = True
+        done += 1
+        with open('latest.jpg', 'wb') as f:
+            f.write(buf)
+        print('frame %d (%d bytes) ok=%d perdidos=%d' % (seq, length, done, lost))
@@ -0,0 +1,269 @@
+#include "mcast_stream.h"
+#include "frame_bus.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <string.h>
+#include <errno.h>
+
+static const char *TAG = "MCAST";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define NVS_NAMESPACE_MCAST  "mcast_cfg"
+#define NVS_KEY_ENABLED      "enabled"
+#define NVS_KEY_GROUP        "group"
+#define NVS_KEY_PORT         "port"
+#define NVS_KEY_TTL          "ttl"
+
+#define MCAST_TASK_STACK     3072
+#define MCAST_TASK_PRIO      (tskIDLE_PRIORITY + 4)
+#define MCAST_TASK_CORE      1
+#define MCAST_FRAME_WAIT_MS  100
+#define MCAST_RETRIES        3      // Reintentos si lwIP se queda sin buffers
+
+typedef struct {
+    bool enabled;
+    char group[16];
+    uint16_t port;
+    uint8_t ttl;
+} mcast_cfg_t;
+
+static mcast_cfg_t s_cfg = {
+    .enabled = false,
+    .group = MCAST_DEFAULT_GROUP,
+    .port = MCAST_DEFAULT_PORT,
+    .ttl = MCAST_DEFAULT_TTL,
+};
+static portMUX_TYPE s_cfg_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool s_reopen = true;
+static TaskHandle_t s_task = NULL;
+static mcast_gate_fn_t s_gate = NULL;
+
+static uint8_t s_dgram[MCAST_HDR_LEN + MCAST_MAX_PAYLOAD];
+
+// Contadores (solo los toca la tarea)
+static uint32_t s_frames_sent = 0;
+static uint32_t s_datagrams_sent = 0;
+static uint32_t s_datagrams_dropped = 0;
+static uint64_t s_bytes_sent = 0;
+
+// ============================================================================
+// NVS
+// ============================================================================
+static void load_config(void) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_MCAST, NVS_READONLY, &nvs_handle) != ESP_OK) return;
+
+    int32_t val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_ENABLED, &val) == ESP_OK) s_cfg.enabled = (val != 0);
+    if (nvs_get_i32(nvs_handle, NVS_KEY_PORT, &val) == ESP_OK && val > 0 && val < 65536) s_cfg.port = val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_TTL, &val) == ESP_OK && val >= 1 && val <= 255) s_cfg.ttl = val;
+    size_t len = sizeof(s_cfg.group);
+    char group[16];
+    if (nvs_get_str(nvs_handle, NVS_KEY_GROUP, group, &len) == ESP_OK) {
+        strncpy(s_cfg.group, group, sizeof(s_cfg.group) - 1);
+    }
+    nvs_close(nvs_handle);
+}
+
+static esp_err_t save_config(const mcast_cfg_t *cfg) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_MCAST, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_ENABLED, cfg->enabled ? 1 : 0);
+    nvs_set_str(nvs_handle, NVS_KEY_GROUP, cfg->group);
+    nvs_set_i32(nvs_handle, NVS_KEY_PORT, cfg->port);
+    nvs_set_i32(nvs_handle, NVS_KEY_TTL, cfg->ttl);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err;
+}
+
+// ============================================================================
+// ENVÍO
+// ============================================================================
+static void put_be16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v & 0xFF;
+}
+
+static int open_socket(const mcast_cfg_t *cfg, struct sockaddr_in *dest) {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) return -1;
+
+    uint8_t ttl = cfg->ttl;
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    uint8_t loop = 0;
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+    memset(dest, 0, sizeof(*dest));
+    dest->sin_family = AF_INET;
+    dest->sin_port = htons(cfg->port);
+    inet_aton(cfg->group, &dest->sin_addr);
+    return sock;
+}
+
+static bool send_datagram(int sock, const struct sockaddr_in *dest, size_t len) {
+    for (int i = 0; i < MCAST_RETRIES; i++) {
+        if (sendto(sock, s_dgram, len, 0, (const struct sockaddr *)dest, sizeof(*dest)) >= 0) {
+            return true;
+        }
+        if (errno != ENOMEM && errno != EAGAIN) return false;
+        vTaskDelay(1);      // Dejar que el WiFi vacíe la cola
+    }
+    return false;
+}
+
+static void send_frame(int sock, const struct sockaddr_in *dest, const frame_t *frame) {
+    uint16_t count = (frame->len + MCAST_MAX_PAYLOAD - 1) / MCAST_MAX_PAYLOAD;
+    uint32_t ts_ms = (uint32_t)(frame->timestamp_us / 1000);
+
+    s_dgram[0] = 'V';
+    s_dgram[1] = 'M';
+    s_dgram[2] = MCAST_VERSION;
+    put_be32(&s_dgram[4], frame->seq);
+    put_be32(&s_dgram[8], frame->len);
+    put_be16(&s_dgram[18], count);
+    put_be32(&s_dgram[20], ts_ms);
+
+    size_t offset = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        size_t chunk = frame->len - offset;
+        if (chunk > MCAST_MAX_PAYLOAD) chunk = MCAST_MAX_PAYLOAD;
+
+        s_dgram[3] = (i == count - 1) ? 0x01 : 0x00;
+        put_be32(&s_dgram[12], offset);
+        put_be16(&s_dgram[16], i);
+        memcpy(&s_dgram[MCAST_HDR_LEN], frame->buf + offset, chunk);
+
+        if (send_datagram(sock, dest, MCAST_HDR_LEN + chunk)) {
+            s_datagrams_sent++;
+            s_bytes_sent += MCAST_HDR_LEN + chunk;
+        } else {
+            s_datagrams_dropped++;
+        }
+        offset += chunk;
+    }
+    s_frames_sent++;
+}
+
+// ============================================================================
+// TAREA
+// ============================================================================
+static void mcast_task(void *arg) {
+    frame_bus_sub_t *sub = NULL;
+    int sock = -1;
+    struct sockaddr_in dest;
+
+    while (true) {
+        mcast_cfg_t cfg;
+        portENTER_CRITICAL(&s_cfg_lock);
+        cfg = s_cfg;
+        bool reopen = s_reopen;
+        s_reopen = false;
+        portEXIT_CRITICAL(&s_cfg_lock);
+
+        // Apagado: soltar todo y dormir hasta la próxima configuración
+        if (!cfg.enabled) {
+            if (sub) {
+                frame_bus_unsubscribe(sub);
+                sub = NULL;
+            }
+            if (sock >= 0) {
+                close(sock);
+                sock = -1;
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if (reopen || sock < 0) {
+            if (sock >= 0) close(sock);
+            sock = open_socket(&cfg, &dest);
+            if (sock < 0) {
+                ESP_LOGE(TAG, "No se pudo crear el socket multicast");
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                continue;
+            }
+            ESP_LOGI(TAG, "Emitiendo a %s:%u (TTL %u)", cfg.group, cfg.port, cfg.ttl);
+        }
+        if (!sub) {
+            sub = frame_bus_subscribe("mcast");
+            if (!sub) {
+                vTaskDelay(pdMS_TO_TICKS(100));
+                continue;
+            }
+        }
+
+        const frame_t *frame = frame_bus_acquire(sub, pdMS_TO_TICKS(MCAST_FRAME_WAIT_MS));
+        if (!frame) continue;
+        if (!s_gate || s_gate()) {
+            send_frame(sock, &dest, frame);
+        }
+        frame_bus_done(sub, frame);
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t mcast_stream_init(mcast_gate_fn_t gate) {
+    if (s_task) return ESP_OK;
+
+    s_gate = gate;
+    load_config();
+    if (xTaskCreatePinnedToCore(mcast_task, "mcast", MCAST_TASK_STACK, NULL,
+                                MCAST_TASK_PRIO, &s_task, MCAST_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea multicast");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Multicast %s (%s:%u)", s_cfg.enabled ? "activo" : "desactivado",
+             s_cfg.group, s_cfg.port);
+    return ESP_OK;
+}
+
+esp_err_t mcast_stream_configure(bool enabled, const char *group, uint16_t port, uint8_t ttl) {
+    // Solo grupos multicast IPv4 (224.0.0.0/4)
+    struct in_addr addr;
+    if (!group || inet_aton(group, &addr) == 0) return ESP_ERR_INVALID_ARG;
+    uint8_t first = ntohl(addr.s_addr) >> 24;
+    if (first < 224 || first > 239 || port == 0 || ttl == 0) return ESP_ERR_INVALID_ARG;
+
+    mcast_cfg_t cfg = { .enabled = enabled, .port = port, .ttl = ttl };
+    strncpy(cfg.group, group, sizeof(cfg.group) - 1);
+
+    portENTER_CRITICAL(&s_cfg_lock);
+    s_cfg = cfg;
+    s_reopen = true;
+    portEXIT_CRITICAL(&s_cfg_lock);
+    if (s_task) xTaskNotifyGive(s_task);
+
+    ESP_LOGI(TAG, "Multicast %s (%s:%u, TTL %u)", enabled ? "activo" : "desactivado", group, port, ttl);
+    return save_config(&cfg);
+}
+
+void mcast_stream_get_status(mcast_stream_status_t *status) {
+    if (!status) return;
+    portENTER_CRITICAL(&s_cfg_lock);
+    status->enabled = s_cfg.enabled;
+    memcpy(status->group, s_cfg.group, sizeof(status->group));
+    status->port = s_cfg.port;
+    status->ttl = s_cfg.ttl;
+    portEXIT_CRITICAL(&s_cfg_lock);
+    status->frames_sent = s_frames_sent;
+    status->datagrams_sent = s_datagrams_sent;
+    status->datagrams_dropped = s_datagrams_dropped;
+    status->bytes_sent = s_bytes_sent;
+}
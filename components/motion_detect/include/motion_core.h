@@ -0,0 +1,57 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// NÚCLEO DEL DETECTOR DE MOVIMIENTO (C puro, sin dependencias de ESP-IDF)
+// ============================================================================
+// Trabaja sobre luma de baja resolución (el JPEG decodificado a 1/8). Mantiene
+// un fondo promediado y cuenta los píxeles que se apartan de él más de
+// pixel_threshold, solo dentro de las celdas no enmascaradas. Compila igual
+// en Linux (gcc motion_core.c) para probarlo con secuencias grabadas.
+
+#define MOTION_GRID_W   16      // Celdas de la máscara de zonas (bits por fila)
+#define MOTION_GRID_H   12
+
+typedef struct {
+    uint8_t pixel_threshold;    // Diferencia de luma para contar un píxel como cambiado
+    uint16_t area_permille;     // Área vigilada que debe cambiar para disparar (‰)
+    uint8_t min_frames;         // Frames seguidos sobre el umbral para disparar
+    uint8_t learn_shift;        // El fondo se acerca 1/2^shift por frame
+    uint16_t mask[MOTION_GRID_H];   // Bit x de la fila y = 1: celda ignorada
+} motion_params_t;
+
+typedef struct {
+    bool motion;                // Estado con histéresis
+    bool triggered;             // Flanco: el movimiento empezó en este frame
+    bool background_reset;      // Cambio global (luz, IR): fondo reiniciado
+    uint16_t area_permille;     // Área cambiada en este frame
+    uint16_t cells[MOTION_GRID_H];  // Celdas con movimiento (mismo formato que mask)
+} motion_result_t;
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint16_t *bg;               // Fondo en punto fijo 8.8
+    uint32_t frames;
+    uint8_t streak;             // Frames seguidos sobre el umbral
+    uint8_t quiet;              // Frames seguidos bajo el umbral
+    bool motion;
+    motion_params_t params;
+} motion_core_t;
+
+void motion_core_default_params(motion_params_t *params);
+
+// Reserva el fondo para luma de width x height. false si no hay memoria.
+bool motion_core_init(motion_core_t *core, uint16_t width, uint16_t height,
+                      const motion_params_t *params);
+void motion_core_free(motion_core_t *core);
+
+// Cambia umbrales / máscara sin perder el fondo aprendido
+void motion_core_set_params(motion_core_t *core, const motion_params_t *params);
+
+// Olvida el fondo (el próximo frame pasa a ser la referencia)
+void motion_core_reset(motion_core_t *core);
+
+// Procesa un frame de luma (width * height bytes, fila por fila)
+void motion_core_process(motion_core_t *core, const uint8_t *luma, motion_result_t *result);
@@ -0,0 +1,55 @@
+#pragma once
+#include "esp_err.h"
+#include "motion_core.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// DETECTOR DE MOVIMIENTO POR SOFTWARE
+// ============================================================================
+// Reemplaza al PIR (la placa AI-Thinker no tiene GPIO libre). Una tarea toma
+// frames del frame bus, los decodifica a 1/8 con esp_jpeg (solo coeficientes
+// DC: 640x480 -> 80x60), los pasa a luma y los analiza con motion_core.
+// Configuración persistida en NVS.
+
+#define MOTION_DETECT_PERIOD_MS     200     // Análisis a 5 fps
+#define MOTION_DETECT_RENOTIFY_MS   1000    // Aviso periódico mientras dura el movimiento
+#define MOTION_SCENE_STALE_MS       1000    // Sin análisis más reciente, la revisión no vale
+
+// started = true en el flanco de inicio; false en los avisos mientras
+// continúa. Se llama desde la tarea del detector: no bloquear.
+typedef void (*motion_detect_cb_t)(bool started);
+
+typedef struct {
+    bool enabled;
+    motion_params_t params;
+} motion_detect_config_t;
+
+typedef struct {
+    bool enabled;
+    bool motion;
+    uint16_t area_permille;     // Último frame analizado
+    uint16_t width;             // Luma analizada
+    uint16_t height;
+    uint32_t frames;
+    uint32_t events;            // Disparos desde el arranque
+    uint32_t light_resets;      // Fondos rearmados por cambio de luz
+    uint32_t errors;            // JPEG que no se pudieron decodificar
+    uint32_t avg_us;            // Decodificar + analizar, promedio
+    uint16_t cells[MOTION_GRID_H];
+} motion_detect_status_t;
+
+// Carga la configuración y crea la tarea
+esp_err_t motion_detect_start(motion_detect_cb_t cb);
+
+void motion_detect_get_config(motion_detect_config_t *cfg);
+
+// Aplica y guarda en NVS
+esp_err_t motion_detect_configure(const motion_detect_config_t *cfg);
+
+void motion_detect_get_status(motion_detect_status_t *status);
+
+// Revisión de la escena: cambia cada vez que un frame analizado tiene alguna
+// celda apartada del fondo (o la luz rearmó el fondo). Igual revisión = nada
+// visible cambió entre medio. false si el detector está apagado o atrasado.
+bool motion_detect_scene_rev(uint32_t *rev);
@@ -0,0 +1,141 @@
+#include "motion_core.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Frames quietos seguidos para dar por terminado el movimiento
+#define MOTION_HOLD_FRAMES          5
+// Más de esta fracción cambiada a la vez es luz o IR, no movimiento
+#define MOTION_GLOBAL_PERMILLE      700
+// Una celda tiene movimiento si cambia al menos 1/8 de sus píxeles
+#define MOTION_CELL_SHIFT           3
+// Los píxeles en movimiento se aprenden más lento, así un intruso quieto
+// tarda en volverse fondo
+#define MOTION_FG_EXTRA_SHIFT       2
+
+void motion_core_default_params(motion_params_t *params) {
+    memset(params, 0, sizeof(*params));
+    params->pixel_threshold = 25;
+    params->area_permille = 20;
+    params->min_frames = 2;
+    params->learn_shift = 4;
+}
+
+bool motion_core_init(motion_core_t *core, uint16_t width, uint16_t height,
+                      const motion_params_t *params) {
+    memset(core, 0, sizeof(*core));
+    if (width < MOTION_GRID_W || height < MOTION_GRID_H) return false;
+
+    core->bg = malloc((size_t)width * height * sizeof(uint16_t));
+    if (!core->bg) return false;
+    core->width = width;
+    core->height = height;
+    motion_core_set_params(core, params);
+    return true;
+}
+
+void motion_core_free(motion_core_t *core) {
+    free(core->bg);
+    memset(core, 0, sizeof(*core));
+}
+
+void motion_core_set_params(motion_core_t *core, const motion_params_t *params) {
+    core->params = *params;
+    if (core->params.learn_shift < 1) core->params.learn_shift = 1;
+    if (core->params.learn_shift > 8) core->params.learn_shift = 8;
+    if (core->params.min_frames < 1) core->params.min_frames = 1;
+}
+
+void motion_core_reset(motion_core_t *core) {
+    core->frames = 0;
+    core->streak = 0;
+    core->quiet = 0;
+    core->motion = false;
+}
+
+void motion_core_process(motion_core_t *core, const uint8_t *luma, motion_result_t *result) {
+    const motion_params_t *p = &core->params;
+    const int w = core->width;
+    const int h = core->height;
+    memset(result, 0, sizeof(*result));
+
+    // Primer frame: pasa a ser el fondo
+    if (core->frames++ == 0) {
+        for (int i = 0; i < w * h; i++) core->bg[i] = (uint16_t)luma[i] << 8;
+        return;
+    }
+
+    uint16_t cell_changed[MOTION_GRID_H][MOTION_GRID_W];
+    uint16_t cell_total[MOTION_GRID_H][MOTION_GRID_W];
+    memset(cell_changed, 0, sizeof(cell_changed));
+    memset(cell_total, 0, sizeof(cell_total));
+
+    uint32_t watched = 0;
+    uint32_t changed = 0;
+    const int fg_shift = p->learn_shift + MOTION_FG_EXTRA_SHIFT;
+
+    for (int y = 0; y < h; y++) {
+        const int cy = y * MOTION_GRID_H / h;
+        const uint16_t mask_row = p->mask[cy];
+        const uint8_t *src = luma + y * w;
+        uint16_t *bg = core->bg + y * w;
+
+        for (int x = 0; x < w; x++) {
+            const int cx = x * MOTION_GRID_W / w;
+            const int32_t pix = (int32_t)src[x] << 8;
+            const int32_t diff = pix - bg[x];
+            const int32_t mag = (diff < 0 ? -diff : diff) >> 8;
+            const bool fg = mag > p->pixel_threshold;
+
+            // Fondo: promedio exponencial en punto fijo (también en zonas
+            // enmascaradas, para no tener saltos si se quita la máscara)
+            bg[x] = (uint16_t)(bg[x] + (diff >> (fg ? fg_shift : p->learn_shift)));
+
+            if (mask_row & (1u << cx)) continue;
+            watched++;
+            cell_total[cy][cx]++;
+            if (fg) {
+                changed++;
+                cell_changed[cy][cx]++;
+            }
+        }
+    }
+    if (watched == 0) return;   // Todo enmascarado
+
+    uint32_t area = changed * 1000 / watched;
+    result->area_permille = (uint16_t)area;
+
+    if (area >= MOTION_GLOBAL_PERMILLE) {
+        // Cambio de iluminación: rearmar el fondo en vez de disparar
+        for (int i = 0; i < w * h; i++) core->bg[i] = (uint16_t)luma[i] << 8;
+        core->streak = 0;
+        result->background_reset = true;
+        result->motion = core->motion;
+        return;
+    }
+
+    for (int cy = 0; cy < MOTION_GRID_H; cy++) {
+        for (int cx = 0; cx < MOTION_GRID_W; cx++) {
+            uint16_t total = cell_total[cy][cx];
+            if (total && cell_changed[cy][cx] >= (total >> MOTION_CELL_SHIFT) && cell_changed[cy][cx] > 0) {
+                result->cells[cy] |= (uint16_t)(1u << cx);
+            }
+        }
+    }
+
+    // Histéresis: min_frames seguidos para empezar, MOTION_HOLD_FRAMES quietos para terminar
+    if (area >= p->area_permille) {
+        core->quiet = 0;
+        if (core->streak < 255) core->streak++;
+        if (!core->motion && core->streak >= p->min_frames) {
+            core->motion = true;
+            result->triggered = true;
+        }
+    } else {
+        core->streak = 0;
+        if (core->motion && ++core->quiet >= MOTION_HOLD_FRAMES) {
+            core->motion = false;
+            core->quiet = 0;
+        }
+    }
+    result->motion = core->motion;
+}
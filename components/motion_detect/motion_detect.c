@@ -0,0 +1,295 @@
+#include "motion_detect.h"
+#include "frame_bus.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "jpeg_decoder.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "MOTION";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define NVS_NAMESPACE_MOTION "motion_det"
+#define NVS_KEY_ENABLED      "enabled"
+#define NVS_KEY_THRESHOLD    "thresh"
+#define NVS_KEY_AREA         "area"
+#define NVS_KEY_FRAMES       "frames"
+#define NVS_KEY_LEARN        "learn"
+#define NVS_KEY_MASK         "mask"
+
+#define MOTION_TASK_STACK    4096
+#define MOTION_TASK_PRIO     (tskIDLE_PRIORITY + 2)
+#define MOTION_TASK_CORE     0      // El core 1 queda para red y streaming
+#define MOTION_FRAME_WAIT_MS 500
+
+static motion_detect_config_t s_cfg;
+static volatile bool s_cfg_changed = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static motion_detect_status_t s_status;
+static TaskHandle_t s_task = NULL;
+static motion_detect_cb_t s_cb = NULL;
+
+// Revisión de escena: sube cuando un frame analizado se aparta del fondo
+static volatile uint32_t s_scene_rev = 0;
+static volatile int64_t s_scene_us = 0;     // Último análisis (0 = detector parado)
+
+// ============================================================================
+// NVS
+// ============================================================================
+static void load_config(void) {
+    s_cfg.enabled = true;
+    motion_core_default_params(&s_cfg.params);
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_MOTION, NVS_READONLY, &nvs_handle) != ESP_OK) return;
+
+    int32_t val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_ENABLED, &val) == ESP_OK) s_cfg.enabled = (val != 0);
+    if (nvs_get_i32(nvs_handle, NVS_KEY_THRESHOLD, &val) == ESP_OK && val >= 1 && val <= 255) s_cfg.params.pixel_threshold = val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_AREA, &val) == ESP_OK && val >= 1 && val <= 1000) s_cfg.params.area_permille = val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_FRAMES, &val) == ESP_OK && val >= 1 && val <= 50) s_cfg.params.min_frames = val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_LEARN, &val) == ESP_OK && val >= 1 && val <= 8) s_cfg.params.learn_shift = val;
+    size_t len = sizeof(s_cfg.params.mask);
+    nvs_get_blob(nvs_handle, NVS_KEY_MASK, s_cfg.params.mask, &len);
+    nvs_close(nvs_handle);
+}
+
+static esp_err_t save_config(const motion_detect_config_t *cfg) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_MOTION, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_ENABLED, cfg->enabled ? 1 : 0);
+    nvs_set_i32(nvs_handle, NVS_KEY_THRESHOLD, cfg->params.pixel_threshold);
+    nvs_set_i32(nvs_handle, NVS_KEY_AREA, cfg->params.area_permille);
+    nvs_set_i32(nvs_handle, NVS_KEY_FRAMES, cfg->params.min_frames);
+    nvs_set_i32(nvs_handle, NVS_KEY_LEARN, cfg->params.learn_shift);
+    nvs_set_blob(nvs_handle, NVS_KEY_MASK, cfg->params.mask, sizeof(cfg->params.mask));
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err;
+}
+
+// ============================================================================
+// DECODIFICACIÓN A LUMA 1/8
+// ============================================================================
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint16_t *rgb;              // RGB565 nativo (little-endian)
+    uint8_t *luma;
+} luma_buf_t;
+
+static void luma_free(luma_buf_t *lb) {
+    free(lb->rgb);
+    free(lb->luma);
+    memset(lb, 0, sizeof(*lb));
+}
+
+static bool luma_alloc(luma_buf_t *lb, uint16_t width, uint16_t height) {
+    luma_free(lb);
+    lb->rgb = malloc((size_t)width * height * sizeof(uint16_t));
+    lb->luma = malloc((size_t)width * height);
+    if (!lb->rgb || !lb->luma) {
+        luma_free(lb);
+        return false;
+    }
+    lb->width = width;
+    lb->height = height;
+    return true;
+}
+
+static esp_err_t decode_luma(const frame_t *frame, luma_buf_t *lb) {
+    // A 1/8 el decodificador solo usa el coeficiente DC de cada bloque
+    uint16_t w = frame->width / 8;
+    uint16_t h = frame->height / 8;
+    if (w != lb->width || h != lb->height) {
+        if (!luma_alloc(lb, w, h)) return ESP_ERR_NO_MEM;
+    }
+
+    esp_jpeg_image_cfg_t cfg = {
+        .indata = (uint8_t *)frame->buf,
+        .indata_size = frame->len,
+        .outbuf = (uint8_t *)lb->rgb,
+        .outbuf_size = (size_t)w * h * sizeof(uint16_t),
+        .out_format = JPEG_IMAGE_FORMAT_RGB565,
+        .out_scale = JPEG_IMAGE_SCALE_1_8,
+    };
+    esp_jpeg_image_output_t img;
+    esp_err_t err = esp_jpeg_decode(&cfg, &img);
+    if (err != ESP_OK) return err;
+
+    // Y = 0.30 R + 0.59 G + 0.11 B (canales expandidos a 8 bits)
+    for (int i = 0; i < w * h; i++) {
+        uint16_t px = lb->rgb[i];
+        uint32_t r = (px >> 11) << 3;
+        uint32_t g = ((px >> 5) & 0x3F) << 2;
+        uint32_t b = (px & 0x1F) << 3;
+        lb->luma[i] = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+    }
+    return ESP_OK;
+}
+
+// ============================================================================
+// TAREA
+// ============================================================================
+static void motion_task(void *arg) {
+    frame_bus_sub_t *sub = NULL;
+    motion_core_t core = {0};
+    luma_buf_t lb = {0};
+    int64_t last_notify = 0;
+    uint64_t total_us = 0;
+
+    while (true) {
+        motion_detect_config_t cfg;
+        portENTER_CRITICAL(&s_lock);
+        cfg = s_cfg;
+        bool changed = s_cfg_changed;
+        s_cfg_changed = false;
+        portEXIT_CRITICAL(&s_lock);
+
+        // Apagado: soltar todo y dormir hasta la próxima configuración
+        if (!cfg.enabled) {
+            if (sub) {
+                frame_bus_unsubscribe(sub);
+                sub = NULL;
+            }
+            motion_core_free(&core);
+            luma_free(&lb);
+            s_status.motion = false;
+            s_scene_us = 0;
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (!sub) {
+            sub = frame_bus_subscribe("motion");
+            if (!sub) {
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                continue;
+            }
+        }
+
+        TickType_t period_start = xTaskGetTickCount();
+        const frame_t *frame = frame_bus_acquire(sub, pdMS_TO_TICKS(MOTION_FRAME_WAIT_MS));
+        if (!frame) continue;
+
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t err = decode_luma(frame, &lb);
+        frame_bus_done(sub, frame);
+        if (err != ESP_OK) {
+            s_status.errors++;
+            vTaskDelay(pdMS_TO_TICKS(MOTION_DETECT_PERIOD_MS));
+            continue;
+        }
+
+        // Cambió la resolución (ABR o región de interés): aprender de nuevo
+        if (core.width != lb.width || core.height != lb.height) {
+            motion_core_free(&core);
+            if (!motion_core_init(&core, lb.width, lb.height, &cfg.params)) {
+                ESP_LOGE(TAG, "Sin memoria para el fondo %ux%u", lb.width, lb.height);
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                continue;
+            }
+            ESP_LOGI(TAG, "Analizando luma %ux%u", lb.width, lb.height);
+        } else if (changed) {
+            motion_core_set_params(&core, &cfg.params);
+        }
+
+        motion_result_t res;
+        motion_core_process(&core, lb.luma, &res);
+
+        int64_t now = esp_timer_get_time();
+        total_us += now - t0;
+        s_status.frames++;
+        s_status.avg_us = (uint32_t)(total_us / s_status.frames);
+        s_status.width = lb.width;
+        s_status.height = lb.height;
+        s_status.area_permille = res.area_permille;
+        s_status.motion = res.motion;
+        memcpy(s_status.cells, res.cells, sizeof(s_status.cells));
+        if (res.background_reset) s_status.light_resets++;
+
+        // Alguna celda con cambios (aunque no alcance para disparar) o luz nueva
+        bool scene_changed = res.background_reset;
+        for (int i = 0; i < MOTION_GRID_H && !scene_changed; i++) scene_changed = res.cells[i] != 0;
+        if (scene_changed) s_scene_rev++;
+        s_scene_us = now;
+
+        if (res.triggered) {
+            s_status.events++;
+            ESP_LOGI(TAG, "Movimiento detectado (%u/1000 del area)", res.area_permille);
+            last_notify = now;
+            if (s_cb) s_cb(true);
+        } else if (res.motion && now - last_notify >= (int64_t)MOTION_DETECT_RENOTIFY_MS * 1000) {
+            last_notify = now;
+            if (s_cb) s_cb(false);
+        }
+
+        // Ritmo fijo de análisis: los frames intermedios los descarta el bus
+        vTaskDelayUntil(&period_start, pdMS_TO_TICKS(MOTION_DETECT_PERIOD_MS));
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t motion_detect_start(motion_detect_cb_t cb) {
+    if (s_task) return ESP_OK;
+
+    s_cb = cb;
+    load_config();
+    if (xTaskCreatePinnedToCore(motion_task, "motion", MOTION_TASK_STACK, NULL,
+                                MOTION_TASK_PRIO, &s_task, MOTION_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea del detector");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Detector %s (umbral %u, area %u/1000)", s_cfg.enabled ? "activo" : "desactivado",
+             s_cfg.params.pixel_threshold, s_cfg.params.area_permille);
+    return ESP_OK;
+}
+
+void motion_detect_get_config(motion_detect_config_t *cfg) {
+    if (!cfg) return;
+    portENTER_CRITICAL(&s_lock);
+    *cfg = s_cfg;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t motion_detect_configure(const motion_detect_config_t *cfg) {
+    if (!cfg) return ESP_ERR_INVALID_ARG;
+    const motion_params_t *p = &cfg->params;
+    if (p->pixel_threshold == 0 || p->area_permille == 0 || p->area_permille > 1000 ||
+        p->min_frames == 0 || p->min_frames > 50 || p->learn_shift == 0 || p->learn_shift > 8) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_cfg = *cfg;
+    s_cfg_changed = true;
+    portEXIT_CRITICAL(&s_lock);
+    if (s_task) xTaskNotifyGive(s_task);
+
+    ESP_LOGI(TAG, "Detector %s (umbral %u, area %u/1000, %u frames)", cfg->enabled ? "activo" : "desactivado",
+             p->pixel_threshold, p->area_permille, p->min_frames);
+    return save_config(cfg);
+}
+
+bool motion_detect_scene_rev(uint32_t *rev) {
+    int64_t last = s_scene_us;
+    if (last == 0 || esp_timer_get_time() - last > (int64_t)MOTION_SCENE_STALE_MS * 1000) return false;
+    if (rev) *rev = s_scene_rev;
+    return true;
+}
+
+void motion_detect_get_status(motion_detect_status_t *status) {
+    if (!status) return;
+    *status = s_status;
+    portENTER_CRITICAL(&s_lock);
+    status->enabled = s_cfg.enabled;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <jpeglib.h>
+
+// ============================================================================
+// CLIPS DE PRUEBA PARA motion_host
+// ============================================================================
+// Genera tres secuencias VGA como las que entrega el sensor (JPEG calidad 80):
+//   static    escena fija con ruido de sensor
+//   lighting  escena fija y a mitad se enciende la luz (+60 de brillo)
+//   walk      alguien cruza el cuadro de izquierda a derecha
+// El ruido sale de un LCG con semilla fija: los clips son siempre los mismos.
+
+#define CLIP_W          640
+#define CLIP_H          480
+#define CLIP_QUALITY    80
+#define CLIP_FRAMES     30
+#define NOISE_AMPL      4       // ± niveles de ruido por píxel
+#define LIGHT_STEP      60      // Brillo que suma la luz al encenderse
+#define PERSON_W        80
+#define PERSON_H        220
+#define PERSON_LEVEL    35
+
+static uint32_t s_rng = 12345;
+
+static int noise(void) {
+    s_rng = s_rng * 1103515245u + 12345u;
+    return (int)((s_rng >> 16) % (2 * NOISE_AMPL + 1)) - NOISE_AMPL;
+}
+
+static uint8_t clamp8(int v) {
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// Fondo con textura: gradiente y un par de "muebles" (40..180 de luma)
+static int scene_level(int x, int y) {
+    int v = 60 + x * 80 / CLIP_W + y * 40 / CLIP_H;
+    if (x > 420 && x < 560 && y > 260 && y < 420) v = 160;  // Mueble claro
+    if (x > 60 && x < 200 && y > 80 && y < 180) v = 45;     // Cuadro oscuro
+    return v;
+}
+
+static int write_jpeg(const char *path, const uint8_t *rgb) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, f);
+    cinfo.image_width = CLIP_W;
+    cinfo.image_height = CLIP_H;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, CLIP_QUALITY, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < CLIP_H) {
+        JSAMPROW row = (JSAMPROW)(rgb + (size_t)cinfo.next_scanline * CLIP_W * 3);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    fclose(f);
+    return 0;
+}
+
+// light: brillo sumado; person_x < -PERSON_W = nadie en cuadro
+static void render(uint8_t *rgb, int light, int person_x) {
+    for (int y = 0; y < CLIP_H; y++) {
+        for (int x = 0; x < CLIP_W; x++) {
+            int v = scene_level(x, y) + light;
+            if (x >= person_x && x < person_x + PERSON_W &&
+                y >= CLIP_H - PERSON_H - 20 && y < CLIP_H - 20) {
+                v = PERSON_LEVEL;
+            }
+            v += noise();
+            uint8_t *px = rgb + ((size_t)y * CLIP_W + x) * 3;
+            // Un poco de tinte para que no sea gris puro
+            px[0] = clamp8(v + 6);
+            px[1] = clamp8(v);
+            px[2] = clamp8(v - 6);
+        }
+    }
+}
+
+static int make_clip(const char *root, const char *name, uint8_t *rgb) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    mkdir(path, 0755);
+
+    for (int i = 0; i < CLIP_FRAMES; i++) {
+        int light = 0;
+        int person_x = -2 * PERSON_W;
+        if (!strcmp(name, "lighting") && i >= CLIP_FRAMES / 2) {
+            light = LIGHT_STEP;
+        } else if (!strcmp(name, "walk") && i >= 8) {
+            // 8 frames vacíos para aprender el fondo, después cruza a 40 px/frame
+            person_x = -PERSON_W + (i - 8) * 40;
+        }
+        render(rgb, light, person_x);
+        snprintf(path, sizeof(path), "%s/%s/%04d.jpg", root, name, i);
+        if (write_jpeg(path, rgb) != 0) return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "uso: %s DIR\n", argv[0]);
+        return 2;
+    }
+    mkdir(argv[1], 0755);
+    uint8_t *rgb = malloc((size_t)CLIP_W * CLIP_H * 3);
+    if (!rgb) return 1;
+
+    const char *clips[] = { "static", "lighting", "walk" };
+    for (size_t i = 0; i < sizeof(clips) / sizeof(clips[0]); i++) {
+        if (make_clip(argv[1], clips[i], rgb) != 0) return 1;
+    }
+    free(rgb);
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include "motion_core.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <jpeglib.h>
+
+// ============================================================================
+// ARNÉS DE HOST: secuencia de JPEG -> luma 1/8 -> motion_core
+// ============================================================================
+// Uso: motion_host DIR quiet|reset|trigger
+//   quiet    ningún disparo ni reinicio de fondo (escena estática)
+//   reset    al menos un background_reset y ningún disparo (cambio de luz)
+//   trigger  al menos un disparo y ningún reinicio (alguien cruza)
+// Imprime µs por frame de decodificación y de análisis por separado.
+
+#define MAX_FRAMES  4096
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint8_t *luma;
+} luma_frame_t;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int cmp_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// ============================================================================
+// DECODIFICACIÓN (igual que decode_luma() en motion_detect.c)
+// ============================================================================
+
+static bool decode_luma(const char *path, luma_frame_t *out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, f);
+    jpeg_read_header(&cinfo, TRUE);
+
+    // A 1/8 libjpeg, como esp_jpeg, solo usa el coeficiente DC de cada bloque
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 8;
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    uint16_t w = cinfo.output_width;
+    uint16_t h = cinfo.output_height;
+    if (out->width != w || out->height != h) {
+        free(out->luma);
+        out->luma = malloc((size_t)w * h);
+        out->width = w;
+        out->height = h;
+    }
+    uint8_t *row = malloc((size_t)w * 3);
+
+    while (cinfo.output_scanline < h) {
+        uint8_t *dst = out->luma + (size_t)cinfo.output_scanline * w;
+        JSAMPROW rows[1] = { row };
+        jpeg_read_scanlines(&cinfo, rows, 1);
+        for (int x = 0; x < w; x++) {
+            // Truncar a RGB565 y expandir a 8 bits como en el equipo
+            uint32_t r = (row[x * 3 + 0] >> 3) << 3;
+            uint32_t g = (row[x * 3 + 1] >> 2) << 2;
+            uint32_t b = (row[x * 3 + 2] >> 3) << 3;
+            dst[x] = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+        }
+    }
+
+    free(row);
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(f);
+    return true;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "uso: %s DIR quiet|reset|trigger\n", argv[0]);
+        return 2;
+    }
+    const char *dir = argv[1];
+    const char *expect = argv[2];
+    if (strcmp(expect, "quiet") && strcmp(expect, "reset") && strcmp(expect, "trigger")) {
+        fprintf(stderr, "expectativa desconocida: %s\n", expect);
+        return 2;
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror(dir);
+        return 2;
+    }
+    static char *names[MAX_FRAMES];
+    int count = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) && count < MAX_FRAMES) {
+        size_t len = strlen(de->d_name);
+        if (len < 4 || strcasecmp(de->d_name + len - 4, ".jpg")) continue;
+        names[count++] = strdup(de->d_name);
+    }
+    closedir(d);
+    if (count == 0) {
+        fprintf(stderr, "%s: sin frames .jpg\n", dir);
+        return 2;
+    }
+    qsort(names, count, sizeof(names[0]), cmp_names);
+
+    motion_params_t params;
+    motion_core_default_params(&params);
+    motion_core_t core = {0};
+    luma_frame_t lf = {0};
+
+    int triggers = 0, resets = 0, motion_frames = 0;
+    int64_t decode_us = 0, process_us = 0;
+    char path[1024];
+
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        int64_t t0 = now_us();
+        if (!decode_luma(path, &lf)) {
+            fprintf(stderr, "%s: no se pudo decodificar\n", path);
+            return 2;
+        }
+        int64_t t1 = now_us();
+
+        if (core.width != lf.width || core.height != lf.height) {
+            motion_core_free(&core);
+            if (!motion_core_init(&core, lf.width, lf.height, &params)) {
+                fprintf(stderr, "%s: luma %ux%u demasiado chica\n", path, lf.width, lf.height);
+                return 2;
+            }
+        }
+        motion_result_t res;
+        motion_core_process(&core, lf.luma, &res);
+        int64_t t2 = now_us();
+
+        decode_us += t1 - t0;
+        process_us += t2 - t1;
+        if (res.triggered) {
+            triggers++;
+            printf("  %s: disparo (área %u‰)\n", names[i], res.area_permille);
+        }
+        if (res.background_reset) {
+            resets++;
+            printf("  %s: fondo reiniciado (área %u‰)\n", names[i], res.area_permille);
+        }
+        if (res.motion) motion_frames++;
+    }
+
+    bool ok;
+    if (!strcmp(expect, "quiet")) ok = triggers == 0 && resets == 0;
+    else if (!strcmp(expect, "reset")) ok = resets > 0 && triggers == 0;
+    else ok = triggers > 0 && resets == 0;
+
+    printf("%s: %d frames %ux%u, %d disparos, %d reinicios, %d con movimiento\n",
+           dir, count, lf.width, lf.height, triggers, resets, motion_frames);
+    printf("%s: %.1f µs/frame decodificando, %.1f µs/frame analizando\n",
+           dir, (double)decode_us / count, (double)process_us / count);
+    printf("%s: %s (esperado: %s)\n", dir, ok ? "OK" : "FALLO", expect);
+
+    motion_core_free(&core);
+    free(lf.luma);
+    for (int i = 0; i < count; i++) free(names[i]);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "esp_err.h"
+#include "frame_bus.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// PRE-EVENTO: ANILLO DE FRAMES EN PSRAM
+// ============================================================================
+// Una tarea copia los frames del bus a un anillo de bytes en PSRAM que guarda
+// los últimos N segundos, sin pasar de un presupuesto de memoria. Al empezar
+// una grabación se vuelca el anillo al clip, así queda lo que pasó antes del
+// disparo. Configuración persistida en NVS.
+
+#define PREROLL_DEFAULT_SECONDS    5
+#define PREROLL_DEFAULT_BUDGET_KB  1024
+#define PREROLL_MAX_SECONDS        30
+#define PREROLL_MIN_BUDGET_KB      128
+#define PREROLL_MAX_BUDGET_KB      2048
+
+// Qué se sacrifica cuando N segundos no entran en el presupuesto
+typedef enum {
+    PREROLL_POLICY_DROP_OLDEST = 0, // Todos los frames; se acorta la ventana
+    PREROLL_POLICY_KEEP_SPAN   = 1, // Toda la ventana; se guarda 1 de cada k frames
+} preroll_policy_t;
+
+typedef struct {
+    uint16_t seconds;               // 0 = desactivado
+    uint16_t budget_kb;
+    preroll_policy_t policy;
+} preroll_config_t;
+
+typedef struct {
+    preroll_config_t cfg;
+    bool allocated;
+    int frames;                     // Frames retenidos ahora
+    uint32_t bytes_used;
+    uint32_t span_ms;               // Del más viejo al más nuevo
+    uint8_t stride;                 // KEEP_SPAN: se guarda 1 de cada 'stride'
+    uint32_t stored;
+    uint32_t evicted;               // Sacados por falta de lugar (no por antigüedad)
+    uint32_t busy_drops;            // No copiados porque el volcado tenía el lock
+} preroll_status_t;
+
+// Devuelve false para cortar el recorrido
+typedef bool (*preroll_visit_fn_t)(const frame_t *frame, void *ctx);
+
+// Carga la configuración y crea la tarea
+esp_err_t preroll_start(void);
+
+void preroll_get_config(preroll_config_t *cfg);
+
+// Aplica (re-reserva el anillo) y guarda en NVS
+esp_err_t preroll_configure(const preroll_config_t *cfg);
+
+// Recorre los frames retenidos del más viejo al más nuevo, incluidos los que
+// entran mientras dura. Cada frame es una copia: 'fn' corre sin el lock y el
+// anillo sigue llenándose. last_seq recibe el seq del último visitado (0 si
+// no hubo ninguno) para que el grabador siga desde ahí sin repetir.
+int preroll_visit(preroll_visit_fn_t fn, void *ctx, uint32_t *last_seq);
+
+void preroll_get_status(preroll_status_t *status);
@@ -0,0 +1,379 @@
+#include "preroll.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "PREROLL";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define NVS_NAMESPACE_PREROLL "preroll"
+#define NVS_KEY_SECONDS       "seconds"
+#define NVS_KEY_BUDGET        "budget_kb"
+#define NVS_KEY_POLICY        "policy"
+
+#define PREROLL_TASK_STACK    3072
+#define PREROLL_TASK_PRIO     (tskIDLE_PRIORITY + 3)
+#define PREROLL_TASK_CORE     0
+#define PREROLL_FRAME_WAIT_MS 200
+#define PREROLL_MIN_FRAME     4096      // Para dimensionar el índice
+#define PREROLL_MAX_STRIDE    8
+#define PREROLL_LOCK_WAIT_MS  5         // Lo que dura copiar un frame del anillo
+
+// Un frame dentro del anillo
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+    uint32_t seq;
+    int64_t timestamp_us;
+    uint16_t width;
+    uint16_t height;
+} pr_entry_t;
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t cap;
+    pr_entry_t *idx;            // FIFO circular de entradas
+    int idx_cap;
+    int head;                   // Más viejo
+    int count;
+} pr_ring_t;
+
+static preroll_config_t s_cfg = {
+    .seconds = PREROLL_DEFAULT_SECONDS,
+    .budget_kb = PREROLL_DEFAULT_BUDGET_KB,
+    .policy = PREROLL_POLICY_DROP_OLDEST,
+};
+static volatile bool s_cfg_changed = true;
+static portMUX_TYPE s_cfg_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_ring_lock = NULL;    // Tarea vs. preroll_visit(), de a un frame
+static TaskHandle_t s_task = NULL;
+
+static pr_ring_t s_ring;
+static preroll_status_t s_status;
+
+// ============================================================================
+// NVS
+// ============================================================================
+static void load_config(void) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_PREROLL, NVS_READONLY, &nvs_handle) != ESP_OK) return;
+
+    int32_t val;
+    if (nvs_get_i32(nvs_handle, NVS_KEY_SECONDS, &val) == ESP_OK && val >= 0 && val <= PREROLL_MAX_SECONDS) {
+        s_cfg.seconds = val;
+    }
+    if (nvs_get_i32(nvs_handle, NVS_KEY_BUDGET, &val) == ESP_OK &&
+        val >= PREROLL_MIN_BUDGET_KB && val <= PREROLL_MAX_BUDGET_KB) {
+        s_cfg.budget_kb = val;
+    }
+    if (nvs_get_i32(nvs_handle, NVS_KEY_POLICY, &val) == ESP_OK &&
+        (val == PREROLL_POLICY_DROP_OLDEST || val == PREROLL_POLICY_KEEP_SPAN)) {
+        s_cfg.policy = (preroll_policy_t)val;
+    }
+    nvs_close(nvs_handle);
+}
+
+static esp_err_t save_config(const preroll_config_t *cfg) {
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_PREROLL, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+    nvs_set_i32(nvs_handle, NVS_KEY_SECONDS, cfg->seconds);
+    nvs_set_i32(nvs_handle, NVS_KEY_BUDGET, cfg->budget_kb);
+    nvs_set_i32(nvs_handle, NVS_KEY_POLICY, cfg->policy);
+    err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    return err;
+}
+
+// ============================================================================
+// ANILLO (solo con s_ring_lock tomado)
+// ============================================================================
+static void ring_free(pr_ring_t *r) {
+    heap_caps_free(r->buf);
+    heap_caps_free(r->idx);
+    memset(r, 0, sizeof(*r));
+}
+
+static bool ring_alloc(pr_ring_t *r, uint32_t cap) {
+    ring_free(r);
+    r->idx_cap = cap / PREROLL_MIN_FRAME + 1;
+    r->buf = heap_caps_malloc(cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    r->idx = heap_caps_malloc(r->idx_cap * sizeof(pr_entry_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!r->buf || !r->idx) {
+        ring_free(r);
+        return false;
+    }
+    r->cap = cap;
+    return true;
+}
+
+static pr_entry_t *ring_oldest(pr_ring_t *r) {
+    return &r->idx[r->head];
+}
+
+static pr_entry_t *ring_newest(pr_ring_t *r) {
+    return &r->idx[(r->head + r->count - 1) % r->idx_cap];
+}
+
+static void ring_pop(pr_ring_t *r) {
+    r->head = (r->head + 1) % r->idx_cap;
+    r->count--;
+}
+
+// Los frames son contiguos: si no entra al final se escribe desde 0. Lo que
+// se pisa es siempre lo más viejo (el anillo avanza en orden).
+static bool ring_push(pr_ring_t *r, const frame_t *frame) {
+    if (frame->len > r->cap) return false;
+
+    uint32_t end = r->count ? ring_newest(r)->off + ring_newest(r)->len : 0;
+    uint32_t pos = end;
+    if (pos + frame->len > r->cap) {
+        // Salto al principio: lo que queda entre 'end' y el final es lo más viejo
+        pos = 0;
+        while (r->count && ring_oldest(r)->off >= end) {
+            ring_pop(r);
+            s_status.evicted++;
+        }
+    }
+    while (r->count && ring_oldest(r)->off >= pos && ring_oldest(r)->off < pos + frame->len) {
+        ring_pop(r);
+        s_status.evicted++;
+    }
+    if (r->count == r->idx_cap) {
+        ring_pop(r);
+        s_status.evicted++;
+    }
+
+    memcpy(r->buf + pos, frame->buf, frame->len);
+    pr_entry_t *e = &r->idx[(r->head + r->count) % r->idx_cap];
+    e->off = pos;
+    e->len = frame->len;
+    e->seq = frame->seq;
+    e->timestamp_us = frame->timestamp_us;
+    e->width = frame->width;
+    e->height = frame->height;
+    r->count++;
+    return true;
+}
+
+// Lo que quedó fuera de la ventana de tiempo
+static void ring_expire(pr_ring_t *r, int64_t now, uint16_t seconds) {
+    int64_t limit = now - (int64_t)seconds * 1000000;
+    while (r->count && ring_oldest(r)->timestamp_us < limit) ring_pop(r);
+}
+
+static void ring_publish_status(pr_ring_t *r) {
+    uint32_t used = 0;
+    for (int i = 0; i < r->count; i++) used += r->idx[(r->head + i) % r->idx_cap].len;
+    s_status.frames = r->count;
+    s_status.bytes_used = used;
+    s_status.span_ms = r->count > 1
+        ? (uint32_t)((ring_newest(r)->timestamp_us - ring_oldest(r)->timestamp_us) / 1000) : 0;
+}
+
+// ============================================================================
+// TAREA
+// ============================================================================
+// KEEP_SPAN: cuántos frames saltear para que 'seconds' entren en el anillo,
+// según el tamaño promedio y el ritmo de llegada
+static uint8_t keep_span_stride(uint32_t avg_len, uint32_t fps_x10, const preroll_config_t *cfg) {
+    uint64_t need = (uint64_t)avg_len * fps_x10 * cfg->seconds / 10;
+    uint64_t cap = (uint64_t)cfg->budget_kb * 1024;
+    uint32_t stride = cap ? (uint32_t)((need + cap - 1) / cap) : 1;
+    if (stride < 1) stride = 1;
+    if (stride > PREROLL_MAX_STRIDE) stride = PREROLL_MAX_STRIDE;
+    return (uint8_t)stride;
+}
+
+static void preroll_task(void *arg) {
+    frame_bus_sub_t *sub = NULL;
+    preroll_config_t cfg = s_cfg;
+    uint32_t avg_len = 0;
+    uint32_t fps_x10 = 0;
+    int64_t last_ts = 0;
+    uint32_t counter = 0;
+
+    while (true) {
+        portENTER_CRITICAL(&s_cfg_lock);
+        bool changed = s_cfg_changed;
+        s_cfg_changed = false;
+        cfg = s_cfg;
+        portEXIT_CRITICAL(&s_cfg_lock);
+
+        if (changed) {
+            xSemaphoreTake(s_ring_lock, portMAX_DELAY);
+            ring_free(&s_ring);
+            s_status.allocated = false;
+            if (cfg.seconds > 0) {
+                s_status.allocated = ring_alloc(&s_ring, (uint32_t)cfg.budget_kb * 1024);
+                if (!s_status.allocated) {
+                    ESP_LOGE(TAG, "Sin PSRAM para %u KB de pre-evento", cfg.budget_kb);
+                }
+            }
+            ring_publish_status(&s_ring);
+            xSemaphoreGive(s_ring_lock);
+            ESP_LOGI(TAG, "Pre-evento: %us en %u KB (%s)", cfg.seconds, cfg.budget_kb,
+                     cfg.policy == PREROLL_POLICY_KEEP_SPAN ? "ventana completa" : "todos los frames");
+        }
+
+        // Apagado: soltar el bus y dormir hasta la próxima configuración
+        if (!s_status.allocated) {
+            if (sub) {
+                frame_bus_unsubscribe(sub);
+                sub = NULL;
+            }
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (!sub) {
+            sub = frame_bus_subscribe("preroll");
+            if (!sub) {
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                continue;
+            }
+        }
+
+        const frame_t *frame = frame_bus_acquire(sub, pdMS_TO_TICKS(PREROLL_FRAME_WAIT_MS));
+        if (!frame) continue;
+
+        // Promedios para KEEP_SPAN (tamaño y frames por segundo de llegada)
+        avg_len = avg_len ? (avg_len * 7 + frame->len) / 8 : frame->len;
+        if (last_ts && frame->timestamp_us > last_ts) {
+            uint32_t inst = (uint32_t)(10000000LL / (frame->timestamp_us - last_ts));
+            fps_x10 = fps_x10 ? (fps_x10 * 7 + inst) / 8 : inst;
+        }
+        last_ts = frame->timestamp_us;
+
+        uint8_t stride = 1;
+        if (cfg.policy == PREROLL_POLICY_KEEP_SPAN) stride = keep_span_stride(avg_len, fps_x10, &cfg);
+        s_status.stride = stride;
+        if (counter++ % stride != 0) {
+            frame_bus_done(sub, frame);
+            continue;
+        }
+
+        // preroll_visit() toma el lock solo mientras copia un frame; si aun
+        // así no se libera a tiempo, este frame no entra al anillo
+        if (xSemaphoreTake(s_ring_lock, pdMS_TO_TICKS(PREROLL_LOCK_WAIT_MS)) == pdTRUE) {
+            ring_expire(&s_ring, frame->timestamp_us, cfg.seconds);
+            if (ring_push(&s_ring, frame)) s_status.stored++;
+            ring_publish_status(&s_ring);
+            xSemaphoreGive(s_ring_lock);
+        } else {
+            s_status.busy_drops++;
+        }
+        frame_bus_done(sub, frame);
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t preroll_start(void) {
+    if (s_task) return ESP_OK;
+
+    s_ring_lock = xSemaphoreCreateMutex();
+    if (!s_ring_lock) return ESP_ERR_NO_MEM;
+    load_config();
+    if (xTaskCreatePinnedToCore(preroll_task, "preroll", PREROLL_TASK_STACK, NULL,
+                                PREROLL_TASK_PRIO, &s_task, PREROLL_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de pre-evento");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void preroll_get_config(preroll_config_t *cfg) {
+    if (!cfg) return;
+    portENTER_CRITICAL(&s_cfg_lock);
+    *cfg = s_cfg;
+    portEXIT_CRITICAL(&s_cfg_lock);
+}
+
+esp_err_t preroll_configure(const preroll_config_t *cfg) {
+    if (!cfg || cfg->seconds > PREROLL_MAX_SECONDS ||
+        cfg->budget_kb < PREROLL_MIN_BUDGET_KB || cfg->budget_kb > PREROLL_MAX_BUDGET_KB ||
+        (cfg->policy != PREROLL_POLICY_DROP_OLDEST && cfg->policy != PREROLL_POLICY_KEEP_SPAN)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_cfg_lock);
+    s_cfg = *cfg;
+    s_cfg_changed = true;
+    portEXIT_CRITICAL(&s_cfg_lock);
+    if (s_task) xTaskNotifyGive(s_task);
+    return save_config(cfg);
+}
+
+// Copia a 'out' el frame más viejo con seq > after (solo con s_ring_lock
+// tomado). false si no hay ninguno o no hay memoria para la copia.
+static bool ring_copy_next(pr_ring_t *r, uint32_t after, frame_t *out,
+                           uint8_t **copy, uint32_t *copy_cap) {
+    for (int i = 0; i < r->count; i++) {
+        const pr_entry_t *e = &r->idx[(r->head + i) % r->idx_cap];
+        if (e->seq <= after) continue;
+
+        if (e->len > *copy_cap) {
+            uint8_t *nb = heap_caps_realloc(*copy, e->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (!nb) return false;
+            *copy = nb;
+            *copy_cap = e->len;
+        }
+        memcpy(*copy, r->buf + e->off, e->len);
+        *out = (frame_t){
+            .buf = *copy,
+            .len = e->len,
+            .width = e->width,
+            .height = e->height,
+            .seq = e->seq,
+            .timestamp_us = e->timestamp_us,
+        };
+        return true;
+    }
+    return false;
+}
+
+int preroll_visit(preroll_visit_fn_t fn, void *ctx, uint32_t *last_seq) {
+    if (last_seq) *last_seq = 0;
+    if (!s_ring_lock || !fn) return 0;
+
+    // El lock se toma de a un frame: la tarea sigue guardando frames nuevos
+    // mientras 'fn' escribe, y el recorrido los alcanza al final. Lo que el
+    // anillo pise antes de llegar se saltea (ring_copy_next busca por seq).
+    uint8_t *copy = NULL;
+    uint32_t copy_cap = 0;
+    uint32_t cursor = 0;
+    int visited = 0;
+    int budget = 0;
+
+    while (true) {
+        frame_t frame;
+        xSemaphoreTake(s_ring_lock, portMAX_DELAY);
+        // Tope: lo que había al empezar más otro anillo entero, por si 'fn'
+        // es más lento que la cámara y nunca se alcanza al más nuevo
+        if (visited == 0) budget = 2 * s_ring.count;
+        bool got = visited < budget && ring_copy_next(&s_ring, cursor, &frame, &copy, &copy_cap);
+        xSemaphoreGive(s_ring_lock);
+        if (!got) break;
+
+        cursor = frame.seq;
+        visited++;
+        if (last_seq) *last_seq = frame.seq;
+        if (!fn(&frame, ctx)) break;
+    }
+    heap_caps_free(copy);
+    return visited;
+}
+
+void preroll_get_status(preroll_status_t *status) {
+    if (!status) return;
+    *status = s_status;
+    preroll_get_config(&status->cfg);
+}
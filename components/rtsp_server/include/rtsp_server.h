@@ -0,0 +1,34 @@
+#pragma once
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// SERVIDOR RTSP (RTP/JPEG, RFC 2435)
+// ============================================================================
+// DESCRIBE / SETUP / PLAY / TEARDOWN con transporte TCP interleaved o UDP.
+// Los JPEG del frame bus se empaquetan tal cual (tipo 0/1, Q=255 con tablas
+// de cuantización en banda): sin transcodificar y sin framing HTTP.
+//
+//   ffprobe -rtsp_transport tcp rtsp://<ip>/stream
+//   ffplay  -rtsp_transport udp rtsp://<ip>/stream
+
+#define RTSP_DEFAULT_PORT  554
+#define RTSP_MAX_SESSIONS  2
+
+// Devuelve true mientras se permite emitir video (misma regla que /stream)
+typedef bool (*rtsp_gate_fn_t)(void);
+
+typedef struct {
+    int sessions;           // Conexiones RTSP abiertas
+    int playing;            // Sesiones recibiendo RTP
+    uint32_t frames_sent;
+    uint32_t frames_unsupported;    // JPEG que no se pudieron empaquetar
+    uint32_t frames_dropped;        // Cortados por socket TCP lleno
+    uint64_t bytes_sent;
+} rtsp_server_stats_t;
+
+// Crea la tarea del servidor. gate puede ser NULL (emitir siempre).
+esp_err_t rtsp_server_start(uint16_t port, rtsp_gate_fn_t gate);
+
+void rtsp_server_get_stats(rtsp_server_stats_t *stats);
@@ -0,0 +1,162 @@
+#include "rtp_jpeg.h"
+#include <string.h>
+
+// ============================================================================
+// PARSEO DEL JPEG
+// ============================================================================
+static uint16_t be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// El OV2640 a veces deja relleno después del EOI: buscar desde el final
+static size_t find_eoi(const uint8_t *jpeg, size_t start, size_t len) {
+    for (size_t i = len - 1; i > start; i--) {
+        if (jpeg[i - 1] == 0xFF && jpeg[i] == 0xD9) return i - 1;
+    }
+    return len;
+}
+
+bool rtp_jpeg_parse(const uint8_t *jpeg, size_t len, rtp_jpeg_frame_t *out) {
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) return false;
+
+    memset(out, 0, sizeof(*out));
+    bool have_sof = false;
+    int max_table = -1;
+    size_t pos = 2;
+
+    while (pos + 4 <= len) {
+        if (jpeg[pos] != 0xFF) return false;
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {           // Relleno
+            pos++;
+            continue;
+        }
+        size_t seg_len = be16(&jpeg[pos + 2]);
+        const uint8_t *seg = &jpeg[pos + 4];
+        if (seg_len < 2 || pos + 2 + seg_len > len) return false;
+
+        switch (marker) {
+        case 0xDB: {                    // DQT: puede traer varias tablas
+            size_t off = 0;
+            while (off < seg_len - 2) {
+                uint8_t pq = seg[off] >> 4;
+                uint8_t tq = seg[off] & 0x0F;
+                if (pq != 0 || tq > 1) return false;    // Solo 8 bits, luma/croma
+                if (off + 65 > seg_len - 2) return false;
+                memcpy(&out->qt[tq * 64], &seg[off + 1], 64);
+                if (tq > max_table) max_table = tq;
+                off += 65;
+            }
+            break;
+        }
+        case 0xC0: {                    // SOF0 (baseline)
+            if (seg_len < 17 || seg[5] != 3) return false;
+            uint16_t height = be16(&seg[1]);
+            uint16_t width = be16(&seg[3]);
+            if (width == 0 || height == 0 || width > 2040 || height > 2040) return false;
+            out->width8 = (width + 7) / 8;
+            out->height8 = (height + 7) / 8;
+
+            // Muestreo de Y: 2x1 = tipo 0, 2x2 = tipo 1. Croma siempre 1x1.
+            uint8_t y_samp = seg[7];
+            if (seg[10] != 0x11 || seg[13] != 0x11) return false;
+            if (y_samp == 0x21) out->type = 0;
+            else if (y_samp == 0x22) out->type = 1;
+            else return false;
+            have_sof = true;
+            break;
+        }
+        case 0xC1: case 0xC2: case 0xC3:    // Progresivo / extendido: no aptos
+            return false;
+        case 0xDD:                      // DRI
+            if (seg_len < 4) return false;
+            out->dri = be16(seg);
+            break;
+        case 0xDA: {                    // SOS: lo que sigue es el scan
+            size_t scan_start = pos + 2 + seg_len;
+            size_t eoi = find_eoi(jpeg, scan_start, len);
+            if (!have_sof || max_table < 0 || eoi <= scan_start) return false;
+            if (out->dri) out->type |= 64;
+            out->qt_len = (max_table + 1) * 64;
+            out->scan = &jpeg[scan_start];
+            out->scan_len = eoi - scan_start;
+            return true;
+        }
+        default:
+            break;
+        }
+        pos += 2 + seg_len;
+    }
+    return false;
+}
+
+// ============================================================================
+// PAQUETES
+// ============================================================================
+int rtp_jpeg_send(rtp_stream_t *st, const rtp_jpeg_frame_t *frame, uint32_t timestamp,
+                  uint8_t *buf, rtp_send_fn_t send, void *ctx) {
+    uint8_t *pkt = buf + RTP_PREFIX_LEN;
+    size_t offset = 0;
+    int total = 0;
+
+    while (offset < frame->scan_len) {
+        uint8_t *p = pkt;
+
+        // Cabecera RTP (el marker se completa al final)
+        p[0] = 0x80;
+        p[1] = RTP_PT_JPEG;
+        p[2] = st->seq >> 8;
+        p[3] = st->seq & 0xFF;
+        p[4] = timestamp >> 24;
+        p[5] = timestamp >> 16;
+        p[6] = timestamp >> 8;
+        p[7] = timestamp;
+        p[8] = st->ssrc >> 24;
+        p[9] = st->ssrc >> 16;
+        p[10] = st->ssrc >> 8;
+        p[11] = st->ssrc;
+        p += RTP_HEADER_LEN;
+
+        // Cabecera JPEG principal: Q=255 -> tablas en banda
+        *p++ = 0;
+        *p++ = offset >> 16;
+        *p++ = offset >> 8;
+        *p++ = offset;
+        *p++ = frame->type;
+        *p++ = 255;
+        *p++ = frame->width8;
+        *p++ = frame->height8;
+
+        if (frame->type & 64) {
+            // Restart header: cada paquete arranca en un MCU cualquiera (F=L=1)
+            *p++ = frame->dri >> 8;
+            *p++ = frame->dri & 0xFF;
+            *p++ = 0xFF;
+            *p++ = 0xFF;
+        }
+        if (offset == 0) {
+            // Las tablas viajan solo en el primer paquete del frame
+            *p++ = 0;                   // MBZ
+            *p++ = 0;                   // Precisión: 8 bits
+            *p++ = frame->qt_len >> 8;
+            *p++ = frame->qt_len & 0xFF;
+            memcpy(p, frame->qt, frame->qt_len);
+            p += frame->qt_len;
+        }
+
+        size_t room = RTP_MAX_PAYLOAD - (size_t)(p - (pkt + RTP_HEADER_LEN));
+        size_t chunk = frame->scan_len - offset;
+        if (chunk > room) chunk = room;
+        memcpy(p, frame->scan + offset, chunk);
+        p += chunk;
+        offset += chunk;
+
+        if (offset >= frame->scan_len) pkt[1] |= 0x80;     // Último paquete del frame
+
+        size_t pkt_len = p - pkt;
+        if (!send(ctx, pkt, pkt_len)) return -1;
+        st->seq++;
+        total += pkt_len;
+    }
+    return total;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// EMPAQUETADO RTP/JPEG (RFC 2435) - uso interno de rtsp_server
+// ============================================================================
+
+#define RTP_HEADER_LEN      12
+#define RTP_MAX_PAYLOAD     1400    // Entra en una trama WiFi sin fragmentar IP
+#define RTP_PT_JPEG         26
+#define RTP_PREFIX_LEN      4       // Lugar para el '$' de TCP interleaved
+#define RTP_PACKET_BUF_LEN  (RTP_PREFIX_LEN + RTP_HEADER_LEN + RTP_MAX_PAYLOAD)
+
+// Lo que RFC 2435 necesita de un JPEG baseline
+typedef struct {
+    uint8_t type;           // 0 = 4:2:2, 1 = 4:2:0 (+64 si hay restart markers)
+    uint8_t width8;         // Ancho / 8
+    uint8_t height8;        // Alto / 8
+    uint16_t dri;           // Intervalo de restart (0 = sin DRI)
+    uint8_t qt[128];        // Tablas de luma y croma (8 bits)
+    uint16_t qt_len;
+    const uint8_t *scan;    // Datos entrópicos (después de SOS, antes de EOI)
+    size_t scan_len;
+} rtp_jpeg_frame_t;
+
+// Estado RTP de un destino
+typedef struct {
+    uint16_t seq;
+    uint32_t ssrc;
+} rtp_stream_t;
+
+// Recibe el paquete en pkt (con RTP_PREFIX_LEN bytes escribibles antes)
+typedef bool (*rtp_send_fn_t)(void *ctx, uint8_t *pkt, size_t len);
+
+// Extrae tablas, tamaño y datos de scan. false si el JPEG no es apto.
+bool rtp_jpeg_parse(const uint8_t *jpeg, size_t len, rtp_jpeg_frame_t *out);
+
+// Envía el frame en paquetes de hasta RTP_MAX_PAYLOAD. Devuelve los bytes
+// enviados o -1 si el callback falló. buf debe medir RTP_PACKET_BUF_LEN.
+int rtp_jpeg_send(rtp_stream_t *st, const rtp_jpeg_frame_t *frame, uint32_t timestamp,
+                  uint8_t *buf, rtp_send_fn_t send, void *ctx);
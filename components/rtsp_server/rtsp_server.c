@@ -0,0 +1,584 @@
+#include "rtsp_server.h"
+#include "rtp_jpeg.h"
+#include "frame_bus.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+static const char *TAG = "RTSP";
+
+// ============================================================================
+// CONFIGURACIÓN
+// ============================================================================
+#define RTSP_TASK_STACK     6144
+#define RTSP_TASK_PRIO      (tskIDLE_PRIORITY + 4)
+#define RTSP_TASK_CORE      1
+#define RTSP_RX_BUF_LEN     1024
+#define RTSP_TX_BUF_LEN     768
+#define RTSP_SESSION_TIMEOUT_S 60   // UDP: sin pedidos RTSP en este tiempo = cliente muerto
+#define RTSP_SEND_TIMEOUT_S 2       // TCP: respuestas bloqueantes; RTP sin avance este tiempo = cliente muerto
+#define RTSP_IDLE_SELECT_MS 500
+#define RTSP_FRAME_WAIT_MS  50
+#define RTP_UDP_BASE_PORT   6970    // Sesión i usa 6970+2i (RTP) y 6971+2i (RTCP)
+#define UDP_RETRIES         3       // Reintentos si lwIP se queda sin buffers
+
+typedef enum {
+    SESS_FREE = 0,
+    SESS_INIT,          // Conectado, sin SETUP
+    SESS_READY,         // SETUP hecho
+    SESS_PLAYING,
+} sess_state_t;
+
+typedef struct {
+    sess_state_t state;
+    int fd;                     // Conexión RTSP (TCP)
+    bool interleaved;           // RTP por la misma conexión TCP
+    uint8_t rtp_channel;
+    int udp_fd;
+    struct sockaddr_in udp_peer;
+    uint16_t client_port;
+    uint16_t server_port;
+    uint32_t session_id;
+    rtp_stream_t rtp;
+    // TCP interleaved: el RTP se manda sin bloquear. Si el socket se llena a
+    // mitad de un paquete, el resto queda acá (el paquete tiene que salir
+    // entero para no romper el framing '$') y el resto del frame se descarta.
+    uint8_t tail[RTP_PACKET_BUF_LEN];
+    size_t tail_len;
+    size_t tail_off;
+    bool stalled;               // El último envío se cortó por socket lleno
+    int64_t stall_since_us;     // Primer frame cortado sin uno completo después
+    int64_t last_request_us;
+    char rx[RTSP_RX_BUF_LEN];
+    size_t rx_len;
+} rtsp_session_t;
+
+static rtsp_session_t s_sessions[RTSP_MAX_SESSIONS];
+static rtsp_gate_fn_t s_gate = NULL;
+static uint16_t s_port = RTSP_DEFAULT_PORT;
+static bool s_started = false;
+static uint8_t s_pkt[RTP_PACKET_BUF_LEN];
+static rtsp_server_stats_t s_stats;
+
+// ============================================================================
+// SESIONES
+// ============================================================================
+static void session_close(rtsp_session_t *s, const char *reason) {
+    ESP_LOGI(TAG, "Sesion %08lx fd=%d cerrada (%s)", (unsigned long)s->session_id, s->fd, reason);
+    if (s->udp_fd >= 0) close(s->udp_fd);
+    if (s->fd >= 0) close(s->fd);
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->udp_fd = -1;
+}
+
+static void session_accept(int listen_fd) {
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    int fd = accept(listen_fd, (struct sockaddr *)&addr, &alen);
+    if (fd < 0) return;
+
+    rtsp_session_t *s = NULL;
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+        if (s_sessions[i].state == SESS_FREE) {
+            s = &s_sessions[i];
+            break;
+        }
+    }
+    if (!s) {
+        static const char *busy = "RTSP/1.0 503 Service Unavailable\r\n\r\n";
+        send(fd, busy, strlen(busy), 0);
+        close(fd);
+        ESP_LOGW(TAG, "Conexion rechazada: %d sesiones ocupadas", RTSP_MAX_SESSIONS);
+        return;
+    }
+
+    struct timeval tv = { .tv_sec = RTSP_SEND_TIMEOUT_S, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    memset(s, 0, sizeof(*s));
+    s->state = SESS_INIT;
+    s->fd = fd;
+    s->udp_fd = -1;
+    s->session_id = esp_random();
+    s->rtp.ssrc = esp_random();
+    s->rtp.seq = (uint16_t)esp_random();
+    s->last_request_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Cliente RTSP fd=%d conectado", fd);
+}
+
+// ============================================================================
+// RESPUESTAS
+// ============================================================================
+static bool send_all(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        int n = send(fd, p, len, 0);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Lo que quedó de un paquete RTP cortado. 1 = vacío, 0 = socket lleno, -1 = error.
+static int flush_tail(rtsp_session_t *s) {
+    while (s->tail_off < s->tail_len) {
+        int n = send(s->fd, s->tail + s->tail_off, s->tail_len - s->tail_off, MSG_DONTWAIT);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        s->tail_off += n;
+    }
+    s->tail_len = 0;
+    s->tail_off = 0;
+    return 1;
+}
+
+static bool reply(rtsp_session_t *s, int cseq, const char *status, const char *extra,
+                  const char *body) {
+    // Una respuesta no puede caer en medio de un paquete RTP interleaved
+    if (s->tail_off < s->tail_len) {
+        if (!send_all(s->fd, s->tail + s->tail_off, s->tail_len - s->tail_off)) return false;
+        s->tail_len = 0;
+        s->tail_off = 0;
+    }
+
+    char hdr[RTSP_TX_BUF_LEN];
+    size_t body_len = body ? strlen(body) : 0;
+    int n = snprintf(hdr, sizeof(hdr), "RTSP/1.0 %s\r\nCSeq: %d\r\nServer: Vigilante-ESP32\r\n%s",
+                     status, cseq, extra ? extra : "");
+    if (body_len) {
+        n += snprintf(hdr + n, sizeof(hdr) - n, "Content-Length: %u\r\n", (unsigned)body_len);
+    }
+    n += snprintf(hdr + n, sizeof(hdr) - n, "\r\n");
+    if (n >= (int)sizeof(hdr)) return false;
+    return send_all(s->fd, hdr, n) && (!body_len || send_all(s->fd, body, body_len));
+}
+
+// Valor de una cabecera (sin espacios iniciales), o NULL
+static const char *header_value(const char *req, const char *name, char *out, size_t out_len) {
+    size_t nlen = strlen(name);
+    const char *line = strstr(req, "\r\n");
+    while (line && line[2] != '\r') {
+        line += 2;
+        if (strncasecmp(line, name, nlen) == 0 && line[nlen] == ':') {
+            const char *v = line + nlen + 1;
+            while (*v == ' ') v++;
+            const char *end = strstr(v, "\r\n");
+            size_t len = end ? (size_t)(end - v) : strlen(v);
+            if (len >= out_len) len = out_len - 1;
+            memcpy(out, v, len);
+            out[len] = '\0';
+            return out;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+static void handle_describe(rtsp_session_t *s, int cseq, const char *url) {
+    struct sockaddr_in local;
+    socklen_t len = sizeof(local);
+    char ip[16] = "0.0.0.0";
+    if (getsockname(s->fd, (struct sockaddr *)&local, &len) == 0) {
+        inet_ntop(AF_INET, &local.sin_addr, ip, sizeof(ip));
+    }
+
+    char sdp[320];
+    snprintf(sdp, sizeof(sdp),
+        "v=0\r\n"
+        "o=- %lu 1 IN IP4 %s\r\n"
+        "s=Vigilante ESP32\r\n"
+        "c=IN IP4 0.0.0.0\r\n"
+        "t=0 0\r\n"
+        "a=control:*\r\n"
+        "m=video 0 RTP/AVP %d\r\n"
+        "a=rtpmap:%d JPEG/90000\r\n"
+        "a=control:track0\r\n",
+        (unsigned long)s->session_id, ip, RTP_PT_JPEG, RTP_PT_JPEG);
+
+    char extra[192];
+    snprintf(extra, sizeof(extra), "Content-Type: application/sdp\r\nContent-Base: %s/\r\n", url);
+    reply(s, cseq, "200 OK", extra, sdp);
+}
+
+static bool open_udp(rtsp_session_t *s, int idx) {
+    struct sockaddr_in peer;
+    socklen_t plen = sizeof(peer);
+    if (getpeername(s->fd, (struct sockaddr *)&peer, &plen) != 0) return false;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) return false;
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons(RTP_UDP_BASE_PORT + 2 * idx),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0) {
+        close(fd);
+        return false;
+    }
+
+    s->udp_fd = fd;
+    s->server_port = RTP_UDP_BASE_PORT + 2 * idx;
+    s->udp_peer = peer;
+    return true;
+}
+
+static void handle_setup(rtsp_session_t *s, int idx, int cseq, const char *req) {
+    char transport[128];
+    if (!header_value(req, "Transport", transport, sizeof(transport))) {
+        reply(s, cseq, "461 Unsupported Transport", NULL, NULL);
+        return;
+    }
+
+    char extra[256];
+    if (strstr(transport, "RTP/AVP/TCP")) {
+        int ch0 = 0, ch1 = 1;
+        const char *il = strstr(transport, "interleaved=");
+        if (il) sscanf(il + 12, "%d-%d", &ch0, &ch1);
+        s->interleaved = true;
+        s->rtp_channel = (uint8_t)ch0;
+        snprintf(extra, sizeof(extra),
+                 "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d;ssrc=%08lX\r\n"
+                 "Session: %08lX;timeout=%d\r\n",
+                 ch0, ch1, (unsigned long)s->rtp.ssrc,
+                 (unsigned long)s->session_id, RTSP_SESSION_TIMEOUT_S);
+    } else {
+        const char *cp = strstr(transport, "client_port=");
+        int p0 = 0;
+        if (!cp || sscanf(cp + 12, "%d", &p0) != 1 || p0 <= 0 || p0 > 65534) {
+            reply(s, cseq, "461 Unsupported Transport", NULL, NULL);
+            return;
+        }
+        s->client_port = (uint16_t)p0;
+        if (s->udp_fd < 0 && !open_udp(s, idx)) {
+            reply(s, cseq, "500 Internal Server Error", NULL, NULL);
+            return;
+        }
+        s->udp_peer.sin_port = htons(s->client_port);
+        s->interleaved = false;
+        snprintf(extra, sizeof(extra),
+                 "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d;ssrc=%08lX\r\n"
+                 "Session: %08lX;timeout=%d\r\n",
+                 p0, p0 + 1, s->server_port, s->server_port + 1, (unsigned long)s->rtp.ssrc,
+                 (unsigned long)s->session_id, RTSP_SESSION_TIMEOUT_S);
+    }
+
+    s->state = SESS_READY;
+    reply(s, cseq, "200 OK", extra, NULL);
+    ESP_LOGI(TAG, "SETUP fd=%d via %s", s->fd, s->interleaved ? "TCP interleaved" : "UDP");
+}
+
+static bool session_matches(rtsp_session_t *s, const char *req) {
+    char value[32];
+    if (!header_value(req, "Session", value, sizeof(value))) return false;
+    return strtoul(value, NULL, 16) == s->session_id;
+}
+
+// Procesa un pedido completo. false si hay que cerrar la sesión.
+static bool handle_request(rtsp_session_t *s, int idx, const char *req) {
+    char method[16] = {0};
+    char url[128] = {0};
+    if (sscanf(req, "%15s %127s", method, url) != 2) return false;
+
+    char value[16];
+    int cseq = header_value(req, "CSeq", value, sizeof(value)) ? atoi(value) : 0;
+    s->last_request_us = esp_timer_get_time();
+
+    // Quitar "/track0" para usar la URL base como Content-Base
+    char *track = strstr(url, "/track0");
+    if (track) *track = '\0';
+
+    if (strcmp(method, "OPTIONS") == 0) {
+        return reply(s, cseq, "200 OK",
+                     "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+    }
+    if (strcmp(method, "DESCRIBE") == 0) {
+        handle_describe(s, cseq, url);
+        return true;
+    }
+    if (strcmp(method, "SETUP") == 0) {
+        handle_setup(s, idx, cseq, req);
+        return true;
+    }
+
+    // El resto necesita una sesión válida
+    if (s->state < SESS_READY || !session_matches(s, req)) {
+        return reply(s, cseq, "454 Session Not Found", NULL, NULL);
+    }
+
+    char extra[96];
+    snprintf(extra, sizeof(extra), "Session: %08lX\r\n", (unsigned long)s->session_id);
+    if (strcmp(method, "PLAY") == 0) {
+        s->state = SESS_PLAYING;
+        ESP_LOGI(TAG, "PLAY fd=%d", s->fd);
+        strncat(extra, "Range: npt=0.000-\r\n", sizeof(extra) - strlen(extra) - 1);
+        return reply(s, cseq, "200 OK", extra, NULL);
+    }
+    if (strcmp(method, "TEARDOWN") == 0) {
+        reply(s, cseq, "200 OK", extra, NULL);
+        return false;
+    }
+    if (strcmp(method, "GET_PARAMETER") == 0) {
+        return reply(s, cseq, "200 OK", extra, NULL);
+    }
+    return reply(s, cseq, "501 Not Implemented", NULL, NULL);
+}
+
+// Lee lo disponible y procesa los pedidos completos
+static bool session_read(rtsp_session_t *s, int idx) {
+    int n = recv(s->fd, s->rx + s->rx_len, sizeof(s->rx) - 1 - s->rx_len, 0);
+    if (n <= 0) return false;
+    s->rx_len += n;
+
+    while (s->rx_len > 0) {
+        // RTCP del cliente por TCP interleaved: se descarta
+        if (s->rx[0] == '$') {
+            if (s->rx_len < 4) break;
+            size_t frame_len = 4 + (((uint8_t)s->rx[2] << 8) | (uint8_t)s->rx[3]);
+            if (frame_len > sizeof(s->rx) - 1) return false;
+            if (s->rx_len < frame_len) break;
+            memmove(s->rx, s->rx + frame_len, s->rx_len - frame_len);
+            s->rx_len -= frame_len;
+            continue;
+        }
+
+        s->rx[s->rx_len] = '\0';
+        char *end = strstr(s->rx, "\r\n\r\n");
+        if (!end) {
+            // Pedido más grande que el buffer: no es un cliente razonable
+            return s->rx_len < sizeof(s->rx) - 1;
+        }
+        end += 4;
+        size_t req_len = end - s->rx;
+
+        // Cuerpo (SET_PARAMETER, ANNOUNCE): se ignora pero hay que saltearlo
+        char value[16];
+        size_t body = header_value(s->rx, "Content-Length", value, sizeof(value)) ? atoi(value) : 0;
+        if (req_len + body > sizeof(s->rx) - 1) return false;
+        if (s->rx_len < req_len + body) break;
+
+        if (!handle_request(s, idx, s->rx)) return false;
+
+        size_t consumed = req_len + body;
+        memmove(s->rx, s->rx + consumed, s->rx_len - consumed);
+        s->rx_len -= consumed;
+    }
+    return true;
+}
+
+// ============================================================================
+// ENVÍO RTP
+// ============================================================================
+// Sin bloquear: con el socket lleno se corta el frame (stalled) en vez de
+// esperar con la referencia del frame bus tomada
+static bool send_rtp_tcp(void *ctx, uint8_t *pkt, size_t len) {
+    rtsp_session_t *s = ctx;
+    int pending = flush_tail(s);
+    if (pending <= 0) {
+        s->stalled = (pending == 0);
+        return false;
+    }
+
+    uint8_t *framed = pkt - RTP_PREFIX_LEN;
+    size_t total = len + RTP_PREFIX_LEN;
+    framed[0] = '$';
+    framed[1] = s->rtp_channel;
+    framed[2] = len >> 8;
+    framed[3] = len & 0xFF;
+    int n = send(s->fd, framed, total, MSG_DONTWAIT);
+    if (n < 0) {
+        s->stalled = (errno == EAGAIN || errno == EWOULDBLOCK);
+        return false;
+    }
+    if ((size_t)n < total) {
+        memcpy(s->tail, framed + n, total - n);
+        s->tail_len = total - n;
+        s->tail_off = 0;
+        s->stalled = true;
+        return false;
+    }
+    return true;
+}
+
+static bool send_rtp_udp(void *ctx, uint8_t *pkt, size_t len) {
+    rtsp_session_t *s = ctx;
+    for (int i = 0; i < UDP_RETRIES; i++) {
+        if (sendto(s->udp_fd, pkt, len, 0, (struct sockaddr *)&s->udp_peer, sizeof(s->udp_peer)) >= 0) {
+            return true;
+        }
+        if (errno != ENOMEM && errno != EAGAIN) return false;
+        vTaskDelay(1);      // Dejar que el WiFi vacíe la cola
+    }
+    return true;            // UDP: perder un paquete no mata la sesión
+}
+
+static void send_frame(const frame_t *frame) {
+    rtp_jpeg_frame_t jf;
+    if (!rtp_jpeg_parse(frame->buf, frame->len, &jf)) {
+        s_stats.frames_unsupported++;
+        return;
+    }
+    uint32_t ts = (uint32_t)(frame->timestamp_us * 9 / 100);   // Reloj de 90 kHz
+    int64_t now = esp_timer_get_time();
+
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+        rtsp_session_t *s = &s_sessions[i];
+        if (s->state != SESS_PLAYING) continue;
+        s->stalled = false;
+        int sent = s->interleaved
+            ? rtp_jpeg_send(&s->rtp, &jf, ts, s_pkt, send_rtp_tcp, s)
+            : rtp_jpeg_send(&s->rtp, &jf, ts, s_pkt, send_rtp_udp, s);
+        if (sent < 0 && s->stalled) {
+            // Frame incompleto (sin marker): el cliente lo descarta entero
+            s_stats.frames_dropped++;
+            if (s->stall_since_us == 0) s->stall_since_us = now;
+            if (now - s->stall_since_us > (int64_t)RTSP_SEND_TIMEOUT_S * 1000000) {
+                session_close(s, "cliente no lee");
+            }
+            continue;
+        }
+        if (sent < 0) {
+            session_close(s, "error enviando RTP");
+            continue;
+        }
+        s->stall_since_us = 0;
+        s_stats.frames_sent++;
+        s_stats.bytes_sent += sent;
+    }
+}
+
+// ============================================================================
+// TAREA
+// ============================================================================
+static int open_listener(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) return -1;
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 2) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void rtsp_task(void *arg) {
+    int listen_fd = open_listener(s_port);
+    if (listen_fd < 0) {
+        ESP_LOGE(TAG, "No se pudo escuchar en el puerto %u", s_port);
+        s_started = false;
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Servidor RTSP en rtsp://<ip>:%u/stream", s_port);
+
+    frame_bus_sub_t *sub = NULL;
+    while (true) {
+        int playing = 0;
+        int open = 0;
+        for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+            if (s_sessions[i].state != SESS_FREE) open++;
+            if (s_sessions[i].state == SESS_PLAYING) playing++;
+        }
+        s_stats.sessions = open;
+        s_stats.playing = playing;
+
+        // Pedidos RTSP y conexiones nuevas (sin esperar si hay que mandar video)
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(listen_fd, &rfds);
+        int maxfd = listen_fd;
+        for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+            if (s_sessions[i].state != SESS_FREE) {
+                FD_SET(s_sessions[i].fd, &rfds);
+                if (s_sessions[i].fd > maxfd) maxfd = s_sessions[i].fd;
+            }
+        }
+        struct timeval tv = { .tv_sec = 0, .tv_usec = playing ? 0 : RTSP_IDLE_SELECT_MS * 1000 };
+        if (select(maxfd + 1, &rfds, NULL, NULL, &tv) > 0) {
+            if (FD_ISSET(listen_fd, &rfds)) session_accept(listen_fd);
+            for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+                rtsp_session_t *s = &s_sessions[i];
+                if (s->state != SESS_FREE && FD_ISSET(s->fd, &rfds) && !session_read(s, i)) {
+                    session_close(s, "desconectado");
+                }
+            }
+        }
+
+        // UDP no avisa si el cliente se fue: vence por falta de keepalive
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+            rtsp_session_t *s = &s_sessions[i];
+            if (s->state != SESS_FREE && !s->interleaved &&
+                now - s->last_request_us > (int64_t)RTSP_SESSION_TIMEOUT_S * 1000000) {
+                session_close(s, "timeout");
+            }
+        }
+
+        // Solo ocupar el frame bus mientras alguien está en PLAY
+        if (playing == 0) {
+            if (sub) {
+                frame_bus_unsubscribe(sub);
+                sub = NULL;
+            }
+            continue;
+        }
+        if (!sub) {
+            sub = frame_bus_subscribe("rtsp");
+            if (!sub) {
+                vTaskDelay(pdMS_TO_TICKS(100));
+                continue;
+            }
+        }
+
+        const frame_t *frame = frame_bus_acquire(sub, pdMS_TO_TICKS(RTSP_FRAME_WAIT_MS));
+        if (!frame) continue;
+        if (!s_gate || s_gate()) {
+            send_frame(frame);
+        }
+        frame_bus_done(sub, frame);
+    }
+}
+
+// ============================================================================
+// API
+// ============================================================================
+esp_err_t rtsp_server_start(uint16_t port, rtsp_gate_fn_t gate) {
+    if (s_started) return ESP_OK;
+
+    s_port = port;
+    s_gate = gate;
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+        s_sessions[i].fd = -1;
+        s_sessions[i].udp_fd = -1;
+    }
+
+    s_started = true;
+    if (xTaskCreatePinnedToCore(rtsp_task, "rtsp", RTSP_TASK_STACK, NULL,
+                                RTSP_TASK_PRIO, NULL, RTSP_TASK_CORE) != pdPASS) {
+        s_started = false;
+        ESP_LOGE(TAG, "No se pudo crear la tarea RTSP");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void rtsp_server_get_stats(rtsp_server_stats_t *stats) {
+    if (stats) *stats = s_stats;
+}